@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+
+"""
+Converts a scheduler trace dumped to the serial port (by calling
+/process/scheduler/dumpTrace) into Chrome's trace event JSON, which
+can be opened in chrome://tracing or ui.perfetto.dev
+
+Each CPU gets a row showing which task was running, with wakeups,
+IPIs, sends and receives as instant events on top.
+
+usage: trace2json.py serial.log [-o trace.json]
+"""
+
+import argparse
+import json
+import sys
+
+EVENT_NAMES = ["switch", "wakeup", "ipi", "send", "receive"]
+CONTEXT_SWITCH = 0
+
+def find_last_dump(lines):
+    dump = None
+    current = None
+
+    for line in lines:
+        start = line.find("[Trace]")
+
+        if start < 0:
+            continue
+
+        fields = line[start:].split()[1:]
+
+        if not fields:
+            continue
+
+        if fields[0] == "begin":
+            current = {"cpus": int(fields[1]), "ticksPerMillisecond": int(fields[2]), "events": []}
+        elif fields[0] == "end":
+            if current is not None:
+                dump = current
+            current = None
+        elif current is not None and len(fields) == 6:
+            cpu, high, low, kind, task, argument = fields
+            current["events"].append({
+                "cpu": int(cpu),
+                "timestamp": (int(high, 16) << 32) | int(low, 16),
+                "type": int(kind),
+                "task": int(task),
+                "argument": int(argument)
+            })
+
+    return dump
+
+def convert(dump):
+    ticksPerMicrosecond = max(dump["ticksPerMillisecond"] / 1000, 1)
+    events = sorted(dump["events"], key=lambda e: e["timestamp"])
+
+    if not events:
+        return {"traceEvents": []}
+
+    base = events[0]["timestamp"]
+    toMicroseconds = lambda ticks: (ticks - base) / ticksPerMicrosecond
+
+    output = []
+    running = {}
+
+    for cpu in range(dump["cpus"]):
+        output.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": cpu,
+            "args": {"name": "CPU {}".format(cpu)}})
+
+    def finish(cpu, end):
+        if cpu not in running:
+            return
+
+        task, start = running.pop(cpu)
+        output.append({"name": "task {}".format(task), "ph": "X", "pid": 0, "tid": cpu,
+            "ts": start, "dur": end - start, "args": {"task": task}})
+
+    for event in events:
+        time = toMicroseconds(event["timestamp"])
+        cpu = event["cpu"]
+
+        if event["type"] == CONTEXT_SWITCH:
+            finish(cpu, time)
+            running[cpu] = (event["task"], time)
+            continue
+
+        name = EVENT_NAMES[event["type"]] if event["type"] < len(EVENT_NAMES) else "unknown"
+        output.append({"name": name, "ph": "i", "s": "t", "pid": 0, "tid": cpu, "ts": time,
+            "args": {"task": event["task"], "argument": event["argument"]}})
+
+    end = toMicroseconds(events[-1]["timestamp"])
+
+    for cpu in list(running):
+        finish(cpu, end)
+
+    return {"traceEvents": output, "displayTimeUnit": "ns"}
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a Saturn scheduler trace to Chrome trace JSON")
+    parser.add_argument("log", help="serial log containing a trace dump")
+    parser.add_argument("-o", "--output", help="where to write the JSON, defaults to stdout")
+    args = parser.parse_args()
+
+    with open(args.log, errors="replace") as log:
+        dump = find_last_dump(log)
+
+    if dump is None:
+        sys.exit("No complete trace dump found in {}".format(args.log))
+
+    trace = convert(dump)
+
+    if args.output:
+        with open(args.output, "w") as output:
+            json.dump(trace, output)
+    else:
+        json.dump(trace, sys.stdout)
+
+if __name__ == "__main__":
+    main()
@@ -87,7 +87,8 @@ namespace APIC {
         }
 
         if (tries == MaxTries) {
-            TSC::stopCalibration();
+            //RTC was using 8Hz rate
+            TSC::stopCalibration((1000 * (tries + 1)) / 8);
             writeLocalAPICRegister(Registers::LVT_Timer, combineFlags(LVT_Mask::DisableInterrupt));
             uint32_t ticks = 0xFFFFFFFF - readLocalAPICRegister(Registers::CurrentCount);
             RTC::disable();
@@ -117,6 +118,30 @@ namespace APIC {
         writeLocalAPICRegister(Registers::InitialCount, timeInMilliseconds * ticksPerMilliSecond);
     }
 
+    void setAPICTimerOneShot(uint32_t timeInMicroseconds) {
+
+        writeLocalAPICRegister(Registers::LVT_Timer, combineFlags(
+            52,
+            LVT_TimerMode::OneShot
+        ));
+
+        auto count = (static_cast<uint64_t>(timeInMicroseconds) * ticksPerMilliSecond) / 1000;
+
+        if (count == 0) {
+            count = 1;
+        }
+        else if (count > 0xFFFFFFFF) {
+            count = 0xFFFFFFFF;
+        }
+
+        writeLocalAPICRegister(Registers::DivideConfiguration, combineFlags(DivideConfiguration::By1));
+        writeLocalAPICRegister(Registers::InitialCount, static_cast<uint32_t>(count));
+    }
+
+    void stopAPICTimer() {
+        writeLocalAPICRegister(Registers::InitialCount, 0);
+    }
+
     void initialize() {
         /*
         The following values/descriptions are from Intel 64 and IA-32 
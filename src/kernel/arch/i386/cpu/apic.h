@@ -76,6 +76,18 @@ namespace APIC {
 
     void setAPICTimer(LVT_TimerMode mode, uint32_t timeInMilliseconds);
 
+    /*
+    Fires the timer interrupt once, after the given time. Times
+    longer than the counter can hold are clamped, so the interrupt
+    might come early but never late
+    */
+    void setAPICTimerOneShot(uint32_t timeInMicroseconds);
+
+    /*
+    Cancels a pending one-shot timer
+    */
+    void stopAPICTimer();
+
     enum class DivideConfiguration {
         By2 = 0b000,
         By4 = 0b001,
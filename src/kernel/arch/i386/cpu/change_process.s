@@ -40,9 +40,7 @@ changeProcess:
     mov eax, [esp + 4] 
     mov [eax + 4], esp ; currentTask->context.kernelESP = esp
 
-    ;saving fpu/sse registers
-    ;mov eax, [eax + 8]
-    ;fxsave [eax]
+    ;fpu/sse registers are switched lazily, see CPU::switchFPU
 
     mov eax, [esp + 8] 
     push eax
@@ -52,10 +50,6 @@ changeProcess:
     mov eax, [esp + 8]           
     mov esp, [eax + 4] ; esp = nextTask->context.kernelESP
 
-    ;restoring fpu/sse registers
-    ;mov eax, [eax + 8]
-    ;fxrstor [eax]
-
     mov ecx, eax
     mov eax, [eax + 48]
     mov ecx, [ecx + 4] ; nextTask->context.kernelESP
@@ -66,10 +60,6 @@ changeProcess:
 global changeProcessSingle
 changeProcessSingle:
 
-    ;saving fpu/sse registers
-    ;mov eax, [eax + 8]
-    ;fxsave [eax]
-
     mov eax, [esp + 8] 
     push eax
     call activateVMM
@@ -78,10 +68,6 @@ changeProcessSingle:
     mov eax, [esp + 8]           
     mov esp, [eax + 4] ; esp = nextTask->context.kernelESP
 
-    ;restoring fpu/sse registers
-    ;mov eax, [eax + 8]
-    ;fxrstor [eax]
-
     mov ecx, eax
     mov eax, [eax + 48]
     mov ecx, [ecx + 4] ; nextTask->context.kernelESP
@@ -173,8 +159,13 @@ setCR3:
     invlpg [0xfffff000]
     ret
 
+extern idleQuiescentState
+
 global idleLoop
 idleLoop:
+    ;a halted core is in an RCU quiescent state until it's interrupted
+    cli
+    call idleQuiescentState
     sti
     hlt
     jmp idleLoop
\ No newline at end of file
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory/virtual_memory_manager.h>
 #include <scheduler.h>
 #include <task.h>
+#include <rcu.h>
 #include "msr.h"
 #include "apic.h"
 
@@ -84,9 +85,45 @@ namespace CPU {
         ActiveCPUs[cpuId].scheduler->setupTimeslice();
     }
 
-    void sendMessage(IPC::RecipientType recipient, IPC::Message* message) {
+    void countInterrupt() {
+        //every handler starts here, before it can do an RCU lookup
+        Kernel::RCU::exitIdle();
+
+        if (ActiveCPUs == nullptr) {
+            return;
+        }
+
+        auto scheduler = ActiveCPUs[getCurrentCPUId()].scheduler;
+
+        if (scheduler != nullptr) {
+            scheduler->countInterrupt();
+        }
+    }
+
+    void sendMessage(IPC::RecipientType recipient, IPC::Message* message, bool blockIfFull) {
+        auto cpuId = getCurrentCPUId();
+        ActiveCPUs[cpuId].scheduler->sendMessage(recipient, message, blockIfFull);
+    }
+
+    bool sendGrant(IPC::RecipientType recipient, IPC::GrantedMessage* message) {
+        auto cpuId = getCurrentCPUId();
+        return ActiveCPUs[cpuId].scheduler->sendGrant(recipient, message);
+    }
+
+    uint32_t sendBatch(IPC::BatchEntry* entries, uint32_t count) {
+        auto cpuId = getCurrentCPUId();
+        return ActiveCPUs[cpuId].scheduler->sendBatch(entries, count);
+    }
+
+    uint32_t receiveBatch(IPC::MaximumMessageBuffer* buffers, uint32_t count) {
+        auto cpuId = getCurrentCPUId();
+        return ActiveCPUs[cpuId].scheduler->receiveBatch(buffers, count);
+    }
+
+    void callMessage(IPC::RecipientType recipient, IPC::Message* message, IPC::Message* buffer,
+        IPC::MessageNamespace filter, uint32_t messageId) {
         auto cpuId = getCurrentCPUId();
-        ActiveCPUs[cpuId].scheduler->sendMessage(recipient, message);
+        ActiveCPUs[cpuId].scheduler->call(recipient, message, buffer, filter, messageId);
     }
 
     void receiveMessage(IPC::Message* buffer) {
@@ -37,6 +37,9 @@ namespace Kernel {
 
 namespace IPC {
     struct Message;
+    struct GrantedMessage;
+    struct MaximumMessageBuffer;
+    struct BatchEntry;
     enum class RecipientType;
     enum class MessageNamespace : uint32_t;
 }
@@ -72,8 +75,19 @@ namespace CPU {
     void notifyTimesliceExpired();
     void setupTimeslice(bool propagate = true);
 
+    /*
+    Adds to the current core's interrupt count, see SchedulerStatistics.
+    Also brings an idle core back online for RCU
+    */
+    void countInterrupt();
+
     //TODO: move this later
-    void sendMessage(IPC::RecipientType recipient, IPC::Message* message);
+    void sendMessage(IPC::RecipientType recipient, IPC::Message* message, bool blockIfFull = false);
+    bool sendGrant(IPC::RecipientType recipient, IPC::GrantedMessage* message);
+    uint32_t sendBatch(IPC::BatchEntry* entries, uint32_t count);
+    uint32_t receiveBatch(IPC::MaximumMessageBuffer* buffers, uint32_t count);
+    void callMessage(IPC::RecipientType recipient, IPC::Message* message, IPC::Message* buffer,
+        IPC::MessageNamespace filter, uint32_t messageId);
 
     void receiveMessage(IPC::Message* buffer);
     void receiveMessage(IPC::Message* buffer, IPC::MessageNamespace filter, uint32_t messageId);
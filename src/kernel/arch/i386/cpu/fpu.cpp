@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "fpu.h"
+#include <cpu/cpu.h>
+#include <scheduler.h>
+#include <task.h>
+
+namespace CPU {
+
+    enum class SaveMethod {
+        FXSave,
+        XSave,
+        XSaveOpt
+    };
+
+    const uint32_t TaskSwitchedFlag {1 << 3};
+    const uint32_t OSXSaveFlag {1 << 18};
+
+    //x87 and SSE, the only state SSEContext has room for
+    const uint32_t SavedComponents {0b11};
+
+    const uint32_t DefaultMXCSR {0x1F80};
+    const int MaxCores {16};
+
+    SaveMethod saveMethod {SaveMethod::FXSave};
+
+    /*
+    The last task to load its state into each core's registers.
+    The registers only still hold its state if the task hasn't
+    used the FPU on another core since, see Task::fpuCPUId
+    */
+    Kernel::Task* fpuOwners[MaxCores];
+
+    void initializeFPU() {
+        uint32_t eax, ebx, ecx, edx;
+        asm volatile("cpuid" 
+            : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) 
+            : "a" (1), "c" (0));
+
+        auto hasXSave = (ecx & (1 << 26)) != 0;
+
+        if (!hasXSave) {
+            return;
+        }
+
+        uint32_t cr4;
+        asm volatile("mov %%cr4, %0" : "=r" (cr4));
+        cr4 |= OSXSaveFlag;
+        asm volatile("mov %0, %%cr4" : : "r" (cr4));
+
+        asm volatile("xsetbv" : : "a" (SavedComponents), "d" (0), "c" (0));
+
+        asm volatile("cpuid" 
+            : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) 
+            : "a" (0xD), "c" (1));
+
+        saveMethod = (eax & 1) ? SaveMethod::XSaveOpt : SaveMethod::XSave;
+    }
+
+    void setTaskSwitched(bool set) {
+        if (set) {
+            uint32_t cr0;
+            asm volatile("mov %%cr0, %0" : "=r" (cr0));
+            asm volatile("mov %0, %%cr0" : : "r" (cr0 | TaskSwitchedFlag));
+        }
+        else {
+            asm volatile("clts");
+        }
+    }
+
+    bool isTaskSwitchedSet() {
+        uint32_t cr0;
+        asm volatile("mov %%cr0, %0" : "=r" (cr0));
+        return (cr0 & TaskSwitchedFlag) != 0;
+    }
+
+    void saveFPU(Kernel::SSEContext* context) {
+        switch (saveMethod) {
+            case SaveMethod::XSaveOpt: {
+                asm volatile("xsaveopt %0" : "+m" (*context) : "a" (SavedComponents), "d" (0));
+                break;
+            }
+            case SaveMethod::XSave: {
+                asm volatile("xsave %0" : "+m" (*context) : "a" (SavedComponents), "d" (0));
+                break;
+            }
+            case SaveMethod::FXSave: {
+                asm volatile("fxsave %0" : "=m" (*context));
+                break;
+            }
+        }
+    }
+
+    void restoreFPU(Kernel::SSEContext* context) {
+        if (saveMethod == SaveMethod::FXSave) {
+            asm volatile("fxrstor %0" : : "m" (*context));
+        }
+        else {
+            asm volatile("xrstor %0" : : "m" (*context), "a" (SavedComponents), "d" (0));
+        }
+    }
+
+    void switchFPU(Kernel::Task* current, Kernel::Task* next) {
+        auto id = getCurrentCPUId() % MaxCores;
+
+        /*
+        TS is only clear if current has its state loaded on this core,
+        and it may run on another core next, so its state has to
+        be written back now
+        */
+        if (current != nullptr 
+            && fpuOwners[id] == current 
+            && !isTaskSwitchedSet()) {
+            saveFPU(current->sseContext);
+        }
+
+        auto stillLoaded = fpuOwners[id] == next && next->fpuCPUId == id;
+        setTaskSwitched(!stillLoaded);
+    }
+
+    void handleDeviceNotAvailable() {
+        setTaskSwitched(false);
+
+        if (ActiveCPUs == nullptr) {
+            return;
+        }
+
+        auto id = getCurrentCPUId();
+        auto task = ActiveCPUs[id].scheduler->getCurrentTask();
+
+        if (task == nullptr) {
+            return;
+        }
+
+        if (task->usedFPU) {
+            restoreFPU(task->sseContext);
+        }
+        else {
+            /*
+            A new task's SSEContext is all zeroes, so restoring it clears
+            whatever the last owner left behind. Zero would unmask every
+            exception though, so the control words start from the defaults
+            */
+            auto mxcsr = DefaultMXCSR;
+            restoreFPU(task->sseContext);
+            asm volatile("fninit");
+            asm volatile("ldmxcsr %0" : : "m" (mxcsr));
+            task->usedFPU = true;
+        }
+
+        fpuOwners[id % MaxCores] = task;
+        task->fpuCPUId = id;
+    }
+}
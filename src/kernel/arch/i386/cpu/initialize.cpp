@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cpu/apic.h>
 #include <cpu/cpu.h>
 #include <cpu/sse.h>
+#include <cpu/fpu.h>
 #include <cpu/pic.h>
 #include <cpu/rtc.h>
 #include <cpu/msr.h>
@@ -86,6 +87,7 @@ namespace CPU {
         loadIDT();
         asm volatile("sti");
         initializeSSE();
+        initializeFPU();
 
         APIC::initialize();
 
@@ -100,7 +102,6 @@ namespace CPU {
 
         loadTSS(0x28 + cpuId * 8);
 
-        APIC::setAPICTimer(APIC::LVT_TimerMode::Periodic, 10);
         APIC::setupISAIRQs({});
         ActiveCPUs[cpuId].scheduler->start();
     }
@@ -240,6 +241,7 @@ namespace CPU {
     Kernel::Scheduler* initialize(uint32_t kernelEndAddress) {
 
         initializeSSE();
+        initializeFPU();
         PIC::disable();
 
         asm volatile("sti");
@@ -45,13 +45,19 @@ namespace TSC {
     }
 
     uint64_t ticksPerSecond {0};
+    uint64_t ticksPerMillisecond {0};
 
-    void stopCalibration() {
+    void stopCalibration(uint32_t elapsedMilliseconds) {
         auto endTime = getTimestamp();
-        ticksPerSecond = endTime - startTime;
+        ticksPerMillisecond = (endTime - startTime) / elapsedMilliseconds;
+        ticksPerSecond = ticksPerMillisecond * 1000;
     }
 
     uint64_t getTicksPerSecond() {
         return ticksPerSecond;
     }
+
+    uint64_t getTicksPerMillisecond() {
+        return ticksPerMillisecond;
+    }
 }
\ No newline at end of file
@@ -29,7 +29,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace TSC {
 
+    uint64_t getTimestamp();
+
     void startCalibration();
-    void stopCalibration();
+
+    /*
+    Called once elapsedMilliseconds have passed since
+    startCalibration, as measured by another clock
+    */
+    void stopCalibration(uint32_t elapsedMilliseconds);
     uint64_t getTicksPerSecond();
+    uint64_t getTicksPerMillisecond();
 }
\ No newline at end of file
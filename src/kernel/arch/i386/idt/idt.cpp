@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory/virtual_memory_manager.h>
 #include <cpu/apic.h>
 #include <cpu/cpu.h>
+#include <cpu/fpu.h>
 #include <scheduler.h>
 #include <system_calls.h>
 #include <services/ps2/ps2.h>
@@ -240,7 +241,7 @@ extern "C" void handleSystemCall(SystemCallFrame* frame) {
             break;
         }
         case static_cast<uint32_t>(SystemCall::Send): {
-            CPU::sendMessage(static_cast<IPC::RecipientType>(frame->ebx), reinterpret_cast<IPC::Message*>(frame->ecx));
+            CPU::sendMessage(static_cast<IPC::RecipientType>(frame->ebx), reinterpret_cast<IPC::Message*>(frame->ecx), true);
             break;
         }
         case static_cast<uint32_t>(SystemCall::Receive): {
@@ -259,6 +260,28 @@ extern "C" void handleSystemCall(SystemCallFrame* frame) {
             frame->eax = CPU::peekReceiveMessage(reinterpret_cast<IPC::Message*>(frame->ebx));
             break;
         }
+        case static_cast<uint32_t>(SystemCall::SendGrant): {
+            frame->eax = CPU::sendGrant(static_cast<IPC::RecipientType>(frame->ebx), reinterpret_cast<IPC::GrantedMessage*>(frame->ecx));
+            break;
+        }
+        case static_cast<uint32_t>(SystemCall::Call): {
+            CPU::callMessage(
+                static_cast<IPC::RecipientType>(frame->ebx),
+                reinterpret_cast<IPC::Message*>(frame->ecx),
+                reinterpret_cast<IPC::Message*>(frame->edx),
+                static_cast<IPC::MessageNamespace>(frame->esi),
+                frame->edi);
+
+            break;
+        }
+        case static_cast<uint32_t>(SystemCall::SendBatch): {
+            frame->eax = CPU::sendBatch(reinterpret_cast<IPC::BatchEntry*>(frame->ebx), frame->ecx);
+            break;
+        }
+        case static_cast<uint32_t>(SystemCall::ReceiveBatch): {
+            frame->eax = CPU::receiveBatch(reinterpret_cast<IPC::MaximumMessageBuffer*>(frame->ebx), frame->ecx);
+            break;
+        }
         default: {
             kprintf("[IDT] Unhandled system call: %d (ebx: %x)\n", frame->eax, frame->ebx);
             break;
@@ -273,11 +296,13 @@ extern "C" void handleSetupScheduler() {
 }
 
 extern "C" void handleReschedule() {
+    CPU::countInterrupt();
     CPU::reschedule();
     APIC::signalEndOfInterrupt();
 }
 
 extern "C" void handleInvlpg() {
+    CPU::countInterrupt();
     auto cpuId = CPU::getCurrentCPUId();
 
     if (CPU::ActiveCPUs[cpuId].ready && CPU::ActiveCPUs[cpuId].vmm != nullptr) {
@@ -288,6 +313,7 @@ extern "C" void handleInvlpg() {
 }
 
 extern "C" void handleSetupTimeslice() {
+    CPU::countInterrupt();
     CPU::setupTimeslice(false);
     APIC::signalEndOfInterrupt();
 }
@@ -317,12 +343,15 @@ const char* exceptions[] = {
 };
 
 extern "C" void taskSwitch() {
+    CPU::countInterrupt();
     APIC::signalEndOfInterrupt();
     CPU::notifyTimesliceExpired();
 }
 
 void interruptHandler(CPU::InterruptStackFrame* frame) {
     
+    CPU::countInterrupt();
+
     switch(frame->interruptNumber) {
         case 0: {
             kprintf("[IDT] Divide Error\n");
@@ -332,6 +361,10 @@ void interruptHandler(CPU::InterruptStackFrame* frame) {
             kprintf("[IDT] %s\n", exceptions[frame->interruptNumber]);
             panic(frame);
         }
+        case 7: {
+            CPU::handleDeviceNotAvailable();
+            break;
+        }
         case 8: {
             panic(frame);
         }
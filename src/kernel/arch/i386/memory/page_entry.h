@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+namespace Memory::PageEntry {
+
+    /*
+    i386 page table entries keep their flags in the low byte. An
+    entry with flags but no frame is allocated but not yet backed,
+    and the page fault handler maps in a fresh zeroed page the
+    first time it's touched
+    */
+    inline constexpr uint32_t FlagsMask {0xFF};
+    inline constexpr uint32_t Present {1u << 0};
+    inline constexpr uint32_t Accessed {1u << 5};
+    inline constexpr uint32_t Dirty {1u << 6};
+
+    inline constexpr bool isMapped(uint32_t entry) {
+        return (entry & FlagsMask) && (entry & ~FlagsMask);
+    }
+
+    inline constexpr bool isAllocated(uint32_t entry) {
+        return (entry & FlagsMask) && !(entry & ~FlagsMask);
+    }
+
+    /*
+    Drops the frame from a released page's entry but keeps it
+    allocated. Present has to go too, otherwise the entry would
+    map physical page 0. A read only page with no other flags
+    goes back to being unallocated
+    */
+    inline constexpr uint32_t release(uint32_t entry) {
+        return entry & FlagsMask & ~(Present | Accessed | Dirty);
+    }
+}
@@ -27,6 +27,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "virtual_memory_manager.h"
 #include "physical_memory_manager.h"
+#include "page_entry.h"
 #include <string.h>
 #include <stdio.h>
 #include <algorithm>
@@ -37,7 +38,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <task.h>
 
 void activateVMM(Kernel::Task* task) {
-    task->virtualMemoryManager->activate();
+    /*
+    Loading CR3 flushes the whole TLB, so skip it when the
+    next task shares the current task's page directory
+    */
+    if (!task->virtualMemoryManager->isActive()) {
+        task->virtualMemoryManager->activate();
+    }
+
     auto oldTSS = reinterpret_cast<uint32_t>(task->tss);
     auto newTSS = 0xCFFF'F000 - 0x1000 * task->cpuId;
 
@@ -267,7 +275,8 @@ namespace Memory {
                     physicalManager->freePage(address, physicalAddress);
                 } 
 
-                pageTable->pageAddresses[tableIndex] &= 0xFF;  
+                //the next touch faults in a fresh zeroed page
+                pageTable->pageAddresses[tableIndex] = PageEntry::release(pageTable->pageAddresses[tableIndex]);
             }
 
             
@@ -281,15 +290,13 @@ namespace Memory {
         auto pageTableAddress = calculatePageTableAddress(virtualAddress);
         auto pageTable = static_cast<PageTable*>(reinterpret_cast<void*>(pageTableAddress));
         auto tableIndex = extractTableIndex(virtualAddress);       
-        auto physicalAddress = pageTable->pageAddresses[tableIndex];
+        auto entry = pageTable->pageAddresses[tableIndex];
 
-        if (physicalAddress & 0xFF) {
-            if (physicalAddress & ~0xFF) {
-                return PageStatus::Mapped;
-            }
-            else {
-                return PageStatus::Allocated;
-            }
+        if (PageEntry::isMapped(entry)) {
+            return PageStatus::Mapped;
+        }
+        else if (PageEntry::isAllocated(entry)) {
+            return PageStatus::Allocated;
         }
         else {
             return PageStatus::Invalid;
@@ -301,6 +308,13 @@ namespace Memory {
         nextAddress = address;
     }
 
+    bool VirtualMemoryManager::isActive() const {
+        uint32_t cr3;
+        asm volatile("movl %%CR3, %0" : "=r" (cr3));
+
+        return pagingActive && cr3 == directoryPhysicalAddress;
+    }
+
     void VirtualMemoryManager::activate() {
 
         asm volatile("movl %0, %%CR3 \n"
@@ -435,6 +449,20 @@ namespace Memory {
 
         int pagesShared = 0;
         for (auto r = recipientTableIndex, o = ownerTableIndex; r < pagesToShare && o < pagesToShare; r++, o++) {
+            auto ownerPage = pageTable->pageAddresses[o];
+
+            if ((ownerPage & 0xFF) && !(ownerPage & ~0xFF)) {
+                /*
+                The owner hasn't touched this page yet, so it only has flags.
+                Give it a real page now, otherwise the recipient would get
+                a different page than the owner on first touch
+                */
+                auto address = (ownerStartAddress & ~0xFFF) + (o - ownerTableIndex) * PageSize;
+                auto physicalPage = physicalManager->allocatePage(1);
+                map(address, physicalPage);
+                physicalManager->finishAllocation(address, 1);
+            }
+
             recipientPageTable->pageAddresses[r] = pageTable->pageAddresses[o];
             pagesShared++;
         }
@@ -450,6 +478,33 @@ namespace Memory {
     
     }
 
+    bool VirtualMemoryManager::detachPages(uintptr_t virtualAddress, uint32_t count, uintptr_t* frames) {
+        auto end = virtualAddress + count * PageSize;
+
+        for (auto address = virtualAddress; address < end; address += PageSize) {
+            auto directoryIndex = extractDirectoryIndex(address);
+
+            if (directory->pageTableAddresses[directoryIndex] == 0
+                || getPageStatus(address) != PageStatus::Mapped) {
+                return false;
+            }
+        }
+
+        for (auto i = 0u; i < count; i++) {
+            auto address = virtualAddress + i * PageSize;
+            auto pageTableAddress = calculatePageTableAddress(address);
+            auto pageTable = static_cast<PageTable*>(reinterpret_cast<void*>(pageTableAddress));
+            auto tableIndex = extractTableIndex(address);
+
+            frames[i] = pageTable->pageAddresses[tableIndex] & ~0xFFF;
+            pageTable->pageAddresses[tableIndex] = 0;
+        }
+
+        updateCR3Address(directoryPhysicalAddress);
+
+        return true;
+    }
+
     #if not TARGET_PREKERNEL
     VirtualMemoryManager* getCurrentVMM() {
         if (CPU::ActiveCPUs == nullptr) {
@@ -145,6 +145,9 @@ namespace Memory {
         */
         void activate();
 
+        //true if this VMM's directory is the one in CR3
+        bool isActive() const;
+
         PageStatus getPageStatus(uintptr_t virtualAddress);
 
         void HACK_setNextAddress(uint32_t address);
@@ -158,6 +161,14 @@ namespace Memory {
 
         void sharePages(uint32_t ownerStartAddress, VirtualMemoryManager* recipientVMM, uint32_t recipientStartAddress, uint32_t count);
 
+        /*
+        Unmaps count pages starting at virtualAddress without freeing them,
+        and stores their physical addresses in frames so they can be mapped
+        elsewhere. Either every page is detached or none are, returns false
+        if any of the pages aren't mapped. Used to grant pages over IPC
+        */
+        bool detachPages(uintptr_t virtualAddress, uint32_t count, uintptr_t* frames);
+
         uint32_t getDirectoryPhysicalAddress() const {
             return directoryPhysicalAddress;
         }
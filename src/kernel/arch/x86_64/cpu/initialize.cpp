@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "metablocks.h"
 #include <memory/virtual_memory_manager.h>
 #include <memory/block_allocator.h>
+#include <memory/pcid.h>
 #include "apic.h"
 #include "timers/rtc.h"
 #include "timers/pit.h"
@@ -59,6 +60,7 @@ namespace CPU {
 
     void applicationProcessorStartup(int cpuId, int apicId) {
         initializeSSE();
+        enablePCIDs();
         GDT::load();
         IDT::initialize();
 
@@ -133,6 +135,8 @@ namespace CPU {
     }
 
     void initialize(KernelConfig* config) {
+        enablePCIDs();
+
         BlockAllocator<TSS> tssAllocator;
 
         setupTSS(tssAllocator);
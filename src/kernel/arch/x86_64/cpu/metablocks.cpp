@@ -47,6 +47,7 @@ namespace CPU {
             Memory::VirtualMemoryManager* virtualMemory) {
         
         InitialCore.self = &InitialCore;
+        InitialCore.id = 0;
         InitialCore.physicalMemory = physicalMemory;
         InitialCore.virtualMemory = virtualMemory;
 
@@ -60,11 +61,13 @@ namespace CPU {
         InitialCore.addressSpaces[static_cast<int>(AddressSpace::Domain::KernelStacks)] = &stackSpace;
     }
 
-    void setupCore(Memory::PhysicalMemoryManager* physicalMemory,
+    void setupCore(int id,
+            Memory::PhysicalMemoryManager* physicalMemory,
             Memory::VirtualMemoryManager* virtualMemory,
             Memory::AddressSpace* addressSpace) {
         static CoreMeta core;
         core.self = &core;
+        core.id = id;
         core.physicalMemory = physicalMemory;
         core.virtualMemory = virtualMemory;
         core.addressSpaces[static_cast<int>(Memory::AddressSpace::Domain::Default)] = addressSpace;
@@ -81,4 +84,8 @@ namespace CPU {
 
         return *pointer;
     }
+
+    int getCurrentCPUId() {
+        return getCurrentCore().id;
+    }
 }
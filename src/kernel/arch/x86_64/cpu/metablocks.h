@@ -40,6 +40,8 @@ namespace APIC {
 
 namespace CPU {
 
+    inline constexpr int MaxCores {16};
+
     /*
     Stored in FS segment
     */
@@ -54,6 +56,11 @@ namespace CPU {
     */
     struct CoreMeta {
         CoreMeta* self;
+
+        //index of this core, from 0 to MaxCores - 1
+        int id;
+
+        //this core's own manager, see PhysicalMemoryManager::CreateCoreManager
         Memory::PhysicalMemoryManager* physicalMemory;
         Memory::VirtualMemoryManager* virtualMemory;
         Memory::AddressSpace* addressSpaces[static_cast<int>(Memory::AddressSpace::Domain::Last)];
@@ -63,12 +70,16 @@ namespace CPU {
     void setupInitialCore(Memory::PhysicalMemoryManager* physicalMemory,
             Memory::VirtualMemoryManager* virtualMemory);
 
-    void setupCore(Memory::PhysicalMemoryManager* physicalMemory,
+    void setupCore(int id,
+            Memory::PhysicalMemoryManager* physicalMemory,
             Memory::VirtualMemoryManager* virtualMemory,
             Memory::AddressSpace* addressSpace);
 
     CoreMeta& getCurrentCore();
 
+    //same as getCurrentCore().id, matches the i386 kernel
+    int getCurrentCPUId();
+
     struct ProcessMeta {
 
     };
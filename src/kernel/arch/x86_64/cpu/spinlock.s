@@ -0,0 +1,69 @@
+%if 0
+
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+%endif
+
+bits 64
+
+section .text
+
+;64-bit version of lock_impl.s, takes the address of the lock in rdi
+;and returns how many times it had to spin
+global spinlock
+spinlock:
+
+    ;take a ticket, see lock_impl.s
+    mov eax, 0x10000
+    lock xadd dword [rdi], eax
+    mov ecx, eax
+    shr ecx, 16
+
+    ;if it's already being served we have the lock
+    cmp ax, cx
+    mov eax, 0
+    je .done
+
+.spin:
+
+    ;notify the CPU that this is a spinlock loop
+    pause
+    inc eax
+
+    cmp word [rdi], cx
+    jne .spin
+
+.done:
+
+    ret
+
+global releaseSpinlock
+releaseSpinlock:
+
+    ;only the holder changes the low word, so this doesn't need a lock prefix
+    add word [rdi], 1
+    ret
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace TSC {
 
+    uint64_t getTimestamp();
     void startCalibration();
     void stopCalibration();
     uint64_t getTicksPerSecond();
@@ -92,9 +92,10 @@ flush_32:
     bts eax, 8
     wrmsr
 
-    ;enable paging
+    ;enable paging and write protect
     mov eax, cr0
     bts eax, 31
+    bts eax, 16
     mov cr0, eax
 
     ;load the 64-bit temporary gdt
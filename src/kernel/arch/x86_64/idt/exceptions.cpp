@@ -118,6 +118,27 @@ void panic() {
     }
 }
 
+/*
+Addresses inside a reservation are backed lazily,
+so the first touch is what allocates the page
+*/
+bool handleReservationFault(CPU::CoreMeta& core, Memory::VirtualAddress linear) {
+    using namespace Memory;
+
+    for (auto space : core.addressSpaces) {
+        if (space == nullptr) {
+            continue;
+        }
+
+        if (auto reservation = space->findReservation(linear)) {
+            reservation->handleFault(linear);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 bool handlePageFault(Memory::VirtualAddress linear, uint32_t errorCode) {
     enum class PageFaultError {
         ProtectionViolation = 1 << 0,
@@ -128,6 +149,14 @@ bool handlePageFault(Memory::VirtualAddress linear, uint32_t errorCode) {
     static int faults = 0;
 
     if (errorCode & static_cast<uint32_t>(PageFaultError::ProtectionViolation)) {
+        auto& core = CPU::getCurrentCore();
+
+        if ((errorCode & static_cast<uint32_t>(PageFaultError::WriteAccess))
+                && core.virtualMemory->handleCopyOnWrite(linear, core.physicalMemory)) {
+            faults++;
+            return true;
+        }
+
         log("[IDT] Page fault: protection violation [%x]", linear.address);
         
         if (errorCode & static_cast<uint32_t>(PageFaultError::UserMode)) {
@@ -142,6 +171,11 @@ bool handlePageFault(Memory::VirtualAddress linear, uint32_t errorCode) {
 
         auto& core = CPU::getCurrentCore();
 
+        if (handleReservationFault(core, linear)) {
+            faults++;
+            return true;
+        }
+
         auto pageStatus = core.virtualMemory->getPageStatus(linear);
         
         if (pageStatus == Memory::PageStatus::Allocated) {
@@ -29,6 +29,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "descriptor.h"
 #include <log.h>
 #include <cpu/apic.h>
+#include <cpu/metablocks.h>
+#include <locks.h>
+#include <rcu.h>
 
 namespace IDT {
 
@@ -50,10 +53,160 @@ namespace IDT {
         idt[46] = encodeEntry(reinterpret_cast<uintptr_t>(&irq14), 0x08);
         idt[47] = encodeEntry(reinterpret_cast<uintptr_t>(&irq15), 0x08);
     }
+
+    /*
+    Actions are published with RCU::assign, so the interrupt
+    handler walks the chain without taking the lock
+    */
+    struct IrqVector {
+        IrqAction* actions {nullptr};
+        uint64_t count {0};
+        uint64_t unhandled {0};
+    };
+
+    IrqVector irqVectors[IrqCount];
+    uint32_t irqVectorsLock {0};
+    Kernel::LockStatistics IrqVectorsLock {"irqVectors"};
+
+    /*
+    Lets unregisterIrqAction tell when a core has stopped walking
+    the chains. depth is how many dispatches the core is partway
+    through, and finished goes up each time it gets back to none
+    */
+    struct alignas(64) DispatchState {
+        uint32_t depth {0};
+        uint64_t finished {0};
+    };
+
+    DispatchState dispatchStates[CPU::MaxCores];
+
+    void waitForDispatches() {
+        //the unlink has to be visible before any core's depth is read
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        for (auto& state : dispatchStates) {
+            auto finished = __atomic_load_n(&state.finished, __ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&state.depth, __ATOMIC_SEQ_CST) == 0) {
+                continue;
+            }
+
+            /*
+            Any dispatch started after the unlink can't find the
+            action, so there's no need to wait for the core to be
+            idle, just for the one it was in to finish
+            */
+            while (__atomic_load_n(&state.finished, __ATOMIC_ACQUIRE) == finished) {
+                asm volatile("pause");
+            }
+        }
+    }
+
+    bool registerIrqAction(uint32_t irq, IrqAction* action) {
+        if (irq >= IrqCount 
+            || (action->handler == nullptr && action->notification == nullptr)
+            || action->notificationBit >= 64) {
+            return false;
+        }
+
+        Kernel::SpinLock lock {&irqVectorsLock, &IrqVectorsLock};
+        auto& vector = irqVectors[irq];
+
+        //the action has to be complete before the handler can see it
+        action->next = vector.actions;
+        Kernel::RCU::assign(vector.actions, action);
+        return true;
+    }
+
+    void unregisterIrqAction(uint32_t irq, IrqAction* action) {
+        if (irq >= IrqCount) {
+            return;
+        }
+
+        {
+            Kernel::SpinLock lock {&irqVectorsLock, &IrqVectorsLock};
+            auto link = &irqVectors[irq].actions;
+
+            while (*link != nullptr) {
+                if (*link == action) {
+                    Kernel::RCU::assign(*link, action->next);
+                    break;
+                }
+
+                link = &(*link)->next;
+            }
+        }
+
+        waitForDispatches();
+    }
+
+    bool dispatchIrq(uint32_t irq) {
+        if (irq >= IrqCount) {
+            return false;
+        }
+
+        auto& state = dispatchStates[CPU::getCurrentCore().id];
+        __atomic_fetch_add(&state.depth, 1, __ATOMIC_SEQ_CST);
+
+        auto& vector = irqVectors[irq];
+        auto action = Kernel::RCU::dereference(vector.actions);
+        auto handled = false;
+
+        __atomic_fetch_add(&vector.count, 1, __ATOMIC_RELAXED);
+
+        /*
+        Every action on a shared line runs, since more than one
+        device may have raised it
+        */
+        while (action != nullptr) {
+            auto raised = true;
+
+            if (action->handler != nullptr) {
+                raised = action->handler(irq, action->context);
+            }
+
+            if (raised) {
+                if (action->notification != nullptr) {
+                    action->notification->signal(action->notificationBit);
+                }
+
+                __atomic_fetch_add(&action->count, 1, __ATOMIC_RELAXED);
+                handled = true;
+            }
+
+            action = Kernel::RCU::dereference(action->next);
+        }
+
+        if (__atomic_sub_fetch(&state.depth, 1, __ATOMIC_RELEASE) == 0) {
+            __atomic_fetch_add(&state.finished, 1, __ATOMIC_RELEASE);
+        }
+
+        if (!handled) {
+            __atomic_fetch_add(&vector.unhandled, 1, __ATOMIC_RELAXED);
+        }
+
+        return handled;
+    }
+
+    IrqVectorStatistics getIrqStatistics(uint32_t irq) {
+        if (irq >= IrqCount) {
+            return {0, 0};
+        }
+
+        auto& vector = irqVectors[irq];
+
+        return {
+            __atomic_load_n(&vector.count, __ATOMIC_RELAXED),
+            __atomic_load_n(&vector.unhandled, __ATOMIC_RELAXED)
+        };
+    }
 }
 
 void irqHandler(IrqFrame* frame) {
 
-   log("irq %d", frame->index);
-   APIC::signalEndOfInterrupt();
+    if (!IDT::dispatchIrq(frame->index)) {
+        log("irq %d", frame->index);
+    }
+
+    APIC::signalEndOfInterrupt();
 }
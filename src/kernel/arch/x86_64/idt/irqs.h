@@ -31,6 +31,70 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace IDT {
     void loadIRQs();
+
+    inline constexpr uint32_t IrqCount {16};
+
+    /*
+    A lightweight way for an interrupt to wake whoever services
+    it. Each IrqAction that targets a notification sets its own
+    bit, and the receiver takes every pending bit at once instead
+    of getting a message per interrupt
+    */
+    struct IrqNotification {
+        uint64_t pending {0};
+
+        void signal(uint32_t bit) {
+            __atomic_fetch_or(&pending, 1ul << bit, __ATOMIC_RELEASE);
+        }
+
+        uint64_t take() {
+            return __atomic_exchange_n(&pending, 0, __ATOMIC_ACQUIRE);
+        }
+    };
+
+    /*
+    Returns true if the handler's device raised the interrupt
+    */
+    using IrqHandler = bool (*)(uint32_t irq, void* context);
+
+    /*
+    One driver's interest in an irq. Drivers own their actions, and
+    several can share a line. An action has a handler that runs in
+    the interrupt, a notification that gets signalled, or both
+    */
+    struct IrqAction {
+        const char* name {nullptr};
+        IrqHandler handler {nullptr};
+        void* context {nullptr};
+        IrqNotification* notification {nullptr};
+        uint32_t notificationBit {0};
+
+        IrqAction* next {nullptr};
+        uint64_t count {0};
+    };
+
+    struct IrqVectorStatistics {
+        uint64_t count;
+        uint64_t unhandled;
+    };
+
+    bool registerIrqAction(uint32_t irq, IrqAction* action);
+
+    /*
+    Unlinks the action, then waits for any core that was partway
+    through dispatching an irq to finish. Once this returns the
+    action is no longer used and can be freed or reused. Since it
+    waits on other cores, it can't be called from an irq handler
+    */
+    void unregisterIrqAction(uint32_t irq, IrqAction* action);
+
+    /*
+    Runs every action registered for irq, returns true if
+    any of them handled it
+    */
+    bool dispatchIrq(uint32_t irq);
+
+    IrqVectorStatistics getIrqStatistics(uint32_t irq);
 }
 
 extern "C" void irq0();
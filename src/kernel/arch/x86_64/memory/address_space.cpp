@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cpu/metablocks.h>
 #include "virtual_memory_manager.h"
 #include "physical_memory_manager.h"
+#include <saturn/heap.h>
 
 namespace Memory {
 
@@ -40,6 +41,29 @@ namespace Memory {
         remainingPages = size / 0x1000;
     }
 
+    /*
+    Allocates everything from start to start + count pages up front,
+    using large pages for any whole 2MB chunks
+    */
+    void backPages(VirtualAddress start, uint64_t count) {
+        auto end = start.address + count * PageSize;
+        auto page = start.address;
+        auto& core = CPU::getCurrentCore();
+
+        while (page < end) {
+            auto isChunkStart = (page & (LargePageSize - 1)) == 0;
+
+            if (isChunkStart && page + LargePageSize <= end
+                    && core.virtualMemory->allocateLargePage({page}, core.physicalMemory)) {
+                page += LargePageSize;
+                continue;
+            }
+
+            core.virtualMemory->allocatePagingTablesFor({page}, core.physicalMemory);
+            page += PageSize;
+        }
+    }
+
     std::optional<VirtualAddress> AddressReservation::allocatePages(uint64_t count) {
         
         if (remainingPages < count) {
@@ -50,6 +74,10 @@ namespace Memory {
         auto page = nextPage;
         nextPage.address += count * 0x1000;
 
+        if (policy == PagingPolicy::Eager) {
+            backPages(page, count);
+        }
+
         return page;
     }
 
@@ -61,10 +89,47 @@ namespace Memory {
         return sibling;
     }
 
+    void AddressReservation::setPagingPolicy(PagingPolicy policy, uint32_t faultAroundPages) {
+        this->policy = policy;
+        this->faultAroundPages = faultAroundPages > 0 ? faultAroundPages : 1;
+    }
+
+    bool AddressReservation::contains(VirtualAddress address) const {
+        return address.address >= start.address 
+            && address.address - start.address < size;
+    }
+
+    void AddressReservation::handleFault(VirtualAddress address) const {
+        auto& core = CPU::getCurrentCore();
+        auto page = address.address & ~(PageSize - 1);
+        auto end = start.address + size;
+        auto chunk = page & ~(LargePageSize - 1);
+
+        /*
+        Fails if some of the chunk was already mapped with 4KB pages,
+        or there's no free 2MB of physical memory
+        */
+        if (chunk >= start.address && chunk + LargePageSize <= end
+                && core.virtualMemory->allocateLargePage({chunk}, core.physicalMemory)) {
+            return;
+        }
+
+        auto pages = policy == PagingPolicy::FaultAround ? faultAroundPages : 1;
+
+        for (auto i = 0u; i < pages && page < end; i++, page += PageSize) {
+            //this only allocates pages that aren't mapped already
+            core.virtualMemory->allocatePagingTablesFor({page}, core.physicalMemory);
+        }
+    }
+
     uint64_t AddressReservation::getSize() const {
         return size;
     }
 
+    VirtualAddress AddressReservation::getStart() const {
+        return start;
+    }
+
     void AddressReservation::clearFreeFlag() {
         isFree = false;
     }
@@ -109,21 +174,51 @@ namespace Memory {
         space.insert(initial);
     }
 
-    std::optional<AddressReservation> AddressSpace::reserve(uint64_t size) {
-        auto node = space.findByTraversal([=](auto& value) {
-            return value.getSize() >= size && value.isAvailable();
+    /*
+    How far start has to move up to be aligned
+    */
+    uint64_t getPadding(VirtualAddress start, uint64_t alignment) {
+        auto misalignment = start.address & (alignment - 1);
+        return misalignment == 0 ? 0 : alignment - misalignment;
+    }
+
+    std::optional<AddressReservation> AddressSpace::reserve(uint64_t size, 
+            PagingPolicy policy, uint32_t faultAroundPages) {
+        /*
+        Reservations big enough for a large page start on a 2MB
+        boundary so that they can actually use them
+        */
+        size = (size + PageSize - 1) & ~(PageSize - 1);
+        auto alignment = size >= LargePageSize ? LargePageSize : PageSize;
+
+        /*
+        Address ordered first fit. Anything this big is guaranteed
+        to fit size after being aligned, so the search only has
+        to look at the largest free reservation under each node
+        */
+        auto required = size + alignment - PageSize;
+
+        auto node = space.findFirst([=](uint64_t largestFree) {
+            return largestFree >= required;
         });
 
         if (node.has_value()) {
             auto result = node.value();
             space.remove(result); 
 
+            if (auto padding = getPadding(result.getStart(), alignment); padding > 0) {
+                auto aligned = result.split(padding);
+                space.insert(result);
+                result = aligned;
+            }
+
             if (result.getSize() > size) {
                 auto remaining = result.split(size);
                 space.insert(remaining);
             }
             
             result.clearFreeFlag();
+            result.setPagingPolicy(policy, faultAroundPages);
             space.insert(result);
 
             return result;
@@ -133,7 +228,68 @@ namespace Memory {
         }
     }
 
+    std::optional<AddressReservation> AddressSpace::findReservation(VirtualAddress address) {
+        auto candidate = space.findAtMost({address, 0});
+
+        if (candidate.has_value() 
+                && !candidate->isAvailable()
+                && candidate->contains(address)) {
+            return candidate;
+        }
+
+        return {};
+    }
+
     void AddressSpace::release(AddressReservation reservation) {
-        //TODO: implement release
+        auto existing = space.findAtMost(reservation);
+
+        if (!existing.has_value()
+                || existing->getStart().address != reservation.getStart().address
+                || existing->isAvailable()) {
+            //not reserved, or already released
+            return;
+        }
+
+        auto start = existing->getStart();
+        auto size = existing->getSize();
+        space.remove(*existing);
+
+        auto& core = CPU::getCurrentCore();
+        core.virtualMemory->releasePages(start, size / PageSize, core.physicalMemory);
+
+        if (start.address > 0) {
+            auto previous = space.findAtMost({{start.address - 1}, 0});
+
+            if (previous.has_value() 
+                    && previous->isAvailable()
+                    && previous->getStart().address + previous->getSize() == start.address) {
+                space.remove(*previous);
+                start = previous->getStart();
+                size += previous->getSize();
+            }
+        }
+
+        auto next = space.findAtLeast({{start.address + size}, 0});
+
+        if (next.has_value()
+                && next->isAvailable()
+                && next->getStart().address == start.address + size) {
+            space.remove(*next);
+            size += next->getSize();
+        }
+
+        space.insert({start, size});
+    }
+}
+
+namespace Saturn::Memory {
+
+    /*
+    Kernel heaps live in lazy reservations, so released pages
+    fault back in zeroed if they're touched again
+    */
+    void releasePages(uintptr_t address, uint32_t pageCount) {
+        auto& core = CPU::getCurrentCore();
+        core.virtualMemory->releasePages({address}, pageCount, core.physicalMemory);
     }
 }
@@ -35,10 +35,29 @@ namespace Memory {
 
     inline const uint64_t PDPSize = 0x8000000000ul;
 
+    /*
+    When the physical pages behind a reservation get allocated
+    */
+    enum class PagingPolicy {
+        //as soon as they're handed out by allocatePages
+        Eager,
+        //zeroed on first touch by the page fault handler
+        Lazy,
+        //like Lazy, but a fault also maps the following pages
+        FaultAround
+    };
+
+    inline constexpr uint32_t DefaultFaultAroundPages {8};
+
     /*
     AddressReservation is responsible for handing out memory addresses
     within its range, so the old-style vmm->allocatePages happens
     here essentially.
+
+    Whole 2MB aligned chunks of a reservation are backed by a large
+    page where possible (see VirtualMemoryManager::allocateLargePage),
+    either when they're handed out or on first touch depending on the
+    reservation's PagingPolicy. Everything else gets 4KB pages.
     */
     class AddressReservation {
     public:
@@ -57,7 +76,17 @@ namespace Memory {
 
         AddressReservation split(uint64_t size);
 
+        void setPagingPolicy(PagingPolicy policy, uint32_t faultAroundPages);
+        bool contains(VirtualAddress address) const;
+
+        /*
+        Called by the page fault handler for a not present
+        address inside this reservation
+        */
+        void handleFault(VirtualAddress address) const;
+
         uint64_t getSize() const;
+        VirtualAddress getStart() const;
         void clearFreeFlag();
         bool isAvailable() const;
 
@@ -68,6 +97,8 @@ namespace Memory {
         bool isFree {true};
         uint64_t remainingPages; 
         VirtualAddress nextPage;
+        PagingPolicy policy {PagingPolicy::Lazy};
+        uint32_t faultAroundPages {1};
     };
 
     inline bool operator>(const AddressReservation& left, const AddressReservation& right) {
@@ -78,6 +109,22 @@ namespace Memory {
         return !operator<(left, right);
     }
 
+    /*
+    Lets the reservation tree find the first free reservation
+    that's big enough without visiting every node
+    */
+    struct LargestFreeReservation {
+        using Summary = uint64_t;
+
+        static Summary summarize(const AddressReservation& reservation) {
+            return reservation.isAvailable() ? reservation.getSize() : 0;
+        }
+
+        static Summary combine(Summary left, Summary right) {
+            return left > right ? left : right;
+        }
+    };
+
     class AddressSpace {
     public:
 
@@ -90,9 +137,22 @@ namespace Memory {
         AddressSpace();
         AddressSpace(VirtualAddress start, uint64_t size, Domain domain);
 
-        std::optional<AddressReservation> reserve(uint64_t size);
+        std::optional<AddressReservation> reserve(uint64_t size, 
+            PagingPolicy policy = PagingPolicy::Lazy,
+            uint32_t faultAroundPages = DefaultFaultAroundPages);
+
+        /*
+        Frees any pages backing the reservation and gives its range
+        back, merging it with free neighbours
+        */
         void release(AddressReservation reservation);
 
+        /*
+        Returns the reservation that address is in, if
+        it's part of one that has been reserved
+        */
+        std::optional<AddressReservation> findReservation(VirtualAddress address);
+
     private:
 
         AddressSpace(const AddressSpace&) = delete;
@@ -169,6 +229,6 @@ namespace Memory {
         };
 
         Allocator allocator;        
-        AVLTree<AddressReservation, Allocator> space;
+        AVLTree<AddressReservation, Allocator, LargestFreeReservation> space;
     };
 }
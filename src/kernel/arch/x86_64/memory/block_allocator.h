@@ -30,19 +30,31 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "virtual_memory_manager.h"
 #include "physical_memory_manager.h"
 #include <cpu/metablocks.h>
+#include <locks.h>
 #include <utility>
 #include "address_space.h"
 
 namespace Memory {
 
+    inline constexpr uint64_t CacheLineSize {64};
+
     /*
-    BlockAllocator is a kernel memory allocator that simplifies allocating
+    BlockAllocator is a slab allocator that simplifies allocating
     instances of one type. Since the kernel doesn't have a heap, this
     is the main way kernel allocations are done.
 
-    BlockAllocator keeps allocating new pages and only frees memory
-    for its entire range at once using releaseMemory, but it can 
-    reuse memory for previously freed allocations.
+    Objects are carved out of slabs, each a reservation holding
+    a fixed number of them. Slabs are kept on full, partial and
+    empty lists, and once more than a few are empty they are
+    released, which gives their pages back to the physical memory
+    manager. Each slab starts its objects at a different cache line
+    offset (its colour), so the first objects of every slab don't
+    all compete for the same cache sets.
+
+    In front of the slabs each core has a pair of small magazines
+    of free objects, so most allocations and frees don't take the
+    allocator's lock. Only when both magazines are empty (or full)
+    does a core go to the slabs, moving several objects at once.
     */
     template<typename T>
     class BlockAllocator {
@@ -55,8 +67,11 @@ namespace Memory {
                 : elementsPerBlock {initialElementCount} {
 
             spaceToUse = space;
-            initialBlock = createBlock(initialElementCount * 10);
-            currentBlock = initialBlock;
+
+            if (auto slab = createSlab(initialElementCount * 10); slab != nullptr) {
+                push(emptySlabs, slab);
+                emptySlabCount++;
+            }
         }
 
         BlockAllocator(AddressSpace::Domain space)
@@ -64,115 +79,358 @@ namespace Memory {
 
         template<typename... Args>
         T* allocate(Args&&... args) {
+            auto& cache = caches[CPU::getCurrentCore().id];
+            auto loaded = &cache.magazines[cache.loaded];
 
-            if (freeList != nullptr) {
-                auto allocation = freeList;
-                freeList = allocation->nextFree;
-                return new (&allocation->value) T(std::forward<Args>(args)...);
-            }
+            if (loaded->count == 0) {
+                auto previous = &cache.magazines[1 - cache.loaded];
 
-            if (currentBlock->remainingAllocations == 0) {
-                auto block = createBlock(elementsPerBlock);
+                if (previous->count == 0) {
+                    Kernel::SpinLock guard {&lock};
 
-                if (block == nullptr) {
-                    return nullptr;
+                    while (previous->count < RefillCount) {
+                        auto allocation = takeFromSlabs();
+
+                        if (allocation == nullptr) {
+                            break;
+                        }
+
+                        previous->objects[previous->count++] = allocation;
+                    }
+
+                    if (previous->count == 0) {
+                        return nullptr;
+                    }
                 }
 
-                currentBlock->next = block;
-                currentBlock = block;
+                cache.loaded = 1 - cache.loaded;
+                loaded = previous;
             }
 
-            auto ptr = currentBlock->buffer++;
-            currentBlock->remainingAllocations--;
-            return new (ptr) T(std::forward<Args>(args)...);
+            auto allocation = loaded->objects[--loaded->count];
+            return new (&allocation->value) T(std::forward<Args>(args)...);
         }
 
+        /*
+        Allocates a contiguous array of count default constructed
+        elements in its own reservation, which must be given back
+        with freeMultiple
+        */
         T* allocateMultiple(int count) {
+            auto requiredSize = ArrayOffset + sizeof(T) * count;
+            requiredSize = (requiredSize + PageSize - 1) & ~(PageSize - 1);
 
-            //TODO: this should be an ArrayAllocator or SequentialAllocator
+            auto maybeReservation = getAddressSpace().reserve(requiredSize, getPagingPolicy());
 
-             /*
-            Note: potentially wastes some memory since we're not starting at
-            the current position in the buffer, but we can't guarantee that
-            the next page address comes right after this one.
-            */
-            /*auto currentBlock = &currentMetaBlock->blocks[currentMetaBlock->currentBlock];
+            if (!maybeReservation.has_value()) {
+                return nullptr;
+            }
 
-            if (currentBlock->remainingAllocations < count) {
-                if (currentBlock->currentBlock < BlockMeta::MaxBlocks) {
-                   currentMetaBlock->blocks[currentMetaBlock->currentBlock] = allocateBlock();
-                }
-                else {
-                    auto meta = allocateBlockMeta();
-                    currentMetaBlock->next = meta;
-                    currentMetaBlock = meta;
-                }
+            auto reservation = maybeReservation.value();
+            auto maybeAllocation = reservation.allocatePages(requiredSize / PageSize);
 
-                currentBlock = &currentMetaBlock->blocks[currentMetaBlock->currentBlock];
+            if (!maybeAllocation.has_value()) {
+                getAddressSpace().release(reservation);
+                return nullptr;
+            }
+
+            auto ptr = reinterpret_cast<uint8_t*>(maybeAllocation.value().address);
+            new (ptr) ArrayHeader {reservation};
+            auto elements = reinterpret_cast<T*>(ptr + ArrayOffset);
+
+            for (int i = 0; i < count; i++) {
+                new (elements + i) T();
             }
 
-            auto ptr = currentBlock->buffer;
-            currentBlock->buffer += count;
-            currentBlock->remainingAllocations -= count;
-            return ptr;*/
+            return elements;
+        }
+
+        void freeMultiple(T* elements) {
+            auto ptr = reinterpret_cast<uint8_t*>(elements) - ArrayOffset;
+            auto header = reinterpret_cast<ArrayHeader*>(ptr);
+            getAddressSpace().release(header->reservation);
         }
 
         void free(T* ptr) {
-            auto address = reinterpret_cast<uintptr_t>(ptr);
-            address -= sizeof(uintptr_t);
-            auto allocation = reinterpret_cast<Allocation*>(address);
+            auto allocation = reinterpret_cast<Allocation*>(ptr);
+            auto& cache = caches[CPU::getCurrentCore().id];
+            auto loaded = &cache.magazines[cache.loaded];
+
+            if (loaded->count == MagazineSize) {
+                auto previous = &cache.magazines[1 - cache.loaded];
 
-            if (freeList != nullptr) {
-                allocation->nextFree = freeList;
-                freeList = allocation;
+                if (previous->count == MagazineSize) {
+                    Kernel::SpinLock guard {&lock};
+                    flush(*previous);
+                }
+
+                cache.loaded = 1 - cache.loaded;
+                loaded = previous;
             }
-            else {
-                freeList = allocation;
+
+            loaded->objects[loaded->count++] = allocation;
+        }
+
+        /*
+        Returns this core's cached objects to their slabs and
+        releases every empty slab
+        */
+        void shrink() {
+            auto& cache = caches[CPU::getCurrentCore().id];
+            Kernel::SpinLock guard {&lock};
+
+            flush(cache.magazines[0]);
+            flush(cache.magazines[1]);
+
+            while (emptySlabs != nullptr) {
+                auto slab = emptySlabs;
+                unlink(emptySlabs, slab);
+                emptySlabCount--;
+                getAddressSpace().release(slab->reservation);
             }
         }
 
         void releaseMemory() {
+            Kernel::SpinLock guard {&lock};
 
-            auto iterator = initialBlock;
-            auto& core = CPU::getCurrentCore();
+            Slab** lists[] = {&fullSlabs, &partialSlabs, &emptySlabs};
 
-            while (iterator != nullptr) {
-                core.addressSpaces[static_cast<int>(spaceToUse)]->release(iterator->reservation);
-                iterator = iterator->next;
+            for (auto list : lists) {
+                while (*list != nullptr) {
+                    auto slab = *list;
+                    unlink(*list, slab);
+                    getAddressSpace().release(slab->reservation);
+                }
+            }
+
+            emptySlabCount = 0;
+
+            for (auto& cache : caches) {
+                cache.magazines[0].count = 0;
+                cache.magazines[1].count = 0;
             }
         }
 
+        struct Statistics {
+            int fullSlabs;
+            int partialSlabs;
+            int emptySlabs;
+        };
+
+        Statistics getStatistics() {
+            Kernel::SpinLock guard {&lock};
+            return {count(fullSlabs), count(partialSlabs), count(emptySlabs)};
+        }
+
     private:
 
-        AddressSpace::Domain spaceToUse {AddressSpace::Domain::Default};
+        struct Slab;
 
+        /*
+        value must come first so that free can turn a T* 
+        back into its Allocation
+        */
         struct Allocation {
-            Allocation* nextFree;
             T value;
+            Slab* slab;
+            Allocation* nextFree;
         };
 
-        Allocation* freeList {nullptr};
-
-        struct Block {
-            Block(Allocation* buffer, int allocations, AddressReservation reservation)
-                : buffer {buffer}, 
-                    remainingAllocations {allocations},
+        struct Slab {
+            Slab(Allocation* buffer, int capacity, AddressReservation reservation)
+                : nextUnused {buffer},
+                    unusedAllocations {capacity},
+                    capacity {capacity},
                     reservation {reservation} {
             }
 
-            Allocation* buffer {nullptr};
-            int remainingAllocations {0};
+            Slab* previous {nullptr};
+            Slab* next {nullptr};
+
+            Allocation* freeList {nullptr};
+
+            /*
+            Objects that have never been handed out, so that a new
+            slab doesn't have to touch all of its pages up front
+            */
+            Allocation* nextUnused;
+            int unusedAllocations;
+
+            int inUse {0};
+            int capacity;
             AddressReservation reservation;
-            Block* next {nullptr};
         };
 
-        Block* createBlock(int numberOfElements) {
-            auto& core = CPU::getCurrentCore(); 
+        static constexpr int MagazineSize {6};
+        static constexpr int RefillCount {MagazineSize / 2};
+        static constexpr int MaxEmptySlabs {1};
+
+        struct Magazine {
+            int count {0};
+            Allocation* objects[MagazineSize];
+        };
+
+        /*
+        Each core's magazines fill exactly two cache lines of their
+        own, so cores don't invalidate each other's. loaded indexes magazines
+        rather than pointing into it so the allocator can be copied
+        */
+        struct alignas(CacheLineSize) CoreCache {
+            Magazine magazines[2];
+            int loaded {0};
+        };
+
+        static_assert(sizeof(CoreCache) == CacheLineSize * 2);
+
+        struct ArrayHeader {
+            AddressReservation reservation;
+        };
+
+        static constexpr uint64_t ArrayOffset {
+            (sizeof(ArrayHeader) + alignof(T) - 1) & ~(alignof(T) - 1)
+        };
+
+        static constexpr uint64_t ColourStep {
+            alignof(Allocation) > CacheLineSize ? alignof(Allocation) : CacheLineSize
+        };
+
+        AddressSpace& getAddressSpace() {
+            auto& core = CPU::getCurrentCore();
+            return *core.addressSpaces[static_cast<int>(spaceToUse)];
+        }
+
+        PagingPolicy getPagingPolicy() {
+            /*
+            Stacks get used by new cores before they can
+            handle page faults, so they can't be lazy
+            */
+            return spaceToUse == AddressSpace::Domain::KernelStacks
+                ? PagingPolicy::Eager
+                : PagingPolicy::Lazy;
+        }
+
+        static void unlink(Slab*& list, Slab* slab) {
+            if (slab->previous != nullptr) {
+                slab->previous->next = slab->next;
+            }
+            else {
+                list = slab->next;
+            }
+
+            if (slab->next != nullptr) {
+                slab->next->previous = slab->previous;
+            }
+
+            slab->previous = nullptr;
+            slab->next = nullptr;
+        }
+
+        static void push(Slab*& list, Slab* slab) {
+            slab->next = list;
+
+            if (list != nullptr) {
+                list->previous = slab;
+            }
+
+            list = slab;
+        }
+
+        static int count(Slab* list) {
+            int total = 0;
+
+            while (list != nullptr) {
+                total++;
+                list = list->next;
+            }
+
+            return total;
+        }
+
+        /*
+        Must hold lock
+        */
+        Allocation* takeFromSlabs() {
+            if (partialSlabs == nullptr) {
+                if (emptySlabs != nullptr) {
+                    auto slab = emptySlabs;
+                    unlink(emptySlabs, slab);
+                    emptySlabCount--;
+                    push(partialSlabs, slab);
+                }
+                else if (auto slab = createSlab(elementsPerBlock); slab != nullptr) {
+                    push(partialSlabs, slab);
+                }
+                else {
+                    return nullptr;
+                }
+            }
+
+            auto slab = partialSlabs;
+            Allocation* allocation;
+
+            if (slab->freeList != nullptr) {
+                allocation = slab->freeList;
+                slab->freeList = allocation->nextFree;
+            }
+            else {
+                allocation = slab->nextUnused++;
+                allocation->slab = slab;
+                slab->unusedAllocations--;
+            }
+
+            slab->inUse++;
+
+            if (slab->inUse == slab->capacity) {
+                unlink(partialSlabs, slab);
+                push(fullSlabs, slab);
+            }
+
+            return allocation;
+        }
+
+        /*
+        Must hold lock
+        */
+        void returnToSlab(Allocation* allocation) {
+            auto slab = allocation->slab;
+
+            if (slab->inUse == slab->capacity) {
+                unlink(fullSlabs, slab);
+                push(partialSlabs, slab);
+            }
+
+            allocation->nextFree = slab->freeList;
+            slab->freeList = allocation;
+            slab->inUse--;
+
+            if (slab->inUse == 0) {
+                unlink(partialSlabs, slab);
+
+                if (emptySlabCount == MaxEmptySlabs) {
+                    getAddressSpace().release(slab->reservation);
+                }
+                else {
+                    push(emptySlabs, slab);
+                    emptySlabCount++;
+                }
+            }
+        }
+
+        /*
+        Must hold lock
+        */
+        void flush(Magazine& magazine) {
+            while (magazine.count > 0) {
+                returnToSlab(magazine.objects[--magazine.count]);
+            }
+        }
+
+        Slab* createSlab(int numberOfElements) {
             auto requiredSize = sizeof(Allocation) * numberOfElements;
-            requiredSize += sizeof(Block);
+            requiredSize += sizeof(Slab);
             requiredSize = (requiredSize & ~0xFFF) + 0x1000;
 
-            auto maybeReservation = core.addressSpaces[static_cast<int>(spaceToUse)]->reserve(requiredSize);
+            auto maybeReservation = getAddressSpace().reserve(requiredSize, getPagingPolicy());
             if (!maybeReservation.has_value()) {
                 return nullptr;
             }
@@ -181,25 +439,47 @@ namespace Memory {
             auto maybeAllocation = reservation.allocatePages(requiredSize / 0x1000);
             
             if (!maybeAllocation.has_value()) {
+                getAddressSpace().release(reservation);
                 return nullptr;
             }
 
             auto allocation = maybeAllocation.value();
 
+            /*
+            Whatever space is left over after the objects and the
+            slab itself is used to offset each new slab's objects
+            */
+            auto leftOver = requiredSize - sizeof(Slab) - sizeof(Allocation) * numberOfElements;
+            auto colour = nextColour * ColourStep;
+
+            if (colour > leftOver) {
+                colour = 0;
+                nextColour = 0;
+            }
+
+            nextColour++;
+
             uint8_t* ptr = reinterpret_cast<uint8_t*>(allocation.address);
-            uint8_t* blockPtr = ptr + requiredSize - sizeof(Block);
-            auto block = new (blockPtr) Block(
-                reinterpret_cast<Allocation*>(ptr),
+            uint8_t* slabPtr = ptr + requiredSize - sizeof(Slab);
+            auto slab = new (slabPtr) Slab(
+                reinterpret_cast<Allocation*>(ptr + colour),
                 numberOfElements,
                 reservation);
             
-            return block;
+            return slab;
         }
 
-        Block* initialBlock;
-        Block* currentBlock;
+        AddressSpace::Domain spaceToUse {AddressSpace::Domain::Default};
+
+        Slab* fullSlabs {nullptr};
+        Slab* partialSlabs {nullptr};
+        Slab* emptySlabs {nullptr};
+        int emptySlabCount {0};
 
         int elementsPerBlock;
-         
+        uint64_t nextColour {0};
+        uint32_t lock {0};
+
+        CoreCache caches[CPU::MaxCores];
     };
 }
@@ -0,0 +1,314 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include "addresses.h"
+
+namespace Memory {
+
+    template<int MaxOrder>
+    struct BuddyStatistics {
+        uint64_t freePages {0};
+        uint64_t freeBlocks[MaxOrder + 1] {};
+
+        //-1 if nothing is free
+        int largestFreeOrder {-1};
+
+        /*
+        Percentage of free pages that sit in blocks too small
+        to satisfy an allocation of the given order
+        */
+        int getFragmentation(int order) const {
+            if (freePages == 0) {
+                return 0;
+            }
+
+            uint64_t unusable {0};
+
+            for (int i = 0; i < order && i <= MaxOrder; i++) {
+                unusable += freeBlocks[i] << i;
+            }
+
+            return (unusable * 100) / freePages;
+        }
+    };
+
+    /*
+    A binary buddy allocator for physical pages. Blocks are 2^order
+    pages, aligned to their own size, so an order 9 block is a 2MB
+    aligned run of 2MB.
+
+    Free pages are never touched, since most of physical memory isn't
+    mapped. Instead each order has a bitmap with one bit per block,
+    set if that block is free as a whole and not part of a larger free
+    block. A summary bitmap per order, one bit per bitmap word, keeps
+    finding a free block from scanning the whole bitmap.
+
+    Frames is the most pages the allocator can cover, starting from
+    base. All the bitmaps are sized from it at compile time, since
+    this has to work before there is anywhere else to put them.
+    */
+    template<uint64_t Frames, int MaxOrder = 10>
+    class BuddyAllocator {
+    public:
+
+        static_assert(Frames % (1ul << MaxOrder) == 0, "Frames must be a multiple of the largest block");
+
+        using Statistics = BuddyStatistics<MaxOrder>;
+
+        constexpr explicit BuddyAllocator(uintptr_t base = 0)
+            : base {base} {}
+
+        /*
+        Marks a range of pages as free. Pages outside of what the
+        allocator covers are ignored. Returns how many were added
+        */
+        uint64_t addRange(PhysicalAddress start, uint64_t pages) {
+            if (start.address < base) {
+                auto skipped = (base - start.address) / PageBytes;
+
+                if (skipped >= pages) {
+                    return 0;
+                }
+
+                pages -= skipped;
+                start.address = base;
+            }
+
+            auto frame = (start.address - base) / PageBytes;
+
+            if (frame >= Frames) {
+                return 0;
+            }
+
+            if (frame + pages > Frames) {
+                pages = Frames - frame;
+            }
+
+            auto added = pages;
+
+            //free the largest aligned blocks that fit
+            while (pages > 0) {
+                int order = MaxOrder;
+
+                while (order > 0 
+                    && ((frame & ((1ul << order) - 1)) != 0 || (1ul << order) > pages)) {
+                    order--;
+                }
+
+                release(frame, order);
+                frame += 1ul << order;
+                pages -= 1ul << order;
+            }
+
+            return added;
+        }
+
+        /*
+        Returns the start of a free block of 2^order pages, or
+        an address of 0 if there isn't one
+        */
+        PhysicalAddress allocate(int order) {
+            if (order < 0 || order > MaxOrder) {
+                return {0};
+            }
+
+            int found = order;
+            int64_t index {-1};
+
+            while (found <= MaxOrder) {
+                index = findFree(found);
+
+                if (index >= 0) {
+                    break;
+                }
+
+                found++;
+            }
+
+            if (index < 0) {
+                return {0};
+            }
+
+            clear(found, index);
+
+            //split the block, freeing the upper half at each order down
+            while (found > order) {
+                found--;
+                index *= 2;
+                set(found, index + 1);
+            }
+
+            freePages -= 1ul << order;
+
+            return {base + ((static_cast<uint64_t>(index) << order) * PageBytes)};
+        }
+
+        /*
+        Returns a block from allocate, merging it with its
+        buddy as far up as possible
+        */
+        void free(PhysicalAddress address, int order) {
+            if (address.address < base || order < 0 || order > MaxOrder) {
+                return;
+            }
+
+            auto frame = (address.address - base) / PageBytes;
+
+            if (frame + (1ul << order) > Frames) {
+                return;
+            }
+
+            release(frame, order);
+        }
+
+        uint64_t getFreePages() const {
+            return freePages;
+        }
+
+        Statistics getStatistics() const {
+            Statistics statistics;
+            statistics.freePages = freePages;
+
+            for (int order = 0; order <= MaxOrder; order++) {
+                statistics.freeBlocks[order] = freeBlocks[order];
+
+                if (freeBlocks[order] > 0) {
+                    statistics.largestFreeOrder = order;
+                }
+            }
+
+            return statistics;
+        }
+
+    private:
+
+        static constexpr uint64_t PageBytes {0x1000};
+
+        static constexpr uint64_t wordsFor(int order) {
+            return ((Frames >> order) + 63) / 64;
+        }
+
+        static constexpr uint64_t summaryWordsFor(int order) {
+            return (wordsFor(order) + 63) / 64;
+        }
+
+        static constexpr uint64_t bitmapOffset(int order) {
+            uint64_t offset {0};
+
+            for (int i = 0; i < order; i++) {
+                offset += wordsFor(i);
+            }
+
+            return offset;
+        }
+
+        static constexpr uint64_t summaryOffset(int order) {
+            uint64_t offset {0};
+
+            for (int i = 0; i < order; i++) {
+                offset += summaryWordsFor(i);
+            }
+
+            return offset;
+        }
+
+        void release(uint64_t frame, int order) {
+            auto index = frame >> order;
+
+            while (order < MaxOrder) {
+                auto buddy = index ^ 1;
+
+                if (!test(order, buddy)) {
+                    break;
+                }
+
+                clear(order, buddy);
+                freePages -= 1ul << order;
+                index /= 2;
+                order++;
+            }
+
+            set(order, index);
+            freePages += 1ul << order;
+        }
+
+        int64_t findFree(int order) {
+            auto summaries = summary + summaryOffset(order);
+            auto words = bitmap + bitmapOffset(order);
+
+            for (auto i = 0u; i < summaryWordsFor(order); i++) {
+                if (summaries[i] == 0) {
+                    continue;
+                }
+
+                auto word = i * 64 + __builtin_ctzl(summaries[i]);
+                return word * 64 + __builtin_ctzl(words[word]);
+            }
+
+            return -1;
+        }
+
+        bool test(int order, uint64_t index) const {
+            if (index >= (Frames >> order)) {
+                return false;
+            }
+
+            auto word = bitmap[bitmapOffset(order) + index / 64];
+            return word & (1ul << (index % 64));
+        }
+
+        void set(int order, uint64_t index) {
+            auto& word = bitmap[bitmapOffset(order) + index / 64];
+            word |= 1ul << (index % 64);
+
+            auto wordIndex = index / 64;
+            summary[summaryOffset(order) + wordIndex / 64] |= 1ul << (wordIndex % 64);
+            freeBlocks[order]++;
+        }
+
+        void clear(int order, uint64_t index) {
+            auto& word = bitmap[bitmapOffset(order) + index / 64];
+            word &= ~(1ul << (index % 64));
+
+            if (word == 0) {
+                auto wordIndex = index / 64;
+                summary[summaryOffset(order) + wordIndex / 64] &= ~(1ul << (wordIndex % 64));
+            }
+
+            freeBlocks[order]--;
+        }
+
+        uintptr_t base;
+        uint64_t freePages {0};
+        uint64_t freeBlocks[MaxOrder + 1] {};
+        uint64_t bitmap[bitmapOffset(MaxOrder + 1)] {};
+        uint64_t summary[summaryOffset(MaxOrder + 1)] {};
+    };
+}
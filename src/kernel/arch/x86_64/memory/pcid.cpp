@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "pcid.h"
+#include <locks.h>
+
+namespace Memory {
+
+    //CPUID.01H:ECX and CR4 both use bit 17 for PCIDs
+    constexpr uint32_t PCIDBit {1u << 17};
+
+    //CR3 bit 63 keeps the TLB entries tagged with the new PCID
+    constexpr uint64_t NoFlush {1ul << 63};
+
+    uint16_t PCIDPool::allocate() {
+        Kernel::SpinLock guard {&lock};
+
+        for (auto i = 0u; i < PCIDCount; i++) {
+            auto pcid = (nextSearch + i) % PCIDCount;
+            auto word = pcid / 64;
+            auto bit = 1ul << (pcid % 64);
+
+            if (!(used[word] & bit)) {
+                used[word] |= bit;
+                nextSearch = (pcid + 1) % PCIDCount;
+                return pcid;
+            }
+        }
+
+        return KernelPCID;
+    }
+
+    void PCIDPool::free(uint16_t pcid) {
+        if (pcid == KernelPCID) {
+            return;
+        }
+
+        Kernel::SpinLock guard {&lock};
+        auto word = pcid / 64;
+        auto bit = 1ul << (pcid % 64);
+
+        used[word] &= ~bit;
+
+        for (auto& core : stale) {
+            __atomic_fetch_or(&core[word], bit, __ATOMIC_RELAXED);
+        }
+    }
+
+    bool PCIDPool::takeStale(int core, uint16_t pcid) {
+        auto bit = 1ul << (pcid % 64);
+        auto previous = __atomic_fetch_and(&stale[core][pcid / 64], ~bit, __ATOMIC_RELAXED);
+        return previous & bit;
+    }
+
+    PCIDPool& getPCIDPool() {
+        static PCIDPool pool;
+        return pool;
+    }
+
+    //CR4.PCIDE is per core, but either every core supports it or none do
+    bool pcidsEnabled {false};
+
+    void enablePCIDs() {
+        uint32_t eax {1}, ebx, ecx, edx;
+        asm("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+
+        if (!(ecx & PCIDBit)) {
+            return;
+        }
+
+        uint64_t cr4;
+        asm volatile("mov %%cr4, %0" : "=r" (cr4));
+        asm volatile("mov %0, %%cr4" : : "r" (cr4 | PCIDBit) : "memory");
+        pcidsEnabled = true;
+    }
+
+    void loadPageMap(PhysicalAddress level4, uint16_t pcid) {
+        auto cr3 = level4.address;
+
+        if (pcidsEnabled) {
+            cr3 |= pcid;
+
+            /*
+            KernelPCID can be shared by several maps once the pool
+            runs out, so only a PCID that's unique is trusted
+            */
+            if (pcid != KernelPCID
+                    && !getPCIDPool().takeStale(CPU::getCurrentCore().id, pcid)) {
+                cr3 |= NoFlush;
+            }
+        }
+
+        asm volatile("mov %0, %%cr3" : : "r" (cr3) : "memory");
+    }
+}
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <cpu/metablocks.h>
+#include "addresses.h"
+
+namespace Memory {
+
+    inline constexpr uint32_t PCIDCount {4096};
+
+    /*
+    Used by the kernel's own page map, and handed out once every
+    other PCID is taken. Loading a map with it always flushes
+    */
+    inline constexpr uint16_t KernelPCID {0};
+
+    /*
+    A process context identifier tags every TLB entry with the
+    address space it came from, so loading a different page map
+    doesn't have to throw away every other space's entries.
+
+    A freed PCID may still tag entries on any core. Rather than
+    flushing every core when it's freed, each core remembers which
+    PCIDs went stale and flushes one the first time it loads it
+    for the new owner
+    */
+    class PCIDPool {
+    public:
+
+        /*
+        Returns a PCID nobody else has, or KernelPCID if
+        they're all in use
+        */
+        uint16_t allocate();
+        void free(uint16_t pcid);
+
+        /*
+        Returns true if core might still have entries tagged with
+        pcid from a previous owner, and forgets that it does
+        */
+        bool takeStale(int core, uint16_t pcid);
+
+    private:
+
+        static constexpr int BitmapWords {PCIDCount / 64};
+
+        uint32_t lock {0};
+
+        //where allocate starts looking, so freed PCIDs are reused last
+        uint32_t nextSearch {1};
+        //KernelPCID is never handed out
+        uint64_t used[BitmapWords] {1};
+        uint64_t stale[CPU::MaxCores][BitmapWords] {};
+    };
+
+    PCIDPool& getPCIDPool();
+
+    /*
+    Sets CR4.PCIDE on the current core if the CPU supports it.
+    Must be called while the current page map uses KernelPCID
+    */
+    void enablePCIDs();
+
+    /*
+    Makes level4 the current page map. If PCIDs are enabled, entries
+    already tagged with pcid are kept unless it went stale
+    */
+    void loadPageMap(PhysicalAddress level4, uint16_t pcid);
+}
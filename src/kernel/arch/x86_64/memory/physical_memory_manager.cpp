@@ -27,16 +27,36 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "physical_memory_manager.h"
 #include <string.h>
+#include <locks.h>
+#include <misc/kernel_initial_arguments.h>
+#include <cpu/metablocks.h>
+#include "virtual_memory_manager.h"
 
 namespace Memory {
 
     PhysicalMemoryManager PhysicalMemoryManager::GlobalManager;
+    PhysicalMemoryManager PhysicalMemoryManager::CoreManagers[MaxCores];
+    int PhysicalMemoryManager::CoreManagerCount {0};
+    Magazine PhysicalMemoryManager::Magazines[MagazineCount];
     uint64_t PhysicalMemoryManager::RealModeFreePages[20];
-    uint64_t PhysicalMemoryManager::DMAFreePages[512];
+    PhysicalMemoryManager::PageAllocator PhysicalMemoryManager::Pages;
 
-    void PhysicalMemoryManager::SetupGlobalManager(PhysicalAddress firstFree, uint64_t totalFreePages) {
+    const uintptr_t firstMegabyte = 0x100'000;
+    const uintptr_t sixteenthMegabyte = 0x1'000'000;
+
+    BuddyAllocator<0x1000> PhysicalMemoryManager::DMAPages {firstMegabyte};
+    uint32_t PhysicalMemoryManager::DMALock {0};
+    uint16_t* PhysicalMemoryManager::References {nullptr};
+
+    /*
+    Inside the kernel's PDP so that every address space has
+    it, but out of the way of the kernel image and stacks
+    */
+    const uintptr_t ReferenceTableAddress {(0xFFFFul << 48) | (511ul << 39) | (1ul << 30)};
+    uint32_t PhysicalMemoryManager::ReferencesLock {0};
+
+    void PhysicalMemoryManager::SetupGlobalManager(const MemoryRange* ranges, uint64_t rangeCount) {
 
-        memset(DMAFreePages, 0xFFFF'FFFF, sizeof(DMAFreePages));
         memset(RealModeFreePages, 0xFFFF'FFFF, sizeof(RealModeFreePages));
 
         /*
@@ -49,63 +69,281 @@ namespace Memory {
             auto used = allocateRealModePage();
         }
 
-        GlobalManager.nextFreeAddress = firstFree.address;
-        GlobalManager.totalPages = totalFreePages;
-        GlobalManager.freePages = totalFreePages;
+        /*
+        The loader keeps 1MB - 16MB out of the ranges it gives us.
+        The first 3 * 64 pages of it are skipped, since that's
+        where the loader itself lives
+        */
+        auto firstDMAPage = firstMegabyte + 3 * 64 * PageSize;
+        DMAPages.addRange({firstDMAPage}, (sixteenthMegabyte - firstDMAPage) / PageSize);
+
+        for (auto i = 0u; i < rangeCount; i++) {
+            GlobalManager.totalPages += Pages.addRange({ranges[i].start}, ranges[i].pages);
+        }
+
+        GlobalManager.freePages = GlobalManager.totalPages;
+
+        for (auto& magazine : Magazines) {
+            magazine.next = GlobalManager.emptyMagazines;
+            GlobalManager.emptyMagazines = &magazine;
+        }
     }
 
     PhysicalMemoryManager& PhysicalMemoryManager::GetGlobalManager() {
         return GlobalManager;
     }
 
-    PhysicalAddress PhysicalMemoryManager::allocatePage() {
-        /*
-        TODO:
+    PhysicalMemoryManager* PhysicalMemoryManager::CreateCoreManager() {
+        Kernel::SpinLock guard {&GlobalManager.lock};
+
+        if (CoreManagerCount == MaxCores) {
+            return nullptr;
+        }
+
+        auto& core = CoreManagers[CoreManagerCount++];
 
-        each physical core gets its own PMM
-        the global PMM (GPMM) hands out batches of
-        pages to core PMMs (CPMM). When a CPMM is empty,
-        it requests pages from the GPMM, needs
-        to support locks there.
+        /*
+        There are always enough magazines for every core to
+        have two, but they might be sitting full in the depot
         */
-        if (freePages == 0) {
-            return {0};
+        auto take = [&]() {
+            auto& list = GlobalManager.emptyMagazines != nullptr 
+                ? GlobalManager.emptyMagazines
+                : GlobalManager.fullMagazines;
+            auto magazine = list;
+            list = magazine->next;
+            magazine->next = nullptr;
+            return magazine;
+        };
+
+        core.loaded = take();
+        core.previous = take();
+
+        return &core;
+    }
+
+    PhysicalAddress PhysicalMemoryManager::allocatePage() {
+
+        if (this == &GlobalManager) {
+            Kernel::SpinLock guard {&lock};
+            auto page = Pages.allocate(0);
+
+            if (page.address != 0) {
+                __atomic_sub_fetch(&freePages, 1, __ATOMIC_RELAXED);
+            }
+
+            return page;
+        }
+
+        if (loaded->isEmpty() && previous->isFull()) {
+            auto swap = loaded;
+            loaded = previous;
+            previous = swap;
         }
 
-        freePages--;
+        if (loaded->isEmpty()) {
+            Kernel::SpinLock guard {&GlobalManager.lock};
 
-        if (waitingToFinish) {
-            int pause = 0;
+            if (auto full = GlobalManager.exchangeEmptyForFull(previous)) {
+                previous = loaded;
+                loaded = full;
+            }
+            else {
+                /*
+                Nothing is cached anywhere, so refill half the magazine
+                from the buddy allocator. Leaving the other half empty
+                means a few frees don't immediately send it back
+                */
+                while (loaded->count < Magazine::Capacity / 2) {
+                    auto page = Pages.allocate(0);
+
+                    if (page.address == 0) {
+                        break;
+                    }
+
+                    loaded->pages[loaded->count] = page;
+                    loaded->count++;
+                }
+            }
         }
 
-        waitingToFinish = true;
+        if (!loaded->isEmpty()) {
+            loaded->count--;
+            __atomic_sub_fetch(&GlobalManager.freePages, 1, __ATOMIC_RELAXED);
+            return loaded->pages[loaded->count];
+        }
 
-        return {nextFreeAddress};
+        return {0};
     }
 
     void PhysicalMemoryManager::finishAllocation(VirtualAddress linear) {
-        waitingToFinish = false;
-        uint64_t* page = reinterpret_cast<uint64_t*>(linear.address & ~0xFFF);
-        nextFreeAddress = *page;
+        auto page = reinterpret_cast<uint64_t*>(linear.address & ~0xFFF);
         memset(page, 0, PageSize);
     }
 
     uint32_t PhysicalMemoryManager::getFreePages() {
-        return freePages;
+        return __atomic_load_n(&GlobalManager.freePages, __ATOMIC_RELAXED);
     }
 
     uint32_t PhysicalMemoryManager::getTotalPages() {
-        return totalPages;
+        return GlobalManager.totalPages;
     }
 
     void PhysicalMemoryManager::freePage(VirtualAddress linear, PhysicalAddress physical) {
-        auto page = reinterpret_cast<uint64_t*>(linear.address & ~0xfff);
-        *page = nextFreeAddress;
-        nextFreeAddress = physical.address;
-        freePages++;
+
+        if (dropReference(physical)) {
+            //someone else still has it mapped
+            return;
+        }
+
+        if (this == &GlobalManager) {
+            Kernel::SpinLock guard {&lock};
+            Pages.free(physical, 0);
+            __atomic_add_fetch(&freePages, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        if (loaded->isFull() && previous->isEmpty()) {
+            auto swap = loaded;
+            loaded = previous;
+            previous = swap;
+        }
+
+        if (loaded->isFull()) {
+            Kernel::SpinLock guard {&GlobalManager.lock};
+
+            if (auto empty = GlobalManager.exchangeFullForEmpty(previous)) {
+                previous = loaded;
+                loaded = empty;
+            }
+        }
+
+        if (!loaded->isFull()) {
+            loaded->pages[loaded->count] = physical;
+            loaded->count++;
+            __atomic_add_fetch(&GlobalManager.freePages, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        //the depot is out of empty magazines, so the page goes back to the buddy allocator
+        GlobalManager.freePage(linear, physical);
+    }
+
+    PhysicalAddress PhysicalMemoryManager::allocateContiguous(int order) {
+        Kernel::SpinLock guard {&GlobalManager.lock};
+        auto address = Pages.allocate(order);
+
+        if (address.address != 0) {
+            __atomic_sub_fetch(&GlobalManager.freePages, 1ul << order, __ATOMIC_RELAXED);
+        }
+
+        return address;
+    }
+
+    void PhysicalMemoryManager::freeContiguous(PhysicalAddress address, int order) {
+        Kernel::SpinLock guard {&GlobalManager.lock};
+        Pages.free(address, order);
+        __atomic_add_fetch(&GlobalManager.freePages, 1ul << order, __ATOMIC_RELAXED);
+    }
+
+    PhysicalMemoryManager::Statistics PhysicalMemoryManager::getStatistics() {
+        Kernel::SpinLock guard {&GlobalManager.lock};
+        return Pages.getStatistics();
+    }
+
+    Magazine* PhysicalMemoryManager::exchangeEmptyForFull(Magazine* empty) {
+        auto full = fullMagazines;
+
+        if (full == nullptr) {
+            return nullptr;
+        }
+
+        fullMagazines = full->next;
+        full->next = nullptr;
+
+        empty->next = emptyMagazines;
+        emptyMagazines = empty;
+
+        return full;
+    }
+
+    Magazine* PhysicalMemoryManager::exchangeFullForEmpty(Magazine* full) {
+        auto empty = emptyMagazines;
+
+        if (empty == nullptr) {
+            return nullptr;
+        }
+
+        emptyMagazines = empty->next;
+        empty->next = nullptr;
+
+        full->next = fullMagazines;
+        fullMagazines = full;
+
+        return empty;
+    }
+
+    uint16_t* PhysicalMemoryManager::getReferenceCount(PhysicalAddress address) {
+        auto frame = address.address / PageSize;
+
+        if (frame >= MaxPhysicalMemory / PageSize) {
+            return nullptr;
+        }
+
+        if (__atomic_load_n(&References, __ATOMIC_ACQUIRE) == nullptr) {
+            return nullptr;
+        }
+
+        return References + frame;
+    }
+
+    void PhysicalMemoryManager::addReference(PhysicalAddress address) {
+
+        if (__atomic_load_n(&References, __ATOMIC_ACQUIRE) == nullptr) {
+            Kernel::SpinLock guard {&ReferencesLock};
+
+            if (References == nullptr) {
+                auto& core = CPU::getCurrentCore();
+                auto size = (MaxPhysicalMemory / PageSize) * sizeof(uint16_t);
+
+                if (!core.virtualMemory->allocateLargePage({ReferenceTableAddress}, core.physicalMemory)) {
+                    for (auto offset = 0ul; offset < size; offset += PageSize) {
+                        core.virtualMemory->allocatePagingTablesFor({ReferenceTableAddress + offset}, core.physicalMemory);
+                    }
+                }
+
+                __atomic_store_n(&References, reinterpret_cast<uint16_t*>(ReferenceTableAddress), __ATOMIC_RELEASE);
+            }
+        }
+
+        if (auto count = getReferenceCount(address)) {
+            __atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    bool PhysicalMemoryManager::isShared(PhysicalAddress address) {
+        auto count = getReferenceCount(address);
+        return count != nullptr && __atomic_load_n(count, __ATOMIC_RELAXED) > 0;
     }
 
-    const int firstMegabyte = 0x100'000;
+    bool PhysicalMemoryManager::dropReference(PhysicalAddress address) {
+        auto count = getReferenceCount(address);
+
+        if (count == nullptr) {
+            return false;
+        }
+
+        auto current = __atomic_load_n(count, __ATOMIC_RELAXED);
+
+        while (current > 0) {
+            if (__atomic_compare_exchange_n(count, &current, current - 1, 
+                    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
 
     PhysicalAddress PhysicalMemoryManager::allocateRealModePage() {
         //TODO: locks
@@ -147,42 +385,17 @@ namespace Memory {
     }
 
     PhysicalAddress PhysicalMemoryManager::allocateDMAPage() {
-        //TODO: locks
-
-        for (int i = 3; i < 512; i++) {
-            if (DMAFreePages[i] > 0) {
-                uint32_t index {0};
-
-                asm("bsf %1, %0"
-                    : "=r" (index)
-                    : "rm" (DMAFreePages[i]));
-
-                DMAFreePages[i] &= ~(1 << index);
-
-                auto page = 64ul * PageSize * i;
-                page += index * PageSize;
-
-                return {page + firstMegabyte};
-            }
-        }
-
-        return {0};
+        Kernel::SpinLock guard {&DMALock};
+        return DMAPages.allocate(0);
     }
 
     void PhysicalMemoryManager::freeDMAPage(VirtualAddress linear) {
 
-        if (linear.address < firstMegabyte) {
-            return;
-        }
-
-        linear.address -= firstMegabyte;
-        int index = linear.address / (64 * 0x1000);
-        int bit = (linear.address % (64 * 0x1000)) / PageSize;
-
-        if (index >= 512) {
+        if (linear.address < firstMegabyte || linear.address >= sixteenthMegabyte) {
             return;
         }
 
-        DMAFreePages[index] |= (1 << bit);
+        Kernel::SpinLock guard {&DMALock};
+        DMAPages.free({linear.address & ~0xFFFul}, 0);
     }
 }
@@ -29,31 +29,86 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdint.h>
 #include "addresses.h"
+#include "buddy_allocator.h"
+
+struct MemoryRange;
 
 namespace Memory {
 
     const int PageSize {0x1000};
 
+    /*
+    A fixed size stack of free physical pages. Core managers
+    keep a couple of these so most allocations and frees never
+    touch the global manager
+    */
+    struct Magazine {
+        static constexpr int Capacity {32};
+
+        PhysicalAddress pages[Capacity];
+        int count {0};
+        Magazine* next {nullptr};
+
+        bool isEmpty() const {
+            return count == 0;
+        }
+
+        bool isFull() const {
+            return count == Capacity;
+        }
+    };
+
+    /*
+    Physical memory above this isn't used
+    */
+    inline constexpr uint64_t MaxPhysicalMemory {4ul << 30};
+
+    /*
+    The order of a 2MB block in the buddy allocators
+    */
+    inline constexpr int LargePageOrder {9};
+
+    /*
+    There is one global manager that owns all of physical memory
+    with a buddy allocator, plus a depot of full and empty magazines.
+    Each core gets its own core manager, pointed to by
+    CoreMeta::physicalMemory, which allocates from and frees to its
+    own magazines without locking. Only when both of its magazines
+    are empty (or full) does it go to the global manager under the
+    global lock, trading a whole magazine with the depot, or
+    refilling straight from the buddy allocator if the depot has
+    nothing to trade.
+    */
     class PhysicalMemoryManager {
     public:
 
-        static void SetupGlobalManager(PhysicalAddress firstFreeAddress, uint64_t totalFreePages);
+        using PageAllocator = BuddyAllocator<MaxPhysicalMemory / PageSize>;
+        using Statistics = PageAllocator::Statistics;
+
+        /*
+        ranges are the usable pages the loader didn't use
+        */
+        static void SetupGlobalManager(const MemoryRange* ranges, uint64_t rangeCount);
         static PhysicalMemoryManager& GetGlobalManager();
 
+        /*
+        Returns a new manager for the calling core, which gets
+        its pages from the global manager
+        */
+        static PhysicalMemoryManager* CreateCoreManager();
+
         /*
         returns a physical address to a free page, and tracks stats.
-        we can't get the address of the next free page yet,
-        because its written in the page itself which needs to be first
-        page mapped before it can be read. so, each call to 
-        allocatePage() needs to be followed by finishAllocation()
+        Free pages aren't mapped, so they can't be cleared until the
+        caller maps them. each call to allocatePage() needs to be
+        followed by finishAllocation()
         */
         [[nodiscard]]
         PhysicalAddress allocatePage();
 
         /*
         here pageAddress is the virtual address mapped from the physical
-        address of the previous call to allocatePage. now we can read the
-        page and get the physical address of the next page
+        address of the previous call to allocatePage. The page is zeroed
         */
         void finishAllocation(VirtualAddress pageAddress);
         void freePage(VirtualAddress virtualAddress, PhysicalAddress physicalAddress);
@@ -61,6 +116,35 @@ namespace Memory {
         uint32_t getFreePages();
         uint32_t getTotalPages();
 
+        /*
+        Allocates 2^order physically contiguous pages, aligned to their
+        size, or returns an address of 0 if there isn't a free run that
+        big. Use LargePageOrder for 2MB pages. The pages aren't zeroed
+        */
+        [[nodiscard]]
+        static PhysicalAddress allocateContiguous(int order);
+        static void freeContiguous(PhysicalAddress address, int order);
+
+        /*
+        Statistics for the buddy allocator. Pages cached in
+        core managers' magazines count as allocated here
+        */
+        static Statistics getStatistics();
+
+        /*
+        Shared pages, such as copy on write pages, are reference counted.
+        A page starts with one owner. Each addReference adds another, and
+        freePage only gives the page back once the last owner frees it.
+        */
+        static void addReference(PhysicalAddress address);
+        static bool isShared(PhysicalAddress address);
+
+        /*
+        Drops one reference to a shared page. Returns false if the
+        caller was the only owner, in which case nothing changed
+        */
+        static bool dropReference(PhysicalAddress address);
+
         /*
         The first 640kb is reserved for the rare times where we're
         stuck in real mode, such as AP trampolines
@@ -78,16 +162,60 @@ namespace Memory {
 
     private:
 
-        uintptr_t nextFreeAddress {0};
+        /*
+        Depot operations, called with the global lock held. Both
+        give back the magazine they're passed and return a
+        replacement, or nullptr if the depot had none to trade
+        */
+        Magazine* exchangeEmptyForFull(Magazine* empty);
+        Magazine* exchangeFullForEmpty(Magazine* full);
+
         uint64_t totalPages {0};
+
+        /*
+        Includes pages cached in magazines, and is updated
+        atomically by every core
+        */
         uint64_t freePages {0};
 
-        bool waitingToFinish {false};
+        /*
+        Core managers only. previous is always completely
+        full or empty, loaded can be anything
+        */
+        Magazine* loaded {nullptr};
+        Magazine* previous {nullptr};
+
+        /*
+        Global manager only, protects the buddy allocator and the depot
+        */
+        uint32_t lock {0};
+        Magazine* fullMagazines {nullptr};
+        Magazine* emptyMagazines {nullptr};
 
         static PhysicalMemoryManager GlobalManager;
+        static PageAllocator Pages;
+
+        static constexpr int MaxCores {16};
+        static constexpr int MagazineCount {128};
+        static PhysicalMemoryManager CoreManagers[MaxCores];
+        static int CoreManagerCount;
+        static Magazine Magazines[MagazineCount];
 
         //640kb ought to be enough for anyone
         static uint64_t RealModeFreePages [20];
-        static uint64_t DMAFreePages [512];
+
+        /*
+        Covers 1MB - 17MB, though only up to 16MB is ever added
+        */
+        static BuddyAllocator<0x1000> DMAPages;
+        static uint32_t DMALock;
+
+        /*
+        The number of extra owners of each page, so 0 means only one.
+        The table is allocated the first time a page is shared
+        */
+        static uint16_t* References;
+        static uint32_t ReferencesLock;
+        static uint16_t* getReferenceCount(PhysicalAddress address);
     };
 }
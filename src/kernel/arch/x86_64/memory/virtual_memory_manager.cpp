@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "physical_memory_manager.h"
 #include "address_space.h"
 #include <cpu/metablocks.h>
+#include <string.h>
 
 namespace Memory {
 
@@ -64,7 +65,53 @@ namespace Memory {
 		PageDirectoryPointerStartAddress	
 		+ (510ul << 12);
 
-	PhysicalAddress reserveIndex(VirtualAddress linear, PagingIndex index, PhysicalMemoryManager* physicalMemory) {
+	constexpr uintptr_t Present = static_cast<uintptr_t>(PageTableFlags::Present);
+	constexpr uintptr_t LargePage = static_cast<uintptr_t>(PageTableFlags::LargePage);
+
+	//bits 21 - 51 of a large page directory entry
+	constexpr uintptr_t LargePageAddressMask = 0x000F'FFFF'FFE0'0000ul;
+
+	//bits 12 - 51 of a page table entry
+	constexpr uintptr_t PageAddressMask = 0x000F'FFFF'FFFF'F000ul;
+
+	void invalidatePage(uintptr_t address) {
+		asm volatile("invlpg (%0)" : : "r" (address) : "memory");
+	}
+
+	uintptr_t getPageTableAddress(uintptr_t linear) {
+		return PageTableStartAddress + ((linear >> 9) & 0x7FFFFFF000);
+	}
+
+	/*
+	Returns the page directory entry covering linear, or nullptr if
+	the directory pointer or directory it would be in doesn't exist
+	*/
+	volatile uintptr_t* getDirectoryEntry(uintptr_t linear) {
+		auto index = calculateIndex(linear);
+		auto& map = *reinterpret_cast<volatile PageMapLevel4*>(Level4StartAddress);
+
+		if (!(map.directoryPointers[index.level4] & Present)) {
+			return nullptr;
+		}
+
+		auto pointerAddress = PageDirectoryPointerStartAddress + ((linear >> 27) & 0x00001ff000);
+		auto& directoryPointer = *reinterpret_cast<volatile PageDirectoryPointer*>(pointerAddress);
+
+		if (!(directoryPointer.directoryTables[index.directoryPointer] & Present)) {
+			return nullptr;
+		}
+
+		auto directoryAddress = PageDirectoryStartAddress + ((linear >> 18) & 0x003ffff000);
+		auto& directory = *reinterpret_cast<volatile PageDirectoryTable*>(directoryAddress);
+
+		return &directory.pageTables[index.directory];
+	}
+
+	/*
+	Allocates the directory pointer and directory for linear if they
+	don't exist yet, and returns the directory
+	*/
+	volatile PageDirectoryTable& reserveDirectory(VirtualAddress linear, PagingIndex index, PhysicalMemoryManager* physicalMemory) {
 		auto& map = *reinterpret_cast<volatile PageMapLevel4*>(Level4StartAddress);
 		auto nextAddress = PageDirectoryPointerStartAddress + (((linear.address) >> 27) & 0x00001ff000);
 
@@ -83,8 +130,17 @@ namespace Memory {
 			physicalMemory->finishAllocation({nextAddress}); 
 		}
 
-		auto& directory = *reinterpret_cast<volatile PageDirectoryTable*>(nextAddress);
-		nextAddress = PageTableStartAddress + (((linear.address) >> 9) & 0x7ffffff000);
+		return *reinterpret_cast<volatile PageDirectoryTable*>(nextAddress);
+	}
+
+	PhysicalAddress reserveIndex(VirtualAddress linear, PagingIndex index, PhysicalMemoryManager* physicalMemory) {
+		auto& directory = reserveDirectory(linear, index, physicalMemory);
+		auto nextAddress = PageTableStartAddress + (((linear.address) >> 9) & 0x7ffffff000);
+
+		if (directory.pageTables[index.directory] & LargePage) {
+			auto largePage = directory.pageTables[index.directory] & LargePageAddressMask;
+			return {largePage + (linear.address & (LargePageSize - 1) & ~0xFFF)};
+		}
 
 		if (directory.pageTables[index.directory] == 0) {
 			auto physicalPage = physicalMemory->allocatePage();
@@ -106,19 +162,171 @@ namespace Memory {
         }
 	}
 
+	/*
+	Replaces a large page's directory entry with a page table
+	mapping the same 512 physical pages, with the same flags
+	*/
+	void splitLargePage(volatile uintptr_t* entry, VirtualAddress linear) {
+		auto& core = CPU::getCurrentCore();
+		auto largePage = *entry & LargePageAddressMask;
+		auto flags = *entry & 0xFFF & ~LargePage;
+		auto start = linear.address & ~(LargePageSize - 1);
+		auto tableAddress = getPageTableAddress(start);
+
+		/*
+		Until the table is filled in the whole 2MB is unmapped, which is
+		fine as long as the caller isn't using memory inside the large page
+		*/
+		auto physicalTable = core.physicalMemory->allocatePage();
+		*entry = physicalTable.address | (flags & 7) | 3;
+		invalidatePage(tableAddress);
+		invalidatePage(start);
+		core.physicalMemory->finishAllocation({tableAddress});
+
+		auto table = reinterpret_cast<volatile PageTable*>(tableAddress);
+
+		for (int i = 0; i < 512; i++) {
+			table->pages[i] = (largePage + i * PageSize) | flags;
+		}
+	}
+
+	VirtualMemoryManager::VirtualMemoryManager() {
+		uintptr_t cr3;
+		asm volatile("mov %%cr3, %0" : "=r" (cr3));
+		pageMap = {cr3 & PageAddressMask};
+	}
+
+	VirtualMemoryManager::VirtualMemoryManager(PhysicalAddress pageMap)
+		: pageMap {pageMap}, pcid {getPCIDPool().allocate()} {
+	}
+
+	VirtualMemoryManager::~VirtualMemoryManager() {
+		getPCIDPool().free(pcid);
+	}
+
+	void VirtualMemoryManager::activate() {
+		loadPageMap(pageMap, pcid);
+	}
+
 	void VirtualMemoryManager::map(VirtualAddress linear, PhysicalAddress physical, uint32_t flags) {
 
+		if (auto entry = getDirectoryEntry(linear.address); entry != nullptr && (*entry & LargePage)) {
+			splitLargePage(entry, linear);
+		}
+
 		auto index = (linear.address >> 12) & 511;
 		auto tableAddress = PageTableStartAddress + ((linear.address >> 9) & 0x7FFFFFF000);
 		auto table = reinterpret_cast<volatile PageTable*>(tableAddress);
 		table->pages[index] = physical.address | 3;
+		invalidatePage(linear.address);
+	}
+
+	bool VirtualMemoryManager::mapLarge(VirtualAddress linear, PhysicalAddress physical, uint32_t flags) {
+		auto entry = getDirectoryEntry(linear.address);
+
+		if (entry == nullptr || *entry != 0) {
+			return false;
+		}
+
+		*entry = (physical.address & LargePageAddressMask) | flags | LargePage | 3;
+		return true;
 	}
 
 	void VirtualMemoryManager::unmap(VirtualAddress linear) {
+		auto entry = getDirectoryEntry(linear.address);
+
+		if (entry != nullptr && (*entry & LargePage)) {
+			splitLargePage(entry, linear);
+		}
+
 		auto index = (linear.address >> 12) & 511;
-		uintptr_t tableAddress = PageTableStartAddress + (linear.address >> 9) & 0x7FFFFFF000;
-		auto table = reinterpret_cast<volatile PageTable*>(tableAddress);
+		auto table = reinterpret_cast<volatile PageTable*>(getPageTableAddress(linear.address));
 		table->pages[index] = 0;
+		invalidatePage(linear.address);
+	}
+
+	void VirtualMemoryManager::unmapLarge(VirtualAddress linear) {
+		auto entry = getDirectoryEntry(linear.address);
+
+		if (entry == nullptr || !(*entry & LargePage)) {
+			return;
+		}
+
+		*entry = 0;
+		invalidatePage(linear.address);
+	}
+
+	bool VirtualMemoryManager::allocateLargePage(VirtualAddress linear, PhysicalMemoryManager* physicalMemory) {
+
+		if (linear.address & (LargePageSize - 1)) {
+			return false;
+		}
+
+		auto index = calculateIndex(linear.address);
+		auto& directory = reserveDirectory(linear, index, physicalMemory);
+
+		if (directory.pageTables[index.directory] != 0) {
+			return false;
+		}
+
+		auto physical = PhysicalMemoryManager::allocateContiguous(LargePageOrder);
+
+		if (physical.address == 0) {
+			return false;
+		}
+
+		directory.pageTables[index.directory] = physical.address | LargePage | 3;
+		memset(reinterpret_cast<void*>(linear.address), 0, LargePageSize);
+
+		return true;
+	}
+
+	bool VirtualMemoryManager::isLargePage(VirtualAddress linear) {
+		auto entry = getDirectoryEntry(linear.address);
+		return entry != nullptr && (*entry & LargePage);
+	}
+
+	void VirtualMemoryManager::releasePages(VirtualAddress start, uint64_t count, PhysicalMemoryManager* physicalMemory) {
+		auto end = start.address + count * PageSize;
+		auto address = start.address & ~0xFFFul;
+
+		while (address < end) {
+			auto entry = getDirectoryEntry(address);
+			auto nextChunk = (address & ~(LargePageSize - 1)) + LargePageSize;
+
+			if (entry == nullptr || !(*entry & Present)) {
+				//nothing in this 2MB was ever touched
+				address = nextChunk;
+				continue;
+			}
+
+			if (*entry & LargePage) {
+				auto isWhole = (address & (LargePageSize - 1)) == 0 && nextChunk <= end;
+
+				if (isWhole) {
+					auto physical = PhysicalAddress {*entry & LargePageAddressMask};
+					*entry = 0;
+					invalidatePage(address);
+					PhysicalMemoryManager::freeContiguous(physical, LargePageOrder);
+					address = nextChunk;
+					continue;
+				}
+
+				splitLargePage(entry, {address});
+			}
+
+			auto index = (address >> 12) & 511;
+			auto table = reinterpret_cast<volatile PageTable*>(getPageTableAddress(address));
+			auto page = table->pages[index];
+
+			if (page & Present) {
+				table->pages[index] = 0;
+				invalidatePage(address);
+				physicalMemory->freePage({address}, {page & PageAddressMask});
+			}
+
+			address += PageSize;
+		}
 	}
 
 	PhysicalAddress VirtualMemoryManager::allocatePagingTablesFor(VirtualAddress linear, 
@@ -127,6 +335,119 @@ namespace Memory {
 		return reserveIndex(linear, index, physicalMemoryManager);	
 	}
 
+	/*
+	While cloning, the clone's level 4 map is put in this slot of the
+	current one, and in the same slot of itself, so that the clone's
+	tables can be reached the same way recursive slot 510 reaches ours
+	*/
+	constexpr uintptr_t ForeignSlot {508};
+	constexpr uintptr_t RecursiveSlot {510};
+
+	constexpr uintptr_t AllowWrite = static_cast<uintptr_t>(PageTableFlags::AllowWrite);
+	constexpr uintptr_t CopyOnWrite = static_cast<uintptr_t>(PageTableFlags::CopyOnWrite);
+	constexpr uintptr_t AllowUserModeAccess = static_cast<uintptr_t>(PageTableFlags::AllowUserModeAccess);
+
+	volatile uintptr_t* getTable(uintptr_t level4, uintptr_t pointer, uintptr_t directory, uintptr_t table) {
+		return reinterpret_cast<volatile uintptr_t*>(SignExtension 
+			| (level4 << 39)
+			| (pointer << 30)
+			| (directory << 21)
+			| (table << 12));
+	}
+
+	void reloadPageTables() {
+		uintptr_t level4;
+		asm volatile("mov %%cr3, %0" : "=r" (level4));
+		asm volatile("mov %0, %%cr3" : : "r" (level4) : "memory");
+	}
+
+	/*
+	Returns the table entry points to, allocating a zeroed one
+	if it doesn't exist. address is where the table is mapped
+	*/
+	volatile uintptr_t* getOrCreateTable(volatile uintptr_t& entry, volatile uintptr_t* address, 
+			PhysicalMemoryManager* physicalMemory) {
+
+		if (!(entry & Present)) {
+			auto physicalPage = physicalMemory->allocatePage();
+			entry = physicalPage.address | 3;
+			invalidatePage(reinterpret_cast<uintptr_t>(address));
+			physicalMemory->finishAllocation({reinterpret_cast<uintptr_t>(address)});
+		}
+
+		return address;
+	}
+
+	/*
+	Walks the lower half of the current address space and shares
+	every page with the clone in ForeignSlot. Only user pages are
+	copied on write. The kernel's own ranges down here, like the
+	Default address space behind every BlockAllocator and the
+	kernel stacks, have to stay the same writable pages in both
+	*/
+	void shareLowerHalf(PhysicalMemoryManager* physicalMemory) {
+		auto map = getTable(RecursiveSlot, RecursiveSlot, RecursiveSlot, RecursiveSlot);
+		auto cloneMap = getTable(ForeignSlot, ForeignSlot, ForeignSlot, ForeignSlot);
+
+		for (auto i = 0u; i < 256; i++) {
+
+			if (!(map[i] & Present)) {
+				continue;
+			}
+
+			auto pointer = getTable(RecursiveSlot, RecursiveSlot, RecursiveSlot, i);
+			auto clonePointer = getOrCreateTable(cloneMap[i], 
+				getTable(ForeignSlot, ForeignSlot, ForeignSlot, i), physicalMemory);
+
+			for (auto j = 0u; j < 512; j++) {
+
+				if (!(pointer[j] & Present)) {
+					continue;
+				}
+
+				auto directory = getTable(RecursiveSlot, RecursiveSlot, i, j);
+				auto cloneDirectory = getOrCreateTable(clonePointer[j], 
+					getTable(ForeignSlot, ForeignSlot, i, j), physicalMemory);
+
+				for (auto k = 0u; k < 512; k++) {
+
+					if (!(directory[k] & Present) || (i == 0 && j == 0 && k == 0)) {
+						//the first 2MB is identity mapped by clone itself
+						continue;
+					}
+
+					if (directory[k] & LargePage) {
+						//copy on write is tracked per 4KB page
+						auto address = (static_cast<uintptr_t>(i) << 39) 
+							| (static_cast<uintptr_t>(j) << 30) 
+							| (static_cast<uintptr_t>(k) << 21);
+						splitLargePage(&directory[k], {address});
+					}
+
+					auto table = getTable(RecursiveSlot, i, j, k);
+					auto cloneTable = getOrCreateTable(cloneDirectory[k], 
+						getTable(ForeignSlot, i, j, k), physicalMemory);
+
+					for (auto l = 0u; l < 512; l++) {
+						auto page = table[l];
+
+						if (!(page & Present)) {
+							continue;
+						}
+
+						if ((page & AllowWrite) && (page & AllowUserModeAccess)) {
+							page = (page & ~AllowWrite) | CopyOnWrite;
+							table[l] = page;
+						}
+
+						cloneTable[l] = page;
+						PhysicalMemoryManager::addReference({page & PageAddressMask});
+					}
+				}
+			}
+		}
+	}
+
 	std::optional<PhysicalAddress> VirtualMemoryManager::clone() {
 		/*
 		Clones need the first page table (first 2MB that's identity mapped),
@@ -134,7 +455,7 @@ namespace Memory {
 		*/
 		auto& core = CPU::getCurrentCore();
 		//TODO: this should be a kernel address space
-		auto maybeReservation = core.addressSpace->reserve(PageSize * 4);
+		auto maybeReservation = core.addressSpaces[static_cast<int>(AddressSpace::Domain::Default)]->reserve(PageSize * 4);
 
 		if (!maybeReservation.has_value()) {
 			return {};
@@ -149,10 +470,11 @@ namespace Memory {
 
 		auto allocation = maybeAllocation.value();
 
-        auto pml4PhysicalAddress = allocatePagingTablesFor(allocation, core.physicalMemory);
-        allocatePagingTablesFor({allocation.address + PageSize * 1}, core.physicalMemory);
-        allocatePagingTablesFor({allocation.address + PageSize * 2}, core.physicalMemory);
-        allocatePagingTablesFor({allocation.address + PageSize * 3}, core.physicalMemory);
+		PhysicalAddress physicalPages[4];
+
+		for (int i = 0; i < 4; i++) {
+			physicalPages[i] = allocatePagingTablesFor({allocation.address + PageSize * i}, core.physicalMemory);
+		}
 
 		auto pageMapLevel4 = reinterpret_cast<uintptr_t*>(allocation.address);
 		auto pageDirectoryPointer = reinterpret_cast<uintptr_t*>(allocation.address + PageSize);
@@ -162,11 +484,12 @@ namespace Memory {
 
 		auto flags = 3;
 
-		*(pageMapLevel4 + 0) = reinterpret_cast<uintptr_t>(pageDirectoryPointer) | flags;
-		*(pageMapLevel4 + 510) = reinterpret_cast<uintptr_t>(pageMapLevel4) | flags;
+		*(pageMapLevel4 + 0) = physicalPages[1].address | flags;
+		*(pageMapLevel4 + 510) = physicalPages[0].address | flags;
 		*(pageMapLevel4 + 511) = currentMap.directoryPointers[511];
-		*pageDirectoryPointer = reinterpret_cast<uintptr_t>(pageDirectory) | flags;
-		*pageDirectory = reinterpret_cast<uint64_t>(pageTable) | flags;
+		*(pageMapLevel4 + ForeignSlot) = physicalPages[0].address | flags;
+		*pageDirectoryPointer = physicalPages[2].address | flags;
+		*pageDirectory = physicalPages[3].address | flags;
 
 		/*
 		Identity-map the first 2 megabytes
@@ -177,10 +500,97 @@ namespace Memory {
 			*pageTable++ = page;
 		}
 
-		return pml4PhysicalAddress;
+		/*
+		These were only mapped here to fill them in, and
+		mustn't end up shared with the clone
+		*/
+		for (int i = 0; i < 4; i++) {
+			unmap({allocation.address + PageSize * i});
+		}
+
+		currentMap.directoryPointers[ForeignSlot] = physicalPages[0].address | flags;
+		reloadPageTables();
+
+		shareLowerHalf(core.physicalMemory);
+
+		getTable(ForeignSlot, ForeignSlot, ForeignSlot, ForeignSlot)[ForeignSlot] = 0;
+		currentMap.directoryPointers[ForeignSlot] = 0;
+
+		//also flushes the pages that just became copy on write
+		reloadPageTables();
+
+		return physicalPages[0];
+	}
+
+	bool VirtualMemoryManager::handleCopyOnWrite(VirtualAddress linear, PhysicalMemoryManager* physicalMemory) {
+		auto entry = getDirectoryEntry(linear.address);
+
+		if (entry == nullptr || !(*entry & Present) || (*entry & LargePage)) {
+			return false;
+		}
+
+		auto index = (linear.address >> 12) & 511;
+		auto table = reinterpret_cast<volatile PageTable*>(getPageTableAddress(linear.address));
+		auto page = table->pages[index];
+
+		if (!(page & Present) || !(page & CopyOnWrite)) {
+			return false;
+		}
+
+		auto flags = (page & ~PageAddressMask & ~CopyOnWrite) | AllowWrite;
+		auto original = PhysicalAddress {page & PageAddressMask};
+		auto pageAddress = linear.address & ~0xFFFul;
+
+		if (!PhysicalMemoryManager::isShared(original)) {
+			//everyone else already made their own copy
+			table->pages[index] = original.address | flags;
+			invalidatePage(pageAddress);
+			return true;
+		}
+
+		if (copyWindow.address == 0) {
+			auto& core = CPU::getCurrentCore();
+			auto space = core.addressSpaces[static_cast<int>(AddressSpace::Domain::Default)];
+			auto reservation = space->reserve(PageSize);
+
+			if (!reservation.has_value()) {
+				return false;
+			}
+
+			copyWindow = reservation->allocatePages(1).value();
+
+			//only the paging tables are wanted, not the page
+			auto unused = allocatePagingTablesFor(copyWindow, physicalMemory);
+			unmap(copyWindow);
+			physicalMemory->freePage(copyWindow, unused);
+		}
+
+		/*
+		The copy overwrites the whole page, so there's
+		no need for finishAllocation to zero it first
+		*/
+		auto copy = physicalMemory->allocatePage();
+		map(copyWindow, copy);
+		memcpy(reinterpret_cast<void*>(copyWindow.address), reinterpret_cast<void*>(pageAddress), PageSize);
+		unmap(copyWindow);
+
+		table->pages[index] = copy.address | flags;
+		invalidatePage(pageAddress);
+
+		if (!PhysicalMemoryManager::dropReference(original)) {
+			//the other owners let go of it while we were copying
+			physicalMemory->freePage({pageAddress}, original);
+		}
+
+		return true;
 	}
 
 	PageStatus VirtualMemoryManager::getPageStatus(VirtualAddress linear) {
+
+		if (isLargePage(linear)) {
+			return PageStatus::Mapped;
+		}
+
 		auto index = (linear.address >> 12) & 511;
 		auto tableAddress = PageTableStartAddress + ((linear.address >> 9) & 0x7FFFFFF000);
 		auto table = reinterpret_cast<PageTable*>(tableAddress);
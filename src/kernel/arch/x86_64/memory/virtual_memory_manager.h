@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 #include <optional>
 #include "addresses.h"
+#include "pcid.h"
 
 namespace Kernel {
     struct Task;
@@ -64,9 +65,19 @@ namespace Memory {
         WriteThrough = 1 << 3,
         CacheDisable = 1 << 4,
         Accessed = 1 << 5,
-        Dirty = 1 << 6
+        Dirty = 1 << 6,
+        LargePage = 1 << 7,
+
+        //available to the OS, marks a read only page that's copied on a write
+        CopyOnWrite = 1 << 9
     };
 
+    /*
+    A page directory entry with LargePage set maps 2MB
+    directly instead of pointing to a page table
+    */
+    inline constexpr uint64_t LargePageSize {0x200000};
+
     enum class PageStatus {
         Allocated,
         Mapped,
@@ -79,20 +90,77 @@ namespace Memory {
 
         static VirtualMemoryManager CreateFromLoader();
 
-        VirtualMemoryManager() = default;
+        /*
+        Manages the page map that's currently loaded, which is
+        the kernel's own so it keeps KernelPCID
+        */
+        VirtualMemoryManager();
+
+        /*
+        Manages a page map made by clone, tagged with a PCID
+        of its own from the pool
+        */
+        explicit VirtualMemoryManager(PhysicalAddress pageMap);
+
         VirtualMemoryManager(VirtualMemoryManager const&) = delete;
 
+        //gives the PCID back to the pool, the page map itself isn't freed
+        ~VirtualMemoryManager();
+
+        /*
+        Loads this page map on the current core. The TLB entries
+        tagged with its PCID survive unless the PCID went stale
+        */
+        void activate();
+
+        uint16_t getPCID() const {
+            return pcid;
+        }
+
         /*
         Maps virtualAddress to physicalAddress so that any reads/writes
-        to virtualAddress actually happen in RAM at physicalAddress
+        to virtualAddress actually happen in RAM at physicalAddress.
+        If virtualAddress is part of a large page, it's split first
         */
         void map(VirtualAddress virtualAddress, PhysicalAddress physicalAddress, uint32_t flags = 0);
 
+        /*
+        Maps a 2MB aligned virtualAddress to a 2MB aligned physicalAddress
+        with a single page directory entry. The directory pointer and
+        directory must already exist. Returns false if something is
+        already mapped there
+        */
+        bool mapLarge(VirtualAddress virtualAddress, PhysicalAddress physicalAddress, uint32_t flags = 0);
+
         /*
         Removes the mapping. This does not free the physical page.
+        If virtualAddress is part of a large page, the large page
+        is split into 4KB pages first and only this one is removed
         */
         void unmap(VirtualAddress virtualAddress);
 
+        /*
+        Removes a whole large page mapping without splitting it.
+        This does not free the physical pages
+        */
+        void unmapLarge(VirtualAddress virtualAddress);
+
+        /*
+        Backs a 2MB aligned virtualAddress with a new zeroed large page.
+        Returns false if there's no free 2MB physical run or part of the
+        range is already mapped, in which case it's left to be demand
+        paged 4KB at a time
+        */
+        bool allocateLargePage(VirtualAddress virtualAddress, PhysicalMemoryManager* pmm);
+
+        bool isLargePage(VirtualAddress virtualAddress);
+
+        /*
+        Unmaps and frees every page that's mapped in the range.
+        Large pages only partly in the range are split first
+        */
+        void releasePages(VirtualAddress start, uint64_t count, PhysicalMemoryManager* pmm);
+
         /*
         Ensures that all of the appropriate paging structures are
         setup for this virtual address. Returns the physical address
@@ -102,12 +170,30 @@ namespace Memory {
 
         /*
         Copies the initial 2MB identity map and the kernel PDP
-        and sets up a new paging hierarchy.
+        and sets up a new paging hierarchy. Every other lower half
+        mapping is shared with the clone. Writable user pages become
+        copy on write in both, kernel and read only pages are just
+        shared.
 
         Returns the physical address of the level 4 page map.
         */
         std::optional<PhysicalAddress> clone();
 
+        /*
+        Called for a write to a present, read only page. If it's a copy
+        on write page it gets its own copy (or just made writable, if
+        nobody else has it anymore) and this returns true
+        */
+        bool handleCopyOnWrite(VirtualAddress virtualAddress, PhysicalMemoryManager* pmm);
+
         PageStatus getPageStatus(VirtualAddress virtualAddress);
+
+    private:
+
+        //where a page being copied on write gets mapped for the copy
+        VirtualAddress copyWindow {0};
+
+        PhysicalAddress pageMap {0};
+        uint16_t pcid {KernelPCID};
     };
 }
\ No newline at end of file
@@ -29,17 +29,45 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <optional>
 
-template<class T, class Allocator>
+/*
+The default for AVLTree's Augment, which keeps nothing
+*/
+struct NoAugment {
+	using Summary = bool;
+
+	template<class T>
+	static Summary summarize(const T&) {
+		return false;
+	}
+
+	static Summary combine(Summary, Summary) {
+		return false;
+	}
+};
+
+/*
+A self balancing binary search tree. Items are ordered with < and found with ==.
+
+Augment lets each node keep a Summary of its whole subtree, built from
+Augment::summarize of each item with Augment::combine, which is kept up
+to date as the tree changes shape. findFirst uses it to skip subtrees
+that can't contain what it's looking for.
+*/
+template<class T, class Allocator, class Augment = NoAugment>
 class AVLTree {
 
+	using Summary = typename Augment::Summary;
+
 	struct Node {
-		Node(T value) : value {value} {}
+		Node(T value) : value {value} {
+			summary = Augment::summarize(value);
+		}
 
 		T value;
-		Node* parent {nullptr};
 		Node* leftChild {nullptr};
 		Node* rightChild {nullptr};
 		int height {0};
+		Summary summary;
 	};
 
 public:
@@ -47,46 +75,11 @@ public:
 	AVLTree(Allocator allocator) 
 		: allocator {allocator} {}
 
-    void insert(T item) {
+	void insert(T item) {
 		auto node = allocator.template allocate<Node>(item);
 		nodeCount++;
-
-		if (root == nullptr) {
-			root = node;
-		}
-		else {
-			auto iterator = root;
-
-			while (iterator != nullptr) {
-
-				if (iterator->value >= item) {
-
-					if (iterator->leftChild != nullptr) {
-						iterator = iterator->leftChild;
-					}
-					else {
-						iterator->leftChild = node;
-						break;
-					}
-				}
-				else {
-
-					if (iterator->rightChild != nullptr) {
-						iterator = iterator->rightChild;
-					}
-					else {
-						iterator->rightChild = node;
-						break;
-					}
-				}
-			}
-
-			node->parent = iterator;
-			iterator->height = height(iterator->leftChild, iterator->rightChild);
-			recalculateHeights(iterator->parent);
-			rebalance(iterator);
-		}
-    }
+		root = insert(root, node);
+	}
 
 	int getNumberOfNodes() const {
 		return nodeCount;
@@ -117,27 +110,20 @@ public:
 		traverse(root, f);
 	}
 
+	/*
+	Returns the smallest item that's >= item
+	*/
 	std::optional<T> findAtLeast(T item) {
 		auto iterator = root;
 		Node* successor = nullptr;
 
 		while (iterator != nullptr) {
-			if (item >= iterator->value) {
-				if (item == iterator->value) {
-					successor = iterator;
-				}
-
+			if (iterator->value < item) {
 				iterator = iterator->rightChild;
 			}
 			else {
 				successor = iterator;
-
-				if (iterator->leftChild != nullptr) {
-					iterator = iterator->leftChild;
-				}
-				else {
-					break;
-				}
+				iterator = iterator->leftChild;
 			}
 		}
 
@@ -149,105 +135,142 @@ public:
 		}
 	}
 
-	template<class Func>
-	std::optional<T> findByTraversal(Func&& f) {
-		if (root == nullptr) {
-			return {};
-		}
-
-		return traversalSearch(root, f);
-	}
-
-	void remove(T item) {
+	/*
+	Returns the largest item that's <= item
+	*/
+	std::optional<T> findAtMost(T item) {
 		auto iterator = root;
+		Node* predecessor = nullptr;
 
 		while (iterator != nullptr) {
-			if (item == iterator->value) {
-				break;
-			}
-			else if (item > iterator->value) {
-				iterator = iterator->rightChild;
+			if (item < iterator->value) {
+				iterator = iterator->leftChild;
 			}
 			else {
-				iterator = iterator->leftChild;
+				predecessor = iterator;
+				iterator = iterator->rightChild;
 			}
 		}
 
-		if (iterator == nullptr) {
-			//the item doesn't exist in this tree
-			return;
+		if (predecessor != nullptr) {
+			return {predecessor->value};
+		}
+		else {
+			return {};
 		}
+	}
 
-		nodeCount--;
+	/*
+	Returns the first item in order whose own summary passes fits.
+	fits must also pass for any summary combined with one that
+	passes, so that a failing subtree summary means nothing in
+	that subtree can pass either. O(log n)
+	*/
+	template<class Fits>
+	std::optional<T> findFirst(Fits&& fits) {
+		auto node = root;
+
+		while (node != nullptr) {
+			if (node->leftChild != nullptr && fits(node->leftChild->summary)) {
+				node = node->leftChild;
+			}
+			else if (fits(Augment::summarize(node->value))) {
+				return node->value;
+			}
+			else if (node->rightChild != nullptr && fits(node->rightChild->summary)) {
+				node = node->rightChild;
+			}
+			else {
+				break;
+			}
+		}
 
-		bool isRoot = iterator == root;
+		return {};
+	}
 
-		if (iterator->leftChild == nullptr
-				&& iterator->rightChild == nullptr) {
+	/*
+	Returns the first item in order that passes f. This is O(n),
+	prefer findFirst when a summary can answer the question
+	*/
+	template<class Func>
+	std::optional<T> findByTraversal(Func&& f) {
+		if (root == nullptr) {
+			return {};
+		}
 
-			auto parent = iterator->parent;
+		return traversalSearch(root, f);
+	}
 
-			if (parent != nullptr) {
-				if (parent->leftChild == iterator) {
-					parent->leftChild = nullptr;
-				}
-				else {
-					parent->rightChild = nullptr;
-				}
-			}
+	void remove(T item) {
+		bool removed {false};
+		root = remove(root, item, removed);
 
-			allocator.template free<Node>(iterator);
+		if (removed) {
+			nodeCount--;
 		}
-		else if (iterator->leftChild == nullptr) {
-			iterator->value = iterator->rightChild->value;
-			allocator.template free<Node>(iterator->rightChild);
-			iterator->rightChild = nullptr;
+	}
+
+private:
+
+	Node* insert(Node* node, Node* newNode) {
+		if (node == nullptr) {
+			return newNode;
 		}
-		else if (iterator->rightChild == nullptr) {
-			iterator->value = iterator->leftChild->value;
-			allocator.template free<Node>(iterator->leftChild);
-			iterator->leftChild = nullptr;
+
+		if (newNode->value < node->value) {
+			node->leftChild = insert(node->leftChild, newNode);
 		}
 		else {
-			auto successor = findSuccessor(iterator->rightChild);
-
-			if (successor != nullptr) {
-				auto parent = successor->parent;
+			node->rightChild = insert(node->rightChild, newNode);
+		}
 
-				if (parent->leftChild == successor) {
-					parent->leftChild = nullptr;
-				}
-				else {
-					parent->rightChild = nullptr;
-				}
+		return rebalance(node);
+	}
 
-				iterator->value = successor->value;
-				allocator.template free<Node>(successor);
-				rebalance(parent);
-			}
+	Node* remove(Node* node, const T& item, bool& removed) {
+		if (node == nullptr) {
+			//the item doesn't exist in this tree
+			return nullptr;
 		}
 
-		if (isRoot) {
-			root = nullptr;
-		}
+		if (item == node->value) {
+			removed = true;
 
-	}	
+			if (node->leftChild == nullptr || node->rightChild == nullptr) {
+				auto child = node->leftChild != nullptr ? node->leftChild : node->rightChild;
+				allocator.template free<Node>(node);
+				return child;
+			}
 
-private:
+			/*
+			Two children, so the node takes its successor's place
+			*/
+			Node* successor {nullptr};
+			node->rightChild = removeSmallest(node->rightChild, successor);
+			successor->leftChild = node->leftChild;
+			successor->rightChild = node->rightChild;
+			allocator.template free<Node>(node);
 
-	Node* findSuccessor(Node* start) {
-		auto iterator = start;
+			return rebalance(successor);
+		}
+		else if (item < node->value) {
+			node->leftChild = remove(node->leftChild, item, removed);
+		}
+		else {
+			node->rightChild = remove(node->rightChild, item, removed);
+		}
 
-		while (iterator != nullptr) {
-			if (iterator->leftChild == nullptr) {
-				return iterator;
-			}
-			else {
-				iterator = iterator->leftChild;
-			}
+		return rebalance(node);
+	}
+
+	Node* removeSmallest(Node* node, Node*& smallest) {
+		if (node->leftChild == nullptr) {
+			smallest = node;
+			return node->rightChild;
 		}
 
-		return nullptr;
+		node->leftChild = removeSmallest(node->leftChild, smallest);
+		return rebalance(node);
 	}
 
 	template<class F>
@@ -267,11 +290,8 @@ private:
 	std::optional<T> traversalSearch(Node* node, F&& f) {
 
 		if (node->leftChild != nullptr) {
-			if (f(node->leftChild->value)) {
-				return node->leftChild->value;
-			}
-			else {
-				traversalSearch(node->leftChild, f);
+			if (auto result = traversalSearch(node->leftChild, f)) {
+				return result;
 			}
 		}
 
@@ -280,126 +300,91 @@ private:
 		}
 
 		if (node->rightChild != nullptr) {
-			if (f(node->rightChild->value)) {
-				return node->rightChild->value;
-			}
-			else {
-				traversalSearch(node->rightChild, f);
-			}
+			return traversalSearch(node->rightChild, f);
 		}
 
 		return {};
 	}
 
-	int height(Node* left, Node* right) {
-		auto leftHeight = (left != nullptr ? left->height : -1);
-		auto rightHeight = (right != nullptr ? right->height : -1);
-
-		return 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
-	}
-
 	int height(Node* node) {
 		if (node != nullptr) {
-			return height(node->leftChild, node->rightChild);
+			return node->height;
 		}
 		else {
 			return -1;
 		}
 	}
 
-	void leftRotate(Node* node) {
-		auto right = node->rightChild;
-		node->rightChild = right->leftChild;
-		
-		if (node->parent->leftChild == node) {
-			node->parent->leftChild = right;
-		}
-		else {
-			node->parent->rightChild = right;
-		}
+	/*
+	Recalculates node's height and summary from its children
+	*/
+	void update(Node* node) {
+		auto leftHeight = height(node->leftChild);
+		auto rightHeight = height(node->rightChild);
+		node->height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
 
-		right->parent = node->parent;
-		node->parent = right;
+		node->summary = Augment::summarize(node->value);
 
-		node->height = height(node->leftChild, node->rightChild);
-		right->height = height(right->leftChild, right->rightChild);
+		if (node->leftChild != nullptr) {
+			node->summary = Augment::combine(node->summary, node->leftChild->summary);
+		}
 
-		recalculateHeights(right->parent);
+		if (node->rightChild != nullptr) {
+			node->summary = Augment::combine(node->summary, node->rightChild->summary);
+		}
 	}
 
-	void recalculateHeights(Node* node) {
-
-		if (node == nullptr) {
-			return;
-		}
+	Node* leftRotate(Node* node) {
+		auto right = node->rightChild;
+		node->rightChild = right->leftChild;
+		right->leftChild = node;
 
-		node->height = height(node->leftChild, node->rightChild);
+		update(node);
+		update(right);
 
-		if (node->parent != nullptr) {
-			recalculateHeights(node->parent);
-		}
+		return right;
 	}
 
-	void rightRotate(Node* node) {
+	Node* rightRotate(Node* node) {
 		auto left = node->leftChild;
 		node->leftChild = left->rightChild;
+		left->rightChild = node;
 
-		if (node->parent->leftChild == node) {
-			node->parent->leftChild = left;
-		}
-		else {
-			node->parent->rightChild = left;
-		}
-
-		left->parent = node->parent;
-		node->parent = left;
+		update(node);
+		update(left);
 
-		node->height = height(node->leftChild, node->rightChild);
-		left->height = height(left->leftChild, left->rightChild);
-
-		recalculateHeights(left->parent);
+		return left;
 	}
 
-	void rebalance(Node* start) {
-		auto difference = height(start->leftChild) - height(start->rightChild);
-		bool rightHeavy = difference <= 0;
+	/*
+	Updates node, rotates it if its children's heights differ
+	by more than one, and returns the subtree's new root
+	*/
+	Node* rebalance(Node* node) {
+		update(node);
 
-		if (difference <= 0) {
-			difference = -difference;
-		}
-		
-		if (difference <= 1) {
-			return;
-		}
+		auto difference = height(node->leftChild) - height(node->rightChild);
 
-		if (rightHeavy) {
-			difference = height(start->rightChild->leftChild) - height(start->rightChild->rightChild);
-			bool rightRightHeavy = difference <= 0;
+		if (difference > 1) {
+			auto left = node->leftChild;
 
-			if (rightRightHeavy) {
-				rightRotate(start);
-			}
-			else {
-				rightRotate(start->rightChild);
-				leftRotate(start);
+			if (height(left->leftChild) < height(left->rightChild)) {
+				node->leftChild = leftRotate(left);
 			}
+
+			return rightRotate(node);
 		}
-		else {
-			difference = height(start->leftChild->leftChild) - height(start->leftChild->rightChild);
-			bool leftRightHeavy = difference <= 0;
+		else if (difference < -1) {
+			auto right = node->rightChild;
 
-			if (leftRightHeavy) {
-				leftRotate(start->leftChild);
-				rightRotate(start);
+			if (height(right->rightChild) < height(right->leftChild)) {
+				node->rightChild = rightRotate(right);
 			}
-			else {
-				leftRotate(start);
-			}
-		}
 
-		if (start->parent != nullptr) {
-			rebalance(start->parent);
+			return leftRotate(node);
 		}
+
+		return node;
 	}
 
 	Node* root {nullptr};
@@ -29,10 +29,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdint.h>
 
+/*
+A run of usable physical pages. Everything here is 64 bit
+so the layout is the same for the 32 bit loader
+*/
+struct MemoryRange {
+    uint64_t start;
+    uint64_t pages;
+};
+
+const int MaxMemoryRanges {16};
+
 struct KernelConfig {
     uint64_t nextFreeAddress;
     uint64_t totalFreePages;
     uint64_t rsdpAddress;
     uint64_t acpiLocation;
     uint64_t acpiLength;
+    uint64_t memoryRangeCount;
+    MemoryRange memoryRanges[MaxMemoryRanges];
 };
\ No newline at end of file
@@ -67,57 +67,49 @@ namespace Kernel {
         scheduler->scheduleTask(task);
     }
 
-    void Director::blockTask(Task* task, BlockReason reason) {
-        task->state = TaskState::Blocked;
-
-        SpinLock lock {blockedTasks.getLock()};
-        blockedTasks.append(task);
-    }
-
-    void Director::sleepTask(Task* task, int time) {
-        SpinLock lock {sleepingTasks.getLock()};
-        auto blocked = sleepingTasks.getHead();
-
-        while (blocked != nullptr) {
-            if (blocked->wakeTime > task->wakeTime) {
+    void Director::unblockTask(Task* task) {
 
-                sleepingTasks.insertBefore(task, blocked);
-                break;
+        /*
+        The task may have been claimed from its mailbox before it
+        finished switching out. In that case it has to stay on the
+        core that still holds its context
+        */
+        if (CPU::ActiveCPUs != nullptr) {
+            auto scheduler = CPU::ActiveCPUs[task->cpuId].scheduler;
+
+            if (scheduler != nullptr && scheduler->isUsingContext(task)) {
+                scheduler->scheduleTask(task);
+                return;
             }
-            else if (blocked->nextTask == nullptr) {
-                
-                sleepingTasks.insertAfter(task, blocked);
-                break;
-            }
-
-            blocked = blocked->nextTask;
         }
+
+        scheduleTask(task);
     }
 
-    void Director::unblockTask(Task* task) {
-        task->state = TaskState::ReadyToRun;
+    Task* Director::stealTask(Scheduler* thief) {
 
-        SpinLock lock {blockedTasks.getLock()};
-        blockedTasks.remove(task);
+        Scheduler* victim {nullptr};
+        int mostQueued {0};
 
-        scheduleTask(task);
-    }
+        for (int i = 0; i < CPU::CPUCount; i++) {
+            auto scheduler = CPU::ActiveCPUs[i].scheduler;
 
-    void Director::unblockWakeableTasks() {
-        SpinLock lock {blockedTasks.getLock()};
-        auto blocked = blockedTasks.getHead(); 
+            if (scheduler == nullptr || scheduler == thief) {
+                continue;
+            }
 
-        while (blocked != nullptr) {
-            auto next = blocked->nextTask;
+            auto queued = scheduler->getQueuedTaskCount();
 
-            if (blocked->mailbox->hasUnreadMessages()) {
-                blockedTasks.remove(blocked);
-                blocked->state = TaskState::ReadyToRun;
-                scheduleTask(blocked);
+            if (queued > mostQueued) {
+                mostQueued = queued;
+                victim = scheduler;
             }
+        }
 
-            blocked = next;
+        if (victim == nullptr) {
+            return nullptr;
         }
-    }
 
+        return victim->surrenderTask();
+    }
 }
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace Kernel {
 
     struct Task;
+    class Scheduler;
 
     enum class BlockReason {
         Sleep,
@@ -46,17 +47,19 @@ namespace Kernel {
 
         void scheduleTask(Task* task);
 
-        void blockTask(Task* task, BlockReason reason);
-        void sleepTask(Task* task, int time);
+        /*
+        Schedules a task that was blocked. Only call this after taking
+        the task off whatever it waited on, ie its mailbox's claimWaiter
+        or another task's blockedSenders, so it's only woken once
+        */
         void unblockTask(Task* task);
-        
-        void unblockWakeableTasks();
-
-    private:
-
-        LinkedList<Task> blockedTasks;
-        LinkedList<Task> sleepingTasks;
-        //(block) sleep list
 
+        /*
+        Called by a scheduler whose run queues are empty, before it
+        falls back to its idle task. Takes a task from the scheduler
+        with the most queued work, or returns nullptr if every other
+        core is idle too
+        */
+        Task* stealTask(Scheduler* thief);
     };
 }
@@ -30,133 +30,439 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace IPC {
 
-    void Mailbox::send(Message* message) {
-        Kernel::SpinLock lock {&bufferLock};
-
-        if (freeMessages > 0) {
-            
-            for (auto i = 0; i < MaxMessages; i++) {
-                if (messages[i].buffer.length == 0) {
-                    memcpy(&messages[i].buffer, message, message->length);
-
-                    if (firstMessage == nullptr) {
-                        firstMessage = &messages[i];
-                        lastMessage = firstMessage;
-                    }
-                    else {
-                        lastMessage->next = &messages[i];
-                        lastMessage = &messages[i];
-                    }
-
-                    break;
+    /*
+    Kernel services send straight to mailboxes with interrupts
+    on, while system calls reach them with interrupts off
+    */
+    Kernel::LockStatistics MailboxLock {.name = "mailbox", .takenByInterrupts = true};
+
+    Mailbox::Mailbox(uintptr_t bufferAddress, uint32_t size) {
+        messages = reinterpret_cast<StoredMessage*>(bufferAddress);
+        bufferSize = size;
+
+        if (MaxMessages * sizeof(StoredMessage) > size) {
+            MaxMessages = size / sizeof(StoredMessage);
+        }
+
+        messageLimit = MaxMessages;
+        addSlots(messages, MaxMessages);
+    }
+
+    void Mailbox::addSlots(StoredMessage* slots, int count) {
+        for (auto i = count - 1; i >= 0; i--) {
+            auto& slot = slots[i];
+            slot.buffer.length = 0;
+            slot.previous = nullptr;
+            slot.nextInBucket = nullptr;
+            slot.previousInBucket = nullptr;
+            slot.granted = false;
+            slot.next = freeSlots;
+            freeSlots = &slot;
+        }
+
+        freeMessages += count;
+    }
+
+    void Mailbox::setBlockSource(MessageBlockSource* source, int limit) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+
+        blockSource = source;
+        messageLimit = limit > MaxMessages ? limit : MaxMessages;
+    }
+
+    void Mailbox::setMessageLimit(int limit) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+
+        messageLimit = limit > MaxMessages ? limit : MaxMessages;
+    }
+
+    bool Mailbox::setCoalescePolicy(MessageNamespace messageNamespace, uint32_t messageId, CoalescePolicy policy) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+
+        CoalesceRule* freeRule {nullptr};
+
+        for (auto& rule : coalesceRules) {
+            if (rule.policy == CoalescePolicy::None) {
+                if (freeRule == nullptr) {
+                    freeRule = &rule;
                 }
             }
+            else if (rule.messageNamespace == messageNamespace && rule.messageId == messageId) {
+                rule.policy = policy;
+                return true;
+            }
+        }
 
-            freeMessages--;
-            unreadMessages++;
+        if (policy == CoalescePolicy::None) {
+            return true;
         }
-        else {
-            asm("cli");
-            asm("hlt");
+
+        if (freeRule == nullptr) {
+            return false;
         }
+
+        freeRule->messageNamespace = messageNamespace;
+        freeRule->messageId = messageId;
+        freeRule->policy = policy;
+
+        return true;
     }
 
-    bool Mailbox::receive(Message* message) {
-        Kernel::SpinLock lock {&bufferLock};
+    bool Mailbox::grow() {
+        if (spareBlock == nullptr || !canGrow()) {
+            return false;
+        }
+
+        auto block = spareBlock;
+        spareBlock = nullptr;
 
-        if (unreadMessages == 0) {
+        addSlots(block->slots, MessageBlock::SlotCount);
+        MaxMessages += MessageBlock::SlotCount;
+
+        return true;
+    }
+
+    bool Mailbox::coalesce(Message* message) {
+        auto policy = CoalescePolicy::None;
+
+        for (auto& rule : coalesceRules) {
+            if (rule.policy != CoalescePolicy::None 
+                && rule.messageNamespace == message->messageNamespace
+                && rule.messageId == message->messageId) {
+                policy = rule.policy;
+                break;
+            }
+        }
+
+        if (policy == CoalescePolicy::None) {
             return false;
         }
 
-        memcpy(message, &firstMessage->buffer, firstMessage->buffer.length);
+        /*
+        Only merge with the newest unread message of the same type,
+        otherwise the order relative to other messages would change
+        */
+        if (lastMessage == nullptr
+            || lastMessage->granted
+            || lastMessage->buffer.messageNamespace != message->messageNamespace
+            || lastMessage->buffer.messageId != message->messageId
+            || lastMessage->buffer.length != message->length) {
+            return false;
+        }
 
-        unreadMessages--;
-        freeMessages++;
-        firstMessage->buffer.length = 0;
+        auto senderTaskId = lastMessage->buffer.senderTaskId;
 
-        auto next = firstMessage->next;
-        firstMessage->next = nullptr;
-        firstMessage = next;
+        if (senderTaskId != message->senderTaskId) {
+            return false;
+        }
 
-        if (firstMessage == nullptr) {
-            lastMessage = nullptr;
+        if (policy == CoalescePolicy::ReplaceLatest) {
+            memcpy(&lastMessage->buffer, message, message->length);
+        }
+        else {
+            auto count = (message->length - sizeof(Message)) / sizeof(int32_t);
+            auto existing = reinterpret_cast<int32_t*>(reinterpret_cast<uint8_t*>(&lastMessage->buffer) + sizeof(Message));
+            auto incoming = reinterpret_cast<int32_t*>(reinterpret_cast<uint8_t*>(message) + sizeof(Message));
+
+            for (auto i = 0u; i < count; i++) {
+                existing[i] += incoming[i];
+            }
         }
 
         return true;
+    }
 
-        /*
-        for (auto i = 0; i < MaxMessages; i++) {
-            if (messages[i].buffer.length > 0) {
-                memcpy(message, &messages[i].buffer, messages[i].buffer.length);
-                unreadMessages--;
-                freeMessages++;
-                messages[i].buffer.length = 0;
+    int Mailbox::getBucketIndex(IPC::MessageNamespace messageNamespace, uint32_t messageId) {
+        auto key = (static_cast<uint32_t>(messageNamespace) << 16) ^ messageId;
+        key ^= key >> 16;
+        key *= 0x45d9f3b;
+        key ^= key >> 16;
+
+        return key % BucketCount;
+    }
+
+    bool Mailbox::reserveBlock() {
+        MessageBlockSource* source {nullptr};
+
+        {
+            Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+
+            if (!canGrow()) {
+                return false;
+            }
+
+            if (spareBlock != nullptr) {
                 return true;
             }
-        }*/
 
-        return false;
-    }
+            source = blockSource;
+        }
 
-    bool Mailbox::filteredReceive(Message* message, IPC::MessageNamespace filter, uint32_t messageId) {
-        Kernel::SpinLock lock {&bufferLock};
+        auto block = source->allocateBlock();
 
-        if (unreadMessages == 0) {
+        if (block == nullptr) {
             return false;
         }
 
+        {
+            Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
 
-        auto iterator = firstMessage;
-        StoredMessage* previous {nullptr};
+            if (spareBlock == nullptr) {
+                spareBlock = block;
+                return true;
+            }
+        }
 
-        while (iterator != nullptr) {
+        //another sender reserved one first
+        source->freeBlock(block);
 
-            if (iterator->buffer.messageNamespace == filter
-                && iterator->buffer.messageId == messageId) {
-                
-                memcpy(message, &iterator->buffer, iterator->buffer.length);
+        return true;
+    }
+
+    SendResult Mailbox::send(Message* message, bool granted) {
+        while (true) {
+            {
+                Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+
+                auto result = store(message, granted);
+
+                if (result != SendResult::Full) {
+                    return result;
+                }
+            }
+
+            if (!reserveBlock()) {
+                return SendResult::Full;
+            }
+        }
+    }
+
+    SendResult Mailbox::trySend(Message* message, bool granted) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
 
-                unreadMessages--;
-                freeMessages++;
-                iterator->buffer.length = 0;
+        return store(message, granted);
+    }
+
+    int Mailbox::sendMultiple(Message** messages, int count) {
+        int stored {0};
 
-                if (previous != nullptr) {
-                    previous->next = iterator->next;
+        while (true) {
+            {
+                Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
 
-                    if (iterator->next == nullptr) {
-                        lastMessage = previous;
-                    }
+                while (stored < count && store(messages[stored], false) != SendResult::Full) {
+                    stored++;
                 }
-                else {
-                    firstMessage = iterator->next;
 
-                    if (firstMessage == nullptr) {
-                        lastMessage = nullptr;
-                    }
+                if (stored == count) {
+                    return count;
                 }
+            }
 
-                return true;
+            if (!reserveBlock()) {
+                return stored;
             }
+        }
+    }
+
+    SendResult Mailbox::store(Message* message, bool granted) {
+        if (!granted && coalesce(message)) {
+            return SendResult::Coalesced;
+        }
 
-            previous = iterator;
-            iterator = iterator->next;
+        if (freeSlots == nullptr && !grow()) {
+            return SendResult::Full;
+        }
+
+        auto slot = freeSlots;
+        freeSlots = slot->next;
+
+        memcpy(&slot->buffer, message, message->length);
+        slot->granted = granted;
+
+        slot->next = nullptr;
+        slot->previous = lastMessage;
+
+        if (lastMessage == nullptr) {
+            firstMessage = slot;
+        }
+        else {
+            lastMessage->next = slot;
+        }
+
+        lastMessage = slot;
+
+        auto& bucket = buckets[getBucketIndex(message->messageNamespace, message->messageId)];
+        slot->nextInBucket = nullptr;
+        slot->previousInBucket = bucket.last;
+
+        if (bucket.last == nullptr) {
+            bucket.first = slot;
+        }
+        else {
+            bucket.last->nextInBucket = slot;
+        }
+
+        bucket.last = slot;
+
+        freeMessages--;
+        unreadMessages++;
+
+        return SendResult::Sent;
+    }
+
+    void Mailbox::take(StoredMessage* stored, Message* message, bool* granted) {
+        memcpy(message, &stored->buffer, stored->buffer.length);
+
+        if (granted != nullptr) {
+            *granted = stored->granted;
+        }
+
+        if (stored->previous != nullptr) {
+            stored->previous->next = stored->next;
+        }
+        else {
+            firstMessage = stored->next;
+        }
+
+        if (stored->next != nullptr) {
+            stored->next->previous = stored->previous;
+        }
+        else {
+            lastMessage = stored->previous;
+        }
+
+        auto& bucket = buckets[getBucketIndex(stored->buffer.messageNamespace, stored->buffer.messageId)];
+
+        if (stored->previousInBucket != nullptr) {
+            stored->previousInBucket->nextInBucket = stored->nextInBucket;
+        }
+        else {
+            bucket.first = stored->nextInBucket;
+        }
+
+        if (stored->nextInBucket != nullptr) {
+            stored->nextInBucket->previousInBucket = stored->previousInBucket;
+        }
+        else {
+            bucket.last = stored->previousInBucket;
+        }
+
+        stored->buffer.length = 0;
+        stored->previous = nullptr;
+        stored->nextInBucket = nullptr;
+        stored->previousInBucket = nullptr;
+        stored->next = freeSlots;
+        freeSlots = stored;
+
+        unreadMessages--;
+        freeMessages++;
+    }
+
+    bool Mailbox::receive(Message* message, bool* granted) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+        return receiveUnlocked(message, granted);
+    }
+
+    bool Mailbox::receiveOrWait(Message* message, bool* granted) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+        auto received = receiveUnlocked(message, granted);
+        waiting = !received;
+        return received;
+    }
+
+    bool Mailbox::receiveUnlocked(Message* message, bool* granted) {
+        if (unreadMessages == 0) {
+            return false;
+        }
+
+        take(firstMessage, message, granted);
+
+        return true;
+    }
+
+    int Mailbox::receiveMultiple(MaximumMessageBuffer* buffers, int count, bool* granted) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+        return receiveMultipleUnlocked(buffers, count, granted);
+    }
+
+    int Mailbox::receiveMultipleOrWait(MaximumMessageBuffer* buffers, int count, bool* granted) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+        auto received = receiveMultipleUnlocked(buffers, count, granted);
+        waiting = received == 0;
+        return received;
+    }
+
+    int Mailbox::receiveMultipleUnlocked(MaximumMessageBuffer* buffers, int count, bool* granted) {
+        if (granted != nullptr) {
+            *granted = false;
+        }
+
+        if (unreadMessages == 0 || count <= 0) {
+            return 0;
+        }
+
+        if (firstMessage->granted) {
+            take(firstMessage, &buffers[0], granted);
+            return 1;
+        }
+
+        int received {0};
+
+        while (received < count
+            && firstMessage != nullptr
+            && !firstMessage->granted) {
+
+            take(firstMessage, &buffers[received], nullptr);
+            received++;
+        }
+
+        return received;
+    }
+
+    bool Mailbox::filteredReceive(Message* message, IPC::MessageNamespace filter, uint32_t messageId, bool* granted) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+        return filteredReceiveUnlocked(message, filter, messageId, granted);
+    }
+
+    bool Mailbox::filteredReceiveOrWait(Message* message, IPC::MessageNamespace filter, uint32_t messageId, bool* granted) {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+        auto received = filteredReceiveUnlocked(message, filter, messageId, granted);
+        waiting = !received;
+        return received;
+    }
+
+    bool Mailbox::claimWaiter() {
+        Kernel::SpinLockIrqSave lock {&bufferLock, &MailboxLock};
+        auto wasWaiting = waiting;
+        waiting = false;
+        return wasWaiting;
+    }
+
+    bool Mailbox::filteredReceiveUnlocked(Message* message, IPC::MessageNamespace filter, uint32_t messageId, bool* granted) {
+        if (unreadMessages == 0) {
+            return false;
         }
 
         /*
-        for (auto i = 0; i < MaxMessages; i++) {
-            if (messages[i].buffer.length > 0
-                && messages[i].buffer.messageNamespace == filter
-                && messages[i].buffer.messageId == messageId) {
-                memcpy(message, &messages[i].buffer, messages[i].buffer.length);
-                unreadMessages--;
-                freeMessages++;
-                messages[i].buffer.length = 0;
+        Only messages that hash to the same bucket need to be checked,
+        and they are in arrival order so the first match is the oldest
+        */
+        auto iterator = buckets[getBucketIndex(filter, messageId)].first;
+
+        while (iterator != nullptr) {
+
+            if (iterator->buffer.messageNamespace == filter
+                && iterator->buffer.messageId == messageId) {
+                
+                take(iterator, message, granted);
                 return true;
             }
+
+            iterator = iterator->nextInBucket;
         }
-        */
 
         return false;
     }
 
-}
\ No newline at end of file
+}
@@ -74,12 +74,53 @@ namespace IPC {
         uint8_t buffer[MaximumMessageSize];
     };
 
+    inline constexpr uint32_t MaximumGrantPages {96};
+
+    /*
+    A GrantedMessage hands whole pages from the sender to the receiver
+    without copying them. On send, the kernel unmaps grantPages pages
+    starting at grantAddress from the sender's address space. When the
+    receiver receives the message, the same physical pages are mapped
+    into its address space and grantAddress is updated to point to them.
+
+    grantAddress must be page aligned, and the sender loses access to
+    the pages once the send succeeds, so only use memory that isn't
+    shared with anything else (ie not the heap). buffer is for any
+    small, message-specific data that describes the pages.
+    */
+    struct GrantedMessage : Message {
+        uintptr_t grantAddress;
+        uint32_t grantPages;
+        uint8_t buffer[128];
+
+        /*
+        Filled in and cleared by the kernel, stores the physical
+        addresses of the granted pages while the message is in flight
+        */
+        uintptr_t frames[MaximumGrantPages];
+    };
+
     enum class RecipientType {
         ServiceRegistryMailbox,
         ServiceName,
         TaskId
     };
 
+    /*
+    One message of a batch, see SystemCall::SendBatch. Each entry
+    can go to a different recipient
+    */
+    struct BatchEntry {
+        RecipientType recipient;
+        Message* message;
+    };
+
+    /*
+    The most messages the kernel handles in one SendBatch or
+    ReceiveBatch, anything past this is ignored
+    */
+    inline constexpr uint32_t MaximumBatchSize {32};
+
     /*
     Helper func that copies the first n bytes from the buffer
     to create a T message
@@ -95,39 +136,163 @@ namespace IPC {
 
     struct StoredMessage {
         MaximumMessageBuffer buffer;
+
+        /*
+        While a message is unread, next/previous link it into the
+        mailbox's arrival order. Free slots are kept on a stack
+        threaded through next
+        */
         StoredMessage* next {nullptr};
+        StoredMessage* previous {nullptr};
+
+        /*
+        Links the message into the bucket for its namespace and
+        messageId, also in arrival order
+        */
+        StoredMessage* nextInBucket {nullptr};
+        StoredMessage* previousInBucket {nullptr};
+
+        bool granted {false};
+    };
+
+    struct MessageBucket {
+        StoredMessage* first {nullptr};
+        StoredMessage* last {nullptr};
+    };
+
+    /*
+    Extra slots a mailbox allocates once its initial buffer is full
+    */
+    struct MessageBlock {
+        static constexpr int SlotCount {8};
+        StoredMessage slots[SlotCount];
+    };
+
+    /*
+    Supplies MessageBlocks to growing mailboxes, implemented by
+    whatever owns the kernel's allocators
+    */
+    class MessageBlockSource {
+    public:
+
+        virtual ~MessageBlockSource() {}
+        virtual MessageBlock* allocateBlock() = 0;
+        virtual void freeBlock(MessageBlock* block) = 0;
+    };
+
+    enum class SendResult {
+        Sent,
+        Coalesced,
+        Full
+    };
+
+    /*
+    Mailboxes can opt in to coalescing a specific namespace and
+    messageId, so a burst of the same message (eg mouse moves) only
+    takes up one slot. ReplaceLatest overwrites the unread message
+    with the new one. SumValues treats everything after the Message
+    header as an array of int32_t and adds the new values to the
+    unread message, which suits messages that carry deltas
+    */
+    enum class CoalescePolicy {
+        None,
+        ReplaceLatest,
+        SumValues
+    };
+
+    struct CoalesceRule {
+        MessageNamespace messageNamespace;
+        uint32_t messageId;
+        CoalescePolicy policy {CoalescePolicy::None};
     };
 
     /*
     A Mailbox stores and provides access to messages. Each task
-    has one mailbox. Messages are stored in a circular byte buffer.
+    has one mailbox. Messages are stored in fixed size slots taken
+    from a free stack. Unread messages are indexed by arrival order
+    for receive, and by a hash of their namespace and messageId
+    for filteredReceive, so neither has to search the whole mailbox.
+
+    Once the initial slots are used up, a mailbox with a block source
+    grows a MessageBlock at a time until it reaches its message limit.
+    Blocks are allocated with bufferLock released and then added
+    under it. Past the limit send reports Full and its up to the caller to either
+    drop the message or wait for the receiver to drain the mailbox.
     */
     class Mailbox {
     public:
 
-        Mailbox(uint32_t bufferAddress, uint32_t size) {
-            //buffers = reinterpret_cast<MaximumMessageBuffer*>(bufferAddress);
-            messages = reinterpret_cast<StoredMessage*>(bufferAddress);
-            bufferSize = size;
+        Mailbox(uintptr_t bufferAddress, uint32_t size);
+
+        /*
+        Copies the message into a free slot if there is space available,
+        growing the mailbox if allowed. Returns Full without storing the
+        message otherwise. granted must only be set by the kernel, for
+        GrantedMessages whose pages have already been detached from the sender
+        */
+        SendResult send(Message* message, bool granted = false);     
+
+        /*
+        Like send, but only grows into a block reserveBlock has already
+        set aside, so it never allocates. For callers holding other locks
+        */
+        SendResult trySend(Message* message, bool granted = false);
+
+        /*
+        Makes sure a spare block is set aside for the next time the
+        mailbox grows, allocating it without holding bufferLock since
+        the block source may switch address spaces and allocate pages.
+        Returns false if the mailbox can't grow
+        */
+        bool reserveBlock();
+
+        bool canGrow() const {
+            return blockSource != nullptr
+                && MaxMessages + MessageBlock::SlotCount <= messageLimit;
         }
 
         /*
-        Copies the message into the buffer if there is space available,
-        overwriting any messages that were previously read
+        Stores messages in order with a single lock acquisition,
+        stopping at the first one that doesn't fit. Returns how
+        many were stored (or coalesced)
         */
-        void send(Message* message);     
+        int sendMultiple(Message** messages, int count);
 
         /*
-        Extracts a message from the buffer and copies it to the supplied message
+        Extracts a message from the buffer and copies it to the supplied message.
+        If granted is supplied, it is set to whether the message was a
+        GrantedMessage that still needs its pages mapped
         */
-        bool receive(Message* message);
+        bool receive(Message* message, bool* granted = nullptr);
+
+        /*
+        Takes up to count messages in arrival order with a single lock
+        acquisition and returns how many were taken. Since a GrantedMessage
+        needs its pages mapped after it's received, one is only ever
+        returned on its own, with granted set
+        */
+        int receiveMultiple(MaximumMessageBuffer* buffers, int count, bool* granted = nullptr);
 
         /*
         Searches for a message with the given namespace and messageId
         Copies the message to message buffer and returns true if found,
         false otherwise
         */
-        bool filteredReceive(Message* message, IPC::MessageNamespace filter, uint32_t messageId);  
+        bool filteredReceive(Message* message, IPC::MessageNamespace filter, uint32_t messageId, bool* granted = nullptr);  
+
+        /*
+        The OrWait versions behave like the ones above, except that when
+        nothing is received they also mark the mailbox as having a waiter,
+        under the same lock. After every successful send, the sender calls
+        claimWaiter, which clears the mark and returns whether it was set.
+        Whoever gets true is responsible for waking the owner. Since the
+        check and the mark can't be split by a send, the owner can never
+        wait on a message that already arrived
+        */
+        bool receiveOrWait(Message* message, bool* granted = nullptr);
+        bool filteredReceiveOrWait(Message* message, IPC::MessageNamespace filter, uint32_t messageId, bool* granted = nullptr);
+        int receiveMultipleOrWait(MaximumMessageBuffer* buffers, int count, bool* granted = nullptr);
+        bool claimWaiter();
 
         bool hasUnreadMessages() {
             return unreadMessages > 0;
@@ -137,18 +302,80 @@ namespace IPC {
             return unreadMessages;
         }
 
+        /*
+        Allows the mailbox to grow using blocks from source, until
+        it can hold messageLimit messages
+        */
+        void setBlockSource(MessageBlockSource* source, int messageLimit);
+
+        /*
+        Changes how many messages the mailbox may grow to hold. The
+        limit can't be lowered below the mailbox's current capacity
+        */
+        void setMessageLimit(int limit);
+
+        /*
+        Sets or clears (with CoalescePolicy::None) the coalescing rule
+        for a namespace and messageId. Returns false if there are
+        already MaxCoalesceRules other rules
+        */
+        bool setCoalescePolicy(MessageNamespace messageNamespace, uint32_t messageId, CoalescePolicy policy);
+
+        int getCapacity() const {
+            return MaxMessages;
+        }
+
+        static constexpr int BucketCount {32};
+        static constexpr int MaxCoalesceRules {4};
+
     private:
 
+        /*
+        Adds count slots to the free stack
+        */
+        void addSlots(StoredMessage* slots, int count);
+
+        /*
+        The bodies of the receive functions, the caller must hold bufferLock
+        */
+        bool receiveUnlocked(Message* message, bool* granted);
+        bool filteredReceiveUnlocked(Message* message, IPC::MessageNamespace filter, uint32_t messageId, bool* granted);
+        int receiveMultipleUnlocked(MaximumMessageBuffer* buffers, int count, bool* granted);
+
+        /*
+        The body of send, the caller must hold bufferLock
+        */
+        SendResult store(Message* message, bool granted);
+
+        /*
+        Adds spareBlock's slots, so growing never allocates while
+        bufferLock is held
+        */
+        bool grow();
+        bool coalesce(Message* message);
+
+        static int getBucketIndex(IPC::MessageNamespace messageNamespace, uint32_t messageId);
+
+        /*
+        Copies the message out, unlinks it from the arrival order
+        and its bucket, and returns its slot to the free stack
+        */
+        void take(StoredMessage* stored, Message* message, bool* granted);
+
         uint32_t unreadMessages {0};
         uint32_t bufferSize {0};
-        uint32_t lastReadOffset {0};
-        uint32_t lastWriteOffset {0};
         uint32_t bufferLock {0};
-        //MaximumMessageBuffer* buffers;
+        bool waiting {false};
         StoredMessage* messages;
+        StoredMessage* freeSlots {nullptr};
         StoredMessage* firstMessage {nullptr};
         StoredMessage* lastMessage {nullptr};
-        int freeMessages {70};
+        MessageBucket buckets[BucketCount];
+        int freeMessages {0};
         int MaxMessages {70};
+        int messageLimit {70};
+        MessageBlockSource* blockSource {nullptr};
+        MessageBlock* spareBlock {nullptr};
+        CoalesceRule coalesceRules[MaxCoalesceRules];
     };
 }
@@ -31,12 +31,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace Kernel {
 
+    /*
+    An intrusive doubly-linked list of tasks. Tracks both ends
+    so it can be used as a deque: the owning scheduler takes
+    from the head, while other cores steal from the tail.
+    */
     template<typename T> class LinkedList {
         public:
             
             void insertBefore(T* item, T* before) {
                 if (head == nullptr) {
                     head = item;
+                    tail = item;
+                    item->previousTask = nullptr;
+                    item->nextTask = nullptr;
                 }
                 else {
                     item->nextTask = before;
@@ -52,11 +60,23 @@ namespace Kernel {
 
                     before->previousTask = item;
                 }
+
+                size++;
             }
 
             void insertAfter(T* item, T* after) {
-                after->nextTask = item;
+                item->nextTask = after->nextTask;
                 item->previousTask = after;
+
+                if (after->nextTask != nullptr) {
+                    after->nextTask->previousTask = item;
+                }
+                else {
+                    tail = item;
+                }
+
+                after->nextTask = item;
+                size++;
             }
 
             void append(T* item) {
@@ -65,44 +85,36 @@ namespace Kernel {
                     item->previousTask = nullptr;
                 }
                 else {
-                    auto current = head;
-
-                    while (current->nextTask != nullptr) {
 
-                        if (current->id == item->id) {
-                            asm("cli");
-                            asm("hlt");
-                        }
-
-                        current = current->nextTask;
+                    if (tail == item) {
+                        asm("cli");
+                        asm("hlt");
                     }
 
-                    current->nextTask = item;
-                    item->previousTask = current;
+                    tail->nextTask = item;
+                    item->previousTask = tail;
                 }
 
+                tail = item;
                 item->nextTask = nullptr;
+                size++;
             }
 
             void remove(T* item) {
-                /*auto previous = item->previousTask;
-                auto next = item->nextTask;
 
-                if (previous != nullptr) {
-                    previous->nextTask = next;
-                }
-                else {
-                    head = next;
+                if (head != item && item->previousTask == nullptr) {
+                    //item isn't in this list
+                    return;
                 }
 
-                if (next != nullptr) {
-                    next->previousTask = previous;
-                }*/
-
                 if (head == item) {
                     head = item->nextTask;
                 }
 
+                if (tail == item) {
+                    tail = item->previousTask;
+                }
+
                 if (item->previousTask != nullptr) {
                     item->previousTask->nextTask = item->nextTask;
                 }
@@ -113,16 +125,25 @@ namespace Kernel {
 
                 item->previousTask = nullptr;
                 item->nextTask = nullptr;
+                size--;
             }
 
             T* getHead() {
                 return head;
             }
 
+            T* getTail() {
+                return tail;
+            }
+
             bool isEmpty() {
                 return head == nullptr;
             }
 
+            int getSize() const {
+                return size;
+            }
+
             uint32_t* getLock() {
                 return &lock;
             }
@@ -130,6 +151,8 @@ namespace Kernel {
         private:
 
         T* head {nullptr};
+        T* tail {nullptr};
+        int size {0};
         uint32_t lock {0};
     };
 }
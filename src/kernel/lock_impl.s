@@ -30,28 +30,35 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 global spinlock
 
+;A ticket lock, the high word of the lock is the next ticket to hand
+;out and the low word is the ticket being served. Waiters are served
+;in the order they arrived. Returns how many times it had to spin
 spinlock:
 
     push ebp
     mov ebp, esp
+    mov edx, [ebp + 8]
 
-    ;first check to see if we can aquire the lock straight away
-    lock bts dword [ebp + 8], 0
-    jnc .done
+    ;take a ticket
+    mov eax, 0x10000
+    lock xadd dword [edx], eax
+    mov ecx, eax
+    shr ecx, 16
+
+    ;if it's already being served we have the lock
+    cmp ax, cx
+    mov eax, 0
+    je .done
 
 .spin:
 
     ;notify the CPU that this is a spinlock loop
     ;see https://stackoverflow.com/questions/4725676/
     pause
+    inc eax
 
-    ;doing lock bts is somewhat expensive, so see if we can skip it
-    bt dword [ebp + 8], 0
-    jc .spin
-
-    ;we might be able to aquire the lock now
-    lock bts dword [ebp + 8], 0
-    jc .spin
+    cmp word [edx], cx
+    jne .spin
 
 .done:
 
@@ -65,8 +72,10 @@ releaseSpinlock:
     push ebp
     mov ebp, esp
 
-    mov dword [ebp + 8], 0
+    ;only the holder changes the low word, so this doesn't need a lock prefix
+    mov edx, [ebp + 8]
+    add word [edx], 1
 
     mov esp, ebp
     pop ebp
-    ret
\ No newline at end of file
+    ret
@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "locks.h"
+
+namespace CPU {
+    int getCurrentCPUId();
+}
+
+namespace Kernel::LockDebug {
+
+    constexpr int MaxCores {16};
+    constexpr int MaxHeldLocks {8};
+
+    struct HeldLocks {
+        LockStatistics* locks[MaxHeldLocks];
+        int count {0};
+    };
+
+    /*
+    Only touched by the core that owns it, while it holds a lock
+    */
+    HeldLocks heldLocks[MaxCores];
+
+    uint64_t getClassBit(LockStatistics* statistics) {
+        return 1ul << statistics->classId;
+    }
+
+    void acquired(LockStatistics* statistics, bool interruptsEnabled) {
+        if (statistics->takenByInterrupts && interruptsEnabled) {
+            statistics->interruptViolation = true;
+        }
+
+        auto& held = heldLocks[CPU::getCurrentCPUId() % MaxCores];
+
+        if (statistics->classId >= 0) {
+            for (int i = 0; i < held.count; i++) {
+                auto previous = held.locks[i];
+
+                //locks with the same name are ordered by the code using them
+                if (previous == statistics || previous->classId < 0) {
+                    continue;
+                }
+
+                __atomic_fetch_or(&statistics->heldBefore, getClassBit(previous), __ATOMIC_RELAXED);
+
+                if (__atomic_load_n(&previous->heldBefore, __ATOMIC_RELAXED) & getClassBit(statistics)) {
+                    LockStatistics* none {nullptr};
+                    __atomic_compare_exchange_n(&statistics->orderViolation, &none, previous, 
+                        false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                }
+            }
+        }
+
+        if (held.count < MaxHeldLocks) {
+            held.locks[held.count] = statistics;
+        }
+
+        held.count++;
+    }
+
+    void released(LockStatistics* statistics) {
+        auto& held = heldLocks[CPU::getCurrentCPUId() % MaxCores];
+
+        //anything past MaxHeldLocks wasn't stored, so assume it's the one released
+        if (held.count > MaxHeldLocks) {
+            held.count--;
+            return;
+        }
+
+        //locks aren't always released in the reverse order they were taken
+        for (int i = held.count - 1; i >= 0; i--) {
+            if (held.locks[i] == statistics) {
+                for (int j = i; j < held.count - 1; j++) {
+                    held.locks[j] = held.locks[j + 1];
+                }
+
+                break;
+            }
+        }
+
+        held.count--;
+    }
+}
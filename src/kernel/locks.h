@@ -25,14 +25,115 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#pragma once
 
 #include <stdint.h>
 
-extern "C" void spinlock(uint32_t* lock);
+/*
+spinlock returns how many times it spun waiting
+for the lock, see lock_impl.s
+*/
+extern "C" uint32_t spinlock(uint32_t* lock);
 extern "C" void releaseSpinlock(uint32_t* lock);
 
+/*
+When enabled, every lock given a LockStatistics is checked for
+ordering and interrupt problems, see LockDebug
+*/
+#ifndef LOCK_DEBUG
+#define LOCK_DEBUG 0
+#endif
+
 namespace Kernel {
 
+    /*
+    Contention counters shared by every lock with the same name,
+    so for instance all of the run queue locks can be looked at
+    together. Declared as a global and passed to SpinLock, it's
+    added to the list that Trace::dump writes out the first time
+    it's used. Times are in TSC ticks
+    */
+    struct LockStatistics {
+        const char* name;
+
+        /*
+        Set for locks that interrupt handlers can take. Anywhere else
+        they have to be taken with SpinLockIrqSave, or a handler on the
+        same core could spin forever on a lock its own core holds
+        */
+        bool takenByInterrupts {false};
+
+        uint32_t acquisitions {0};
+        uint32_t contendedAcquisitions {0};
+        uint64_t spinCycles {0};
+        uint64_t maxHoldTime {0};
+        LockStatistics* next {nullptr};
+        bool registered {false};
+
+        /*
+        Only tracked with LOCK_DEBUG. Bit n of heldBefore is set if
+        the lock with classId n was held while this one was taken
+        */
+        int classId {-1};
+        uint64_t heldBefore {0};
+
+        //the first lock found to be taken in both orders with this one
+        LockStatistics* orderViolation {nullptr};
+
+        //set if takenByInterrupts and it was taken with interrupts on
+        bool interruptViolation {false};
+    };
+
+    inline constexpr int MaxLockClasses {64};
+    inline int LockClassCount {0};
+
+    inline LockStatistics* LockStatisticsHead {nullptr};
+
+    inline void registerLockStatistics(LockStatistics* statistics) {
+        if (__atomic_exchange_n(&statistics->registered, true, __ATOMIC_ACQ_REL)) {
+            return;
+        }
+
+        auto classId = __atomic_fetch_add(&LockClassCount, 1, __ATOMIC_RELAXED);
+        statistics->classId = classId < MaxLockClasses ? classId : -1;
+
+        auto head = __atomic_load_n(&LockStatisticsHead, __ATOMIC_RELAXED);
+
+        do {
+            statistics->next = head;
+        } while (!__atomic_compare_exchange_n(&LockStatisticsHead, &head, statistics, 
+            true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    inline constexpr uintptr_t InterruptFlag {1 << 9};
+
+    inline uintptr_t readFlags() {
+        uintptr_t flags;
+        asm volatile("pushf \n"
+            "pop %0"
+            : "=r" (flags)
+            : //no inputs
+            : "memory");
+        return flags;
+    }
+
+    namespace LockDebug {
+
+        /*
+        Called with the lock held/just before it's released. Keeps a
+        stack of the locks each core holds, and records an ordering
+        violation if a lock is taken while holding one that has
+        previously been taken while holding it
+        */
+        void acquired(LockStatistics* statistics, bool interruptsEnabled);
+        void released(LockStatistics* statistics);
+    }
+
+    /*
+    A FIFO fair ticket lock that's held for the lifetime of the
+    object. If statistics is given, the acquisition is counted
+    along with how long it spun and was held for
+    */
     class SpinLock {
     public:
 
@@ -42,17 +143,96 @@ namespace Kernel {
             spinlock(lock);
         }
 
+        SpinLock(uint32_t* lock, LockStatistics* statistics)
+            : lock {lock}, statistics {statistics} {
+
+            auto start = __builtin_ia32_rdtsc();
+            auto spins = spinlock(lock);
+            acquiredAt = __builtin_ia32_rdtsc();
+
+            registerLockStatistics(statistics);
+            __atomic_fetch_add(&statistics->acquisitions, 1, __ATOMIC_RELAXED);
+
+            if (spins > 0) {
+                __atomic_fetch_add(&statistics->contendedAcquisitions, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&statistics->spinCycles, acquiredAt - start, __ATOMIC_RELAXED);
+            }
+
+            #if LOCK_DEBUG
+            LockDebug::acquired(statistics, readFlags() & InterruptFlag);
+            #endif
+        }
+
         ~SpinLock() {
+            if (statistics != nullptr) {
+                #if LOCK_DEBUG
+                LockDebug::released(statistics);
+                #endif
+
+                auto held = __builtin_ia32_rdtsc() - acquiredAt;
+                auto longest = __atomic_load_n(&statistics->maxHoldTime, __ATOMIC_RELAXED);
+
+                while (held > longest 
+                    && !__atomic_compare_exchange_n(&statistics->maxHoldTime, &longest, held, 
+                        true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                }
+            }
+
             releaseSpinlock(lock);
         }
 
     private:
 
         uint32_t* lock;
+        LockStatistics* statistics {nullptr};
+        uint64_t acquiredAt {0};
+    };
 
-        /*
-        TODO: add statistics like tracking lock contention
-        */
+    /*
+    Disables interrupts for its lifetime, and afterwards
+    only enables them if they were enabled to begin with
+    */
+    class InterruptsDisabled {
+    public:
+
+        InterruptsDisabled()
+            : flags {readFlags()} {
+            asm volatile("cli" : : : "memory");
+        }
+
+        ~InterruptsDisabled() {
+            if (flags & InterruptFlag) {
+                asm volatile("sti" : : : "memory");
+            }
+        }
+
+    private:
+
+        uintptr_t flags;
+    };
+
+    /*
+    A SpinLock that also disables interrupts while it's held, for
+    locks that interrupt handlers can take but that are also taken
+    with interrupts on. Code that only ever runs with interrupts
+    off, like the handlers themselves, can use a plain SpinLock
+    */
+    class SpinLockIrqSave {
+    public:
+
+        SpinLockIrqSave(uint32_t* lock)
+            : guard {lock} {
+        }
+
+        SpinLockIrqSave(uint32_t* lock, LockStatistics* statistics)
+            : guard {lock, statistics} {
+        }
+
+    private:
+
+        //members are destroyed in reverse, so the lock is released first
+        InterruptsDisabled interrupts;
+        SpinLock guard;
     };
 
 }
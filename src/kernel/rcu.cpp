@@ -0,0 +1,175 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "rcu.h"
+#include "locks.h"
+
+namespace CPU {
+    int getCurrentCPUId();
+}
+
+namespace Kernel::RCU {
+
+    /*
+    Each core only ever writes its own line, so reporting a
+    quiescent state doesn't bounce a shared cache line around
+    */
+    struct alignas(64) CoreState {
+        uint64_t seenEpoch {0};
+        bool idle {false};
+    };
+
+    CoreState cores[MaxCores];
+    uint32_t onlineCores {0};
+    uint64_t currentEpoch {0};
+
+    Callback* pendingHead {nullptr};
+    Callback* pendingTail {nullptr};
+    uint32_t pendingLock {0};
+    LockStatistics PendingLock {.name = "rcu", .takenByInterrupts = true};
+
+    /*
+    The newest epoch that every online core has seen
+    */
+    uint64_t getCompletedEpoch() {
+        /*
+        Pairs with exitIdle, either the core is seen online here or
+        its lookups see everything unpublished before this
+        */
+        auto online = __atomic_load_n(&onlineCores, __ATOMIC_SEQ_CST);
+        auto completed = __atomic_load_n(&currentEpoch, __ATOMIC_ACQUIRE);
+
+        for (int i = 0; i < MaxCores; i++) {
+            if (online & (1u << i)) {
+                auto seen = __atomic_load_n(&cores[i].seenEpoch, __ATOMIC_ACQUIRE);
+
+                if (seen < completed) {
+                    completed = seen;
+                }
+            }
+        }
+
+        return completed;
+    }
+
+    void defer(Callback* callback) {
+        SpinLockIrqSave lock {&pendingLock, &PendingLock};
+
+        /*
+        Whatever the callback reclaims was unpublished before this,
+        so any core that sees the new epoch can't still reach it
+        */
+        callback->next = nullptr;
+        callback->epoch = __atomic_add_fetch(&currentEpoch, 1, __ATOMIC_SEQ_CST);
+
+        if (pendingTail == nullptr) {
+            pendingHead = callback;
+        }
+        else {
+            pendingTail->next = callback;
+        }
+
+        pendingTail = callback;
+    }
+
+    void quiescentState() {
+        auto id = CPU::getCurrentCPUId() % MaxCores;
+        auto epoch = __atomic_load_n(&currentEpoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&cores[id].seenEpoch, epoch, __ATOMIC_RELEASE);
+
+        if (!(__atomic_load_n(&onlineCores, __ATOMIC_RELAXED) & (1u << id))) {
+            __atomic_fetch_or(&onlineCores, 1u << id, __ATOMIC_RELEASE);
+        }
+
+        if (__atomic_load_n(&pendingHead, __ATOMIC_RELAXED) != nullptr) {
+            reclaim();
+        }
+    }
+
+    void enterIdle() {
+        auto id = CPU::getCurrentCPUId() % MaxCores;
+        auto epoch = __atomic_load_n(&currentEpoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&cores[id].seenEpoch, epoch, __ATOMIC_RELEASE);
+        cores[id].idle = true;
+        __atomic_fetch_and(&onlineCores, ~(1u << id), __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&pendingHead, __ATOMIC_RELAXED) != nullptr) {
+            reclaim();
+        }
+    }
+
+    void exitIdle() {
+        auto id = CPU::getCurrentCPUId() % MaxCores;
+
+        if (!cores[id].idle) {
+            return;
+        }
+
+        /*
+        seenEpoch is left at what it was when the core went idle,
+        so anything deferred since then waits for its next
+        quiescent state
+        */
+        cores[id].idle = false;
+        __atomic_fetch_or(&onlineCores, 1u << id, __ATOMIC_SEQ_CST);
+    }
+
+    void reclaim() {
+        Callback* ready {nullptr};
+
+        {
+            SpinLockIrqSave lock {&pendingLock, &PendingLock};
+            auto completed = getCompletedEpoch();
+            Callback* last {nullptr};
+
+            //epochs are handed out under the lock, so the list is in order
+            while (pendingHead != nullptr && pendingHead->epoch <= completed) {
+                if (ready == nullptr) {
+                    ready = pendingHead;
+                }
+
+                last = pendingHead;
+                pendingHead = pendingHead->next;
+            }
+
+            if (last != nullptr) {
+                last->next = nullptr;
+            }
+
+            if (pendingHead == nullptr) {
+                pendingTail = nullptr;
+            }
+        }
+
+        //callbacks may defer more work, so they run without the lock
+        while (ready != nullptr) {
+            auto next = ready->next;
+            ready->function(ready->argument);
+            ready = next;
+        }
+    }
+}
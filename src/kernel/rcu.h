@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+namespace Kernel::RCU {
+
+    /*
+    Read-copy-update for read-mostly kernel tables
+
+    Readers load published pointers with dereference and never take
+    a lock or write to shared memory. Writers publish with assign,
+    and anything unpublished is only reclaimed through defer once
+    every core has passed a quiescent state, which is a finished
+    context switch or time spent idle. Kernel lookups can't be preempted or block partway
+    through, so a reader can't still be holding an old pointer by
+    the time its core switches tasks.
+    */
+
+    inline constexpr int MaxCores {16};
+
+    struct Callback {
+        Callback* next {nullptr};
+        uint64_t epoch {0};
+        void (*function)(void* argument) {nullptr};
+        void* argument {nullptr};
+    };
+
+    template<class T>
+    T dereference(const T& pointer) {
+        return __atomic_load_n(&pointer, __ATOMIC_ACQUIRE);
+    }
+
+    template<class T>
+    void assign(T& pointer, T value) {
+        __atomic_store_n(&pointer, value, __ATOMIC_RELEASE);
+    }
+
+    /*
+    Runs callback->function(callback->argument) after a grace period,
+    ie after every online core has context switched at least once.
+    The callback must stay valid until then
+    */
+    void defer(Callback* callback);
+
+    /*
+    Called by the scheduler once a context switch has finished, so
+    the task that was switched away from is off its kernel stack.
+    A core counts as online from the first time it reports a
+    quiescent state
+    */
+    void quiescentState();
+
+    /*
+    Called by the idle loop right before it halts, with interrupts
+    off. A halted core can't be partway through a lookup, so grace
+    periods stop waiting on it until it's interrupted
+    */
+    void enterIdle();
+
+    /*
+    Called on every interrupt before the handler can do a lookup.
+    Puts an idle core back online, otherwise does nothing
+    */
+    void exitIdle();
+
+    /*
+    Runs any deferred callbacks whose grace period has ended
+    */
+    void reclaim();
+}
@@ -48,7 +48,7 @@ extern "C"
 void initializeKernel(KernelConfig* config) {
     PIC::disable();
     GDT::setup();
-    Memory::PhysicalMemoryManager::SetupGlobalManager(config->nextFreeAddress, config->totalFreePages);
+    Memory::PhysicalMemoryManager::SetupGlobalManager(config->memoryRanges, config->memoryRangeCount);
     auto& physicalMemoryManager = PhysicalMemoryManager::GetGlobalManager();
 
     initializeSSE();
@@ -63,7 +63,7 @@ void initializeKernel(KernelConfig* config) {
 
     physicalMemoryManager.freeDMAPage(p2);
 
-    CPU::setupInitialCore(&physicalMemoryManager, &virtualMemoryManager);
+    CPU::setupInitialCore(PhysicalMemoryManager::CreateCoreManager(), &virtualMemoryManager);
 
   //  Test::runKernelTests();
     CPU::initialize(config);
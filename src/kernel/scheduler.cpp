@@ -29,9 +29,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <memory/physical_memory_manager.h>
 #include <memory/virtual_memory_manager.h>
+#include <memory/guard.h>
 #include <cpu/apic.h>
 #include <cpu/cpu.h>
+#include <cpu/fpu.h>
 #include <cpu/msr.h>
+#include <cpu/tsc.h>
 #include <saturn/heap.h>
 #include "ipc.h"
 #include <new>
@@ -40,14 +43,49 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <system_calls.h>
 #include "task.h"
 #include <locks.h>
+#include "rcu.h"
 #include "director.h"
+#include "trace.h"
 
 extern "C" void changeProcess(Kernel::Task* current, Kernel::Task* next);
 extern "C" void changeProcessSingle(Kernel::Task* current, Kernel::Task* next);
 extern "C" void idleLoop();
 
+/*
+The idle loop calls this before every hlt
+*/
+extern "C" void idleQuiescentState() {
+    Kernel::RCU::enterIdle();
+}
+
 namespace Kernel {
 
+    static_assert(Trace::HistogramBuckets == SchedulingHistogramBuckets, 
+        "Task histograms must fit in TaskSchedulingStatisticsResult");
+
+    /*
+    The timer and IPI handlers reach all of these, so anything that
+    can run with interrupts on has to use SpinLockIrqSave
+    */
+    LockStatistics RunQueueLock {.name = "runQueue", .takenByInterrupts = true};
+    LockStatistics SleepingTasksLock {.name = "sleepingTasks", .takenByInterrupts = true};
+    LockStatistics BlockedSendersLock {.name = "blockedSenders", .takenByInterrupts = true};
+
+    static_assert(sizeof(TaskHeapStatisticsResult) <= IPC::MaximumMessageSize,
+        "HeapStatistics must fit in a single message");
+
+    /*
+    Exited tasks are freed after a grace period, since a sender on
+    another core could have looked them up just before they exited
+    */
+    void reclaimUserTask(void* task) {
+        CurrentTaskLauncher->freeUserTask(static_cast<Task*>(task));
+    }
+
+    void reclaimKernelTask(void* task) {
+        CurrentTaskLauncher->freeKernelTask(static_cast<Task*>(task));
+    }
+
     void cleanupTasksService() {
         //currentScheduler->cleanupTasks();
     }
@@ -91,6 +129,114 @@ namespace Kernel {
 
                             break;
                         }
+                        case MessageId::GetSchedulerStatistics: {
+
+                            SchedulerStatisticsResult result;
+                            result.recipientId = buffer.senderTaskId;
+                            result.cpuCount = CPU::CPUCount;
+
+                            for (int i = 0; i < CPU::CPUCount; i++) {
+                                auto scheduler = CPU::ActiveCPUs[i].scheduler;
+
+                                if (scheduler == nullptr) {
+                                    continue;
+                                }
+
+                                auto statistics = scheduler->getStatistics();
+                                result.steals += statistics.steals;
+                                result.migrations += statistics.migrations;
+
+                                if (i < static_cast<int>(MaxStatisticsCPUs)) {
+                                    result.interruptsPerSecond[i] = statistics.interruptsPerSecond;
+                                }
+                            }
+
+                            send(IPC::RecipientType::TaskId, &result);
+
+                            break;
+                        }
+                        case MessageId::SetMailboxPolicy: {
+
+                            auto policy = IPC::extractMessage<SetMailboxPolicy>(buffer);
+                            auto task = TaskStore::getInstance().getTask(policy.senderTaskId);
+
+                            if (task == nullptr) {
+                                break;
+                            }
+
+                            if (policy.messageLimit > 0) {
+                                auto limit = policy.messageLimit;
+
+                                if (limit > MaximumMailboxMessageLimit) {
+                                    limit = MaximumMailboxMessageLimit;
+                                }
+
+                                task->mailbox->setMessageLimit(limit);
+                            }
+
+                            if (policy.coalesce != IPC::CoalescePolicy::None) {
+                                task->mailbox->setCoalescePolicy(policy.coalesceNamespace, 
+                                    policy.coalesceMessageId, policy.coalesce);
+                            }
+
+                            break;
+                        }
+                        case MessageId::GetTaskSchedulingStatistics: {
+
+                            auto request = IPC::extractMessage<GetTaskSchedulingStatistics>(buffer);
+                            auto task = TaskStore::getInstance().getTask(request.taskId);
+
+                            TaskSchedulingStatisticsResult result;
+                            result.recipientId = request.senderTaskId;
+
+                            if (task != nullptr) {
+                                result.found = true;
+                                memcpy(result.runQueueLatency, task->runQueueLatency.buckets, sizeof(result.runQueueLatency));
+                                memcpy(result.runTime, task->runTime.buckets, sizeof(result.runTime));
+                            }
+
+                            send(IPC::RecipientType::TaskId, &result);
+
+                            break;
+                        }
+                        case MessageId::DumpSchedulerTrace: {
+                            Trace::dump();
+                            break;
+                        }
+                        case MessageId::GetTaskHeapStatistics: {
+
+                            auto request = IPC::extractMessage<GetTaskHeapStatistics>(buffer);
+                            auto task = TaskStore::getInstance().getTask(request.taskId);
+
+                            TaskHeapStatisticsResult result;
+                            result.recipientId = request.senderTaskId;
+
+                            if (task != nullptr && task->heap != nullptr) {
+                                /*
+                                The heap lives in the task's own address space, and
+                                result is on the kernel stack which every space maps
+                                */
+                                MemoryGuard guard {task->virtualMemoryManager};
+                                result.found = true;
+                                result.statistics = task->heap->getStatistics();
+                            }
+
+                            send(IPC::RecipientType::TaskId, &result);
+
+                            break;
+                        }
+                        case MessageId::SetTaskHeapSampling: {
+
+                            auto request = IPC::extractMessage<SetTaskHeapSampling>(buffer);
+                            auto task = TaskStore::getInstance().getTask(request.taskId);
+
+                            if (task != nullptr && task->heap != nullptr) {
+                                MemoryGuard guard {task->virtualMemoryManager};
+                                task->heap->setSampleInterval(request.sampleInterval);
+                            }
+
+                            break;
+                        }
                         default: {
                             kprintf("[Scheduler] Unhandled message\n");
                         }
@@ -147,73 +293,147 @@ namespace Kernel {
 
     void Scheduler::scheduleNextTask() {
         
-        auto task = findNextTask();
+        auto task = takeNextTask();
 
         if (task == nullptr) {
             unblockWakeableTasks();
-            task = findNextTask();
+            task = takeNextTask();
+        }
+
+        if (task == nullptr && CPU::ActiveCPUs != nullptr) {
+            task = Director::GetInstance().stealTask(this);
+
+            if (task != nullptr) {
+                statistics.steals++;
+            }
         }
 
         if (task == nullptr) {
             nextTask = startTask;
+
+            auto& queue = priorityGroups[static_cast<int>(Priority::Idle)];
+            SpinLockIrqSave queueLock {queue.getLock(), &RunQueueLock};
+            queue.remove(nextTask);
         }
         else {
             nextTask = task;
         }
-
-        priorityGroups[static_cast<int>(nextTask->priority)].remove(nextTask);
-        //scheduleTask(nextTask);
     }
 
-    Task* Scheduler::findNextTask() {
+    Task* Scheduler::takeNextTask() {
         
         for (int i = 0; i < static_cast<int>(Priority::Idle); i++) {
             auto& queue = priorityGroups[i];
 
-            if (!queue.isEmpty()) {
-                return queue.getHead();
+            if (queue.isEmpty()) {
+                continue;
+            }
+
+            SpinLockIrqSave queueLock {queue.getLock(), &RunQueueLock};
+            auto task = queue.getHead();
+
+            if (task != nullptr) {
+                queue.remove(task);
+                return task;
+            }
+        }
+
+        return nullptr;
+    }
+
+    int Scheduler::getQueuedTaskCount() {
+        int count = 0;
+
+        for (int i = 0; i < static_cast<int>(Priority::Idle); i++) {
+            count += priorityGroups[i].getSize();
+        }
+
+        return count;
+    }
+
+    Task* Scheduler::surrenderTask() {
+
+        for (int i = 0; i < static_cast<int>(Priority::Idle); i++) {
+            auto& queue = priorityGroups[i];
+
+            if (queue.isEmpty()) {
+                continue;
+            }
+
+            SpinLockIrqSave queueLock {queue.getLock(), &RunQueueLock};
+            auto task = queue.getTail();
+
+            while (task != nullptr && (task == switchingOutTask || task == currentTask)) {
+                task = task->previousTask;
+            }
+
+            if (task != nullptr) {
+                queue.remove(task);
+                return task;
             }
         }
 
         return nullptr;
     }
 
-    void Scheduler::runNextTask() {
+    void Scheduler::runNextTask(bool keepTimeslice) {
+        if (startedTasks) {
+            armTimer(nextTask, keepTimeslice);
+        }
+
         if (currentTask == nextTask) {
+            /*
+            The task was woken before it finished blocking, and got
+            picked again. Whoever woke it queued it, so take it back out
+            */
+            if (currentTask->state != TaskState::Running) {
+                auto& queue = priorityGroups[static_cast<int>(currentTask->priority)];
+                SpinLockIrqSave queueLock {queue.getLock(), &RunQueueLock};
+                queue.remove(currentTask);
+                currentTask->state = TaskState::Running;
+                currentTask->readySince = 0;
+            }
+
+            //an exiting task is never picked again, so this one isn't on its way out
+            RCU::quiescentState();
             return;
         }
 
         {
             auto& queue = priorityGroups[static_cast<int>(nextTask->priority)];
-            SpinLock queueLock {queue.getLock()};
+            SpinLockIrqSave queueLock {queue.getLock(), &RunQueueLock};
             queue.remove(nextTask);
         }
 
+        switchingOutTask = currentTask;
+
         if (currentTask != nullptr && currentTask->state == TaskState::Running) {
             currentTask->state = TaskState::ReadyToRun;
             auto& queue = priorityGroups[static_cast<int>(currentTask->priority)];
-            SpinLock queueLock {queue.getLock()};
+            SpinLockIrqSave queueLock {queue.getLock(), &RunQueueLock};
             queue.append(currentTask);
         }
 
         nextTask->oldCPUId = nextTask->cpuId;
         nextTask->cpuId = CPU::getCurrentCPUId();
 
-        if (nextTask->oldCPUId != nextTask->cpuId) {
-            int pause = 0;
+        if (nextTask->oldCPUId != nextTask->cpuId && nextTask->timesSwitchedTo > 0) {
+            statistics.migrations++;
         }
 
         nextTask->state = TaskState::Running;
+        recordSwitch(currentTask, nextTask);
 
         if (CPU::ActiveCPUs != nullptr) {
             CPU::ActiveCPUs[nextTask->cpuId].heap = nextTask->heap;
         }
 
-        auto oldTSS = reinterpret_cast<uint32_t>(nextTask->tss);
         auto newTSS = 0xCFFF'F000 - 0x1000 * nextTask->cpuId;
-        auto oldVMM = Memory::getCurrentVMM();
-        nextTask->virtualMemoryManager->activate();
 
+        /*
+        The page directory is switched by activateVMM as part of
+        changeProcess, there's no need to load it here as well
+        */
         if (nextTask->cpuId == 0) {
             if (newTSS != 0xCFFF'F000) {
                 asm("cli");
@@ -228,8 +448,7 @@ namespace Kernel {
         }
 
         nextTask->timesSwitchedTo++;
-
-        oldVMM->activate();
+        CPU::switchFPU(currentTask, nextTask);
 
         if (currentTask == nullptr) {
             currentTask = nextTask;
@@ -241,6 +460,14 @@ namespace Kernel {
             currentTask = nextTask;
 
             changeProcess(current, nextTask);
+
+            /*
+            This is the task that was switched back to, the one that
+            switched away is done with its kernel stack. Reporting any
+            earlier would let an exiting task be reclaimed while it's
+            still running on a single core
+            */
+            RCU::quiescentState();
         }
     }
 
@@ -250,21 +477,121 @@ namespace Kernel {
             return;
         }
 
-        elapsedTime_milliseconds += timeslice_milliseconds;
+        updateElapsedTime();
+        updateInterruptRate();
 
         unblockWakeableTasks();
         scheduleNextTask(); 
 
-        if (nextTask->priority == Priority::Idle) {
-            Director::GetInstance().unblockWakeableTasks();
+        runNextTask();
+    }
+
+    void Scheduler::updateElapsedTime() {
+        auto ticksPerMillisecond = TSC::getTicksPerMillisecond();
 
-            if (nextTask->priority == Priority::Idle) {
-                runNextTask();
+        if (ticksPerMillisecond == 0) {
+            return;
+        }
+
+        elapsedTime_milliseconds = (TSC::getTimestamp() - startTimestamp) / ticksPerMillisecond;
+    }
+
+    void Scheduler::updateInterruptRate() {
+        auto window = elapsedTime_milliseconds - rateWindowStart_milliseconds;
+
+        if (window < 1000) {
+            return;
+        }
+
+        auto interrupts = statistics.interrupts - rateWindowInterrupts;
+        statistics.interruptsPerSecond = (static_cast<uint64_t>(interrupts) * 1000) / window;
+        rateWindowStart_milliseconds = elapsedTime_milliseconds;
+        rateWindowInterrupts = statistics.interrupts;
+    }
+
+    void Scheduler::armTimer(Task* next, bool keepTimeslice) {
+
+        if (TSC::getTicksPerMillisecond() == 0) {
+            //the APIC timer is still being calibrated
+            return;
+        }
+
+        updateElapsedTime();
+
+        auto deadline = TimerWheel<Task>::NoExpiry;
+
+        if (next->priority != Priority::Idle) {
+            if (keepTimeslice && timesliceDeadline_milliseconds != TimerWheel<Task>::NoExpiry) {
+                /*
+                Otherwise a pair of tasks calling each other would
+                get a fresh timeslice on every message and never
+                be preempted
+                */
+                deadline = timesliceDeadline_milliseconds;
+            }
+            else {
+                deadline = elapsedTime_milliseconds + timeslice_milliseconds;
             }
         }
-        else {
-            runNextTask();
+
+        timesliceDeadline_milliseconds = deadline;
+
+        {
+            SpinLockIrqSave lock {sleepingTasks.getLock(), &SleepingTasksLock};
+            auto wakeTime = sleepingTasks.getNextExpiry();
+
+            if (wakeTime < deadline) {
+                deadline = wakeTime;
+            }
+        }
+
+        if (deadline == TimerWheel<Task>::NoExpiry) {
+            APIC::stopAPICTimer();
+            return;
+        }
+
+        uint64_t remaining {0};
+
+        if (deadline > elapsedTime_milliseconds) {
+            remaining = deadline - elapsedTime_milliseconds;
+        }
+
+        //the one-shot counter is 32 bits, so very long waits get clamped and rearmed
+        const uint64_t maxMilliseconds {0xFFFF'FFFF / 1000};
+
+        if (remaining > maxMilliseconds) {
+            remaining = maxMilliseconds;
+        }
+
+        APIC::setAPICTimerOneShot(remaining == 0 ? 50 : remaining * 1000);
+    }
+
+    void Scheduler::recordSwitch(Task* previous, Task* next) {
+        auto now = TSC::getTimestamp();
+        auto calibrated = TSC::getTicksPerMillisecond() != 0;
+
+        if (previous != nullptr) {
+            if (calibrated) {
+                previous->runTime.add(Trace::toMicroseconds(now - previous->runningSince));
+            }
+
+            if (previous->state == TaskState::ReadyToRun) {
+                //it was preempted, so its waiting again from now
+                previous->readySince = now;
+            }
+        }
+
+        if (calibrated) {
+            //a task that was handed off to directly never waited on a queue
+            auto waited = next->readySince == 0 ? 0 : now - next->readySince;
+            next->runQueueLatency.add(Trace::toMicroseconds(waited));
         }
+
+        next->readySince = 0;
+        next->runningSince = now;
+
+        Trace::record(Trace::EventType::ContextSwitch, next->id, 
+            previous != nullptr ? previous->id : 0);
     }
 
     /*void Scheduler::blockTask(BlockReason reason, uint32_t arg) {
@@ -326,31 +653,12 @@ namespace Kernel {
 
     void Scheduler::sleepTask(int time) {
 
-        //todo: lower to ~1sec
-        if (time > 100000) {
-            Director::GetInstance().sleepTask(currentTask, time);
-        }
-        else {
-            currentTask->state = TaskState::Sleeping;
-            currentTask->wakeTime = elapsedTime_milliseconds + time;
-
-            auto blocked = sleepingTasks.getHead();
-
-            while (blocked != nullptr) {
-                if (blocked->wakeTime > currentTask->wakeTime) {
-
-                    sleepingTasks.insertBefore(currentTask, blocked);
-                    break;
-                }
-                else if (blocked->nextTask == nullptr) {
-                    
-                    sleepingTasks.insertAfter(currentTask, blocked);
-                    break;
-                }
+        currentTask->state = TaskState::Sleeping;
+        currentTask->wakeTime = elapsedTime_milliseconds + time;
 
-                blocked = blocked->nextTask;
-            }
-                
+        {
+            SpinLockIrqSave lock {sleepingTasks.getLock(), &SleepingTasksLock};
+            sleepingTasks.insert(currentTask);
         }
 
         reschedule();
@@ -368,27 +676,42 @@ namespace Kernel {
     }*/
 
     void Scheduler::unblockWakeableTasks() {
-        auto blocked = sleepingTasks.getHead();
+        /*
+        scheduleTask can preempt straight into runNextTask, which
+        arms the timer under the same lock, so the expired tasks are
+        only collected here and woken once it's released. They're out
+        of the wheel by now, so nextTimer is free to chain them
+        */
+        Task* expired {nullptr};
+        Task** tail {&expired};
 
-        while (blocked != nullptr) {
-            auto next = blocked->nextTask;
+        {
+            SpinLockIrqSave lock {sleepingTasks.getLock(), &SleepingTasksLock};
 
-            if (blocked->state == TaskState::Sleeping 
-                && blocked->wakeTime <= elapsedTime_milliseconds) {
-                blocked->state = TaskState::ReadyToRun;
-                sleepingTasks.remove(blocked);
-                scheduleTask(blocked);
-            }
-            
-            blocked = next;
+            sleepingTasks.advance(elapsedTime_milliseconds, [&](Task* task) {
+                task->nextTimer = nullptr;
+                *tail = task;
+                tail = &task->nextTimer;
+            });
+        }
+
+        while (expired != nullptr) {
+            auto task = expired;
+            expired = task->nextTimer;
+            task->nextTimer = nullptr;
+            task->state = TaskState::ReadyToRun;
+            scheduleTask(task);
         }
     }
 
     void Scheduler::scheduleTask(Task* task) {
 
+        task->readySince = TSC::getTimestamp();
+
         {
+            //reached from kernel tasks with interrupts on, see CPU::scheduleTask
             auto& queue = priorityGroups[static_cast<int>(task->priority)];
-            SpinLock queueLock {queue.getLock()};
+            SpinLockIrqSave queueLock {queue.getLock(), &RunQueueLock};
 
             queue.append(task);
         }
@@ -397,13 +720,19 @@ namespace Kernel {
 
         if (!startedTasks) return;
 
-        task->cpuId = currentTask->cpuId;
+        /*
+        task->cpuId is left alone so runNextTask can tell
+        whether the task migrated since it last ran
+        */
+        auto targetCPUId = currentTask->cpuId;
+        Trace::record(Trace::EventType::Wakeup, task->id, targetCPUId);
 
         if ((static_cast<int>(task->priority) < static_cast<int>(currentTask->priority))
             || currentTask->priority == Priority::IRQ) {
             
-            if (task->cpuId != CPU::getCurrentCPUId()) {
-                auto apicId = CPU::ActiveCPUs[task->cpuId].apicId;
+            if (targetCPUId != CPU::getCurrentCPUId()) {
+                auto apicId = CPU::ActiveCPUs[targetCPUId].apicId;
+                Trace::record(Trace::EventType::InterprocessorInterrupt, task->id, apicId);
                 APIC::sendInterprocessorInterrupt(apicId, APIC::InterprocessorInterrupt::Reschedule);
             }
             else {
@@ -414,9 +743,9 @@ namespace Kernel {
     }
 
     void Scheduler::setupTimeslice() {
-        auto id = CPU::getCurrentCPUId();
-
-        APIC::setAPICTimer(APIC::LVT_TimerMode::Periodic, timeslice_milliseconds);
+        if (currentTask != nullptr) {
+            armTimer(currentTask, false);
+        }
     }
 
     void Scheduler::changePriority(Task* task, Priority priority) {
@@ -429,7 +758,7 @@ namespace Kernel {
             auto oldPriority = task->priority;
             {
                 auto& queue = priorityGroups[static_cast<int>(task->priority)];
-                SpinLock queueLock {queue.getLock()};
+                SpinLockIrqSave queueLock {queue.getLock(), &RunQueueLock};
                 queue.remove(task);
             }
             task->priority = priority;
@@ -443,38 +772,25 @@ namespace Kernel {
         runNextTask();
     }
 
-    void Scheduler::sendMessage(IPC::RecipientType recipient, IPC::Message* message) {
+    void Scheduler::sendMessage(IPC::RecipientType recipient, IPC::Message* message, bool blockIfFull) {
 
         if (currentTask != nullptr) {
             message->senderTaskId = currentTask->id;
         }
 
         //TODO: implement return value for recipient not found?
-        uint32_t taskId {0};
-
         if (recipient == IPC::RecipientType::ServiceRegistryMailbox) {
             ServiceRegistryInstance->receiveMessage(message);
             return;
         }
 
-        if (recipient == IPC::RecipientType::ServiceName) {
-            taskId = ServiceRegistryInstance->getServiceTaskId(message->serviceType);
+        auto task = findRecipient(recipient, message);
 
-            if (taskId == 0) {
-                kprintf("[Scheduler] Unknown Service Name\n");
-                return;
-            }
-        }
-        else {
-            taskId = message->recipientId;
+        if (task == nullptr) {
+            return;
         }
 
-        auto task = TaskStore::getInstance().getTask(taskId);
-        task->mailbox->send(message);
-
-        if (task->state == TaskState::Blocked) {
-            Director::GetInstance().unblockTask(task);
-        }
+        deliver(task, message, false, blockIfFull);
 
         /*
             auto cpuId = CPU::getCurrentCPUId();
@@ -507,55 +823,528 @@ namespace Kernel {
 
         return;
 
-        kprintf("[Scheduler] Unsent message from: %d to: %d type: %d\n", message->senderTaskId, taskId, recipient);
+        kprintf("[Scheduler] Unsent message from: %d to: %d type: %d\n", message->senderTaskId, message->recipientId, recipient);
         asm("hlt");
     }
 
-    void Scheduler::receiveMessage(IPC::Message* buffer) {
-        if (currentTask != nullptr) {
-            auto task = currentTask;
+    uint32_t Scheduler::sendBatch(IPC::BatchEntry* entries, uint32_t count) {
+
+        if (count > IPC::MaximumBatchSize) {
+            count = IPC::MaximumBatchSize;
+        }
+
+        Task* recipients[IPC::MaximumBatchSize];
+        uint32_t recipientIds[IPC::MaximumBatchSize];
 
-            while (!task->mailbox->receive(buffer)) {
-                Director::GetInstance().blockTask(task, BlockReason::WaitingForMessage);
-                {
-                    auto& queue = priorityGroups[static_cast<int>(task->priority)];
-                    SpinLock queueLock {queue.getLock()};
-                    queue.remove(task);
+        for (auto i = 0u; i < count; i++) {
+            auto& entry = entries[i];
+
+            if (currentTask != nullptr) {
+                entry.message->senderTaskId = currentTask->id;
+            }
+
+            if (entry.recipient == IPC::RecipientType::ServiceRegistryMailbox) {
+                recipients[i] = nullptr;
+            }
+            else {
+                recipients[i] = findRecipient(entry.recipient, entry.message);
+
+                if (recipients[i] != nullptr) {
+                    recipientIds[i] = recipients[i]->id;
                 }
-                reschedule();
             }
         }
+
+        uint32_t delivered {0};
+        auto i = 0u;
+
+        while (i < count) {
+            auto task = recipients[i];
+
+            if (task == nullptr) {
+                if (entries[i].recipient == IPC::RecipientType::ServiceRegistryMailbox) {
+                    ServiceRegistryInstance->receiveMessage(entries[i].message);
+                    delivered++;
+                }
+
+                i++;
+                continue;
+            }
+
+            IPC::Message* run[IPC::MaximumBatchSize];
+            int runLength {0};
+            auto taskId = recipientIds[i];
+
+            while (i < count && recipients[i] == task) {
+                run[runLength++] = entries[i].message;
+                i++;
+            }
+
+            /*
+            An earlier run may have blocked for space, and switching away
+            was a quiescent state, so the pointers above only group entries
+            */
+            task = TaskStore::getInstance().getTask(taskId);
+
+            if (task == nullptr) {
+                continue;
+            }
+
+            auto stored = task->mailbox->sendMultiple(run, runLength);
+
+            for (auto j = 0; j < stored; j++) {
+                Trace::record(Trace::EventType::Send, run[j]->senderTaskId, task->id);
+            }
+
+            //whatever didn't fit goes through the normal path, which waits for space
+            for (auto j = stored; j < runLength; j++) {
+                if (deliver(task, run[j], false, true, false)) {
+                    stored++;
+                }
+                else if (task == nullptr) {
+                    //exited while we waited for space
+                    break;
+                }
+            }
+
+            delivered += stored;
+
+            //same protocol as deliver, so a concurrent send can't queue it twice
+            if (task != nullptr && stored > 0 && task->mailbox->claimWaiter()) {
+                Director::GetInstance().unblockTask(task);
+            }
+        }
+
+        return delivered;
     }
 
-    void Scheduler::receiveMessage(IPC::Message* buffer, IPC::MessageNamespace filter, uint32_t messageId) {
-        if (currentTask != nullptr) {
-            auto task = currentTask;
+    Task* Scheduler::findRecipient(IPC::RecipientType recipient, IPC::Message* message) {
+        uint32_t taskId {0};
+
+        if (recipient == IPC::RecipientType::ServiceName) {
+            taskId = ServiceRegistryInstance->getServiceTaskId(message->serviceType);
+
+            if (taskId == 0) {
+                kprintf("[Scheduler] Unknown Service Name\n");
+                return nullptr;
+            }
+        }
+        else {
+            taskId = message->recipientId;
+        }
+
+        return TaskStore::getInstance().getTask(taskId);
+    }
+
+    bool Scheduler::sendGrant(IPC::RecipientType recipient, IPC::GrantedMessage* message) {
+
+        if (currentTask == nullptr
+            || recipient == IPC::RecipientType::ServiceRegistryMailbox
+            || message->grantPages == 0
+            || message->grantPages > IPC::MaximumGrantPages
+            || (message->grantAddress & (Memory::PageSize - 1)) != 0) {
+            return false;
+        }
+
+        message->senderTaskId = currentTask->id;
+
+        auto task = findRecipient(recipient, message);
+
+        if (task == nullptr) {
+            return false;
+        }
+
+        IPC::GrantedMessage grant;
+        memcpy(&grant, message, sizeof(IPC::GrantedMessage));
+        grant.length = sizeof(IPC::GrantedMessage);
+
+        auto vmm = currentTask->virtualMemoryManager;
+
+        if (!vmm->detachPages(grant.grantAddress, grant.grantPages, grant.frames)) {
+            return false;
+        }
+
+        if (!deliver(task, &grant, true, true)) {
+            //give the pages back to the sender
+            auto flags = static_cast<uint32_t>(Memory::PageTableFlags::AllowWrite)
+                | static_cast<uint32_t>(Memory::PageTableFlags::AllowUserModeAccess);
+
+            for (auto i = 0u; i < grant.grantPages; i++) {
+                auto isLastPage = i == grant.grantPages - 1;
+                vmm->map(grant.grantAddress + i * Memory::PageSize, grant.frames[i], flags, isLastPage);
+            }
+
+            return false;
+        }
+
+        return true;
+    }
+
+    bool Scheduler::deliver(Task*& task, IPC::Message* message, bool granted, bool blockIfFull, bool wakeRecipient) {
+
+        auto taskId = task->id;
+
+        while (true) {
+            auto mustWait = false;
+
+            {
+                SpinLockIrqSave lock {task->blockedSenders.getLock(), &BlockedSendersLock};
+
+                if (task->exiting) {
+                    return false;
+                }
+
+                if (task->mailbox->trySend(message, granted) != IPC::SendResult::Full) {
+                    Trace::record(Trace::EventType::Send, message->senderTaskId, task->id);
+                    break;
+                }
+
+                if (!task->mailbox->canGrow()) {
+                    if (!blockIfFull || currentTask == nullptr || currentTask == task) {
+                        kprintf("[Scheduler] Dropped message to task %d, mailbox is full\n", task->id);
+                        return false;
+                    }
+
+                    /*
+                    Checking for space and joining blockedSenders both happen under
+                    the blockedSenders lock, so the receiver can't drain the
+                    mailbox in between and miss waking us up
+                    */
+                    currentTask->state = TaskState::WaitingToSend;
+                    task->blockedSenders.append(currentTask);
+                    mustWait = true;
+                }
+            }
+
+            if (!mustWait) {
+                /*
+                The mailbox can still grow, but that allocates pages so it
+                can't happen under the lock. If someone else grew it to its
+                limit first, the next pass waits instead
+                */
+                if (!task->mailbox->reserveBlock() && task->mailbox->canGrow()) {
+                    kprintf("[Scheduler] Dropped message to task %d, couldn't grow its mailbox\n", task->id);
+                    return false;
+                }
+
+                continue;
+            }
+
+            reschedule();
+
+            /*
+            Switching away was a quiescent state, so task may have
+            exited and been reclaimed since it was looked up
+            */
+            task = TaskStore::getInstance().getTask(taskId);
+
+            if (task == nullptr) {
+                return false;
+            }
+        }
+
+        if (!wakeRecipient || !task->mailbox->claimWaiter()) {
+            return true;
+        }
+
+        if (blockIfFull && currentTask != nullptr && currentTask->replyTo == task) {
+            //task is waiting on a call to us, so this is the reply
+            currentTask->replyTo = nullptr;
+
+            if (tryHandoff(task)) {
+                return true;
+            }
+        }
+
+        Director::GetInstance().unblockTask(task);
+
+        return true;
+    }
+
+    bool Scheduler::canHandoff(Task* task) {
+
+        /*
+        If task last ran on another CPU, that CPU might not have saved
+        its context yet. On this CPU, any switch away from it has finished
+        */
+        if (task->cpuId != CPU::getCurrentCPUId()) {
+            auto scheduler = CPU::ActiveCPUs[task->cpuId].scheduler;
+
+            if (scheduler->isUsingContext(task)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool Scheduler::tryHandoff(Task* task) {
+
+        if (!canHandoff(task)) {
+            return false;
+        }
+
+        Trace::record(Trace::EventType::Wakeup, task->id, CPU::getCurrentCPUId());
+        nextTask = task;
+        runNextTask(true);
+
+        return true;
+    }
+
+    template<typename F>
+    void Scheduler::waitForMessage(F tryReceive) {
+        auto task = currentTask;
+
+        /*
+        tryReceive must use one of the mailbox's OrWait functions,
+        and marks the mailbox as waiting when it fails. The task is
+        Blocked first, so whoever claims the waiter can wake it even
+        if it hasn't finished switching out
+        */
+        while (true) {
+            task->state = TaskState::Blocked;
+
+            if (tryReceive()) {
+                task->state = TaskState::Running;
+                return;
+            }
+
+            reschedule();
+        }
+    }
+
+    void Scheduler::call(IPC::RecipientType recipient, IPC::Message* message, IPC::Message* buffer, 
+        IPC::MessageNamespace filter, uint32_t messageId) {
+
+        if (currentTask == nullptr || recipient == IPC::RecipientType::ServiceRegistryMailbox) {
+            sendMessage(recipient, message, true);
+            receiveMessage(buffer, filter, messageId);
+            return;
+        }
+
+        message->senderTaskId = currentTask->id;
+        auto task = findRecipient(recipient, message);
+
+        if (task == nullptr || task == currentTask) {
+            return;
+        }
+
+        /*
+        Set before delivering so a reply can't arrive before
+        the recipient knows who to switch back to
+        */
+        task->replyTo = currentTask;
+
+        if (!deliver(task, message, false, true, false)) {
+            return;
+        }
 
-            while (true) {
+        if (task->mailbox->claimWaiter()) {
+            auto caller = currentTask;
 
-                //wake me up
+            if (canHandoff(task)) {
+                bool granted {false};
 
-                if (task->mailbox->filteredReceive(buffer, filter, messageId)) {
-                    //wake me up inside
+                /*
+                Mark the caller as waiting for the reply before switching
+                to the recipient, the same way waitForMessage does
+                */
+                caller->state = TaskState::Blocked;
+
+                if (caller->mailbox->filteredReceiveOrWait(buffer, filter, messageId, &granted)) {
+                    //a matching message was already there
+                    caller->state = TaskState::Running;
+                    Director::GetInstance().unblockTask(task);
+
+                    if (granted) {
+                        acceptGrant(buffer);
+                    }
+
+                    Trace::record(Trace::EventType::Receive, caller->id, buffer->senderTaskId);
+                    wakeBlockedSender(caller);
                     return;
                 }
 
-                //can't wake up
-                Director::GetInstance().blockTask(task, BlockReason::WaitingForMessage);
-                {
-                    auto& queue = priorityGroups[static_cast<int>(task->priority)];
-                    SpinLock queueLock {queue.getLock()};
-                    queue.remove(task);
+                if (!tryHandoff(task)) {
+                    Director::GetInstance().unblockTask(task);
                 }
-                reschedule();
             }
+            else {
+                Director::GetInstance().unblockTask(task);
+            }
+        }
+
+        receiveMessage(buffer, filter, messageId);
+    }
+
+    void Scheduler::wakeBlockedSender(Task* task) {
+
+        Task* sender {nullptr};
+
+        {
+            /*
+            Has to check under the lock deliver holds across send and
+            append, otherwise a sender that just found the mailbox full
+            could join the list right after we saw it empty
+            */
+            SpinLockIrqSave lock {task->blockedSenders.getLock(), &BlockedSendersLock};
+            sender = task->blockedSenders.getHead();
+
+            if (sender != nullptr) {
+                task->blockedSenders.remove(sender);
+            }
+        }
+
+        if (sender != nullptr) {
+            Director::GetInstance().unblockTask(sender);
+        }
+    }
+
+    void Scheduler::wakeAllBlockedSenders(Task* task) {
+
+        LinkedList<Task> senders;
+
+        {
+            SpinLockIrqSave lock {task->blockedSenders.getLock(), &BlockedSendersLock};
+            task->exiting = true;
+
+            auto sender = task->blockedSenders.getHead();
+
+            while (sender != nullptr) {
+                task->blockedSenders.remove(sender);
+                senders.append(sender);
+                sender = task->blockedSenders.getHead();
+            }
+        }
+
+        //unblockTask links them onto a run queue, so they come off this list first
+        auto sender = senders.getHead();
+
+        while (sender != nullptr) {
+            senders.remove(sender);
+            Director::GetInstance().unblockTask(sender);
+            sender = senders.getHead();
+        }
+    }
+
+    void Scheduler::freeUnreceivedGrants() {
+
+        auto vmm = currentTask->virtualMemoryManager;
+        IPC::MaximumMessageBuffer buffer;
+        bool granted {false};
+
+        while (currentTask->mailbox->receive(&buffer, &granted)) {
+            if (!granted) {
+                continue;
+            }
+
+            //map them like a normal receive, so freePages can release them
+            acceptGrant(&buffer);
+
+            auto grant = reinterpret_cast<IPC::GrantedMessage*>(&buffer);
+            vmm->freePages(grant->grantAddress, grant->grantPages);
+        }
+    }
+
+    void Scheduler::acceptGrant(IPC::Message* buffer) {
+        /*
+        Called from the receiving task's context, so its VMM
+        is the active one
+        */
+        auto grant = static_cast<IPC::GrantedMessage*>(buffer);
+        auto vmm = currentTask->virtualMemoryManager;
+        auto address = vmm->allocatePages(grant->grantPages, static_cast<uint32_t>(Memory::PageTableFlags::AllowWrite));
+
+        for (auto i = 0u; i < grant->grantPages; i++) {
+            auto isLastPage = i == grant->grantPages - 1;
+            vmm->map(address + i * Memory::PageSize, grant->frames[i], 0, isLastPage);
+            grant->frames[i] = 0;
+        }
+
+        grant->grantAddress = address;
+    }
+
+    uint32_t Scheduler::receiveBatch(IPC::MaximumMessageBuffer* buffers, uint32_t count) {
+        if (currentTask == nullptr || count == 0) {
+            return 0;
+        }
+
+        if (count > IPC::MaximumBatchSize) {
+            count = IPC::MaximumBatchSize;
+        }
+
+        auto task = currentTask;
+        bool granted {false};
+        int received {0};
+
+        waitForMessage([&]() {
+            received = task->mailbox->receiveMultipleOrWait(buffers, count, &granted);
+            return received > 0;
+        });
+
+        if (granted) {
+            acceptGrant(buffers);
+        }
+
+        for (int i = 0; i < received; i++) {
+            Trace::record(Trace::EventType::Receive, task->id, buffers[i].senderTaskId);
+            wakeBlockedSender(task);
+        }
+
+        return received;
+    }
+
+    void Scheduler::receiveMessage(IPC::Message* buffer) {
+        if (currentTask != nullptr) {
+            auto task = currentTask;
+            bool granted {false};
+
+            waitForMessage([&]() {
+                return task->mailbox->receiveOrWait(buffer, &granted);
+            });
+
+            if (granted) {
+                acceptGrant(buffer);
+            }
+
+            Trace::record(Trace::EventType::Receive, task->id, buffer->senderTaskId);
+            wakeBlockedSender(task);
+        }
+    }
+
+    void Scheduler::receiveMessage(IPC::Message* buffer, IPC::MessageNamespace filter, uint32_t messageId) {
+        if (currentTask != nullptr) {
+            auto task = currentTask;
+            bool granted {false};
+
+            waitForMessage([&]() {
+                return task->mailbox->filteredReceiveOrWait(buffer, filter, messageId, &granted);
+            });
+
+            if (granted) {
+                acceptGrant(buffer);
+            }
+
+            Trace::record(Trace::EventType::Receive, task->id, buffer->senderTaskId);
+            wakeBlockedSender(task);
         }
     }
 
     bool Scheduler::peekReceiveMessage(IPC::Message* buffer) {
         if (currentTask != nullptr) {
+            bool granted {false};
+            auto received = currentTask->mailbox->receive(buffer, &granted);
+
+            if (granted) {
+                acceptGrant(buffer);
+            }
+
+            if (received) {
+                Trace::record(Trace::EventType::Receive, currentTask->id, buffer->senderTaskId);
+                wakeBlockedSender(currentTask);
+            }
 
-            return currentTask->mailbox->receive(buffer);
+            return received;
         }
 
         return false;
@@ -587,7 +1376,12 @@ namespace Kernel {
         }*/
 
         //idGenerator.freeId(currentTask->id);
-        CurrentTaskLauncher->freeUserTask(currentTask);
+        TaskStore::getInstance().removeTask(currentTask->id);
+        wakeAllBlockedSenders(currentTask);
+        freeUnreceivedGrants();
+        currentTask->reclaim.function = reclaimUserTask;
+        currentTask->reclaim.argument = currentTask;
+        RCU::defer(&currentTask->reclaim);
 
         currentTask->state = TaskState::Blocked;
         priorityGroups[static_cast<int>(currentTask->priority)].remove(currentTask);
@@ -613,7 +1407,12 @@ namespace Kernel {
         LibC_Implementation::KernelHeap = kernelHeap;*/
 
         //idGenerator.freeId(currentTask->id);
-        CurrentTaskLauncher->freeKernelTask(currentTask);
+        TaskStore::getInstance().removeTask(currentTask->id);
+        wakeAllBlockedSenders(currentTask);
+        freeUnreceivedGrants();
+        currentTask->reclaim.function = reclaimKernelTask;
+        currentTask->reclaim.argument = currentTask;
+        RCU::defer(&currentTask->reclaim);
 
         currentTask->state = TaskState::Blocked;
         priorityGroups[static_cast<int>(currentTask->priority)].remove(currentTask);
@@ -627,6 +1426,7 @@ namespace Kernel {
     void Scheduler::start() {
 
         startTask->virtualMemoryManager = Memory::getCurrentVMM();
+        startTimestamp = TSC::getTimestamp();
         scheduleNextTask();
         startedTasks = true;
         runNextTask();
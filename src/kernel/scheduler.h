@@ -31,6 +31,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <task_context.h>
 #include <vector>
 #include "list.h"
+#include "timerWheel.h"
+#include "trace.h"
 
 namespace Memory {
     class VirtualMemoryManager;
@@ -39,6 +41,9 @@ namespace Memory {
 namespace IPC {
     class Mailbox;
     struct Message;
+    struct GrantedMessage;
+    struct MaximumMessageBuffer;
+    struct BatchEntry;
     enum class RecipientType;
     enum class MessageNamespace : uint32_t;
 }
@@ -61,6 +66,22 @@ namespace Kernel {
     struct Task;
     enum class Priority;
 
+    /*
+    Counters exposed through /process/scheduler so load balancing
+    can be observed from userland. steals counts tasks this core
+    pulled from another core's run queue, migrations counts how
+    often a task ran here after last running on a different core.
+    interrupts counts every interrupt this core handled, and
+    interruptsPerSecond is averaged over the last window of at
+    least a second, so an idle core drops towards zero.
+    */
+    struct SchedulerStatistics {
+        uint32_t steals {0};
+        uint32_t migrations {0};
+        uint32_t interrupts {0};
+        uint32_t interruptsPerSecond {0};
+    };
+
     class Scheduler {
     public:
 
@@ -76,7 +97,54 @@ namespace Kernel {
         void start();
         void setupTimeslice();
 
-        void sendMessage(IPC::RecipientType recipient, IPC::Message* message);
+        /*
+        If the recipient's mailbox is full, blockIfFull makes the current
+        task wait until the recipient receives a message, otherwise
+        the message is dropped. Only pass true from a task's own
+        context, never from an interrupt handler
+        */
+        void sendMessage(IPC::RecipientType recipient, IPC::Message* message, bool blockIfFull = false);
+
+        /*
+        Detaches the message's pages from the current task and
+        delivers the message. The pages are mapped into the recipient
+        when it receives the message. Returns false if the grant
+        was invalid or the recipient couldn't be found
+        */
+        bool sendGrant(IPC::RecipientType recipient, IPC::GrantedMessage* message);
+
+        /*
+        Sends a message and waits for a reply with the given namespace
+        and messageId. If the recipient is blocked waiting for messages,
+        this CPU switches directly to it instead of going through the
+        Director, and the recipient's reply switches straight back.
+        The recipient runs for the rest of the caller's timeslice
+        */
+        void call(IPC::RecipientType recipient, IPC::Message* message, IPC::Message* buffer, 
+            IPC::MessageNamespace filter, uint32_t messageId);
+
+        /*
+        Whether this scheduler might still be using task's saved
+        context, ie its running it or hasn't finished switching away
+        */
+        bool isUsingContext(Task* task) {
+            return task == currentTask || task == switchingOutTask;
+        }
+
+        /*
+        Sends up to IPC::MaximumBatchSize messages in one go. Consecutive
+        entries for the same recipient are stored with one mailbox lock
+        acquisition, and the recipient is only woken once. Returns how
+        many messages were delivered
+        */
+        uint32_t sendBatch(IPC::BatchEntry* entries, uint32_t count);
+
+        /*
+        Blocks until there is at least one message, then receives up to
+        count of them at once. Returns how many were received
+        */
+        uint32_t receiveBatch(IPC::MaximumMessageBuffer* buffers, uint32_t count);
+
         void receiveMessage(IPC::Message* buffer);
         void receiveMessage(IPC::Message* buffer, IPC::MessageNamespace filter, uint32_t messageId);
         bool peekReceiveMessage(IPC::Message* buffer);
@@ -95,22 +163,124 @@ namespace Kernel {
 
         int getPriorityScore(Task* pending);
 
+        /*
+        Returns how many tasks are waiting in this scheduler's
+        non-idle run queues. This is read without taking the
+        queue locks, so its only meant as a load estimate
+        */
+        int getQueuedTaskCount();
+
+        /*
+        Called by another core's scheduler that ran out of work.
+        Removes the task at the tail of the highest priority
+        non-empty queue, or returns nullptr if there is nothing
+        that can be given away
+        */
+        Task* surrenderTask();
+
+        SchedulerStatistics getStatistics() {
+            return statistics;
+        }
+
+        void countInterrupt() {
+            statistics.interrupts++;
+        }
+
+        /*
+        Only this scheduler's CPU records into its trace, other
+        CPUs may read it at any time
+        */
+        Trace::Ring& getTrace() {
+            return trace;
+        }
+
     private:
 
         void scheduleNextTask();
-        Task* findNextTask();
-        void runNextTask();
+        Task* takeNextTask();
+
+        /*
+        keepTimeslice is for call/reply handoffs, where next runs
+        out the rest of the current task's timeslice instead of
+        starting a fresh one
+        */
+        void runNextTask(bool keepTimeslice = false);
+
+        void updateElapsedTime();
+        void updateInterruptRate();
+
+        /*
+        Programs a one-shot timer for whichever comes first, the end
+        of next's timeslice or the next sleeping task's wakeTime. The
+        idle task has no timeslice, so with no sleepers the timer is
+        stopped and the core only wakes for other interrupts.
+        With keepTimeslice, next inherits the current deadline
+        */
+        void armTimer(Task* next, bool keepTimeslice);
+
+        /*
+        Updates the run queue latency of next and the run time of
+        previous, and records the switch in the trace
+        */
+        void recordSwitch(Task* previous, Task* next);
         
         void unblockTask(Task* task);
         void unblockWakeableTasks();
 
+        Task* findRecipient(IPC::RecipientType recipient, IPC::Message* message);
+
+        /*
+        If the mailbox is full and blockIfFull is set, waits for space
+        and then looks task up again, since it may have exited in the
+        meantime. task is updated, and is nullptr if it did exit
+        */
+        bool deliver(Task*& task, IPC::Message* message, bool granted, bool blockIfFull, bool wakeRecipient = true);
+        void wakeBlockedSender(Task* task);
+
+        /*
+        Wakes every sender blocked on an exiting task. They look
+        it up again, don't find it, and give up on the send
+        */
+        void wakeAllBlockedSenders(Task* task);
+
+        /*
+        Gives the pages of every GrantedMessage the exiting current
+        task never received back to the PMM. Once wakeAllBlockedSenders
+        has run nothing else can be delivered, so none are missed
+        */
+        void freeUnreceivedGrants();
+        bool canHandoff(Task* task);
+
+        /*
+        Switches straight to task, which must have just been claimed
+        from its mailbox's waiter. The current task goes back on a run
+        queue unless its state was already changed from Running
+        */
+        bool tryHandoff(Task* task);
+
+        /*
+        Calls tryReceive until it succeeds, blocking the current
+        task in between
+        */
+        template<typename F>
+        void waitForMessage(F tryReceive);
+        void acceptGrant(IPC::Message* buffer);
+
         Task* currentTask {nullptr};
         Task* nextTask {nullptr};
         Task* startTask {nullptr};
         Task* cleanupTask {nullptr};
+
+        /*
+        The task that was most recently switched away from. It
+        gets appended to a run queue before changeProcess has
+        saved its context, so it must not be surrendered until
+        the next switch
+        */
+        Task* switchingOutTask {nullptr};
         //Task* schedulerTask {nullptr};
         LinkedList<Task> readyQueue;
-        LinkedList<Task> sleepingTasks;
+        TimerWheel<Task> sleepingTasks;
         //LinkedList<Task> deleteQueue;
 
         LinkedList<Task> priorityGroups[6];
@@ -118,8 +288,24 @@ namespace Kernel {
         uint64_t elapsedTime_milliseconds;
         uint32_t timeslice_milliseconds;
 
+        //when the running timeslice ends, NoExpiry for the idle task
+        uint64_t timesliceDeadline_milliseconds {TimerWheel<Task>::NoExpiry};
+
+        /*
+        elapsedTime is measured with the TSC from here, rather than
+        counting timer interrupts, since they no longer come at a
+        fixed rate
+        */
+        uint64_t startTimestamp {0};
+
+        uint64_t rateWindowStart_milliseconds {0};
+        uint32_t rateWindowInterrupts {0};
+
         State state {State::StartCurrent};
 
+        SchedulerStatistics statistics;
+        Trace::Ring trace;
+
         bool startedTasks {false};
     };
 }
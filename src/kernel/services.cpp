@@ -36,6 +36,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <task.h>
 #include <system_calls.h>
 #include <memory/guard.h>
+#include <rcu.h>
+#include "director.h"
 
 namespace Kernel {
 
@@ -111,6 +113,14 @@ namespace Kernel {
                         
                         break;
                     }
+                    case MessageId::UnmapMemory: {
+                        auto request = IPC::extractMessage<UnmapMemory>(
+                            *static_cast<IPC::MaximumMessageBuffer*>(message));
+
+                        handleUnmapMemory(request);
+
+                        break;
+                    }
                     case MessageId::ShareMemoryRequest: {
                         auto request = IPC::extractMessage<ShareMemoryRequest>(
                             *static_cast<IPC::MaximumMessageBuffer*>(message));
@@ -139,14 +149,14 @@ namespace Kernel {
 
         auto index = static_cast<uint32_t>(type);
 
-        if (knownServices[index].taskId != 0) {
+        if (serviceTaskIds[index] != 0) {
             kprintf("[ServiceRegistry] Tried to register a service[%d] that's taken\n", index);
             return false;
         }
 
         setupService(taskId, type);
 
-        knownServices[index].taskId = taskId;
+        RCU::assign(serviceTaskIds[index], taskId);
         return true;
     }
 
@@ -195,7 +205,7 @@ namespace Kernel {
         auto lastService = static_cast<uint32_t>(ServiceType::ServiceTypeEnd);
 
         for (auto i = 0u; i < lastService; i++) {
-            if (knownServices[i].taskId == senderTaskId) {
+            if (serviceTaskIds[i] == senderTaskId) {
                 knownServices[i].isReady = true;
                 notifySubscribers(i);
                 break;
@@ -220,14 +230,22 @@ namespace Kernel {
 
         auto currentTask = CPU::getTask(request.senderTaskId);
         auto vmm = currentTask->virtualMemoryManager;
-        auto cachedNextAddress = vmm->HACK_getNextAddress();
+        uintptr_t allocatedAddress {0};
 
-        /*
-        TODO: just a hacked up implementation to get the elf loader test working
-        */
-        vmm->HACK_setNextAddress(request.address);
-        auto allocatedAddress = vmm->allocatePages(request.size, request.flags);
-        vmm->HACK_setNextAddress(cachedNextAddress);
+        if (request.address == 0) {
+            //anywhere will do
+            allocatedAddress = vmm->allocatePages(request.size, request.flags);
+        }
+        else {
+            auto cachedNextAddress = vmm->HACK_getNextAddress();
+
+            /*
+            TODO: just a hacked up implementation to get the elf loader test working
+            */
+            vmm->HACK_setNextAddress(request.address);
+            allocatedAddress = vmm->allocatePages(request.size, request.flags);
+            vmm->HACK_setNextAddress(cachedNextAddress);
+        }
 
         MapMemoryResult result;
         result.senderTaskId = request.senderTaskId;
@@ -237,6 +255,24 @@ namespace Kernel {
         currentTask->mailbox->send(&result);
     }
 
+    void handleUnmapMemory(UnmapMemory request) {
+
+        /*
+        Like handleMapMemory, this expects the sender's VMM
+        to be the active one
+        */
+
+        auto currentTask = CPU::getTask(request.senderTaskId);
+        auto vmm = currentTask->virtualMemoryManager;
+        vmm->freePages(request.address, request.pageCount);
+
+        UnmapMemoryResult result;
+        result.senderTaskId = request.senderTaskId;
+        result.recipientId = request.senderTaskId;
+
+        currentTask->mailbox->send(&result);
+    }
+
     void handleShareMemoryRequest(ShareMemoryRequest request) {
 
         /*
@@ -297,19 +333,22 @@ namespace Kernel {
             );
 
             recipientTask->mailbox->send(&result);
+
+            //the recipient is another task, most likely blocked in receive
+            if (recipientTask->mailbox->claimWaiter()) {
+                Director::GetInstance().unblockTask(recipientTask);
+            }
         }
     }
 
     uint32_t ServiceRegistry::getServiceTaskId(ServiceType type) {
 
-        MemoryGuard guard {kernelVMM};
-
-        if (type == ServiceType::ServiceTypeEnd) {
+        if (type >= ServiceType::ServiceTypeEnd) {
             kprintf("[ServiceRegistry] Tried to get ServiceTypeEnd taskId\n");
             return 0;
         }
 
-        return knownServices[static_cast<uint32_t>(type)].taskId;
+        return RCU::dereference(serviceTaskIds[static_cast<uint32_t>(type)]);
     }
 
     bool ServiceRegistry::handleDriverIrq(uint32_t irq) {
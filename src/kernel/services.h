@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 #include <ipc.h>
 #include <memory/block_allocator.h>
+#include <saturn/heap.h>
 
 namespace Memory {
     class VirtualMemoryManager;
@@ -71,10 +72,21 @@ namespace Kernel {
         LinearFrameBufferFound,
         MapMemory,
         MapMemoryResult,
+        UnmapMemory,
+        UnmapMemoryResult,
         ShareMemoryRequest,
         ShareMemoryInvitation,
         ShareMemoryResponse,
-        ShareMemoryResult
+        ShareMemoryResult,
+        GetSchedulerStatistics,
+        SchedulerStatisticsResult,
+        SetMailboxPolicy,
+        GetTaskSchedulingStatistics,
+        TaskSchedulingStatisticsResult,
+        DumpSchedulerTrace,
+        GetTaskHeapStatistics,
+        TaskHeapStatisticsResult,
+        SetTaskHeapSampling
     };
 
     struct RegisterService : IPC::Message {
@@ -214,6 +226,135 @@ namespace Kernel {
         uint32_t pid;
     };
 
+    struct GetSchedulerStatistics : IPC::Message {
+        GetSchedulerStatistics() {
+            messageId = static_cast<uint32_t>(MessageId::GetSchedulerStatistics);
+            length = sizeof(GetSchedulerStatistics);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+    };
+
+    inline constexpr uint32_t MaxStatisticsCPUs {16};
+
+    /*
+    Totals of every core's SchedulerStatistics, except interrupt
+    rates which are reported per core
+    */
+    struct SchedulerStatisticsResult : IPC::Message {
+        SchedulerStatisticsResult() {
+            messageId = static_cast<uint32_t>(MessageId::SchedulerStatisticsResult);
+            length = sizeof(SchedulerStatisticsResult);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+        uint32_t steals {0};
+        uint32_t migrations {0};
+        uint32_t cpuCount {0};
+        uint32_t interruptsPerSecond[MaxStatisticsCPUs] {};
+    };
+
+    struct GetTaskSchedulingStatistics : IPC::Message {
+        GetTaskSchedulingStatistics() {
+            messageId = static_cast<uint32_t>(MessageId::GetTaskSchedulingStatistics);
+            length = sizeof(GetTaskSchedulingStatistics);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+        uint32_t taskId {0};
+    };
+
+    inline constexpr uint32_t SchedulingHistogramBuckets {20};
+
+    /*
+    A task's run queue latency and run time histograms. Bucket 0
+    counts anything under 2us, bucket i counts [2^i, 2^(i+1)) us,
+    and the last bucket also counts everything longer
+    */
+    struct TaskSchedulingStatisticsResult : IPC::Message {
+        TaskSchedulingStatisticsResult() {
+            messageId = static_cast<uint32_t>(MessageId::TaskSchedulingStatisticsResult);
+            length = sizeof(TaskSchedulingStatisticsResult);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+        bool found {false};
+        uint32_t runQueueLatency[SchedulingHistogramBuckets] {};
+        uint32_t runTime[SchedulingHistogramBuckets] {};
+    };
+
+    /*
+    Writes every CPU's scheduler trace to the serial port,
+    see Kernel::Trace::dump
+    */
+    struct DumpSchedulerTrace : IPC::Message {
+        DumpSchedulerTrace() {
+            messageId = static_cast<uint32_t>(MessageId::DumpSchedulerTrace);
+            length = sizeof(DumpSchedulerTrace);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+    };
+
+    struct GetTaskHeapStatistics : IPC::Message {
+        GetTaskHeapStatistics() {
+            messageId = static_cast<uint32_t>(MessageId::GetTaskHeapStatistics);
+            length = sizeof(GetTaskHeapStatistics);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+        uint32_t taskId {0};
+    };
+
+    /*
+    A copy of a task's Saturn::Memory::HeapStatistics. found
+    is false if the task doesn't exist or has no heap
+    */
+    struct TaskHeapStatisticsResult : IPC::Message {
+        TaskHeapStatisticsResult() {
+            messageId = static_cast<uint32_t>(MessageId::TaskHeapStatisticsResult);
+            length = sizeof(TaskHeapStatisticsResult);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+        bool found {false};
+        Saturn::Memory::HeapStatistics statistics {};
+    };
+
+    /*
+    Records every sampleInterval'th allocation made by the
+    task's heap, or stops sampling if it's 0
+    */
+    struct SetTaskHeapSampling : IPC::Message {
+        SetTaskHeapSampling() {
+            messageId = static_cast<uint32_t>(MessageId::SetTaskHeapSampling);
+            length = sizeof(SetTaskHeapSampling);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+        uint32_t taskId {0};
+        uint32_t sampleInterval {0};
+    };
+
+    /*
+    Changes how the sender's own mailbox handles bursts of messages.
+    A messageLimit of 0 leaves the limit unchanged, and one above
+    MaximumMailboxMessageLimit is clamped to it. If coalesce isn't
+    None, unread messages matching coalesceNamespace and
+    coalesceMessageId are merged using that policy
+    */
+    struct SetMailboxPolicy : IPC::Message {
+        SetMailboxPolicy() {
+            messageId = static_cast<uint32_t>(MessageId::SetMailboxPolicy);
+            length = sizeof(SetMailboxPolicy);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+        int messageLimit {0};
+        IPC::CoalescePolicy coalesce {IPC::CoalescePolicy::None};
+        IPC::MessageNamespace coalesceNamespace;
+        uint32_t coalesceMessageId {0};
+    };
+
     struct LinearFrameBufferFound : IPC::Message {
         LinearFrameBufferFound() {
             messageId = static_cast<uint32_t>(MessageId::LinearFrameBufferFound);
@@ -246,6 +387,29 @@ namespace Kernel {
         void* start;
     };
 
+    /*
+    Frees the physical pages behind a range of the sender's memory,
+    which stays reserved and is backed again on the next touch
+    */
+    struct UnmapMemory : IPC::Message {
+        UnmapMemory() {
+            messageId = static_cast<uint32_t>(MessageId::UnmapMemory);
+            length = sizeof(UnmapMemory);
+            messageNamespace = IPC::MessageNamespace::ServiceRegistry;
+        }
+
+        uintptr_t address;
+        uint32_t pageCount;
+    };
+
+    struct UnmapMemoryResult : IPC::Message {
+        UnmapMemoryResult() {
+            messageId = static_cast<uint32_t>(MessageId::UnmapMemoryResult);
+            length = sizeof(UnmapMemoryResult);
+            messageNamespace = IPC::MessageNamespace::ServiceRegistry;
+        }
+    };
+
     /*
     NOTE: For the ShareXY messages,
     A refers to the task that wants to share memory
@@ -344,7 +508,6 @@ namespace Kernel {
     inline uint32_t ServiceRegistryMailbox {0};
 
     struct ServiceHandle {
-        uint32_t taskId {0};
         bool isReady {false};
         uint32_t* subscribers {nullptr};
         int subscriberCount {0};
@@ -373,6 +536,10 @@ namespace Kernel {
         in its own service, so the current heap when invoking a registry
         function is most likely a user task's heap, so the registry's
         member variables would be garbage.
+
+        getServiceTaskId is the exception, it runs on every send to a
+        service name and only reads serviceTaskIds, which is stored
+        in the registry itself rather than on the kernel heap.
         */
         void receiveMessage(IPC::Message* message);
         uint32_t getServiceTaskId(ServiceType type);
@@ -392,6 +559,12 @@ namespace Kernel {
         ServiceHandle* knownServices; 
         uint32_t* driverTaskIds;
 
+        /*
+        Published with RCU::assign once a service registers, and
+        never changed after that, so lookups don't need a lock
+        */
+        uint32_t serviceTaskIds[static_cast<int>(ServiceType::ServiceTypeEnd)] {};
+
         KnownHardwareAddresses addresses;
 
         Memory::VirtualMemoryManager* kernelVMM;
@@ -401,5 +574,6 @@ namespace Kernel {
     };
 
     void handleMapMemory(MapMemory request);
+    void handleUnmapMemory(UnmapMemory request);
     void handleShareMemoryRequest(ShareMemoryRequest request);
 }
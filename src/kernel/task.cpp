@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory/physical_memory_manager.h>
 #include <cpu/cpu.h>
 #include <locks.h>
+#include <stdio.h>
 
 #include <saturn/heap.h>
 
@@ -119,7 +120,9 @@ namespace Kernel {
         : stackAllocator {Memory::InitialKernelVMM},
             smallStackAllocator {Memory::InitialKernelVMM},
             taskAllocator {Memory::InitialKernelVMM},
+            sseAllocator {Memory::InitialKernelVMM},
             mailboxAllocator {Memory::InitialKernelVMM},
+            messageBlockAllocator {Memory::InitialKernelVMM},
             vmmAllocator {Memory::InitialKernelVMM},
             kernelTSS {kernelTSS}
         {
@@ -199,11 +202,12 @@ namespace Kernel {
         //task->tss = kernelTSS;
         task->kernelStack = kernelStack;
         task->mailbox = &mailboxAllocator.allocate()->box;
+        task->mailbox->setBlockSource(&messageBlockAllocator, DefaultMailboxMessageLimit);
 
         adjustStack<KernelStackExtras>(task, {reinterpret_cast<uintptr_t>(callExitKernelTask)});
 
-        //auto sseMemory = task->heap->aligned_allocate(16, sizeof(SSEContext));
-        //task->sseContext = new (sseMemory) SSEContext;
+        //zeroed, so an XRSTOR of it puts the FPU in its initial state
+        task->sseContext = sseAllocator.allocate();
 
         return task;
     }
@@ -241,8 +245,6 @@ namespace Kernel {
 
         task->heap = Saturn::Memory::createHeap(Memory::PageSize * Memory::PageSize, vmm);
 
-        //auto sseMemory = task->heap->aligned_allocate(16, sizeof(SSEContext));
-        //task->sseContext = new (sseMemory) SSEContext;
         auto userStackPointer = getStackPointer(stack) + sizeof(InitialKernelStack);
         userStackPointer -= sizeof(TaskStack);
 
@@ -266,12 +268,36 @@ namespace Kernel {
         //TODO
     }
 
+    MessageBlockAllocator::MessageBlockAllocator(Memory::VirtualMemoryManager* vmm)
+        : vmm {vmm}, allocator {vmm} {
+    }
+
+    IPC::MessageBlock* MessageBlockAllocator::allocateBlock() {
+        SpinLock spin {&lock};
+        MemoryGuard guard {vmm};
+
+        return allocator.allocate();
+    }
+
+    void MessageBlockAllocator::freeBlock(IPC::MessageBlock* block) {
+        SpinLock spin {&lock};
+        MemoryGuard guard {vmm};
+
+        allocator.free(block);
+    }
+
     TaskStore* TaskStore::instance = nullptr;
 
     TaskStore::TaskStore() 
-        : blockAllocator {Memory::InitialKernelVMM, 1} {
-        blocks[0] = blockAllocator.allocate();
-        maxIds = TaskBlock::IdsPerBlock;
+        : blockAllocator {Memory::InitialKernelVMM, MaxBlocks} {
+
+        /*
+        Blocks are allocated up front since tasks are stored while
+        a new task's address space is active
+        */
+        for (auto i = 0; i < MaxBlocks; i++) {
+            blocks[i] = blockAllocator.allocate();
+        }
 
         if (instance == nullptr) {
             instance = this;
@@ -283,26 +309,49 @@ namespace Kernel {
     }
 
     Task* TaskStore::getTask(uint32_t id) {
-        if (id >= maxIds) {
+        if (id >= MaxBlocks * TaskBlock::IdsPerBlock) {
             return nullptr;
         }
 
         auto blockId = id / TaskBlock::IdsPerBlock;
         auto taskId = id % TaskBlock::IdsPerBlock;
 
-        return blocks[blockId]->tasks[taskId];
+        return RCU::dereference(blocks[blockId]->tasks[taskId]);
     }
 
     void TaskStore::storeTask(Task* task) {
         auto id = task->id;
 
-        if (id >= maxIds) {
-            //panic();
+        if (id >= MaxBlocks * TaskBlock::IdsPerBlock) {
+            kprintf("[TaskStore] Tried to store task %d, which is out of range\n", id);
+            return;
         }
 
         auto blockId = id / TaskBlock::IdsPerBlock;
         auto taskId = id % TaskBlock::IdsPerBlock;
 
-        blocks[blockId]->tasks[taskId] = task;
+        RCU::assign(blocks[blockId]->tasks[taskId], task);
+    }
+
+    void TaskStore::removeTask(uint32_t id) {
+        if (id >= MaxBlocks * TaskBlock::IdsPerBlock) {
+            return;
+        }
+
+        auto blockId = id / TaskBlock::IdsPerBlock;
+        auto taskId = id % TaskBlock::IdsPerBlock;
+
+        RCU::assign(blocks[blockId]->tasks[taskId], static_cast<Task*>(nullptr));
+    }
+}
+
+namespace Saturn::Memory {
+
+    /*
+    Kernel tasks' heaps can free their pages directly,
+    see libc for the usermode version
+    */
+    void releasePages(uintptr_t address, uint32_t pageCount) {
+        ::Memory::getCurrentVMM()->freePages(address, pageCount);
     }
 }
@@ -34,6 +34,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory/block_allocator.h>
 #include <memory/virtual_memory_manager.h>
 #include "ipc.h"
+#include "list.h"
+#include "trace.h"
+#include "rcu.h"
 
 namespace Saturn::Memory {
     class Heap;
@@ -45,7 +48,8 @@ namespace Kernel {
         Running,
         ReadyToRun,
         Sleeping,
-        Blocked
+        Blocked,
+        WaitingToSend
     };
 
     struct InitialKernelStack {
@@ -69,8 +73,12 @@ namespace Kernel {
         uint32_t eip {0};
     };
 
-    struct alignas(16) SSEContext {
-        uint8_t data[512];
+    /*
+    Big enough for an FXSAVE image, plus the XSAVE header that
+    follows it, see CPU::initializeFPU
+    */
+    struct alignas(64) SSEContext {
+        uint8_t data[512 + 64];
     };
 
     struct KernelStackExtras {
@@ -104,6 +112,13 @@ namespace Kernel {
         uint32_t id {0};
         TaskState state;
         uint64_t wakeTime {0};
+
+        /*
+        Links the task into its scheduler's TimerWheel while sleeping
+        */
+        Task* nextTimer {nullptr};
+        Task* previousTimer {nullptr};
+        int timerSlot {-1};
         Memory::VirtualMemoryManager* virtualMemoryManager;
         Saturn::Memory::Heap* heap;
         IPC::Mailbox* mailbox;
@@ -113,6 +128,45 @@ namespace Kernel {
         uint8_t cpuId {0};
         uint8_t oldCPUId {0};
         int timesSwitchedTo {0};
+
+        /*
+        Tasks that tried to send to this task while its
+        mailbox was full, woken as it receives messages
+        */
+        LinkedList<Task> blockedSenders;
+
+        //set under blockedSenders' lock, so nobody joins it after it's drained
+        bool exiting {false};
+
+        /*
+        The last task that made a call to this task. When this task
+        sends it a message, the CPU switches straight back to it
+        */
+        Task* replyTo {nullptr};
+
+        /*
+        How long the task waits on a run queue before running, and how
+        long it runs before switching out, exposed through
+        /process/<pid>/sched. readySince and runningSince are TSC
+        timestamps, readySince is 0 while the task isn't queued
+        */
+        Trace::Histogram runQueueLatency;
+        Trace::Histogram runTime;
+        uint64_t readySince {0};
+        uint64_t runningSince {0};
+
+        /*
+        Frees the task once it has been removed from the TaskStore
+        and no core can still be looking it up
+        */
+        RCU::Callback reclaim;
+
+        /*
+        Whether sseContext holds anything yet, and which core last
+        loaded it into its registers, see CPU::switchFPU
+        */
+        bool usedFPU {false};
+        int fpuCPUId {-1};
     };
 
     /*
@@ -144,6 +198,36 @@ namespace Kernel {
         }
     };
 
+    /*
+    How many messages a task's mailbox may grow to hold, unless
+    the task asks for a different limit with SetMailboxPolicy
+    */
+    inline constexpr int DefaultMailboxMessageLimit {256};
+
+    /*
+    The most a task can raise its own limit to, since every
+    block comes out of the kernel's address space
+    */
+    inline constexpr int MaximumMailboxMessageLimit {1024};
+
+    /*
+    Lets mailboxes grow using blocks allocated from the kernel VMM
+    */
+    class MessageBlockAllocator : public IPC::MessageBlockSource {
+    public:
+
+        MessageBlockAllocator(Memory::VirtualMemoryManager* vmm);
+
+        IPC::MessageBlock* allocateBlock() override;
+        void freeBlock(IPC::MessageBlock* block) override;
+
+    private:
+
+        Memory::VirtualMemoryManager* vmm;
+        BlockAllocator<IPC::MessageBlock> allocator;
+        uint32_t lock {0};
+    };
+
     class TaskLauncher {
     public:
 
@@ -164,7 +248,9 @@ namespace Kernel {
         BlockAllocator<Stack> stackAllocator;
         BlockAllocator<SmallStack> smallStackAllocator;
         BlockAllocator<Task> taskAllocator;
+        BlockAllocator<SSEContext> sseAllocator;
         BlockAllocator<BufferedMailbox> mailboxAllocator;
+        MessageBlockAllocator messageBlockAllocator;
         BlockAllocator<Memory::VirtualMemoryManager> vmmAllocator;
 
         uint32_t lock {0};
@@ -175,6 +261,12 @@ namespace Kernel {
         Task* tasks[IdsPerBlock];
     };
 
+    /*
+    Maps task ids to tasks. getTask runs on every message send, so
+    it's wait-free: slots are published with RCU::assign, and a
+    removed task is only reclaimed after an RCU grace period, see
+    Scheduler::exitTask
+    */
     class TaskStore {
     public:
 
@@ -184,13 +276,16 @@ namespace Kernel {
 
         Task* getTask(uint32_t id);
         void storeTask(Task* task);
+        void removeTask(uint32_t id);
 
     private:
 
+        //enough for every id IdGenerator can hand out
+        static const int MaxBlocks {2};
+
         static TaskStore* instance;
-        TaskBlock* blocks[1];
+        TaskBlock* blocks[MaxBlocks];
         BlockAllocator<TaskBlock> blockAllocator;
-        int maxIds;
     };
 
     inline TaskLauncher* CurrentTaskLauncher;
@@ -0,0 +1,298 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+namespace Kernel {
+
+    /*
+    A hierarchical timer wheel for things that need to happen at
+    some time in the future, like waking sleeping tasks. Inserting
+    and cancelling are O(1), and advancing only looks at the slots
+    for the ticks that passed. Stretches where the lower levels are
+    empty are skipped a whole slot at a time.
+
+    Each level has SlotCount slots. A level 0 slot holds the items
+    that expire on one tick, a level 1 slot holds SlotCount ticks
+    worth, and so on. As time reaches the start of a higher level
+    slot, its items are cascaded down to lower levels. Items further
+    out than the top level can cover sit in the top level's last slot
+    and get reinserted until they're in range, so there is no limit
+    on how far in the future they can expire.
+
+    Items are intrusive, T needs:
+        T* nextTimer
+        T* previousTimer
+        int timerSlot, -1 while not in a wheel
+        uint64_t wakeTime, in the same units as advance's time
+    */
+    template<typename T> class TimerWheel {
+    public:
+
+        /*
+        resolution is how many units of time one tick covers,
+        wakeTimes are rounded up to the next tick
+        */
+        TimerWheel(uint32_t resolution = 1)
+            : resolution {resolution} {
+        }
+
+        void insert(T* item) {
+            auto expiry = getTick(item->wakeTime);
+
+            if (expiry < currentTick) {
+                expiry = currentTick;
+            }
+
+            auto delta = expiry - currentTick;
+            int level = 0;
+
+            while (level < LevelCount - 1 && delta >= (1ull << (SlotBits * (level + 1)))) {
+                level++;
+            }
+
+            if (delta >= (1ull << (SlotBits * LevelCount))) {
+                //too far out to cover, park it in the furthest slot
+                expiry = currentTick + (1ull << (SlotBits * LevelCount)) - 1;
+            }
+
+            auto index = (expiry >> (SlotBits * level)) & (SlotCount - 1);
+            link(item, level * SlotCount + index);
+            count++;
+        }
+
+        /*
+        Removes an item before it expires. Does nothing if
+        the item isn't in the wheel
+        */
+        void cancel(T* item) {
+            if (item->timerSlot < 0) {
+                return;
+            }
+
+            unlink(item);
+            count--;
+        }
+
+        /*
+        Expires everything with a wakeTime up to and including time,
+        calling expired(item) for each one. The item has already
+        been removed when expired is called, so it can be reinserted
+        with a later wakeTime
+        */
+        template<typename F>
+        void advance(uint64_t time, F expired) {
+            auto now = time / resolution;
+            skipEmptyTicks(now);
+
+            while (currentTick <= now) {
+                auto index = currentTick & (SlotCount - 1);
+
+                if (index == 0) {
+                    cascade(1);
+                }
+
+                auto item = slots[index];
+
+                while (item != nullptr) {
+                    auto next = item->nextTimer;
+                    unlink(item);
+                    count--;
+                    expired(item);
+                    item = next;
+                }
+
+                currentTick++;
+                skipEmptyTicks(now);
+            }
+        }
+
+        /*
+        Returns a time no later than the earliest wakeTime in the wheel,
+        or NoExpiry if it's empty. It's exact for items in the lowest
+        level. For the rest it's when the slot holding the item
+        cascades, so a one-shot timer armed for this time needs to
+        be rearmed after advancing
+        */
+        uint64_t getNextExpiry() const {
+            if (count == 0) {
+                return NoExpiry;
+            }
+
+            auto earliest = NoExpiry;
+
+            for (int level = 0; level < LevelCount; level++) {
+                if (levelCounts[level] == 0) {
+                    continue;
+                }
+
+                auto shift = SlotBits * level;
+                auto position = currentTick >> shift;
+
+                for (int i = 0; i < SlotCount; i++) {
+                    auto slot = position + i;
+
+                    if (slots[level * SlotCount + (slot & (SlotCount - 1))] != nullptr) {
+                        auto start = slot << shift;
+
+                        if (start < currentTick) {
+                            start = currentTick;
+                        }
+
+                        if (start < earliest) {
+                            earliest = start;
+                        }
+
+                        break;
+                    }
+                }
+            }
+
+            return earliest * resolution;
+        }
+
+        bool isEmpty() const {
+            return count == 0;
+        }
+
+        int getCount() const {
+            return count;
+        }
+
+        uint32_t* getLock() {
+            return &lock;
+        }
+
+        static constexpr uint64_t NoExpiry {~0ull};
+        static constexpr int SlotBits {6};
+        static constexpr int SlotCount {1 << SlotBits};
+        static constexpr int LevelCount {4};
+
+    private:
+
+        uint64_t getTick(uint64_t time) const {
+            return (time + resolution - 1) / resolution;
+        }
+
+        /*
+        If the lowest levels are empty, nothing can expire until the
+        next level with items cascades, so jump straight there
+        */
+        void skipEmptyTicks(uint64_t now) {
+            int level = 0;
+
+            while (level < LevelCount && levelCounts[level] == 0) {
+                level++;
+            }
+
+            if (level == 0) {
+                return;
+            }
+
+            uint64_t next = now + 1;
+
+            if (level < LevelCount) {
+                auto span = 1ull << (SlotBits * level);
+                auto boundary = (currentTick + span - 1) & ~(span - 1);
+
+                if (boundary < next) {
+                    next = boundary;
+                }
+            }
+
+            if (next > currentTick) {
+                currentTick = next;
+            }
+        }
+
+        /*
+        Moves everything in this level's current slot down a level,
+        after first cascading the level above if its slot changed too
+        */
+        void cascade(int level) {
+            if (level >= LevelCount) {
+                return;
+            }
+
+            auto index = (currentTick >> (SlotBits * level)) & (SlotCount - 1);
+
+            if (index == 0) {
+                cascade(level + 1);
+            }
+
+            auto item = slots[level * SlotCount + index];
+
+            while (item != nullptr) {
+                auto next = item->nextTimer;
+                unlink(item);
+                count--;
+                insert(item);
+                item = next;
+            }
+        }
+
+        void link(T* item, int slot) {
+            item->timerSlot = slot;
+            item->previousTimer = nullptr;
+            item->nextTimer = slots[slot];
+
+            if (slots[slot] != nullptr) {
+                slots[slot]->previousTimer = item;
+            }
+
+            slots[slot] = item;
+            levelCounts[slot / SlotCount]++;
+        }
+
+        void unlink(T* item) {
+            if (item->previousTimer != nullptr) {
+                item->previousTimer->nextTimer = item->nextTimer;
+            }
+            else {
+                slots[item->timerSlot] = item->nextTimer;
+            }
+
+            if (item->nextTimer != nullptr) {
+                item->nextTimer->previousTimer = item->previousTimer;
+            }
+
+            levelCounts[item->timerSlot / SlotCount]--;
+            item->nextTimer = nullptr;
+            item->previousTimer = nullptr;
+            item->timerSlot = -1;
+        }
+
+        T* slots[SlotCount * LevelCount] {};
+        int levelCounts[LevelCount] {};
+        uint64_t currentTick {0};
+        uint32_t resolution;
+        int count {0};
+        uint32_t lock {0};
+    };
+}
@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "trace.h"
+#include "scheduler.h"
+#include <cpu/cpu.h>
+#include <cpu/tsc.h>
+#include <locks.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace Kernel::Trace {
+
+    void record(EventType type, uint32_t taskId, uint32_t argument) {
+        if (CPU::ActiveCPUs == nullptr) {
+            return;
+        }
+
+        /*
+        Interrupts stay off so the task can't move to another CPU
+        after finding the ring, and so an interrupt that records
+        can't land in the middle of this one
+        */
+        uintptr_t flags;
+        asm volatile("pushf\n"
+            "pop %0\n"
+            "cli"
+            : "=r" (flags)
+            : //no input
+            : "memory");
+
+        auto scheduler = CPU::ActiveCPUs[CPU::getCurrentCPUId()].scheduler;
+
+        if (scheduler != nullptr) {
+            scheduler->getTrace().record(TSC::getTimestamp(), type, taskId, argument);
+        }
+
+        if (flags & static_cast<uintptr_t>(EFlags::InterruptEnable)) {
+            asm volatile("sti" ::: "memory");
+        }
+    }
+
+    uint64_t toMicroseconds(uint64_t ticks) {
+        auto ticksPerMillisecond = TSC::getTicksPerMillisecond();
+
+        if (ticksPerMillisecond < 1000) {
+            return 0;
+        }
+
+        return ticks / (ticksPerMillisecond / 1000);
+    }
+
+    void writeSerial(const char* line, int length) {
+        //COM1 is set up by the serial driver
+        const uint16_t port {0x3f8};
+
+        for (int i = 0; i < length; i++) {
+            uint8_t status;
+
+            do {
+                asm volatile("inb %1, %0"
+                    : "=a" (status)
+                    : "Nd" (static_cast<uint16_t>(port + 5)));
+            } while ((status & 0x20) == 0);
+
+            asm volatile("outb %0, %1"
+                : //no output
+                : "a"(static_cast<uint8_t>(line[i])), "Nd" (port));
+        }
+    }
+
+    void dump() {
+        /*
+        Static since kernel stacks are too small to hold a
+        whole ring. dump is only called by the scheduler service
+        */
+        static Event events[RingSize];
+        char line[80];
+
+        //sprintf doesn't null terminate, so lines are written by length
+        auto length = sprintf(line, "[Trace] begin %d %u\n", CPU::CPUCount, 
+            static_cast<uint32_t>(TSC::getTicksPerMillisecond()));
+        writeSerial(line, length);
+
+        for (int cpu = 0; cpu < CPU::CPUCount; cpu++) {
+            auto scheduler = CPU::ActiveCPUs[cpu].scheduler;
+
+            if (scheduler == nullptr) {
+                continue;
+            }
+
+            auto count = scheduler->getTrace().copy(events, RingSize);
+
+            for (auto i = 0u; i < count; i++) {
+                auto& event = events[i];
+                length = sprintf(line, "[Trace] %d %x %x %u %u %u\n", 
+                    cpu, 
+                    static_cast<uint32_t>(event.timestamp >> 32),
+                    static_cast<uint32_t>(event.timestamp),
+                    static_cast<uint32_t>(event.type),
+                    event.taskId,
+                    event.argument);
+                writeSerial(line, length);
+            }
+        }
+
+        const char* end = "[Trace] end\n";
+        writeSerial(end, strlen(end));
+
+        auto lock = __atomic_load_n(&Kernel::LockStatisticsHead, __ATOMIC_ACQUIRE);
+
+        while (lock != nullptr) {
+            length = sprintf(line, "[Lock] %s %u %u %x %x %x %x\n",
+                lock->name,
+                lock->acquisitions,
+                lock->contendedAcquisitions,
+                static_cast<uint32_t>(lock->spinCycles >> 32),
+                static_cast<uint32_t>(lock->spinCycles),
+                static_cast<uint32_t>(lock->maxHoldTime >> 32),
+                static_cast<uint32_t>(lock->maxHoldTime));
+            writeSerial(line, length);
+
+            if (lock->orderViolation != nullptr) {
+                length = sprintf(line, "[Lock] %s order %s\n", lock->name, lock->orderViolation->name);
+                writeSerial(line, length);
+            }
+
+            if (lock->interruptViolation) {
+                length = sprintf(line, "[Lock] %s interrupts\n", lock->name);
+                writeSerial(line, length);
+            }
+
+            lock = lock->next;
+        }
+    }
+}
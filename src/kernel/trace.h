@@ -0,0 +1,190 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <stdint.h>
+
+namespace Kernel::Trace {
+
+    enum class EventType : uint32_t {
+        //taskId switched in, argument is the task switched out (0 if none)
+        ContextSwitch,
+        //taskId was made runnable, argument is the CPU it was queued on
+        Wakeup,
+        //taskId sent an IPI, argument is the target APIC id
+        InterprocessorInterrupt,
+        //taskId sent a message, argument is the recipient's id
+        Send,
+        //taskId received a message, argument is the sender's id
+        Receive
+    };
+
+    struct Event {
+        uint64_t timestamp;
+        EventType type;
+        uint32_t taskId;
+        uint32_t argument;
+    };
+
+    inline constexpr uint32_t RingSize {1024};
+    static_assert((RingSize & (RingSize - 1)) == 0, "RingSize must be a power of two");
+
+    /*
+    A fixed size log of the most recent scheduler events on one CPU.
+    Only the owning CPU records into it, with interrupts disabled, so
+    recording needs no lock. Readers on other CPUs copy events out
+    and throw away any that were overwritten while they were copying.
+    When full, the oldest events are overwritten
+    */
+    class Ring {
+    public:
+
+        void record(uint64_t timestamp, EventType type, uint32_t taskId, uint32_t argument) {
+            auto position = head;
+            auto& event = events[position & (RingSize - 1)];
+            event.timestamp = timestamp;
+            event.type = type;
+            event.taskId = taskId;
+            event.argument = argument;
+
+            //the event must be complete before readers can see it
+            __atomic_store_n(&head, position + 1, __ATOMIC_RELEASE);
+        }
+
+        /*
+        Copies up to count of the most recent events into buffer,
+        oldest first. Returns how many were copied. The writer could
+        be partway through overwriting the oldest event, so at most
+        RingSize - 1 come out of a full ring
+        */
+        uint32_t copy(Event* buffer, uint32_t count) {
+            auto end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+            auto available = end < RingSize ? end : RingSize;
+
+            if (count > available) {
+                count = available;
+            }
+
+            auto start = end - count;
+
+            for (auto i = 0u; i < count; i++) {
+                buffer[i] = events[(start + i) & (RingSize - 1)];
+            }
+
+            /*
+            Anything the writer lapped while we were copying is torn,
+            so drop it from the front. The slot for position latest
+            may be mid-write too, hence the + 1
+            */
+            auto latest = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+            auto span = latest - start + 1;
+            auto overwritten = span > RingSize ? span - RingSize : 0u;
+
+            if (overwritten >= count) {
+                return 0;
+            }
+
+            if (overwritten > 0) {
+                for (auto i = 0u; i < count - overwritten; i++) {
+                    buffer[i] = buffer[i + overwritten];
+                }
+
+                count -= overwritten;
+            }
+
+            return count;
+        }
+
+        uint32_t getRecordedCount() {
+            return __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        }
+
+    private:
+
+        Event events[RingSize];
+
+        //total events ever recorded, it wraps along with the ring
+        uint32_t head {0};
+    };
+
+    inline constexpr uint32_t HistogramBuckets {20};
+
+    /*
+    Counts durations in power of two buckets of microseconds.
+    Bucket 0 is anything under 2us, bucket i covers [2^i, 2^(i+1))
+    and the last bucket also collects everything longer
+    */
+    struct Histogram {
+
+        void add(uint64_t microseconds) {
+            uint32_t bucket {0};
+
+            while (microseconds > 1 && bucket < HistogramBuckets - 1) {
+                microseconds >>= 1;
+                bucket++;
+            }
+
+            buckets[bucket]++;
+        }
+
+        uint32_t buckets[HistogramBuckets] {};
+    };
+
+    /*
+    Records into the current CPU's ring, timestamped with the TSC.
+    Safe to call from any CPU and any context
+    */
+    void record(EventType type, uint32_t taskId, uint32_t argument);
+
+    /*
+    Converts a TSC difference to microseconds, or returns
+    0 if the TSC hasn't been calibrated yet
+    */
+    uint64_t toMicroseconds(uint64_t ticks);
+
+    /*
+    Writes every CPU's ring to COM1, one event per line, so it
+    can be pulled out of the emulator's serial log by
+    meta/trace2json.py. The format is:
+
+        [Trace] begin <cpuCount> <ticksPerMillisecond>
+        [Trace] <cpu> <timestamp high> <timestamp low> <type> <taskId> <argument>
+        [Trace] end
+
+    with timestamps split into two 32 bit hex halves. It's followed by
+    the statistics of every lock that's passed a LockStatistics, as
+
+        [Lock] <name> <acquisitions> <contended> <spin cycles high> <low> <max hold high> <low>
+
+    With LOCK_DEBUG, a lock that's been taken in both orders with
+    another is followed by [Lock] <name> order <other name>, and one
+    that interrupts take but was taken with them enabled by
+    [Lock] <name> interrupts
+    */
+    void dump();
+}
@@ -43,88 +43,76 @@ size_t fread(void* restrict ptr, size_t size, size_t count, FILE* restrict strea
     auto remainingBytes = size * count;
     auto buffer = static_cast<unsigned char*>(ptr);
 
-    if (remainingBytes > 4096) {
+    /*
+    Large reads come back as granted pages. Each request is limited
+    to what one GrantedMessage can carry, and the rest is read
+    512 bytes at a time
+    */
+    const size_t maxSizePerStream = IPC::MaximumGrantPages * Memory::PageSize;
+
+    while (remainingBytes > 4096) {
 
         ReadStreamRequest streamRequest;
         streamRequest.fileDescriptor = stream->descriptor;
-        streamRequest.readLength = remainingBytes;
+        streamRequest.readLength = remainingBytes < maxSizePerStream ? remainingBytes : maxSizePerStream;
         streamRequest.serviceType = Kernel::ServiceType::VFS;
 
         send(IPC::RecipientType::ServiceName, &streamRequest);
 
-        Kernel::ShareMemoryRequest shareRequest;
-        shareRequest.ownerAddress = reinterpret_cast<uintptr_t>(ptr);
-        shareRequest.sharedServiceType = Kernel::ServiceType::VFS;
-        shareRequest.recipientIsTaskId = false;
-        shareRequest.size = remainingBytes;
-
-        //make sure that all the pages have been allocated before sharing them
-        memset(ptr, 0, remainingBytes);
+        IPC::MaximumMessageBuffer messageBuffer;
+        filteredReceive(&messageBuffer,
+            IPC::MessageNamespace::VFS,
+            static_cast<uint32_t>(MessageId::ReadStreamResult));
 
-        send(IPC::RecipientType::ServiceRegistryMailbox, &shareRequest);
+        auto result = IPC::extractMessage<ReadStreamResult>(messageBuffer);
 
-        {
-            IPC::MaximumMessageBuffer buffer;
-            filteredReceive(&buffer, 
-                IPC::MessageNamespace::ServiceRegistry,
-                static_cast<uint32_t>(Kernel::MessageId::ShareMemoryResult));
+        if (!result.succeeded()) {
+            return bytesRead;
         }
 
-        {
-            IPC::MaximumMessageBuffer buffer;
-            filteredReceive(&buffer,
-                IPC::MessageNamespace::VFS,
-                static_cast<uint32_t>(MessageId::ReadStreamResult));
-
-            auto result = IPC::extractMessage<ReadStreamResult>(buffer);
-
-            if (result.success) {
-                //TODO: stop sharing
-                return result.bytesWritten;
-            }
-            else {
-                return 0;
-            }
-        }
+        auto bytesWritten = result.getBytesWritten();
+        memcpy(buffer + bytesRead, reinterpret_cast<void*>(result.grantAddress), bytesWritten);
+        unmap(result.grantAddress, result.grantPages);
 
+        bytesRead += bytesWritten;
+        remainingBytes -= bytesWritten;
+        stream->position += bytesWritten;
     }
-    else {
 
-        while (remainingBytes > 0) {
-            uint32_t length {0};
+    while (remainingBytes > 0) {
+        uint32_t length {0};
 
-            if (maxSizePerRequest < remainingBytes) {
-                length = maxSizePerRequest;
-            }
-            else {
-                length = remainingBytes;
-            }
+        if (maxSizePerRequest < remainingBytes) {
+            length = maxSizePerRequest;
+        }
+        else {
+            length = remainingBytes;
+        }
 
-            auto result = read512Synchronous(stream->descriptor, length);
+        auto result = read512Synchronous(stream->descriptor, length);
 
-            if (result.success) {
-                
-                for (int i = 0; i < 2; i++) {
+        if (result.success) {
+            
+            for (int i = 0; i < 2; i++) {
 
-                    memcpy(buffer + bytesRead, result.buffer, result.bytesWritten);
-                    bytesRead += result.bytesWritten;
-                    remainingBytes -= result.bytesWritten;
-                    stream->position += result.bytesWritten;
+                memcpy(buffer + bytesRead, result.buffer, result.bytesWritten);
+                bytesRead += result.bytesWritten;
+                remainingBytes -= result.bytesWritten;
+                stream->position += result.bytesWritten;
 
-                    if (result.expectMore) {
-                        IPC::MaximumMessageBuffer messageBuffer;
-                        filteredReceive(&messageBuffer, IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::Read512Result));
+                if (result.expectMore) {
+                    IPC::MaximumMessageBuffer messageBuffer;
+                    filteredReceive(&messageBuffer, IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::Read512Result));
 
-                        result = IPC::extractMessage<Read512Result>(messageBuffer);
-                    }
-                    else {
-                        break;
-                    }
+                    result = IPC::extractMessage<Read512Result>(messageBuffer);
+                }
+                else {
+                    break;
                 }
             }
-            else {
-                break;
-            }
+        }
+        else {
+            break;
         }
     }
 
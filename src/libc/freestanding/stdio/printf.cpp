@@ -35,8 +35,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <services/terminal/terminal.h>
 
 template<typename T>
-void printInteger(uint32_t i, T& write, bool isNegative, int base = 10, bool upper = false) {
-    char buffer[CHAR_BIT * sizeof(int) - 1];
+void printInteger(uint64_t i, T& write, bool isNegative, int base = 10, bool upper = false) {
+    char buffer[CHAR_BIT * sizeof(uint64_t) / 2];
     char hexDigits[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
         'a', 'b', 'c', 'd', 'e', 'f'};
     int digits {0};
@@ -65,9 +65,9 @@ void printInteger(uint32_t i, T& write, bool isNegative, int base = 10, bool upp
 }
 
 template<typename T>
-void printInteger(int32_t i, T& write, int base = 10, bool upper = false) {
+void printInteger(int64_t i, T& write, int base = 10, bool upper = false) {
     if (i < 0) {
-        printInteger(i * -1, write, true, base, upper);
+        printInteger(0 - static_cast<uint64_t>(i), write, true, base, upper);
     }
     else {
         printInteger(i, write, false, base, upper); 
@@ -88,6 +88,9 @@ int printf_impl(const char* format, va_list args, T write, int& charactersWritte
             else {
                 bool done {false};
 
+                //%lx and friends read a long, for pointer sized values
+                bool isLong {false};
+
                 while (!done) {
                     switch (*format) {
                         case 'c': {
@@ -107,8 +110,12 @@ int printf_impl(const char* format, va_list args, T write, int& charactersWritte
 
                             break;
                         }
+                        case 'l': {
+                            isLong = true;
+                            break;
+                        }
                         case 'd': {
-                            auto i = va_arg(args, int);
+                            int64_t i = isLong ? va_arg(args, long) : va_arg(args, int);
                             printInteger(i, write);                            
 
                             done = true;
@@ -123,22 +130,22 @@ int printf_impl(const char* format, va_list args, T write, int& charactersWritte
                             break;
                         }
                         case 'x': {
-                            auto i = va_arg(args, int);
-                            printInteger(static_cast<uint32_t>(i), write, false, 16);   
+                            uint64_t i = isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+                            printInteger(i, write, false, 16);   
 
                             done = true;
                             break;
                         }
                         case 'X': {
-                            auto i = va_arg(args, int);
+                            uint64_t i = isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
                             printInteger(i, write, false, 16, true);
 
                             done = true;
                             break;
                         }
                         case 'u': {
-                            auto i = va_arg(args, int);
-                            printInteger(static_cast<uint32_t>(i), write, false);
+                            uint64_t i = isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+                            printInteger(i, write, false);
 
                             done = true;
                             break;
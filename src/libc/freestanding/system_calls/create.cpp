@@ -31,20 +31,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace VirtualFileSystem;
 
-void create(const char* path) {
+static CreateRequest createCreateRequest(const char* path) {
     CreateRequest request;
     request.serviceType = Kernel::ServiceType::VFS;
     auto pathLength = strlen(path) + 1;
     memcpy(request.path, path, pathLength);
     request.shrink(pathLength);
+    return request;
+}
+
+void create(const char* path) {
+    auto request = createCreateRequest(path);
     send(IPC::RecipientType::ServiceName, &request);
 }  
 
 VirtualFileSystem::CreateResult createSynchronous(const char* path) {
-    create(path);
+    auto request = createCreateRequest(path);
 
     IPC::MaximumMessageBuffer buffer;
-    filteredReceive(&buffer, IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::CreateResult));
+    call(IPC::RecipientType::ServiceName, &request, &buffer, 
+        IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::CreateResult));
 
     return IPC::extractMessage<CreateResult>(buffer);
 }
\ No newline at end of file
@@ -38,14 +38,13 @@ void* map(uint32_t address, uint32_t size, uint32_t flags) {
 
     send(IPC::RecipientType::ServiceRegistryMailbox, &request);
 
+    /*
+    Services call this from their message loops, so like unmap
+    it must leave any other queued messages alone
+    */
     IPC::MaximumMessageBuffer buffer;
-    receive(&buffer);
-
-    if (buffer.messageNamespace == IPC::MessageNamespace::ServiceRegistry
-            && buffer.messageId == static_cast<uint32_t>(MessageId::MapMemoryResult)) {
-        return IPC::extractMessage<MapMemoryResult>(buffer).start;
-    }
-    else {
-        return nullptr;
-    }
+    filteredReceive(&buffer, IPC::MessageNamespace::ServiceRegistry, 
+        static_cast<uint32_t>(MessageId::MapMemoryResult));
+
+    return IPC::extractMessage<MapMemoryResult>(buffer).start;
 }
\ No newline at end of file
@@ -31,20 +31,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace VirtualFileSystem;
 
-void open(const char* path) {
+static OpenRequest createOpenRequest(const char* path) {
     OpenRequest open;
     open.serviceType = Kernel::ServiceType::VFS;
     auto pathLength = strlen(path) + 1;
     memcpy(open.path, path, pathLength);
     open.shrink(pathLength);
-    send(IPC::RecipientType::ServiceName, &open);
+    return open;
+}
+
+void open(const char* path) {
+    auto request = createOpenRequest(path);
+    send(IPC::RecipientType::ServiceName, &request);
 }
 
 OpenResult openSynchronous(const char* path) {
-    open(path);
+    auto request = createOpenRequest(path);
 
     IPC::MaximumMessageBuffer buffer;
-    filteredReceive(&buffer, IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::OpenResult));
+    call(IPC::RecipientType::ServiceName, &request, &buffer, 
+        IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::OpenResult));
 
     return IPC::extractMessage<OpenResult>(buffer);
 
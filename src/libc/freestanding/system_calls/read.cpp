@@ -31,29 +31,35 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace VirtualFileSystem;
 
-void read(uint32_t fileDescriptor, uint32_t length) {
+static ReadRequest createReadRequest(uint32_t fileDescriptor, uint32_t length) {
     ReadRequest request;
     request.fileDescriptor = fileDescriptor;
     request.readLength = length;
     request.serviceType = Kernel::ServiceType::VFS;
+    return request;
+}
 
+void read(uint32_t fileDescriptor, uint32_t length) {
+    auto request = createReadRequest(fileDescriptor, length);
     send(IPC::RecipientType::ServiceName, &request);
 }
 
 ReadResult readSynchronous(uint32_t fileDescriptor, uint32_t length) {
-    read(fileDescriptor, length);
+    auto request = createReadRequest(fileDescriptor, length);
 
     IPC::MaximumMessageBuffer buffer;
-    filteredReceive(&buffer, IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::ReadResult));
+    call(IPC::RecipientType::ServiceName, &request, &buffer, 
+        IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::ReadResult));
 
     return IPC::extractMessage<ReadResult>(buffer);
 }
 
 Read512Result read512Synchronous(uint32_t fileDescriptor, uint32_t length) {
-    read(fileDescriptor, length);
+    auto request = createReadRequest(fileDescriptor, length);
 
     IPC::MaximumMessageBuffer buffer;
-    filteredReceive(&buffer, IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::Read512Result));
+    call(IPC::RecipientType::ServiceName, &request, &buffer, 
+        IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::Read512Result));
 
     return IPC::extractMessage<Read512Result>(buffer);
 }
\ No newline at end of file
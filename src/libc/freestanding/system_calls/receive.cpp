@@ -26,6 +26,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include <system_calls.h>
+#include <ipc.h>
 
 void receive(IPC::Message* buffer) {
     uint32_t systemCall = static_cast<uint32_t>(SystemCall::Receive);
@@ -61,6 +62,21 @@ bool peekReceive(IPC::Message* buffer) {
     return result;
 }
 
+uint32_t receiveBatch(IPC::MaximumMessageBuffer* buffers, uint32_t count) {
+    uint32_t systemCall = static_cast<uint32_t>(SystemCall::ReceiveBatch);
+    uint32_t received {0};
+
+    asm volatile(
+        "int $0xFF"
+        : "=a" (received)
+        : "0" (systemCall),
+          "b" (buffers),
+          "c" (count)
+        : "memory");
+
+    return received;
+}
+
 void receiveAndIgnore() {
     IPC::MaximumMessageBuffer buffer;
     receive(&buffer);
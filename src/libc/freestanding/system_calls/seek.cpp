@@ -31,20 +31,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace VirtualFileSystem;
 
-void seek(uint32_t fileDescriptor, uint32_t offset, uint32_t origin) {
+static SeekRequest createSeekRequest(uint32_t fileDescriptor, uint32_t offset, uint32_t origin) {
     SeekRequest request;
     request.serviceType = Kernel::ServiceType::VFS;
     request.fileDescriptor = fileDescriptor;
     request.offset = offset;
     request.origin = static_cast<Origin>(origin);
+    return request;
+}
+
+void seek(uint32_t fileDescriptor, uint32_t offset, uint32_t origin) {
+    auto request = createSeekRequest(fileDescriptor, offset, origin);
     send(IPC::RecipientType::ServiceName, &request);
 }
 
 VirtualFileSystem::SeekResult seekSynchronous(uint32_t fileDescriptor, uint32_t offset, uint32_t origin) {
-    seek(fileDescriptor, offset, origin);
+    auto request = createSeekRequest(fileDescriptor, offset, origin);
 
     IPC::MaximumMessageBuffer buffer;
-    filteredReceive(&buffer, IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::SeekResult));
+    call(IPC::RecipientType::ServiceName, &request, &buffer, 
+        IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::SeekResult));
 
     return IPC::extractMessage<SeekResult>(buffer);
 }
\ No newline at end of file
@@ -33,4 +33,43 @@ extern "C" void sendImplementation(uint32_t recipient, uint64_t message);
 void send(IPC::RecipientType recipient, IPC::Message* message) {
     
     sendImplementation(static_cast<uint32_t>(recipient), reinterpret_cast<uint64_t>(message));
-}
\ No newline at end of file
+}
+
+bool sendGrant(IPC::RecipientType recipient, IPC::GrantedMessage* message) {
+    uint32_t systemCall = static_cast<uint32_t>(SystemCall::SendGrant);
+    bool result {false};
+
+    asm volatile(
+        "int $0xFF \n"
+        "mov %%eax, %%edx"
+        : "=d" (result)
+        : "a" (systemCall),
+          "b" (recipient),
+          "c" (message));
+
+    return result;
+}
+
+uint32_t sendBatch(IPC::BatchEntry* entries, uint32_t count) {
+    uint32_t systemCall = static_cast<uint32_t>(SystemCall::SendBatch);
+    uint32_t delivered {0};
+
+    while (count > 0) {
+        auto batchSize = count < IPC::MaximumBatchSize ? count : IPC::MaximumBatchSize;
+        uint32_t result {0};
+
+        asm volatile(
+            "int $0xFF"
+            : "=a" (result)
+            : "0" (systemCall),
+              "b" (entries),
+              "c" (batchSize)
+            : "memory");
+
+        delivered += result;
+        entries += batchSize;
+        count -= batchSize;
+    }
+
+    return delivered;
+}
@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <system_calls.h>
+#include <services.h>
+#include <saturn/heap.h>
+
+using namespace Kernel;
+
+void unmap(uintptr_t address, uint32_t pageCount) {
+    UnmapMemory request;
+    request.address = address;
+    request.pageCount = pageCount;
+
+    send(IPC::RecipientType::ServiceRegistryMailbox, &request);
+
+    /*
+    Wait for the reply so the caller can't reuse the range
+    before the pages behind it are gone. This runs whenever the
+    heap frees pages, so it must leave any other queued
+    messages alone
+    */
+    IPC::MaximumMessageBuffer buffer;
+    filteredReceive(&buffer, IPC::MessageNamespace::ServiceRegistry, 
+        static_cast<uint32_t>(MessageId::UnmapMemoryResult));
+}
+
+namespace Saturn::Memory {
+
+    void releasePages(uintptr_t address, uint32_t pageCount) {
+        unmap(address, pageCount);
+    }
+}
@@ -31,20 +31,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace VirtualFileSystem;
 
-void write(uint32_t fileDescriptor, const void* data, uint32_t length) {
+static WriteRequest createWriteRequest(uint32_t fileDescriptor, const void* data, uint32_t length) {
     WriteRequest request;
     request.fileDescriptor = fileDescriptor;
     request.writeLength = length;
     request.serviceType = Kernel::ServiceType::VFS;
     memcpy(request.buffer, data, length);
+    return request;
+}
+
+void write(uint32_t fileDescriptor, const void* data, uint32_t length) {
+    auto request = createWriteRequest(fileDescriptor, data, length);
     send(IPC::RecipientType::ServiceName, &request);
 }
 
 VirtualFileSystem::WriteResult writeSynchronous(uint32_t fileDescriptor, const void* data, uint32_t length) {
-    write(fileDescriptor, data, length);
+    auto request = createWriteRequest(fileDescriptor, data, length);
 
     IPC::MaximumMessageBuffer buffer;
-    filteredReceive(&buffer, IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::WriteResult));
+    call(IPC::RecipientType::ServiceName, &request, &buffer, 
+        IPC::MessageNamespace::VFS, static_cast<uint32_t>(MessageId::WriteResult));
 
     return IPC::extractMessage<WriteResult>(buffer);
 }
\ No newline at end of file
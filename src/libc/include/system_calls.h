@@ -36,6 +36,9 @@ extern "C" void print(int a, int b);
 
 namespace IPC {
     struct Message;
+    struct GrantedMessage;
+    struct MaximumMessageBuffer;
+    struct BatchEntry;
     enum class RecipientType;
 }
 
@@ -49,12 +52,43 @@ enum class SystemCall {
     Send,
     Receive,
     FilteredReceive,
-    PeekReceive
+    PeekReceive,
+    SendGrant,
+    Call,
+    SendBatch,
+    ReceiveBatch
 };
 
 //TODO: should return a bool for success/failure
 //ie check if messageId = 0, means service wasn't setup yet
 void send(IPC::RecipientType recipient, IPC::Message* message);
+
+/*
+Sends a GrantedMessage, moving its pages into the recipient's address
+space instead of copying them. Returns false if nothing was sent
+*/
+bool sendGrant(IPC::RecipientType recipient, IPC::GrantedMessage* message);
+
+/*
+Sends a message and blocks until the recipient replies with a message
+matching filter and messageId. If the recipient is waiting for
+messages, the kernel switches directly to it and back again
+*/
+void call(IPC::RecipientType recipient, IPC::Message* message, IPC::Message* buffer, 
+    IPC::MessageNamespace filter, uint32_t messageId);
+
+/*
+Sends every entry's message to its recipient, IPC::MaximumBatchSize
+messages per system call. Returns how many were delivered
+*/
+uint32_t sendBatch(IPC::BatchEntry* entries, uint32_t count);
+
+/*
+Blocks until at least one message arrives, then receives up to
+count (at most IPC::MaximumBatchSize) messages at once. Returns
+how many were received
+*/
+uint32_t receiveBatch(IPC::MaximumMessageBuffer* buffers, uint32_t count);
 void receive(IPC::Message* buffer);
 void filteredReceive(IPC::Message* buffer, IPC::MessageNamespace filter, uint32_t messageId);
 bool peekReceive(IPC::Message* buffer);
@@ -84,4 +118,9 @@ namespace Kernel {
 uint32_t run(uintptr_t entryPoint, Kernel::Priority priority);
 uint32_t run(const char* path);
 
-void* map(uint32_t address, uint32_t size, uint32_t flags);
\ No newline at end of file
+/*
+Allocates size pages starting at address, or wherever there's
+room if address is 0. They're backed when first touched
+*/
+void* map(uint32_t address, uint32_t size, uint32_t flags);
+void unmap(uintptr_t address, uint32_t pageCount);
\ No newline at end of file
@@ -160,9 +160,11 @@ finalEnter:
     bts eax, 8
     wrmsr
 
-    ;enable paging 
+    ;enable paging, and write protect so the kernel's writes to
+    ;read only (copy on write) pages fault too
     mov eax, CR0
     bts eax, 31
+    bts eax, 16
     mov cr0, eax
 
     lgdt [gp64]
@@ -40,6 +40,9 @@ struct PhysicalMemStats {
     uint64_t acpiLocation {0};
     uint64_t acpiLength {0};
     bool reservedDMARegion {false};
+    MemoryRange ranges[MaxMemoryRanges];
+    int rangeCount {0};
+    uint64_t loaderPages {0};
 };
 
 void freePhysicalPages(uint64_t pageAddress, uint64_t count, PhysicalMemStats& stats) {
@@ -70,6 +73,10 @@ void freePhysicalPages(uint64_t pageAddress, uint64_t count, PhysicalMemStats& s
     stats.firstAddress = pageAddress;
     pageAddress += PageSize * 4;
 
+    if (count > 4 && stats.rangeCount < MaxMemoryRanges) {
+        stats.ranges[stats.rangeCount++] = {pageAddress, count - 4};
+    }
+
     for (uint64_t i = 4; i < count; i++) {
         auto page = reinterpret_cast<uint64_t volatile*>(pageAddress & ~0xfff);
         *page = stats.nextFreeAddress;
@@ -461,9 +468,31 @@ uint64_t allocatePage(Configuration& config) {
     auto address = config.physicalMemoryStats.nextFreeAddress;
     auto nextPage = *reinterpret_cast<uint64_t*>(address);
     config.physicalMemoryStats.nextFreeAddress = nextPage;
+    config.physicalMemoryStats.loaderPages++;
     return address;
 }
 
+/*
+Pages are taken off the top of the free list, which is the end
+of the last range, so whatever the loader used comes off the
+ranges from the back
+*/
+void removeLoaderPages(PhysicalMemStats& stats) {
+    auto used = stats.loaderPages;
+
+    while (used > 0 && stats.rangeCount > 0) {
+        auto& range = stats.ranges[stats.rangeCount - 1];
+
+        if (range.pages > used) {
+            range.pages -= used;
+            break;
+        }
+
+        used -= range.pages;
+        stats.rangeCount--;
+    }
+}
+
 void clearPage(uint64_t* page) {
     for (int i = 0; i < 512; i++) {
         *page++ = 0;
@@ -697,6 +726,13 @@ void startup(uint32_t address, uint32_t magicNumber) {
         config.physicalMemoryStats.acpiLength
     };
 
+    removeLoaderPages(config.physicalMemoryStats);
+    kernel.memoryRangeCount = config.physicalMemoryStats.rangeCount;
+
+    for (int i = 0; i < config.physicalMemoryStats.rangeCount; i++) {
+        kernel.memoryRanges[i] = config.physicalMemoryStats.ranges[i];
+    }
+
     enterLongMode(config.programs[config.kernelProgram].entryPoint, kernel);
 
     panic("Should never get here");
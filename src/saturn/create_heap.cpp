@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "heap.h"
+#include <memory/physical_memory_manager.h>
+#include <memory/virtual_memory_manager.h>
+#include <new>
+
+using namespace Memory;
+
+namespace Saturn::Memory {
+
+    const uint32_t kernelPageFlags = 
+        static_cast<uint32_t>(PageTableFlags::AllowWrite);
+
+    void Heap::initialize(uint32_t heapSize, ::Memory::VirtualMemoryManager* vmm) {
+        /*
+        The heap's pages are only reserved here, each one gets
+        allocated and zeroed on first touch by the page fault handler
+        */
+        auto start = vmm->allocatePages(heapSize / PageSize, kernelPageFlags);
+        initialize(start, heapSize);
+    }
+
+    Heap* createHeap(uint32_t heapSize, ::Memory::VirtualMemoryManager* vmm) {
+        auto virtualAddress = vmm->allocatePages(1, kernelPageFlags);
+        auto physicalPage = ::Memory::currentPMM->allocatePage(1);
+        vmm->map(virtualAddress, physicalPage);
+        ::Memory::currentPMM->finishAllocation(virtualAddress, 1);
+        auto ptr = reinterpret_cast<void*>(virtualAddress);
+
+        auto heap = new (ptr) Heap;
+        heap->initialize(heapSize, vmm);
+        return heap;
+    }
+}
@@ -26,335 +26,467 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "heap.h"
-#include <memory/physical_memory_manager.h>
-#include <memory/virtual_memory_manager.h>
-#include <stdio.h>
-//#include <cpu/cpu.h>
-#include <new>
-
-using namespace Memory;
 
 namespace Saturn::Memory {
 
-    const uint32_t kernelPageFlags = 
-        static_cast<uint32_t>(PageTableFlags::AllowWrite);
+    constexpr uintptr_t PageSize {0x1000};
 
-    int getPreallocationCount(int size) {
+    constexpr uint32_t InUse = static_cast<uint32_t>(ChunkFlags::InUse);
+    constexpr uint32_t PreviousInUse = static_cast<uint32_t>(ChunkFlags::PreviousInUse);
+    constexpr uint32_t Small = static_cast<uint32_t>(ChunkFlags::Small);
+    constexpr uint32_t Released = static_cast<uint32_t>(ChunkFlags::Released);
+    constexpr uint32_t SizeClassShift {8};
 
-        if (size <= 64) {
-            return 200;
-        }
-        else if (size <= 128) {
-            return 100;
+    //a free chunk needs room for its tree links and its size at the end
+    constexpr uint32_t MinimumChunkSize = (sizeof(FreeChunk) + sizeof(uint32_t) + 7) & ~7;
+
+    uint32_t getChunkSize(ChunkHeader* chunk) {
+        return sizeof(ChunkHeader) + chunk->size;
+    }
+
+    ChunkHeader* getNextChunk(ChunkHeader* chunk) {
+        auto address = reinterpret_cast<uintptr_t>(chunk) + getChunkSize(chunk);
+        return reinterpret_cast<ChunkHeader*>(address);
+    }
+
+    /*
+    Only valid if the previous chunk is free
+    */
+    ChunkHeader* getPreviousChunk(ChunkHeader* chunk) {
+        auto previousSize = *(reinterpret_cast<uint32_t*>(chunk) - 1);
+        auto address = reinterpret_cast<uintptr_t>(chunk) - previousSize;
+        return reinterpret_cast<ChunkHeader*>(address);
+    }
+
+    void markFree(ChunkHeader* chunk, uint32_t chunkSize, uint32_t flags) {
+        chunk->flags = flags;
+        chunk->size = chunkSize - sizeof(ChunkHeader);
+
+        auto footer = reinterpret_cast<uint32_t*>(reinterpret_cast<uintptr_t>(chunk) + chunkSize) - 1;
+        *footer = chunkSize;
+
+        auto freeChunk = reinterpret_cast<FreeChunk*>(chunk);
+        freeChunk->left = nullptr;
+        freeChunk->right = nullptr;
+    }
+
+    /*
+    The free chunk tree is a treap ordered by size then address,
+    with each chunk's priority derived from its address
+    */
+    bool isBefore(FreeChunk* a, FreeChunk* b) {
+        return a->header.size < b->header.size
+            || (a->header.size == b->header.size && a < b);
+    }
+
+    uint32_t getPriority(FreeChunk* chunk) {
+        return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(chunk) >> 3) * 2654435761u;
+    }
+
+    void insertFreeChunk(FreeChunk*& root, FreeChunk* chunk) {
+        if (root == nullptr) {
+            root = chunk;
         }
-        else if (size <= 168) {
-            return 50;
+        else if (isBefore(chunk, root)) {
+            insertFreeChunk(root->left, chunk);
+
+            if (getPriority(root->left) > getPriority(root)) {
+                auto left = root->left;
+                root->left = left->right;
+                left->right = root;
+                root = left;
+            }
         }
         else {
-            return 10;
+            insertFreeChunk(root->right, chunk);
+
+            if (getPriority(root->right) > getPriority(root)) {
+                auto right = root->right;
+                root->right = right->left;
+                right->left = root;
+                root = right;
+            }
         }
     }
 
-    void Heap::initialize(uint32_t heapSize, ::Memory::VirtualMemoryManager* vmm) {
-        currentPage = vmm->allocatePages(heapSize / PageSize, kernelPageFlags);
+    FreeChunk* mergeFreeChunks(FreeChunk* left, FreeChunk* right) {
+        if (left == nullptr) {
+            return right;
+        }
+        else if (right == nullptr) {
+            return left;
+        }
+        else if (getPriority(left) > getPriority(right)) {
+            left->right = mergeFreeChunks(left->right, right);
+            return left;
+        }
+        else {
+            right->left = mergeFreeChunks(left, right->left);
+            return right;
+        }
+    }
 
-/*
-TODO:
-preallocate some number of pages to reduce page faults
-*/
-if (false && currentPage <= 0xD000'0000) {
-        auto pages = heapSize / PageSize;
-        for (int i = 0; i < pages; i++) {
-            auto physicalPage = ::Memory::currentPMM->allocatePage(1);
-            auto page = currentPage + (i * PageSize);
-            vmm->map(page, physicalPage);
-            ::Memory::currentPMM->finishAllocation(page, 1);
+    void removeFreeChunk(FreeChunk*& root, FreeChunk* chunk) {
+        if (root == nullptr) {
+            return;
         }
-}
+        else if (root == chunk) {
+            root = mergeFreeChunks(root->left, root->right);
+        }
+        else if (isBefore(chunk, root)) {
+            removeFreeChunk(root->left, chunk);
+        }
+        else {
+            removeFreeChunk(root->right, chunk);
+        }
+    }
 
-        nextFreeChunk = reinterpret_cast<ChunkHeader*>(currentPage);
-        nextFreeChunk->magic = 0xabababab;
-        nextFreeChunk->magic2 = 0xcdcdcdcd;
-        nextFreeChunk->size = heapSize - sizeof(ChunkHeader);
-        nextFreeChunk->free = true;
-        nextFreeChunk->next = nullptr;
-        nextFreeChunk->previous = nullptr;
-        heapStart = nextFreeChunk;
+    void Heap::initialize(uintptr_t start, uint32_t heapSize) {
+        heapStart = start;
+        heapEnd = heapStart + heapSize;
 
-        remainingPageSpace = PageSize - sizeof(ChunkHeader);
+        //an in use chunk at the end stops coalescing from running off the heap
+        auto sentinel = reinterpret_cast<ChunkHeader*>(heapEnd - sizeof(ChunkHeader));
+        sentinel->flags = InUse;
+        sentinel->size = 0;
 
-        for (int i = 0; i < MaxNumberOfBins; i++) {
-            int thisSize = (i + 1) * 8;
-            int chunksToPrellocate = getPreallocationCount(thisSize);
+        auto first = reinterpret_cast<ChunkHeader*>(heapStart);
+        markFree(first, heapSize - sizeof(ChunkHeader), PreviousInUse | Released);
 
-            auto chunk = preallocateFixedChunks(thisSize, chunksToPrellocate);        
-            fixedBins[i] = chunk;
+        freeChunks = nullptr;
+        insertFreeChunk(freeChunks, reinterpret_cast<FreeChunk*>(first));
+
+        for (auto& sizeClass : sizeClasses) {
+            sizeClass = nullptr;
         }
+
+        statistics = {};
+        allocationsUntilSample = 0;
+    }
+
+    const HeapStatistics& Heap::getStatistics() const {
+        return statistics;
+    }
+
+    void Heap::setSampleInterval(uint32_t interval) {
+        statistics.sampleInterval = interval;
+        allocationsUntilSample = interval;
     }
 
-    FixedSizeHeader* Heap::preallocateFixedChunks(int size, int count) {
-        int spaceRequired = 8 + size;
-        int preallocatedSpace = count * spaceRequired;
+    void Heap::recordAllocation(SizeClassStatistics& counts, uint32_t size) {
+        counts.allocations++;
+        counts.liveBytes += size;
 
-        auto chunk = findFreeChunk(preallocatedSpace);
-        auto buffer = reinterpret_cast<uint8_t*>(allocate(chunk, preallocatedSpace));
-        auto header = reinterpret_cast<FixedSizeHeader*>(buffer);
-        auto first = header;
+        if (counts.liveBytes > counts.peakBytes) {
+            counts.peakBytes = counts.liveBytes;
+        }
+
+        if (statistics.sampleInterval == 0 || --allocationsUntilSample > 0) {
+            return;
+        }
+
+        allocationsUntilSample = statistics.sampleInterval;
 
-        for (int j = 0; j < count; j++) {
-            header->size = size;
-            buffer += spaceRequired;
+        auto& sample = statistics.samples[statistics.nextSample];
+        statistics.nextSample = (statistics.nextSample + 1) % HeapSampleCount;
+        sample = {};
+        sample.size = size;
 
-            if (j < (count - 1)) {
-                header->next = reinterpret_cast<FixedSizeHeader*>(buffer);
-                header = header->next;
+        /*
+        Everything is built with frame pointers, so each frame starts
+        with the caller's frame pointer followed by the return address.
+        The first frame is whichever Heap function called this
+        */
+        auto frame = reinterpret_cast<uintptr_t*>(__builtin_frame_address(0));
+
+        for (int i = 0; i < HeapSampleDepth + 1 && frame != nullptr; i++) {
+            if (i > 0) {
+                sample.callers[i - 1] = frame[1];
             }
-            else {
-                header->next = nullptr;
+
+            auto next = reinterpret_cast<uintptr_t*>(frame[0]);
+
+            //stacks grow down, so anything else means the chain ended
+            if (next <= frame) {
+                break;
             }
+
+            frame = next;
+        }
+    }
+
+    void Heap::recordFree(SizeClassStatistics& counts, uint32_t size) {
+        counts.frees++;
+        counts.liveBytes -= size;
+    }
+
+    int Heap::getSizeClass(size_t size) {
+        if (size <= 256) {
+            return size == 0 ? 0 : (size - 1) / 8;
         }
 
-        preallocatedTimesCalled++;
+        int sizeClass = 32;
+
+        for (uint32_t band = 256; band < MaxSmallSize; band *= 2) {
+            if (size <= band * 2) {
+                return sizeClass + (size - band - 1) / (band / 4);
+            }
+
+            sizeClass += 4;
+        }
 
-        return first;
+        return -1;
     }
 
-    [[noreturn]]
-    void uhoh() {
-        while (true) {}
+    uint32_t Heap::getClassSize(int sizeClass) {
+        if (sizeClass < 32) {
+            return (sizeClass + 1) * 8;
+        }
+
+        sizeClass -= 32;
+        uint32_t band = 256 << (sizeClass / 4);
+        return band + (sizeClass % 4 + 1) * (band / 4);
     }
 
-    void* Heap::aligned_allocate(size_t alignment, size_t size) {
-        if (size <= MaxFixedBinSize && alignment == 8) {
-            alignedFilledFromFixed++;
-            return allocate(size);
+    bool Heap::refillSizeClass(int sizeClass) {
+        auto classSize = getClassSize(sizeClass);
+        auto stride = classSize + sizeof(ChunkHeader);
+        auto count = 16384 / stride;
+        count = count < 8 ? 8 : count;
+
+        auto run = allocateChunk(count * stride, 8);
+
+        if (run == nullptr) {
+            return false;
         }
-        else if (size <= MaxFixedBinSize) {
-            possibleFixedAligned++;
+
+        statistics.runsAllocated++;
+        auto buffer = reinterpret_cast<uint8_t*>(run + 1);
+
+        for (auto i = 0u; i < count; i++) {
+            auto header = reinterpret_cast<ChunkHeader*>(buffer + i * stride);
+            header->flags = Small | (sizeClass << SizeClassShift);
+            header->size = classSize;
+
+            auto object = reinterpret_cast<FreeObject*>(header + 1);
+            object->next = sizeClasses[sizeClass];
+            sizeClasses[sizeClass] = object;
         }
 
-        alignedFilledFromOld++;
+        return true;
+    }
 
-        auto chunk = findFreeAlignedChunk(size, alignment);
-        if (chunk == nullptr) {
-            uhoh();
+    void* Heap::allocateSmall(int sizeClass) {
+        if (sizeClasses[sizeClass] == nullptr && !refillSizeClass(sizeClass)) {
             return nullptr;
         }
 
-        auto startingAddress = reinterpret_cast<uint32_t>(chunk) + sizeof(ChunkHeader);
-        auto alignedAddress = (startingAddress + alignment - 1) & ~(alignment - 1);
+        auto object = sizeClasses[sizeClass];
+        sizeClasses[sizeClass] = object->next;
 
-        if (startingAddress != alignedAddress) {
-            //can we fit it inside the chunk?
-            auto chunkEndAddress = startingAddress + chunk->size;
+        auto header = reinterpret_cast<ChunkHeader*>(object) - 1;
+        header->flags |= InUse;
 
-            //TODO: this should never be true
-            if ((alignedAddress - startingAddress) < sizeof(ChunkHeader)) {
-                alignedAddress = (startingAddress + sizeof(ChunkHeader) + alignment - 1) & ~(alignment - 1);
+        recordAllocation(statistics.sizeClasses[sizeClass], header->size);
+        return object;
+    }
 
-                if ((alignedAddress + size) > chunkEndAddress) {
-                    uhoh();
-                }
-            }
+    FreeChunk* Heap::findBestFit(uint32_t chunkSize) {
+        auto node = freeChunks;
+        FreeChunk* best = nullptr;
 
-            if ((alignedAddress - startingAddress) < sizeof(ChunkHeader)) {
-                //TODO: not enough space to split chunk, wat do
-                uhoh();
-                kprintf("[HEAP] aligned_allocate not enough space in this chunk??\n");
-                return nullptr;
+        while (node != nullptr) {
+            if (getChunkSize(&node->header) >= chunkSize) {
+                best = node;
+                node = node->left;
             }
-            else if ((alignedAddress + size) > chunkEndAddress) {
-                    uhoh();
-                }
             else {
-                auto alignedChunk = reinterpret_cast<ChunkHeader*>(alignedAddress - sizeof(ChunkHeader));
-                alignedChunk->magic = 0xabababab;
-                alignedChunk->magic2 = 0xcdcdcdcd;
-                alignedChunk->size = chunkEndAddress - alignedAddress;
-                alignedChunk->free = true;
-                alignedChunk->next = chunk->next;
-                alignedChunk->previous = chunk;
-                
-                chunk->size = alignedAddress - startingAddress - sizeof(ChunkHeader);
-                chunk->next = alignedChunk;
-
-                return allocate(alignedChunk, size);
+                node = node->right;
             }
         }
-        else {
-            return allocate(chunk, size);
-        }
+
+        return best;
     }
 
-    ChunkHeader* Heap::findFreeChunk(size_t size) {
-        if (nextFreeChunk->size >= size && nextFreeChunk->free) {
-            return nextFreeChunk;
-        }
-        else {
-            auto chunk = heapStart;
+    ChunkHeader* Heap::allocateChunk(size_t size, size_t alignment) {
+        size = (size + 7) & ~7;
+        uint32_t chunkSize = size + sizeof(ChunkHeader);
+        chunkSize = chunkSize < MinimumChunkSize ? MinimumChunkSize : chunkSize;
 
-            while (chunk != nullptr) {
-                if (chunk->free && chunk->size >= size) {
-                    return chunk;
-                }                
+        auto searchSize = chunkSize;
 
-                chunk = chunk->next;
-            }
+        if (alignment > 8) {
+            //room to split off a free chunk in front of the aligned one
+            searchSize += alignment + MinimumChunkSize;
         }
 
-        uhoh();
+        auto fit = findBestFit(searchSize);
 
-        kprintf("[Heap] findFreeChunk for %d size returned null\n", size);
+        if (fit == nullptr) {
+            return nullptr;
+        }
 
-        return nullptr;
-    }
+        removeFreeChunk(freeChunks, fit);
 
-    ChunkHeader* Heap::findFreeAlignedChunk(size_t size, size_t alignment) {
-        auto chunk = findFreeChunk(size);
-        auto startingAddress = reinterpret_cast<uint32_t>(chunk) + sizeof(ChunkHeader);
-        auto alignedAddress = (startingAddress + alignment - 1) & ~(alignment -  1);
+        auto chunk = &fit->header;
+        auto fitSize = getChunkSize(chunk);
+        auto released = chunk->flags & Released;
+        auto previousInUse = chunk->flags & PreviousInUse;
 
-        if (startingAddress != alignedAddress) {
-            //can we fit it inside the chunk?
-            auto chunkEndAddress = startingAddress + chunk->size;
+        if (alignment > 8) {
+            auto start = reinterpret_cast<uintptr_t>(chunk);
+            auto payload = (start + sizeof(ChunkHeader) + alignment - 1) & ~(alignment - 1);
+            auto leading = payload - sizeof(ChunkHeader) - start;
 
-            if ((alignedAddress + size) <= chunkEndAddress) {
-                return chunk;
+            while (leading > 0 && leading < MinimumChunkSize) {
+                payload += alignment;
+                leading += alignment;
             }
-            else {
-                auto chunk = heapStart;
-
-                while (chunk != nullptr) {
-                    if (chunk != nextFreeChunk && chunk->size >= size) {
-                        startingAddress = reinterpret_cast<uint32_t>(chunk) + sizeof(ChunkHeader); 
-                        alignedAddress = (startingAddress + alignment - 1) & ~(alignment - 1);
-
-                        if (startingAddress != alignedAddress) {
-                            //can we fit it inside the chunk?
-                            auto chunkEndAddress = startingAddress + chunk->size;
-
-                            if ((alignedAddress + size) < chunkEndAddress) {
-                                return chunk;
-                            }
-                        }
-                        else {
-                            return chunk;
-                        }
-                    }
-
-                    chunk = chunk->next;
-                }
+
+            if (leading > 0) {
+                markFree(chunk, leading, previousInUse | released);
+                insertFreeChunk(freeChunks, reinterpret_cast<FreeChunk*>(chunk));
+
+                chunk = reinterpret_cast<ChunkHeader*>(payload - sizeof(ChunkHeader));
+                fitSize -= leading;
+                previousInUse = 0;
             }
         }
+
+        auto remainder = fitSize - chunkSize;
+
+        if (remainder >= MinimumChunkSize) {
+            auto rest = reinterpret_cast<ChunkHeader*>(reinterpret_cast<uintptr_t>(chunk) + chunkSize);
+            markFree(rest, remainder, PreviousInUse | released);
+            insertFreeChunk(freeChunks, reinterpret_cast<FreeChunk*>(rest));
+        }
         else {
-            return chunk;
+            chunkSize = fitSize;
         }
 
-        uhoh();
+        chunk->flags = InUse | previousInUse;
+        chunk->size = chunkSize - sizeof(ChunkHeader);
 
-        kprintf("[HEAP] couldn't find free aligned chunk\n");
-        return nullptr;
-    }
+        if (remainder < MinimumChunkSize) {
+            getNextChunk(chunk)->flags |= PreviousInUse;
+        }
 
-    void* Heap::allocate(ChunkHeader* chunk, size_t size) {
-        chunk->free = false;
-        
-        //use up first part of chunk and split rest into new free
-        //pages are already allocated
-        auto currentAddress = reinterpret_cast<uint32_t>(chunk);
-        currentAddress += sizeof(ChunkHeader);
-        uint32_t allocatedAddress = currentAddress;
-        currentAddress += size;
-
-        if (chunk->size > (size + sizeof(ChunkHeader))) {
-            //theres space left over, create a new chunk with that space
-            ChunkHeader* nextChunk = reinterpret_cast<ChunkHeader*>(currentAddress);
-            nextChunk->magic = 0xabababab;
-            nextChunk->magic2 = 0xcdcdcdcd;
-            nextChunk->size = chunk->size - size - sizeof(ChunkHeader);
-            nextChunk->free = true;
-            nextChunk->next = chunk->next;
-            nextChunk->previous = chunk;
-
-            chunk->next = nextChunk;
-            chunk->size = size;
-
-            nextFreeChunk = nextChunk;
-        }
-
-        return reinterpret_cast<void*>(allocatedAddress);
+        return chunk;
     }
 
-    void* Heap::allocate(size_t size) {
-       
-        if (size <= MaxFixedBinSize) {
-            auto bin = (size >> 3) + ((size & 7) > 0);
-            bin = bin > 0 ? bin - 1 : 0;
+    void Heap::freeChunk(ChunkHeader* chunk) {
+        auto start = reinterpret_cast<uintptr_t>(chunk);
+        auto end = start + getChunkSize(chunk);
 
-            if (fixedBins[bin] == nullptr) {
-                auto fixedSize = (bin + 1) << 3;
-                fixedBins[bin] = preallocateFixedChunks(fixedSize, getPreallocationCount(fixedSize));
-            }   
+        /*
+        Pages that may have been touched since they were last
+        given back, if the coalesced chunk is big enough
+        */
+        auto touchedStart = start;
 
-            auto chunk = fixedBins[bin];
-            fixedBins[bin] = chunk->next;
+        if (!(chunk->flags & PreviousInUse)) {
+            auto previous = getPreviousChunk(chunk);
+            removeFreeChunk(freeChunks, reinterpret_cast<FreeChunk*>(previous));
+            start = reinterpret_cast<uintptr_t>(previous);
+
+            if (!(previous->flags & Released)) {
+                touchedStart = start;
+            }
+        }
 
-            filledFromFixed++;
+        auto next = reinterpret_cast<ChunkHeader*>(end);
 
-            return reinterpret_cast<uint8_t*>(chunk) + sizeof(FixedSizeHeader);
+        if (!(next->flags & InUse)) {
+            removeFreeChunk(freeChunks, reinterpret_cast<FreeChunk*>(next));
+            end += getChunkSize(next);
         }
 
-        filledFromOld++;
+        auto size = end - start;
+        auto release = size >= ReleaseThreshold;
+        auto merged = reinterpret_cast<ChunkHeader*>(start);
+
+        markFree(merged, size, PreviousInUse | (release ? Released : 0));
+        reinterpret_cast<ChunkHeader*>(end)->flags &= ~PreviousInUse;
+        insertFreeChunk(freeChunks, reinterpret_cast<FreeChunk*>(merged));
 
-        auto chunk = findFreeChunk(size);
+        if (release) {
+            auto firstUnused = start + sizeof(FreeChunk);
+            releaseFreePages(touchedStart > firstUnused ? touchedStart : firstUnused, 
+                end - sizeof(uint32_t));
+        }
+    }
+
+    void Heap::releaseFreePages(uintptr_t start, uintptr_t end) {
+        start = (start + PageSize - 1) & ~(PageSize - 1);
+        end &= ~(PageSize - 1);
+
+        if (end > start) {
+            auto pageCount = (end - start) / PageSize;
+            releasePages(start, pageCount);
+            statistics.pagesReleased += pageCount;
+        }
+    }
+
+    void* Heap::aligned_allocate(size_t alignment, size_t size) {
+        if (alignment <= 8) {
+            return allocate(size);
+        }
+
+        if (size >= HugeSize && alignment < PageSize) {
+            alignment = PageSize;
+        }
+
+        auto chunk = allocateChunk(size, alignment);
 
         if (chunk == nullptr) {
-            uhoh();
             return nullptr;
         }
 
-        return allocate(chunk, size); 
+        recordAllocation(statistics.chunks, chunk->size);
+        return chunk + 1;
     }
 
-    void Heap::free(void* ptr) {
+    void* Heap::allocate(size_t size) {
+        if (size <= MaxSmallSize) {
+            return allocateSmall(getSizeClass(size));
+        }
 
-        auto size = *(reinterpret_cast<uint32_t*>(ptr) - 1);
+        //huge allocations get their own pages so they can all be given back
+        auto chunk = allocateChunk(size, size >= HugeSize ? PageSize : 8);
 
-        if (size > MaxFixedBinSize) {
-            freeFromOld++;
-        }
-        else {
-            freeFromFixed++;
-            auto bin = (size >> 3) - 1;
-            auto header = reinterpret_cast<FixedSizeHeader*>(ptr) - 1;
-            header->next = fixedBins[bin];
-            fixedBins[bin] = header;
+        if (chunk == nullptr) {
+            return nullptr;
         }
 
-        return;
+        recordAllocation(statistics.chunks, chunk->size);
+        return chunk + 1;
     }
 
-    ChunkHeader* Heap::combineChunkWithNext(ChunkHeader* chunk) {
-        chunk->size += chunk->next->size + sizeof(ChunkHeader);
-        chunk->next = chunk->next->next;
-        return chunk;
-    }
+    void Heap::free(void* ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
 
-    void Heap::HACK_syncPageWithVMM() {
-        currentPage = ::Memory::getCurrentVMM()->allocatePages(1, kernelPageFlags);
-        remainingPageSpace = PageSize;
-    }
+        auto header = reinterpret_cast<ChunkHeader*>(ptr) - 1;
 
-    Heap* createHeap(uint32_t heapSize, ::Memory::VirtualMemoryManager* vmm) {
-        auto virtualAddress = vmm->allocatePages(1, kernelPageFlags);
-        auto physicalPage = ::Memory::currentPMM->allocatePage(1);
-        vmm->map(virtualAddress, physicalPage);
-        ::Memory::currentPMM->finishAllocation(virtualAddress, 1);
-        auto ptr = reinterpret_cast<void*>(virtualAddress);
+        if (!(header->flags & InUse)) {
+            //double free
+            return;
+        }
 
-        auto heap = new (ptr) Heap;
-        heap->initialize(heapSize, vmm);
-        return heap;
-    }
+        if (header->flags & Small) {
+            header->flags &= ~InUse;
+
+            auto sizeClass = header->flags >> SizeClassShift;
+            auto object = reinterpret_cast<FreeObject*>(ptr);
+            object->next = sizeClasses[sizeClass];
+            sizeClasses[sizeClass] = object;
 
-}
\ No newline at end of file
+            recordFree(statistics.sizeClasses[sizeClass], header->size);
+        }
+        else {
+            recordFree(statistics.chunks, header->size);
+            freeChunk(header);
+        }
+    }
+}
@@ -36,71 +36,154 @@ namespace Memory {
 
 namespace Saturn::Memory {
 
+    /*
+    Every allocation is preceded by a ChunkHeader. size is always
+    the number of usable bytes after the header, realloc relies on
+    it being the last 4 bytes before the allocation
+    */
     struct ChunkHeader {
-        uint32_t magic {0xabababab};
-        uint32_t magic2 {0xcdcdcdcd};
-        ChunkHeader* next;
-        ChunkHeader* previous; 
-        uint32_t size : 31;
-        bool free : 1;
+        uint32_t flags;
+        uint32_t size;
     };
 
-    struct FixedSizeHeader {
-        FixedSizeHeader* next;
-        uint32_t size: 29;
-        bool free : 1;
-        int unused : 2;
+    enum class ChunkFlags : uint32_t {
+        InUse = 1 << 0,
+        PreviousInUse = 1 << 1,
+
+        //carved out of a run for one size class, the class is in the upper bits
+        Small = 1 << 2,
+
+        //a free chunk whose pages have already been given back
+        Released = 1 << 3
+    };
+
+    /*
+    Free chunks hold their links in the best fit tree where the
+    allocation would go, and their total size in their last 4 bytes
+    so the chunk after them can find their start when coalescing
+    */
+    struct FreeChunk {
+        ChunkHeader header;
+        FreeChunk* left;
+        FreeChunk* right;
+    };
+
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    /*
+    8 byte steps up to 256, then 4 classes per power of two up to 4KB
+    */
+    inline constexpr int SizeClassCount {48};
+    inline constexpr int HeapSampleCount {6};
+    inline constexpr int HeapSampleDepth {3};
+
+    struct SizeClassStatistics {
+        uint32_t allocations;
+        uint32_t frees;
+        uint32_t liveBytes;
+        uint32_t peakBytes;
     };
 
-    struct RegularHeader {
-        uint32_t size: 29;
-        bool free : 1;
-        int unused : 2;
-        RegularHeader* next;
-        RegularHeader* prev;
+    /*
+    The size of a sampled allocation and the return
+    addresses of the functions that led to it
+    */
+    struct HeapSample {
+        uint32_t size;
+        uintptr_t callers[HeapSampleDepth];
     };
 
+    /*
+    Lives inside the heap so the kernel can copy it out of a
+    task's address space, see Kernel::GetTaskHeapStatistics
+    */
+    struct HeapStatistics {
+        SizeClassStatistics sizeClasses[SizeClassCount];
+
+        //anything bigger than the largest size class
+        SizeClassStatistics chunks;
+
+        uint32_t runsAllocated;
+        uint32_t pagesReleased;
+
+        /*
+        Every sampleInterval'th allocation is recorded in samples,
+        overwriting the oldest. 0 turns sampling off
+        */
+        uint32_t sampleInterval;
+        uint32_t nextSample;
+        HeapSample samples[HeapSampleCount];
+    };
+
+    /*
+    Sizes up to MaxSmallSize are rounded up to a size class and
+    served from per class free lists, which are refilled a run at a time.
+    Anything bigger comes from chunks with boundary tags, free ones
+    are coalesced with their neighbours and kept in a tree ordered by
+    size then address, so allocation takes the best fit. Allocations of
+    HugeSize or more are page aligned, and whenever a free chunk grows
+    past ReleaseThreshold the pages inside it are given back.
+    */
     class Heap {
     public:
 
+        /*
+        Reserves heapSize bytes from vmm, see create_heap.cpp
+        */
         void initialize(uint32_t heapSize, ::Memory::VirtualMemoryManager* vmm);
+
+        /*
+        Sets the heap up in a range that's already reserved, whose
+        pages are zero filled when they're first touched
+        */
+        void initialize(uintptr_t start, uint32_t heapSize);
+
         void* allocate(size_t size);
         void* aligned_allocate(size_t alignment, size_t size);
         void free(void* ptr);
-        void HACK_syncPageWithVMM();
+
+        const HeapStatistics& getStatistics() const;
+        void setSampleInterval(uint32_t interval);
+
+        static uint32_t getClassSize(int sizeClass);
 
     private:
 
-        void* allocate(ChunkHeader* chunk, size_t size);
-        ChunkHeader* findFreeChunk(size_t size);
-        ChunkHeader* findFreeAlignedChunk(size_t size, size_t alignment);
-        ChunkHeader* combineChunkWithNext(ChunkHeader* chunk);
-        
-        uint32_t currentPage {0};
-        uint32_t remainingPageSpace {0};
-        ChunkHeader* heapStart;
-        ChunkHeader* nextFreeChunk;
+        static constexpr uint32_t MaxSmallSize {4096};
+        static constexpr uint32_t HugeSize {128 * 1024};
+        static constexpr uint32_t ReleaseThreshold {64 * 1024};
 
-        void* allocateFromFixed(size_t size);
-        FixedSizeHeader* preallocateFixedChunks(int size, int count);
+        static int getSizeClass(size_t size);
 
-        static const int MaxNumberOfBins {32};
-        static const int MaxFixedBinSize {256};
+        void* allocateSmall(int sizeClass);
+        bool refillSizeClass(int sizeClass);
 
-        FixedSizeHeader* fixedBins[MaxNumberOfBins];
+        ChunkHeader* allocateChunk(size_t size, size_t alignment);
+        void freeChunk(ChunkHeader* chunk);
 
-        int filledFromFixed {0};
-        int filledFromOld {0};
+        FreeChunk* findBestFit(uint32_t chunkSize);
 
-        int alignedFilledFromFixed {0};
-        int possibleFixedAligned {0};
-        int alignedFilledFromOld {0};
+        void releaseFreePages(uintptr_t start, uintptr_t end);
 
-        int freeFromFixed {0};
-        int freeFromOld {0};
+        void recordAllocation(SizeClassStatistics& counts, uint32_t size);
+        void recordFree(SizeClassStatistics& counts, uint32_t size);
 
-        int preallocatedTimesCalled {0};
+        uintptr_t heapStart;
+        uintptr_t heapEnd;
+        FreeChunk* freeChunks;
+        FreeObject* sizeClasses[SizeClassCount];
+        HeapStatistics statistics;
+        uint32_t allocationsUntilSample;
     };
 
     Heap* createHeap(uint32_t heapSize, ::Memory::VirtualMemoryManager* vmm);
-}
\ No newline at end of file
+
+    /*
+    Gives back the physical pages behind a range of the heap, which
+    stays reserved so the pages fault back in zeroed if touched again.
+    The kernel and userland libc each provide their own
+    */
+    void releasePages(uintptr_t address, uint32_t pageCount);
+}
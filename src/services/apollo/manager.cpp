@@ -572,6 +572,17 @@ namespace Apollo {
             return 1;
         }
 
+        /*
+        Mouse moves arrive much faster than frames are rendered,
+        so let the kernel merge consecutive ones into a single move
+        */
+        Kernel::SetMailboxPolicy policy;
+        policy.serviceType = Kernel::ServiceType::Scheduler;
+        policy.coalesce = IPC::CoalescePolicy::SumValues;
+        policy.coalesceNamespace = IPC::MessageNamespace::Mouse;
+        policy.coalesceMessageId = static_cast<uint32_t>(Mouse::MessageId::MouseMove);
+        send(IPC::RecipientType::ServiceName, &policy);
+
         Manager manager {framebufferAddress};
         manager.messageLoop();
 
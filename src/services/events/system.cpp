@@ -241,9 +241,26 @@ namespace Event {
         signature.args.readType();
         signature.args.write(event.data(), Vostok::ArgTypes::Cstring);
 
+        std::vector<WriteRequest> writes;
+        writes.reserve(subscribers.size());
+
         for (auto subscriber : subscribers) {
-            write(subscriber, signature.result.buffer, sizeof(signature.result.buffer));
+            WriteRequest request;
+            request.serviceType = Kernel::ServiceType::VFS;
+            request.fileDescriptor = subscriber;
+            request.writeLength = sizeof(signature.result.buffer);
+            memcpy(request.buffer, signature.result.buffer, sizeof(signature.result.buffer));
+            writes.push_back(request);
         }
+
+        std::vector<IPC::BatchEntry> batch;
+        batch.reserve(writes.size());
+
+        for (auto& request : writes) {
+            batch.push_back({IPC::RecipientType::ServiceName, &request});
+        }
+
+        sendBatch(batch.data(), batch.size());
     }
 
     void EventSystem::forwardToSerialPort(WriteRequest& request) {
@@ -0,0 +1,287 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "heap.h"
+#include <string.h>
+#include <stdio.h>
+#include <system_calls.h>
+#include <services.h>
+#include <saturn/time.h>
+#include <services/virtualFileSystem/virtualFileSystem.h>
+
+using namespace VirtualFileSystem;
+using namespace Vostok;
+using namespace Saturn::Memory;
+
+namespace PFS {
+
+    void replyWriteSucceeded(uint32_t requesterTaskId, uint32_t requestId, bool success);
+
+    Kernel::TaskHeapStatisticsResult getHeapStatistics(uint32_t pid) {
+        Kernel::GetTaskHeapStatistics request;
+        request.serviceType = Kernel::ServiceType::Scheduler;
+        request.taskId = pid;
+        send(IPC::RecipientType::ServiceName, &request);
+
+        IPC::MaximumMessageBuffer buffer;
+        filteredReceive(&buffer, IPC::MessageNamespace::Scheduler, static_cast<uint32_t>(Kernel::MessageId::TaskHeapStatisticsResult));
+
+        return IPC::extractMessage<Kernel::TaskHeapStatisticsResult>(buffer);
+    }
+
+    /*
+    Writes classSize:value for every size class that has been used.
+    A result that doesn't fit is cut off, but the large bucket is
+    always kept at the end
+    */
+    template<typename Getter>
+    void writeSizeClasses(ArgBuffer& args, const HeapStatistics& statistics, Getter getValue) {
+        //leave room in the 256 byte result for the type tags
+        char values[200];
+        char large[24];
+        int written {0};
+
+        auto largeLength = snprintf(large, sizeof(large), "large:%u", getValue(statistics.chunks));
+        auto limit = static_cast<int>(sizeof(values)) - largeLength - 1;
+        values[0] = '\0';
+
+        for (int i = 0; i < SizeClassCount; i++) {
+            auto& sizeClass = statistics.sizeClasses[i];
+
+            if (sizeClass.allocations == 0) {
+                continue;
+            }
+
+            char pair[24];
+            auto length = snprintf(pair, sizeof(pair), "%u:%u ", Heap::getClassSize(i), getValue(sizeClass));
+
+            if (written + length > limit) {
+                break;
+            }
+
+            memcpy(values + written, pair, length + 1);
+            written += length;
+        }
+
+        memcpy(values + written, large, largeLength + 1);
+        args.writeValueWithType(values, ArgTypes::Cstring);
+    }
+
+    void writeSamples(ArgBuffer& args, const HeapStatistics& statistics) {
+        char samples[200];
+        int written {0};
+
+        samples[0] = '\0';
+
+        //oldest first, nextSample is the one that gets overwritten next
+        for (int i = 0; i < HeapSampleCount; i++) {
+            auto& sample = statistics.samples[(statistics.nextSample + i) % HeapSampleCount];
+
+            if (sample.size == 0) {
+                continue;
+            }
+
+            char entry[64];
+            auto length = snprintf(entry, sizeof(entry), written == 0 ? "%u@%lx,%lx,%lx" : " %u@%lx,%lx,%lx",
+                sample.size,
+                static_cast<unsigned long>(sample.callers[0]),
+                static_cast<unsigned long>(sample.callers[1]),
+                static_cast<unsigned long>(sample.callers[2]));
+
+            if (written + length >= static_cast<int>(sizeof(samples))) {
+                break;
+            }
+
+            memcpy(samples + written, entry, length + 1);
+            written += length;
+        }
+
+        args.writeValueWithType(samples, ArgTypes::Cstring);
+    }
+
+    HeapObject::HeapObject(uint32_t pid)
+        : pid{pid} {
+    }
+
+    void HeapObject::readSelf(uint32_t requesterTaskId, uint32_t requestId) {
+        ReadResult result;
+        result.success = true;
+        result.requestId = requestId;
+        ArgBuffer args {result.buffer, sizeof(result.buffer)};
+        args.writeType(ArgTypes::Property);
+
+        args.writeValueWithType("live", ArgTypes::Cstring);
+        args.writeValueWithType("peak", ArgTypes::Cstring);
+        args.writeValueWithType("rate", ArgTypes::Cstring);
+        args.writeValueWithType("sampling", ArgTypes::Cstring);
+        args.writeValueWithType("samples", ArgTypes::Cstring);
+
+        args.writeType(ArgTypes::EndArg);
+
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    /*
+    Vostok Object function support
+    */
+    int HeapObject::getFunction(std::string_view) {
+        return -1;
+    }
+
+    void HeapObject::readFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t functionId) {
+        describeFunction(requesterTaskId, requestId, functionId);
+    }
+
+    void HeapObject::writeFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t, ArgBuffer&) {
+        replyWriteSucceeded(requesterTaskId, requestId, false);
+    }
+
+    void HeapObject::describeFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t) {
+        ReadResult result {};
+        result.requestId = requestId;
+        result.success = false;
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    /*
+    Vostok Object property support
+    */
+    int HeapObject::getProperty(std::string_view name) {
+        if (name.compare("live") == 0) {
+            return static_cast<int>(PropertyId::Live);
+        }
+        else if (name.compare("peak") == 0) {
+            return static_cast<int>(PropertyId::Peak);
+        }
+        else if (name.compare("rate") == 0) {
+            return static_cast<int>(PropertyId::Rate);
+        }
+        else if (name.compare("sampling") == 0) {
+            return static_cast<int>(PropertyId::Sampling);
+        }
+        else if (name.compare("samples") == 0) {
+            return static_cast<int>(PropertyId::Samples);
+        }
+
+        return -1;
+    }
+
+    void HeapObject::readProperty(uint32_t requesterTaskId, uint32_t requestId, uint32_t propertyId) {
+        auto reply = getHeapStatistics(pid);
+        auto& statistics = reply.statistics;
+
+        ReadResult result;
+        result.requestId = requestId;
+        result.success = reply.found;
+        ArgBuffer args{result.buffer, sizeof(result.buffer)};
+        args.writeType(ArgTypes::Property);
+
+        switch(static_cast<PropertyId>(propertyId)) {
+            case PropertyId::Live: {
+                writeSizeClasses(args, statistics, [](auto& counts) { return counts.liveBytes; });
+                break;
+            }
+            case PropertyId::Peak: {
+                writeSizeClasses(args, statistics, [](auto& counts) { return counts.peakBytes; });
+                break;
+            }
+            case PropertyId::Rate: {
+                auto now = Saturn::Time::getHighResolutionTimeSeconds();
+                auto elapsed = now - lastReadTime;
+                uint32_t previous[SizeClassCount + 1];
+                memcpy(previous, lastAllocations, sizeof(previous));
+
+                for (int i = 0; i < SizeClassCount; i++) {
+                    lastAllocations[i] = statistics.sizeClasses[i].allocations;
+                }
+
+                lastAllocations[SizeClassCount] = statistics.chunks.allocations;
+
+                //the first read has nothing to compare against
+                auto firstRead = lastReadTime == 0;
+                lastReadTime = now;
+
+                writeSizeClasses(args, statistics, [&](auto& counts) {
+                    if (firstRead || elapsed <= 0) {
+                        return 0u;
+                    }
+
+                    auto index = &counts == &statistics.chunks 
+                        ? SizeClassCount 
+                        : static_cast<int>(&counts - statistics.sizeClasses);
+                    auto allocations = counts.allocations - previous[index];
+                    return static_cast<uint32_t>(allocations / elapsed);
+                });
+                break;
+            }
+            case PropertyId::Sampling: {
+                args.writeValueWithType(statistics.sampleInterval, ArgTypes::Uint32);
+                break;
+            }
+            case PropertyId::Samples: {
+                writeSamples(args, statistics);
+                break;
+            }
+        }
+
+        args.writeType(ArgTypes::EndArg);
+
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    void HeapObject::writeProperty(uint32_t requesterTaskId, uint32_t requestId, uint32_t propertyId, ArgBuffer& args) {
+        auto type = args.readType();
+
+        //only sampling is writable, the statistics are read-only
+        if (type != ArgTypes::Property || propertyId != static_cast<uint32_t>(PropertyId::Sampling)) {
+            replyWriteSucceeded(requesterTaskId, requestId, false);
+            return;
+        }
+
+        auto interval = args.read<uint32_t>(ArgTypes::Uint32);
+
+        if (args.hasErrors()) {
+            replyWriteSucceeded(requesterTaskId, requestId, false);
+            return;
+        }
+
+        Kernel::SetTaskHeapSampling request;
+        request.serviceType = Kernel::ServiceType::Scheduler;
+        request.taskId = pid;
+        request.sampleInterval = interval;
+        send(IPC::RecipientType::ServiceName, &request);
+
+        replyWriteSucceeded(requesterTaskId, requestId, true);
+    }
+
+    Object* HeapObject::getNestedObject(std::string_view) {
+        return nullptr;
+    }
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <services/virtualFileSystem/vostok.h>
+#include <saturn/heap.h>
+
+namespace PFS {
+
+    /*
+    The HeapObject is mounted at /process/<pid>/heap and exposes the
+    task's Saturn::Memory::HeapStatistics. live, peak and rate are
+    written as a space separated list of classSize:value pairs,
+    skipping size classes that were never used, followed by
+    large:value for everything bigger than the largest class.
+    rate is allocations per second since the previous read.
+    Writing a nonzero interval to sampling records every
+    interval'th allocation, which samples lists as
+    size@caller,caller,caller
+    */
+    class HeapObject : public Vostok::Object {
+    public:
+
+        HeapObject(uint32_t pid = 0);
+        virtual ~HeapObject() {}
+
+        void readSelf(uint32_t requesterTaskId, uint32_t requestId) override;
+
+        int getFunction(std::string_view name) override;
+        void readFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t functionId) override;
+        void writeFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t functionId, Vostok::ArgBuffer& args) override;
+        void describeFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t functionId) override;
+
+        int getProperty(std::string_view name) override;
+        void readProperty(uint32_t requesterTaskId, uint32_t requestId, uint32_t propertyId) override;
+        void writeProperty(uint32_t requesterTaskId, uint32_t requestId, uint32_t propertyId, Vostok::ArgBuffer& args) override;
+
+        Object* getNestedObject(std::string_view name) override;
+
+        uint32_t pid;
+
+    private:
+
+        enum class PropertyId {
+            Live,
+            Peak,
+            Rate,
+            Sampling,
+            Samples
+        };
+
+        //allocation counts as of the previous read of rate, chunks last
+        uint32_t lastAllocations[Saturn::Memory::SizeClassCount + 1] {};
+        double lastReadTime {0};
+    };
+}
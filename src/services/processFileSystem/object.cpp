@@ -36,7 +36,7 @@ using namespace Vostok;
 namespace PFS {
 
     ProcessObject::ProcessObject(uint32_t pid)
-        : pid{pid} {
+        : pid{pid}, sched{pid}, heap{pid} {
         memset(executable, '\0', sizeof(executable));
     }
 
@@ -48,6 +48,8 @@ namespace PFS {
         args.writeType(ArgTypes::Property);
 
         args.writeValueWithType("executable", ArgTypes::Cstring);
+        args.writeValueWithType("sched", ArgTypes::Cstring);
+        args.writeValueWithType("heap", ArgTypes::Cstring);
 
         args.writeType(ArgTypes::EndArg);
 
@@ -211,7 +213,14 @@ namespace PFS {
         }
     }
 
-    Object* ProcessObject::getNestedObject(std::string_view) {
+    Object* ProcessObject::getNestedObject(std::string_view name) {
+        if (name.compare("sched") == 0) {
+            return &sched;
+        }
+        else if (name.compare("heap") == 0) {
+            return &heap;
+        }
+
         return nullptr;
     }
 
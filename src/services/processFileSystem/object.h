@@ -29,6 +29,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdint.h>
 #include <services/virtualFileSystem/vostok.h>
+#include "taskScheduling.h"
+#include "heap.h"
 
 namespace PFS {
 
@@ -36,7 +38,8 @@ namespace PFS {
     A ProcessObject is meant to emulate entries in Plan9's /proc
     It allows the user/other processes to query data about
     the process, such as the executable it started,
-    or the commandline args perhaps
+    or the commandline args perhaps. Scheduling statistics
+    are in the nested sched object, and heap usage in heap
     */
     class ProcessObject : public Vostok::Object {
     public:
@@ -61,6 +64,9 @@ namespace PFS {
 
     private:
 
+        TaskSchedulingObject sched;
+        HeapObject heap;
+
         void testA(uint32_t requesterTaskId, int x);
         void testB(uint32_t requesterTaskId, bool b);
 
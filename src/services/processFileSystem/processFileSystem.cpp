@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <services/virtualFileSystem/virtualFileSystem.h>
 #include <stdio.h>
 #include "object.h"
+#include "scheduler.h"
 #include <stdlib.h>
 #include <vector>
 #include <saturn/parsing.h>
@@ -52,7 +53,8 @@ namespace PFS {
         return false;
     }
 
-    void handleOpenRequest(OpenRequest& request, std::vector<ProcessObject>& processes, std::vector<FileDescriptor>& openDescriptors) {
+    void handleOpenRequest(OpenRequest& request, std::vector<ProcessObject>& processes, 
+        SchedulerObject& scheduler, std::vector<FileDescriptor>& openDescriptors) {
         bool failed {true};
         OpenResult result;
         result.requestId = request.requestId;
@@ -68,17 +70,56 @@ namespace PFS {
 
         auto words = split({request.path, strlen(request.path)}, '/');
 
-        if (words.size() > 0) {
+        if (words.size() > 0 && words[0].compare("scheduler") == 0) {
+
+            if (words.size() > 1) {
+                //path is /process/scheduler/<function or property>
+                auto functionId = scheduler.getFunction(words[1]);
+
+                if (functionId >= 0) {
+                    addDescriptor(&scheduler, functionId, DescriptorType::Function);
+                }
+                else {
+                    auto propertyId = scheduler.getProperty(words[1]);
+
+                    if (propertyId >= 0) {
+                        addDescriptor(&scheduler, propertyId, DescriptorType::Property);
+                    }
+                }
+            }
+            else {
+                addDescriptor(&scheduler, 0, DescriptorType::Object);
+            }
+        }
+        else if (words.size() > 0) {
             char pidString[11];
             memset(pidString, '\0', sizeof(pidString));
-            words[0].copy(pidString, words[1].length());
+            words[0].copy(pidString, words[0].length());
             uint32_t pid = strtol(pidString, nullptr, 10);
             ProcessObject* process;
             auto found = findObject(processes, pid, &process);
 
             if (found) {
 
-                if (words.size() > 1) {
+                auto nested = words.size() > 1 
+                    ? process->getNestedObject(words[1])
+                    : nullptr;
+
+                if (nested != nullptr) {
+
+                    if (words.size() > 2) {
+                        //path is /process/<pid>/<nested>/<property>
+                        auto propertyId = nested->getProperty(words[2]);
+
+                        if (propertyId >= 0) {
+                            addDescriptor(nested, propertyId, DescriptorType::Property);
+                        }
+                    }
+                    else {
+                        addDescriptor(nested, 0, DescriptorType::Object);
+                    }
+                }
+                else if (words.size() > 1) {
                     //path is /process/<pid>/<function or property>
                     auto functionId = process->getFunction(words[1]);
 
@@ -143,7 +184,7 @@ namespace PFS {
         send(IPC::RecipientType::ServiceName, &result);
     } 
 
-    void handleReadRequest(ReadRequest& request, std::vector<FileDescriptor>& openDescriptors) {
+    void handleReadRequest(ReadRequest& request, std::vector<ProcessObject>& processes, std::vector<FileDescriptor>& openDescriptors) {
         auto& descriptor = openDescriptors[request.fileDescriptor];
 
         if (descriptor.type == DescriptorType::Object) {
@@ -156,10 +197,8 @@ namespace PFS {
             if (descriptor.instance == nullptr) {
                 //its the main /process thing, return a list of all objects
 
-                for (auto& desc : openDescriptors) {
-                    if (desc.instance != nullptr)  {
-                        args.writeValueWithType(static_cast<ProcessObject*>(desc.instance)->pid, ArgTypes::Uint32);
-                    }
+                for (auto& process : processes) {
+                    args.writeValueWithType(process.pid, ArgTypes::Uint32);
                 }
 
             }
@@ -187,6 +226,7 @@ namespace PFS {
     void messageLoop() {
 
         std::vector<ProcessObject> processes;
+        SchedulerObject scheduler;
         std::vector<FileDescriptor> openDescriptors;
 
         while (true) {
@@ -198,7 +238,7 @@ namespace PFS {
                     switch(static_cast<MessageId>(buffer.messageId)) {
                         case MessageId::OpenRequest: {
                             auto request = IPC::extractMessage<OpenRequest>(buffer);
-                            handleOpenRequest(request, processes, openDescriptors);
+                            handleOpenRequest(request, processes, scheduler, openDescriptors);
                             break;
                         }
                         case MessageId::CreateRequest: {
@@ -208,7 +248,7 @@ namespace PFS {
                         }
                         case MessageId::ReadRequest: {
                             auto request = IPC::extractMessage<ReadRequest>(buffer);
-                            handleReadRequest(request, openDescriptors);
+                            handleReadRequest(request, processes, openDescriptors);
                             break;
                         }
                         case MessageId::WriteRequest: {
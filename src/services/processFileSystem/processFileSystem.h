@@ -36,6 +36,9 @@ object being a "file" in that directory with its pid as its filename.
 
 One ProcessObject is created per kernel task started, and stores read-only
 information about the process.
+
+/process/scheduler is a SchedulerObject that reports the kernel
+scheduler's work stealing and task migration counts.
 */
 
 namespace PFS {
@@ -0,0 +1,206 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "scheduler.h"
+#include <string.h>
+#include <stdio.h>
+#include <system_calls.h>
+#include <services.h>
+#include <services/virtualFileSystem/virtualFileSystem.h>
+
+using namespace VirtualFileSystem;
+using namespace Vostok;
+
+namespace PFS {
+
+    void replyWriteSucceeded(uint32_t requesterTaskId, uint32_t requestId, bool success);
+
+    Kernel::SchedulerStatisticsResult getStatistics() {
+        Kernel::GetSchedulerStatistics request;
+        request.serviceType = Kernel::ServiceType::Scheduler;
+        send(IPC::RecipientType::ServiceName, &request);
+
+        IPC::MaximumMessageBuffer buffer;
+        filteredReceive(&buffer, IPC::MessageNamespace::Scheduler, static_cast<uint32_t>(Kernel::MessageId::SchedulerStatisticsResult));
+
+        return IPC::extractMessage<Kernel::SchedulerStatisticsResult>(buffer);
+    }
+
+    void SchedulerObject::readSelf(uint32_t requesterTaskId, uint32_t requestId) {
+        ReadResult result;
+        result.success = true;
+        result.requestId = requestId;
+        ArgBuffer args {result.buffer, sizeof(result.buffer)};
+        args.writeType(ArgTypes::Property);
+
+        args.writeValueWithType("steals", ArgTypes::Cstring);
+        args.writeValueWithType("migrations", ArgTypes::Cstring);
+        args.writeValueWithType("cpus", ArgTypes::Cstring);
+        args.writeValueWithType("interrupts", ArgTypes::Cstring);
+
+        args.writeType(ArgTypes::EndArg);
+
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    /*
+    Vostok Object function support
+    */
+    int SchedulerObject::getFunction(std::string_view name) {
+        if (name.compare("dumpTrace") == 0) {
+            return static_cast<int>(FunctionId::DumpTrace);
+        }
+
+        return -1;
+    }
+
+    void SchedulerObject::readFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t functionId) {
+        describeFunction(requesterTaskId, requestId, functionId);
+    }
+
+    void SchedulerObject::writeFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t functionId, ArgBuffer& args) {
+        auto type = args.readType();
+
+        if (type != ArgTypes::Function) {
+            replyWriteSucceeded(requesterTaskId, requestId, false);
+            return;
+        }
+
+        switch(functionId) {
+            case static_cast<uint32_t>(FunctionId::DumpTrace): {
+                Kernel::DumpSchedulerTrace request;
+                request.serviceType = Kernel::ServiceType::Scheduler;
+                send(IPC::RecipientType::ServiceName, &request);
+
+                replyWriteSucceeded(requesterTaskId, requestId, true);
+                break;
+            }
+            default: {
+                replyWriteSucceeded(requesterTaskId, requestId, false);
+            }
+        }
+    }
+
+    void SchedulerObject::describeFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t functionId) {
+        ReadResult result {};
+        result.requestId = requestId;
+        result.success = true;
+        ArgBuffer args{result.buffer, sizeof(result.buffer)};
+        args.writeType(ArgTypes::Function);
+
+        switch(functionId) {
+            case static_cast<uint32_t>(FunctionId::DumpTrace): {
+                args.writeType(ArgTypes::Void);
+                args.writeType(ArgTypes::EndArg);
+                break;
+            }
+            default: {
+                result.success = false;
+            }
+        }
+
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    /*
+    Vostok Object property support
+    */
+    int SchedulerObject::getProperty(std::string_view name) {
+        if (name.compare("steals") == 0) {
+            return static_cast<int>(PropertyId::Steals);
+        }
+        else if (name.compare("migrations") == 0) {
+            return static_cast<int>(PropertyId::Migrations);
+        }
+        else if (name.compare("cpus") == 0) {
+            return static_cast<int>(PropertyId::CPUs);
+        }
+        else if (name.compare("interrupts") == 0) {
+            return static_cast<int>(PropertyId::Interrupts);
+        }
+
+        return -1;
+    }
+
+    void SchedulerObject::readProperty(uint32_t requesterTaskId, uint32_t requestId, uint32_t propertyId) {
+        auto statistics = getStatistics();
+
+        ReadResult result;
+        result.requestId = requestId;
+        result.success = true;
+        ArgBuffer args{result.buffer, sizeof(result.buffer)};
+        args.writeType(ArgTypes::Property);
+
+        switch(static_cast<PropertyId>(propertyId)) {
+            case PropertyId::Steals: {
+                args.writeValueWithType(statistics.steals, ArgTypes::Uint32);
+                break;
+            }
+            case PropertyId::Migrations: {
+                args.writeValueWithType(statistics.migrations, ArgTypes::Uint32);
+                break;
+            }
+            case PropertyId::CPUs: {
+                args.writeValueWithType(statistics.cpuCount, ArgTypes::Uint32);
+                break;
+            }
+            case PropertyId::Interrupts: {
+                char rates[128];
+                int written {0};
+                auto count = statistics.cpuCount < Kernel::MaxStatisticsCPUs
+                    ? statistics.cpuCount 
+                    : Kernel::MaxStatisticsCPUs;
+
+                rates[0] = '\0';
+
+                for (auto i = 0u; i < count && written < static_cast<int>(sizeof(rates)); i++) {
+                    written += snprintf(rates + written, sizeof(rates) - written, 
+                        i == 0 ? "%d" : " %d", statistics.interruptsPerSecond[i]);
+                }
+
+                args.writeValueWithType(rates, ArgTypes::Cstring);
+                break;
+            }
+        }
+
+        args.writeType(ArgTypes::EndArg);
+
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    void SchedulerObject::writeProperty(uint32_t requesterTaskId, uint32_t requestId, uint32_t, ArgBuffer&) {
+        //all scheduler properties are read-only
+        replyWriteSucceeded(requesterTaskId, requestId, false);
+    }
+
+    Object* SchedulerObject::getNestedObject(std::string_view) {
+        return nullptr;
+    }
+}
@@ -0,0 +1,159 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "taskScheduling.h"
+#include <string.h>
+#include <stdio.h>
+#include <system_calls.h>
+#include <services.h>
+#include <services/virtualFileSystem/virtualFileSystem.h>
+
+using namespace VirtualFileSystem;
+using namespace Vostok;
+
+namespace PFS {
+
+    void replyWriteSucceeded(uint32_t requesterTaskId, uint32_t requestId, bool success);
+
+    Kernel::TaskSchedulingStatisticsResult getTaskStatistics(uint32_t pid) {
+        Kernel::GetTaskSchedulingStatistics request;
+        request.serviceType = Kernel::ServiceType::Scheduler;
+        request.taskId = pid;
+        send(IPC::RecipientType::ServiceName, &request);
+
+        IPC::MaximumMessageBuffer buffer;
+        filteredReceive(&buffer, IPC::MessageNamespace::Scheduler, static_cast<uint32_t>(Kernel::MessageId::TaskSchedulingStatisticsResult));
+
+        return IPC::extractMessage<Kernel::TaskSchedulingStatisticsResult>(buffer);
+    }
+
+    void writeHistogram(ArgBuffer& args, uint32_t* buckets) {
+        char counts[256];
+        int written {0};
+
+        counts[0] = '\0';
+
+        for (auto i = 0u; i < Kernel::SchedulingHistogramBuckets && written < static_cast<int>(sizeof(counts)); i++) {
+            written += snprintf(counts + written, sizeof(counts) - written, 
+                i == 0 ? "%d" : " %d", buckets[i]);
+        }
+
+        args.writeValueWithType(counts, ArgTypes::Cstring);
+    }
+
+    TaskSchedulingObject::TaskSchedulingObject(uint32_t pid)
+        : pid{pid} {
+    }
+
+    void TaskSchedulingObject::readSelf(uint32_t requesterTaskId, uint32_t requestId) {
+        ReadResult result;
+        result.success = true;
+        result.requestId = requestId;
+        ArgBuffer args {result.buffer, sizeof(result.buffer)};
+        args.writeType(ArgTypes::Property);
+
+        args.writeValueWithType("latency", ArgTypes::Cstring);
+        args.writeValueWithType("runtime", ArgTypes::Cstring);
+
+        args.writeType(ArgTypes::EndArg);
+
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    /*
+    Vostok Object function support
+    */
+    int TaskSchedulingObject::getFunction(std::string_view) {
+        return -1;
+    }
+
+    void TaskSchedulingObject::readFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t functionId) {
+        describeFunction(requesterTaskId, requestId, functionId);
+    }
+
+    void TaskSchedulingObject::writeFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t, ArgBuffer&) {
+        replyWriteSucceeded(requesterTaskId, requestId, false);
+    }
+
+    void TaskSchedulingObject::describeFunction(uint32_t requesterTaskId, uint32_t requestId, uint32_t) {
+        ReadResult result {};
+        result.requestId = requestId;
+        result.success = false;
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    /*
+    Vostok Object property support
+    */
+    int TaskSchedulingObject::getProperty(std::string_view name) {
+        if (name.compare("latency") == 0) {
+            return static_cast<int>(PropertyId::Latency);
+        }
+        else if (name.compare("runtime") == 0) {
+            return static_cast<int>(PropertyId::RunTime);
+        }
+
+        return -1;
+    }
+
+    void TaskSchedulingObject::readProperty(uint32_t requesterTaskId, uint32_t requestId, uint32_t propertyId) {
+        auto statistics = getTaskStatistics(pid);
+
+        ReadResult result;
+        result.requestId = requestId;
+        result.success = statistics.found;
+        ArgBuffer args{result.buffer, sizeof(result.buffer)};
+        args.writeType(ArgTypes::Property);
+
+        switch(static_cast<PropertyId>(propertyId)) {
+            case PropertyId::Latency: {
+                writeHistogram(args, statistics.runQueueLatency);
+                break;
+            }
+            case PropertyId::RunTime: {
+                writeHistogram(args, statistics.runTime);
+                break;
+            }
+        }
+
+        args.writeType(ArgTypes::EndArg);
+
+        result.recipientId = requesterTaskId;
+        send(IPC::RecipientType::TaskId, &result);
+    }
+
+    void TaskSchedulingObject::writeProperty(uint32_t requesterTaskId, uint32_t requestId, uint32_t, ArgBuffer&) {
+        //the histograms are read-only
+        replyWriteSucceeded(requesterTaskId, requestId, false);
+    }
+
+    Object* TaskSchedulingObject::getNestedObject(std::string_view) {
+        return nullptr;
+    }
+}
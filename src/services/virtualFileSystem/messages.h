@@ -240,17 +240,38 @@ namespace VirtualFileSystem {
         uint32_t readLength;
     };
 
-    struct ReadStreamResult : IPC::Message {
+    /*
+    A successful read is sent with sendGrant, so the data arrives
+    in pages mapped at grantAddress instead of being copied through
+    a shared buffer. A failed read is sent normally, without pages
+    */
+    struct ReadStreamResult : IPC::GrantedMessage {
         ReadStreamResult() {
             messageId = static_cast<uint32_t>(MessageId::ReadStreamResult);
             length = sizeof(ReadStreamResult);
-            bytesWritten = 0;
             messageNamespace = IPC::MessageNamespace::VFS;
+            grantAddress = 0;
+            grantPages = 0;
+            setBytesWritten(0);
         }
 
-        uint32_t requestId;
-        bool success;
-        uint32_t bytesWritten;
+        bool succeeded() const {
+            return grantPages > 0;
+        }
+
+        /*
+        Kept in buffer, since that's all sendGrant copies
+        past the GrantedMessage header
+        */
+        uint32_t getBytesWritten() const {
+            uint32_t bytesWritten;
+            memcpy(&bytesWritten, buffer, sizeof(bytesWritten));
+            return bytesWritten;
+        }
+
+        void setBytesWritten(uint32_t bytesWritten) {
+            memcpy(buffer, &bytesWritten, sizeof(bytesWritten));
+        }
     };
 
     struct WriteRequest : IPC::Message {
@@ -1085,8 +1085,7 @@ namespace VirtualFileSystem {
                 pendingRequest->stream.currentBlock++;
                 pendingRequest->stream.remainingBlocks--;
 
-                if (pendingRequest->stream.remainingBlocks == 0
-                    && pendingRequest->stream.bufferShareWasSuccessful) {
+                if (pendingRequest->stream.remainingBlocks == 0) {
                     completeReadStreamRequest(*pendingRequest, descriptor);
                     pendingRequests.erase(pendingRequest);
                 }
@@ -1143,8 +1142,21 @@ namespace VirtualFileSystem {
                         pending.stream.startingFilePosition = descriptor.filePosition;
                         pending.stream.readLength = request.readLength;
                         pending.stream.remainingBlocks = blocksToRead;
+
+                        if (blocksToRead == 0) {
+                            completeReadStreamRequest(pending, descriptor);
+                            return;
+                        }
+
                         pendingRequests.push_back(pending);
 
+                        /*
+                        All of the block reads go to the same filesystem,
+                        so send them as a batch instead of one system call each
+                        */
+                        std::vector<ReadRequest> reads;
+                        reads.reserve(blocksToRead);
+
                         for (auto block = currentBlock; block <= endBlock; block++) {
                             if (!file->hasValue[block]) {
 
@@ -1154,10 +1166,19 @@ namespace VirtualFileSystem {
                                 read.readLength = 512;
                                 read.recipientId = descriptor.mountTaskId;
                                 read.filePosition = block * 512;
-                                send(IPC::RecipientType::TaskId, &read);
+                                reads.push_back(read);
                             }
                         }
 
+                        std::vector<IPC::BatchEntry> batch;
+                        batch.reserve(reads.size());
+
+                        for (auto& read : reads) {
+                            batch.push_back({IPC::RecipientType::TaskId, &read});
+                        }
+
+                        sendBatch(batch.data(), batch.size());
+
                         failed = false;
                     }
                 }
@@ -1169,7 +1190,6 @@ namespace VirtualFileSystem {
 
         if (failed) {
             ReadStreamResult result;
-            result.success = false;
             result.recipientId = request.senderTaskId;
             send(IPC::RecipientType::TaskId, &result);
         }
@@ -1335,46 +1355,43 @@ namespace VirtualFileSystem {
         }
     }
 
-    void VirtualFileSystem::handleShareMemoryInvitation(Kernel::ShareMemoryInvitation& invitation) {
-        auto request = std::find_if(begin(pendingRequests), end(pendingRequests), [&](const auto& a) {
-            return a.requesterTaskId == invitation.senderTaskId
-                && a.type == RequestType::Stream;
-        });
-
-        Kernel::ShareMemoryResponse response;
-        response.recipientId = invitation.senderTaskId;
-
-        if (request != end(pendingRequests)) {
-            response.accepted = true;
-            auto space = invitation.size;
-            auto buffer = (uint8_t*)aligned_alloc(0x1000, space);
-            request->stream.buffer = buffer;
-            response.sharedAddress = reinterpret_cast<uintptr_t>(buffer);
-        }
-        else {
-            response.accepted = false;
-        }
-
-        send(IPC::RecipientType::TaskId, &response);
-    }
-
     void completeReadStreamRequest(PendingRequest& request, VirtualFileDescriptor& descriptor) {
 
         auto file = static_cast<Cache::File*>(descriptor.entry);
-        auto buffer = request.stream.buffer;
         auto source = reinterpret_cast<uint8_t*>(&file->data[0]);
+        auto pages = (request.stream.readLength + Memory::PageSize - 1) / Memory::PageSize;
 
-        memcpy(buffer + request.stream.pageOffset,
+        ReadStreamResult streamResult;
+        streamResult.recipientId = request.requesterTaskId;
+
+        /*
+        The pages are freshly mapped rather than taken from the heap,
+        since sending them unmaps them from the VFS
+        */
+        auto buffer = pages <= IPC::MaximumGrantPages
+            ? static_cast<uint8_t*>(map(0, pages, static_cast<uint32_t>(Memory::PageTableFlags::AllowWrite)))
+            : nullptr;
+
+        if (buffer == nullptr) {
+            send(IPC::RecipientType::TaskId, &streamResult);
+            return;
+        }
+
+        memcpy(buffer,
             source + request.stream.startingFilePosition,
             request.stream.readLength);
 
-        ReadStreamResult streamResult;
-        streamResult.success = true;
-        streamResult.bytesWritten = request.stream.readLength;
-        streamResult.recipientId = request.requesterTaskId;
+        streamResult.grantAddress = reinterpret_cast<uintptr_t>(buffer);
+        streamResult.grantPages = pages;
+        streamResult.setBytesWritten(request.stream.readLength);
 
-        send(IPC::RecipientType::TaskId, &streamResult);
-        //free request.stream.buffer;
+        if (!sendGrant(IPC::RecipientType::TaskId, &streamResult)) {
+            streamResult.grantAddress = 0;
+            streamResult.grantPages = 0;
+            send(IPC::RecipientType::TaskId, &streamResult);
+            unmap(reinterpret_cast<uintptr_t>(buffer), pages);
+            return;
+        }
 
         SyncPositionWithCache sync;
         sync.fileDescriptor = descriptor.descriptor;
@@ -1384,45 +1401,6 @@ namespace VirtualFileSystem {
         send(IPC::RecipientType::TaskId, &sync);
     }
 
-    void VirtualFileSystem::handleShareMemoryResult(Kernel::ShareMemoryResult& result) {
-
-        auto request = std::find_if(begin(pendingRequests), end(pendingRequests), [&](const auto& a) {
-            return a.requesterTaskId == result.senderTaskId
-                && a.type == RequestType::Stream;
-        });
-
-        if (request != end(pendingRequests)) {
-            if (result.succeeded) {
-
-                request->stream.bufferShareWasSuccessful = true;
-                request->stream.pageOffset = result.pageOffset;
-
-                if (request->stream.remainingBlocks == 0) {
-
-                    if (request->virtualFileDescriptor < openFileDescriptors.size()) {
-                        auto& descriptor = openFileDescriptors[request->virtualFileDescriptor];
-
-                        completeReadStreamRequest(*request, descriptor);
-                        pendingRequests.erase(request);
-                    }
-                }
-            }
-            else {
-
-                ReadStreamResult streamResult;
-                streamResult.success = false;
-                streamResult.bytesWritten = 0;
-                streamResult.recipientId = request->requesterTaskId;
-
-                send(IPC::RecipientType::TaskId, &streamResult);
-
-                delete request->stream.buffer;
-
-                pendingRequests.erase(request);
-            }
-        }
-    }
-
     void VirtualFileSystem::readDirectoryFromCache(ReadRequest& request, VirtualFileDescriptor& descriptor) {
         ReadResult result;
         result.requestId = request.requestId;
@@ -1567,24 +1545,6 @@ namespace VirtualFileSystem {
 
                     break;
                 }
-                case IPC::MessageNamespace::ServiceRegistry: {
-                    switch(static_cast<Kernel::MessageId>(buffer.messageId)) {
-                        case Kernel::MessageId::ShareMemoryInvitation: {
-                            auto message = IPC::extractMessage<Kernel::ShareMemoryInvitation>(buffer);
-                            handleShareMemoryInvitation(message);
-                            break;
-                        }
-                        case Kernel::MessageId::ShareMemoryResult: {
-                            auto message = IPC::extractMessage<Kernel::ShareMemoryResult>(buffer);
-                            handleShareMemoryResult(message);
-                            break;
-                        }
-                        default:
-                            break;
-                    }
-
-                    break;
-                }
                 default:
                     break;
             }
@@ -37,11 +37,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "cache.h"
 #include "messages.h"
 
-namespace Kernel {
-    struct ShareMemoryInvitation;
-    struct ShareMemoryResult;
-}
-
 namespace VirtualFileSystem {
 
     struct PendingOpen {
@@ -81,9 +76,6 @@ namespace VirtualFileSystem {
         std::vector<PendingBlock> blocks;
         int remainingBlocks;
         int currentBlock {0};
-        uint8_t* buffer {nullptr};
-        bool bufferShareWasSuccessful {false};
-        uint32_t pageOffset;
     };
 
     enum class RequestType {
@@ -157,9 +149,6 @@ namespace VirtualFileSystem {
         void handleSeekResult(SeekResult& request);
         void handleSubscribeMount(SubscribeMount& request);
 
-        void handleShareMemoryInvitation(Kernel::ShareMemoryInvitation& invitation);
-        void handleShareMemoryResult(Kernel::ShareMemoryResult& result);
-
         void readDirectoryFromCache(ReadRequest& request, VirtualFileDescriptor& descriptor);
         void readFileFromCache(ReadRequest& request, VirtualFileDescriptor& descriptor);
         uint32_t getNextRequestId();
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "pageEntry.h"
+#include <misc/testing.h>
+#include <arch/i386/memory/page_entry.h>
+#include <stdint.h>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Memory;
+
+    //a user heap page, writable, touched and then written to
+    constexpr uint32_t AllowWrite {1u << 1};
+    constexpr uint32_t AllowUserModeAccess {1u << 2};
+    constexpr uint32_t HeapFlags {AllowWrite | AllowUserModeAccess};
+    constexpr uint32_t MappedHeapPage {0x1234'5000 | HeapFlags
+        | PageEntry::Present | PageEntry::Accessed | PageEntry::Dirty};
+
+    bool PageEntrySuite::release_KeepsPageAllocated() {
+        auto released = PageEntry::release(MappedHeapPage);
+        auto wasMapped = PageEntry::isMapped(MappedHeapPage);
+        auto allocated = PageEntry::isAllocated(released);
+        auto flags = released & HeapFlags;
+
+        return Assert::all(
+            Assert::isTrue(wasMapped, "Heap page wasn't mapped to begin with"),
+            Assert::isTrue(allocated, "Released page isn't allocated anymore"),
+            Assert::isEqual(flags, HeapFlags, "Released page lost its flags")
+        );
+    }
+
+    bool PageEntrySuite::release_DoesntMapFrameZero() {
+        auto released = PageEntry::release(MappedHeapPage);
+        auto present = (released & PageEntry::Present) != 0;
+        auto frame = released & ~PageEntry::FlagsMask;
+        auto mapped = PageEntry::isMapped(released);
+        uint32_t none {0};
+
+        return Assert::all(
+            Assert::isFalse(present, "Released page is still present, so it maps frame 0"),
+            Assert::isEqual(frame, none, "Released page kept its frame"),
+            Assert::isFalse(mapped, "Released page is still mapped")
+        );
+    }
+
+    bool PageEntrySuite::release_LeavesUnusedEntriesAlone() {
+        auto released = PageEntry::release(0);
+        auto allocated = PageEntry::isAllocated(released);
+        uint32_t none {0};
+
+        return Assert::all(
+            Assert::isEqual(released, none, "Releasing an unused entry allocated it"),
+            Assert::isFalse(allocated, "Unused entry counts as allocated")
+        );
+    }
+
+    bool PageEntrySuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(release_KeepsPageAllocated, "Released pages stay allocated with their flags"),
+            test(release_DoesntMapFrameZero, "Released pages fault back in instead of mapping frame 0"),
+            test(release_LeavesUnusedEntriesAlone, "Releasing an unused entry leaves it unused")
+        );
+    }
+}
@@ -0,0 +1,150 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "addressSpace.h"
+#include <misc/testing.h>
+#include <memory/address_space.h>
+#include <memory/virtual_memory_manager.h>
+#include <memory/physical_memory_manager.h>
+#include <cpu/metablocks.h>
+#include <stdint.h>
+#include <optional>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Memory;
+
+    AddressSpace& getDefaultSpace() {
+        auto& core = CPU::getCurrentCore();
+        return *core.addressSpaces[static_cast<int>(AddressSpace::Domain::Default)];
+    }
+
+    bool AddressSpaceSuite::reserve_EagerPolicyMapsPagesImmediately() {
+        auto& core = CPU::getCurrentCore();
+        auto reservation = getDefaultSpace().reserve(4 * PageSize, PagingPolicy::Eager);
+        auto allMapped = false;
+
+        if (reservation.has_value()) {
+            auto start = reservation->allocatePages(4);
+            allMapped = start.has_value();
+
+            for (int i = 0; i < 4 && allMapped; i++) {
+                auto status = core.virtualMemory->getPageStatus({start->address + i * PageSize});
+                allMapped = status == PageStatus::Mapped;
+            }
+        }
+
+        return Assert::all(
+            Assert::isTrue(allMapped, "Eager reservation's pages weren't mapped up front")
+        );
+    }
+
+    bool AddressSpaceSuite::reserve_LazyPolicyMapsPagesOnFirstTouch() {
+        auto& core = CPU::getCurrentCore();
+        auto& space = getDefaultSpace();
+        auto reservation = space.reserve(4 * PageSize, PagingPolicy::Lazy);
+        auto allocated = false;
+        auto unmappedBefore = false;
+        auto found = false;
+        auto zeroed = false;
+        auto mappedAfter = false;
+
+        if (reservation.has_value()) {
+            auto start = reservation->allocatePages(4);
+            allocated = start.has_value();
+
+            if (allocated) {
+                auto inside = VirtualAddress {start->address + 2 * PageSize + 8};
+                unmappedBefore = core.virtualMemory->getPageStatus(inside) != PageStatus::Mapped;
+                found = space.findReservation(inside).has_value();
+
+                //this faults the page in
+                auto page = reinterpret_cast<volatile uint64_t*>(inside.address);
+                zeroed = *page == 0;
+                mappedAfter = core.virtualMemory->getPageStatus(inside) == PageStatus::Mapped;
+            }
+        }
+
+        return Assert::all(
+            Assert::isTrue(allocated, "Lazy reservation couldn't allocate pages"),
+            Assert::isTrue(unmappedBefore, "Lazy reservation's page was mapped before it was touched"),
+            Assert::isTrue(found, "Fault handler can't find the reservation"),
+            Assert::isTrue(zeroed, "Lazily allocated page wasn't zeroed"),
+            Assert::isTrue(mappedAfter, "Touching the page didn't map it")
+        );
+    }
+
+    bool AddressSpaceSuite::release_CoalescesAfterManyCycles() {
+        auto& space = getDefaultSpace();
+        const int liveCount = 32;
+        std::optional<AddressReservation> live[liveCount];
+        auto allReserved = true;
+
+        //only address space is reserved here, none of it is ever touched
+        for (int i = 0; i < 4'000 && allReserved; i++) {
+            auto slot = (i * 7) % liveCount;
+
+            if (live[slot].has_value()) {
+                space.release(*live[slot]);
+            }
+
+            auto pages = 1 + (i * 13) % 600;
+            live[slot] = space.reserve(pages * PageSize);
+            allReserved = live[slot].has_value();
+        }
+
+        for (auto& reservation : live) {
+            if (reservation.has_value()) {
+                space.release(*reservation);
+            }
+        }
+
+        //everything was given back, so one huge run should be free again
+        auto huge = space.reserve(512ul * 1024 * 1024 * 1024);
+        auto coalesced = huge.has_value();
+
+        if (coalesced) {
+            space.release(*huge);
+        }
+
+        return Assert::all(
+            Assert::isTrue(allReserved, "Ran out of address space while cycling"),
+            Assert::isTrue(coalesced, "Released reservations weren't coalesced")
+        );
+    }
+
+    bool AddressSpaceSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(reserve_EagerPolicyMapsPagesImmediately, "Eager reservations are mapped when allocated"),
+            test(reserve_LazyPolicyMapsPagesOnFirstTouch, "Lazy reservations are zero filled on first touch"),
+            test(release_CoalescesAfterManyCycles, "Release coalesces after thousands of reserve/release cycles")
+        );
+    }
+}
@@ -29,6 +29,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "blockAllocator.h"
 #include <misc/testing.h>
 #include <memory/block_allocator.h>
+#include <memory/virtual_memory_manager.h>
+#include <cpu/metablocks.h>
 #include <stdint.h>
 #include <new>
 #include <array>
@@ -135,6 +137,84 @@ namespace Test {
         return Assert::all(allValuesMatch);
     }
 
+    bool BlockAllocatorSuite::allocate_UsesLargePagesForLargeBlocks() {
+
+        struct Page {
+            uint8_t bytes[Memory::PageSize];
+        };
+
+        //the initial block is 10x this, so just over 2MB
+        Memory::BlockAllocator<Page> allocator(52);
+        auto& core = CPU::getCurrentCore();
+
+        auto page = allocator.allocate();
+        page->bytes[0] = 42;
+
+        auto address = reinterpret_cast<uintptr_t>(page);
+        auto isLarge = core.virtualMemory->isLargePage({address});
+        auto value = page->bytes[0];
+        uint8_t expectedValue {42};
+
+        return Assert::all(
+            Assert::isTrue(isLarge, "Block wasn't backed by a large page"),
+            Assert::isEqual(value, expectedValue, "Large page didn't hold the written value")
+        );
+    }
+
+    bool BlockAllocatorSuite::free_ReusesObjectsFromTheCoreCache() {
+        Memory::BlockAllocator<int> allocator(5);
+
+        auto first = allocator.allocate();
+        allocator.free(first);
+        auto second = allocator.allocate();
+
+        return Assert::all(
+            Assert::isTrue(first == second, "Freed object wasn't handed out again")
+        );
+    }
+
+    bool BlockAllocatorSuite::shrink_ReleasesEmptySlabs() {
+        Memory::BlockAllocator<int> allocator(5);
+        int* allocations[100];
+
+        for (int i = 0; i < 100; i++) {
+            allocations[i] = allocator.allocate();
+        }
+
+        auto before = allocator.getStatistics();
+
+        for (int i = 0; i < 100; i++) {
+            allocator.free(allocations[i]);
+        }
+
+        allocator.shrink();
+        auto after = allocator.getStatistics();
+        auto slabsInUse = after.fullSlabs + after.partialSlabs + after.emptySlabs;
+
+        return Assert::all(
+            Assert::isTrue(before.fullSlabs > 0, "Allocations didn't fill any slabs"),
+            Assert::isEqual(slabsInUse, 0, "Empty slabs weren't released")
+        );
+    }
+
+    bool BlockAllocatorSuite::allocateMultiple_ReturnsContiguousArray() {
+        Memory::BlockAllocator<uint64_t> allocator;
+
+        auto elements = allocator.allocateMultiple(1000);
+        std::array<uint64_t, 3> expected {0, 999, 0}, actual {};
+
+        if (elements != nullptr) {
+            elements[999] = 999;
+            actual = {elements[0], elements[999], elements[500]};
+            allocator.freeMultiple(elements);
+        }
+
+        return Assert::all(
+            Assert::isTrue(elements != nullptr, "allocateMultiple failed"),
+            Assert::arraySame(actual, expected, "Array wasn't usable or wasn't zeroed")
+        );
+    }
+
     bool BlockAllocatorSuite::run() {
         using namespace Preflight;
 
@@ -142,7 +222,11 @@ namespace Test {
             test(allocate_HandlesSimpleAllocations, "Allocate handles simple allocations"),
             test(allocate_HandlesExcessiveAllocations, "Allocate handles excessive allocations"),
             test(allocate_HandlesMultipleReservations, "Allocate manages multiple AddressReservations"),
-            test(allocate_HandlesFreeList, "Allocate prioritizes using freeList elements when possible")
+            test(allocate_HandlesFreeList, "Allocate prioritizes using freeList elements when possible"),
+            test(allocate_UsesLargePagesForLargeBlocks, "Blocks of 2MB or more are backed by large pages"),
+            test(free_ReusesObjectsFromTheCoreCache, "Free caches objects for the same core"),
+            test(shrink_ReleasesEmptySlabs, "Shrink releases empty slabs"),
+            test(allocateMultiple_ReturnsContiguousArray, "AllocateMultiple returns a usable array")
         );
     }
 }
\ No newline at end of file
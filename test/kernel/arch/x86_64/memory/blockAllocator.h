@@ -38,6 +38,10 @@ namespace Test {
         static bool allocate_HandlesExcessiveAllocations();
         static bool allocate_HandlesMultipleReservations();
         static bool allocate_HandlesFreeList();
+        static bool allocate_UsesLargePagesForLargeBlocks();
+        static bool free_ReusesObjectsFromTheCoreCache();
+        static bool shrink_ReleasesEmptySlabs();
+        static bool allocateMultiple_ReturnsContiguousArray();
 
         static bool run();
     };
@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "buddyAllocator.h"
+#include <misc/testing.h>
+#include <memory/buddy_allocator.h>
+#include <stdint.h>
+#include <array>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Memory;
+
+    /*
+    The allocator never touches the pages it hands out,
+    so the addresses here don't need to be real
+    */
+    using SmallAllocator = BuddyAllocator<1024, 4>;
+    const uint64_t PageBytes {0x1000};
+    const uintptr_t base {0x100'000};
+
+    std::array<uint64_t, 5> getFreeBlocks(const SmallAllocator::Statistics& statistics) {
+        std::array<uint64_t, 5> blocks;
+
+        for (auto i = 0u; i < blocks.size(); i++) {
+            blocks[i] = statistics.freeBlocks[i];
+        }
+
+        return blocks;
+    }
+
+    bool BuddyAllocatorSuite::allocate_SplitsAndMergesBlocks() {
+        static SmallAllocator allocator {base};
+        allocator.addRange({base}, 16);
+
+        auto first = allocator.allocate(0);
+        auto second = allocator.allocate(0);
+        auto afterSplit = allocator.getStatistics();
+
+        allocator.free(first, 0);
+        allocator.free(second, 0);
+        auto afterMerge = allocator.getStatistics();
+        auto blocksAfterSplit = getFreeBlocks(afterSplit);
+
+        auto firstAddress = first.address;
+        auto secondAddress = second.address;
+        auto expectedSecond = base + PageBytes;
+        uint64_t freeAfterSplit {14};
+        std::array<uint64_t, 5> expectedBlocks = {0, 1, 1, 1, 0};
+        int largestOrder {4};
+
+        return Assert::all(
+            Assert::isEqual(firstAddress, base, "First page wasn't at the start of the range"),
+            Assert::isEqual(secondAddress, expectedSecond, "Second page wasn't the first one's buddy"),
+            Assert::isEqual(afterSplit.freePages, freeAfterSplit, "Free page count is wrong after splitting"),
+            Assert::arraySame(blocksAfterSplit, expectedBlocks, "Splitting left the wrong blocks free"),
+            Assert::isEqual(afterMerge.largestFreeOrder, largestOrder, "Freed buddies didn't merge back into one block")
+        );
+    }
+
+    bool BuddyAllocatorSuite::allocate_ReturnsAlignedBlocks() {
+        static SmallAllocator allocator {base};
+        allocator.addRange({base}, 64);
+
+        auto single = allocator.allocate(0);
+        auto large = allocator.allocate(4);
+        auto medium = allocator.allocate(2);
+        auto tooBig = allocator.allocate(5);
+
+        auto largeOffset = (large.address - base) % (16 * PageBytes);
+        auto mediumOffset = (medium.address - base) % (4 * PageBytes);
+        auto overlaps = single.address >= large.address 
+            && single.address < large.address + 16 * PageBytes;
+        auto tooBigAddress = tooBig.address;
+        uintptr_t zero {0};
+        uint64_t zeroOffset {0};
+
+        return Assert::all(
+            Assert::isEqual(largeOffset, zeroOffset, "Order 4 block wasn't aligned to 16 pages"),
+            Assert::isEqual(mediumOffset, zeroOffset, "Order 2 block wasn't aligned to 4 pages"),
+            Assert::isTrue(!overlaps, "Blocks overlap"),
+            Assert::isEqual(tooBigAddress, zero, "Allocating more than the max order succeeded")
+        );
+    }
+
+    bool BuddyAllocatorSuite::addRange_HandlesUnalignedRanges() {
+        static SmallAllocator allocator {base};
+
+        //pages 3 through 15, which can't hold anything bigger than order 3
+        auto added = allocator.addRange({base + 3 * PageBytes}, 13);
+        auto statistics = allocator.getStatistics();
+        auto large = allocator.allocate(3);
+
+        auto fragmentation = statistics.getFragmentation(3);
+        auto blocks = getFreeBlocks(statistics);
+        auto largeAddress = large.address;
+        auto expectedLarge = base + 8 * PageBytes;
+        uint64_t expectedAdded {13};
+        std::array<uint64_t, 5> expectedBlocks = {1, 0, 1, 1, 0};
+        int largestOrder {3};
+        int expectedFragmentation {(5 * 100) / 13};
+
+        return Assert::all(
+            Assert::isEqual(added, expectedAdded, "Not all of the range was added"),
+            Assert::arraySame(blocks, expectedBlocks, "Range wasn't split into aligned blocks"),
+            Assert::isEqual(statistics.largestFreeOrder, largestOrder, "Largest free order is wrong"),
+            Assert::isEqual(fragmentation, expectedFragmentation, "Fragmentation is wrong"),
+            Assert::isEqual(largeAddress, expectedLarge, "Order 3 block isn't the aligned one")
+        );
+    }
+
+    bool BuddyAllocatorSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(allocate_SplitsAndMergesBlocks, "Allocations split blocks and frees merge buddies"),
+            test(allocate_ReturnsAlignedBlocks, "Blocks are aligned to their size"),
+            test(addRange_HandlesUnalignedRanges, "Unaligned ranges are split into aligned blocks")
+        );
+    }
+}
@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "heap.h"
+#include <misc/testing.h>
+#include <memory/address_space.h>
+#include <memory/virtual_memory_manager.h>
+#include <memory/physical_memory_manager.h>
+#include <cpu/metablocks.h>
+#include <saturn/heap.h>
+#include <stdint.h>
+#include <optional>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Memory;
+    using namespace Saturn::Memory;
+
+    const uint32_t TestHeapSize {1024 * 1024};
+    Heap testHeap;
+
+    AddressSpace& getHeapSpace() {
+        auto& core = CPU::getCurrentCore();
+        return *core.addressSpaces[static_cast<int>(AddressSpace::Domain::Default)];
+    }
+
+    /*
+    Each test gets a fresh heap in its own lazy reservation,
+    which has to be released when the test is done
+    */
+    std::optional<AddressReservation> createTestHeap() {
+        auto reservation = getHeapSpace().reserve(TestHeapSize, PagingPolicy::Lazy);
+
+        if (reservation.has_value()) {
+            auto start = reservation->allocatePages(TestHeapSize / PageSize);
+
+            if (!start.has_value()) {
+                getHeapSpace().release(*reservation);
+                return {};
+            }
+
+            testHeap.initialize(start->address, TestHeapSize);
+        }
+
+        return reservation;
+    }
+
+    bool HeapSuite::allocate_RoundTripsEverySizeClass() {
+        auto reservation = createTestHeap();
+        auto created = reservation.has_value();
+        auto allocated = created;
+        auto reused = created;
+        auto balanced = created;
+
+        for (int i = 0; i < SizeClassCount && created; i++) {
+            auto size = Heap::getClassSize(i);
+            auto first = static_cast<uint8_t*>(testHeap.allocate(size));
+            allocated = allocated && first != nullptr;
+
+            if (first == nullptr) {
+                break;
+            }
+
+            first[0] = 0xAB;
+            first[size - 1] = 0xCD;
+            testHeap.free(first);
+
+            //size class free lists are last in first out
+            auto second = testHeap.allocate(size);
+            reused = reused && second == first;
+            testHeap.free(second);
+
+            auto& counts = testHeap.getStatistics().sizeClasses[i];
+            balanced = balanced && counts.allocations == 2 
+                && counts.frees == 2 
+                && counts.liveBytes == 0;
+        }
+
+        if (created) {
+            getHeapSpace().release(*reservation);
+        }
+
+        return Assert::all(
+            Assert::isTrue(created, "Couldn't reserve the test heap"),
+            Assert::isTrue(allocated, "A size class couldn't allocate"),
+            Assert::isTrue(reused, "A freed object wasn't handed out again"),
+            Assert::isTrue(balanced, "Allocations weren't counted against their size class")
+        );
+    }
+
+    bool HeapSuite::free_CoalescesAdjacentChunks() {
+        auto reservation = createTestHeap();
+        auto created = reservation.has_value();
+        auto adjacent = false;
+        auto coalesced = false;
+
+        if (created) {
+            const uint32_t size {8192};
+            auto first = static_cast<uint8_t*>(testHeap.allocate(size));
+            auto second = static_cast<uint8_t*>(testHeap.allocate(size));
+            auto third = testHeap.allocate(size);
+            adjacent = second == first + size + sizeof(ChunkHeader);
+
+            testHeap.free(first);
+            testHeap.free(second);
+
+            //only fits exactly where first and second were if they merged
+            auto merged = testHeap.allocate(2 * size + sizeof(ChunkHeader));
+            coalesced = merged == first;
+
+            testHeap.free(merged);
+            testHeap.free(third);
+            getHeapSpace().release(*reservation);
+        }
+
+        return Assert::all(
+            Assert::isTrue(created, "Couldn't reserve the test heap"),
+            Assert::isTrue(adjacent, "Chunks weren't carved out next to each other"),
+            Assert::isTrue(coalesced, "Adjacent free chunks weren't coalesced")
+        );
+    }
+
+    bool HeapSuite::alignedAllocate_ReturnsAlignedAddresses() {
+        auto reservation = createTestHeap();
+        auto created = reservation.has_value();
+        auto aligned = created;
+        auto hugeIsPageAligned = false;
+        auto allFreed = false;
+
+        if (created) {
+            const int count {4};
+            size_t alignments[count] {16, 64, 512, 4096};
+            void* allocations[count];
+
+            for (int i = 0; i < count; i++) {
+                allocations[i] = testHeap.aligned_allocate(alignments[i], 100);
+                auto address = reinterpret_cast<uintptr_t>(allocations[i]);
+                aligned = aligned && address != 0 && (address & (alignments[i] - 1)) == 0;
+            }
+
+            auto huge = testHeap.aligned_allocate(16, 200 * 1024);
+            hugeIsPageAligned = huge != nullptr 
+                && (reinterpret_cast<uintptr_t>(huge) & (PageSize - 1)) == 0;
+
+            for (auto allocation : allocations) {
+                testHeap.free(allocation);
+            }
+
+            testHeap.free(huge);
+            allFreed = testHeap.getStatistics().chunks.liveBytes == 0;
+            getHeapSpace().release(*reservation);
+        }
+
+        return Assert::all(
+            Assert::isTrue(created, "Couldn't reserve the test heap"),
+            Assert::isTrue(aligned, "aligned_allocate ignored the alignment"),
+            Assert::isTrue(hugeIsPageAligned, "Huge allocation wasn't page aligned"),
+            Assert::isTrue(allFreed, "Aligned allocations weren't all freed")
+        );
+    }
+
+    bool HeapSuite::free_ReleasesPagesOfLargeChunks() {
+        auto& core = CPU::getCurrentCore();
+        auto reservation = createTestHeap();
+        auto created = reservation.has_value();
+        auto released = false;
+        auto unmapped = false;
+        auto zeroed = false;
+
+        if (created) {
+            const uint32_t size {256 * 1024};
+            const uint32_t pages {size / PageSize};
+            auto before = testHeap.getStatistics().pagesReleased;
+            auto big = static_cast<uint8_t volatile*>(testHeap.allocate(size));
+
+            for (auto i = 0u; i < pages; i++) {
+                big[i * PageSize] = 1;
+            }
+
+            testHeap.free(const_cast<uint8_t*>(big));
+
+            auto address = reinterpret_cast<uintptr_t>(big) + PageSize;
+            released = testHeap.getStatistics().pagesReleased - before >= pages;
+            unmapped = core.virtualMemory->getPageStatus({address}) != PageStatus::Mapped;
+
+            //given back pages fault in zeroed when the heap reuses them
+            auto again = static_cast<uint8_t volatile*>(testHeap.allocate(size));
+            zeroed = again == big && again[PageSize] == 0;
+
+            testHeap.free(const_cast<uint8_t*>(again));
+            getHeapSpace().release(*reservation);
+        }
+
+        return Assert::all(
+            Assert::isTrue(created, "Couldn't reserve the test heap"),
+            Assert::isTrue(released, "Freeing a large chunk didn't release its pages"),
+            Assert::isTrue(unmapped, "Released page is still mapped"),
+            Assert::isTrue(zeroed, "Released page wasn't zeroed when reused")
+        );
+    }
+
+    bool HeapSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(allocate_RoundTripsEverySizeClass, "Every size class round trips an allocation"),
+            test(free_CoalescesAdjacentChunks, "Adjacent free chunks are coalesced"),
+            test(alignedAllocate_ReturnsAlignedAddresses, "aligned_allocate honours the alignment"),
+            test(free_ReleasesPagesOfLargeChunks, "Freeing a large chunk gives its pages back")
+        );
+    }
+}
@@ -29,10 +29,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "memory.h"
 #include <misc/testing.h>
 #include "blockAllocator.h"
+#include "physicalMemory.h"
+#include "buddyAllocator.h"
+#include "addressSpace.h"
+#include "pcid.h"
+#include "heap.h"
+#include "../../i386/memory/pageEntry.h"
 
 namespace Test {
 
     bool runMemoryTests() {
-        return Preflight::runTestSuites<BlockAllocatorSuite>();
+        return Preflight::runTestSuites<BlockAllocatorSuite, PhysicalMemorySuite, BuddyAllocatorSuite,
+            AddressSpaceSuite, PCIDSuite, HeapSuite, PageEntrySuite>();
     }
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "pcid.h"
+#include <misc/testing.h>
+#include <memory/pcid.h>
+#include <memory/virtual_memory_manager.h>
+#include <cpu/metablocks.h>
+#include <stdint.h>
+#include <new>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Memory;
+
+    /*
+    The pool is too big for the stack, and each test wants a fresh one
+    */
+    PCIDPool& createPool() {
+        alignas(PCIDPool) static uint8_t buffer[sizeof(PCIDPool)];
+        return *new (buffer) PCIDPool;
+    }
+
+    bool PCIDSuite::allocate_NeverReturnsKernelPCID() {
+        auto& pool = createPool();
+        auto first = pool.allocate();
+        auto second = pool.allocate();
+        auto allUnique = first != KernelPCID && second != KernelPCID && first != second;
+
+        return Assert::all(
+            Assert::isTrue(allUnique, "Pool handed out the kernel's or a duplicate PCID")
+        );
+    }
+
+    bool PCIDSuite::allocate_ReturnsKernelPCIDWhenExhausted() {
+        auto& pool = createPool();
+        auto handedOut = 0u;
+
+        while (pool.allocate() != KernelPCID) {
+            handedOut++;
+        }
+
+        pool.free(42);
+        auto reused = pool.allocate();
+        uint16_t expectedReuse {42};
+        auto expectedCount = PCIDCount - 1;
+
+        return Assert::all(
+            Assert::isEqual(handedOut, expectedCount, "Pool didn't hand out every PCID"),
+            Assert::isEqual(reused, expectedReuse, "Freed PCID wasn't reused")
+        );
+    }
+
+    bool PCIDSuite::free_MarksPCIDStaleOnEveryCore() {
+        auto& pool = createPool();
+        auto pcid = pool.allocate();
+        auto freshIsStale = pool.takeStale(0, pcid);
+
+        pool.free(pcid);
+
+        auto firstCoreStale = pool.takeStale(0, pcid);
+        auto firstCoreStillStale = pool.takeStale(0, pcid);
+        auto lastCoreStale = pool.takeStale(CPU::MaxCores - 1, pcid);
+
+        return Assert::all(
+            Assert::isFalse(freshIsStale, "A never used PCID was stale"),
+            Assert::isTrue(firstCoreStale, "Freed PCID wasn't stale"),
+            Assert::isFalse(firstCoreStillStale, "Stale PCID should only be flushed once per core"),
+            Assert::isTrue(lastCoreStale, "Freed PCID wasn't stale on every core")
+        );
+    }
+
+    bool PCIDSuite::vmm_ReleasesPCIDWhenDestroyed() {
+        auto core = CPU::getCurrentCore().id;
+        uint16_t pcid;
+
+        {
+            //never activated, so any page map will do
+            VirtualMemoryManager vmm {PhysicalAddress {0}};
+            pcid = vmm.getPCID();
+        }
+
+        auto gotOwnPCID = pcid != KernelPCID;
+        auto released = getPCIDPool().takeStale(core, pcid);
+
+        return Assert::all(
+            Assert::isTrue(gotOwnPCID, "Cloned VMM didn't get a PCID of its own"),
+            Assert::isTrue(released, "Destroyed VMM didn't give its PCID back")
+        );
+    }
+
+    bool PCIDSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(allocate_NeverReturnsKernelPCID, "Allocate never hands out the kernel's PCID"),
+            test(allocate_ReturnsKernelPCIDWhenExhausted, "Allocate falls back to the kernel's PCID"),
+            test(free_MarksPCIDStaleOnEveryCore, "Freed PCIDs are flushed lazily on each core"),
+            test(vmm_ReleasesPCIDWhenDestroyed, "VMMs take a PCID and give it back when destroyed")
+        );
+    }
+}
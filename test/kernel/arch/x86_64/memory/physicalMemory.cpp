@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "physicalMemory.h"
+#include <misc/testing.h>
+#include <memory/physical_memory_manager.h>
+#include <stdint.h>
+#include <array>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Memory;
+
+    /*
+    Pages going through a core manager's magazines are never
+    touched, so made up physical addresses are fine. finishAllocation
+    still zeroes whatever the page is mapped at though
+    */
+    alignas(PageSize) static uint8_t scratch[PageSize];
+    const uintptr_t fakePages {0xDEAD'0000'0000ul};
+
+    bool PhysicalMemorySuite::allocatePage_ReusesFreedPages() {
+        auto core = PhysicalMemoryManager::CreateCoreManager();
+        auto scratchAddress = reinterpret_cast<uintptr_t>(scratch);
+
+        for (auto i = 0u; i < 3; i++) {
+            core->freePage({scratchAddress}, {fakePages + i * PageSize});
+        }
+
+        std::array<uintptr_t, 3> expected = {
+            fakePages + 2 * PageSize, 
+            fakePages + PageSize, 
+            fakePages
+        };
+        std::array<uintptr_t, 3> result;
+
+        scratch[10] = 0xFF;
+
+        for (auto i = 0u; i < result.size(); i++) {
+            result[i] = core->allocatePage().address;
+            core->finishAllocation({scratchAddress});
+        }
+
+        auto zeroed = scratch[10] == 0;
+
+        return Assert::all(
+            Assert::arraySame(result, expected, "Freed pages weren't reused last in first out"),
+            Assert::isTrue(zeroed, "finishAllocation didn't zero the page")
+        );
+    }
+
+    bool PhysicalMemorySuite::freePage_TradesMagazinesWithDepot() {
+        auto core = PhysicalMemoryManager::CreateCoreManager();
+        auto scratchAddress = reinterpret_cast<uintptr_t>(scratch);
+        auto freeBefore = core->getFreePages();
+
+        //enough to fill both magazines and hand one to the depot
+        const int count {3 * Magazine::Capacity};
+        static std::array<int, count> timesAllocated;
+        timesAllocated.fill(0);
+
+        for (int i = 0; i < count; i++) {
+            core->freePage({scratchAddress}, {fakePages + i * PageSize});
+        }
+
+        auto freeWhileCached = core->getFreePages();
+        auto expectedWhileCached = freeBefore + count;
+        bool allFake {true};
+
+        for (int i = 0; i < count; i++) {
+            auto page = core->allocatePage().address;
+            core->finishAllocation({scratchAddress});
+
+            if (page < fakePages || page >= fakePages + count * PageSize) {
+                allFake = false;
+                continue;
+            }
+
+            timesAllocated[(page - fakePages) / PageSize]++;
+        }
+
+        bool eachOnce {true};
+
+        for (auto times : timesAllocated) {
+            if (times != 1) {
+                eachOnce = false;
+            }
+        }
+
+        auto freeAfter = core->getFreePages();
+
+        return Assert::all(
+            Assert::isEqual(freeWhileCached, expectedWhileCached, "Cached pages weren't counted as free"),
+            Assert::isTrue(allFake, "Got a page that wasn't freed to this core"),
+            Assert::isTrue(eachOnce, "A freed page wasn't allocated exactly once"),
+            Assert::isEqual(freeAfter, freeBefore, "Free page count didn't return to where it started")
+        );
+    }
+
+    bool PhysicalMemorySuite::freePage_KeepsSharedPages() {
+        auto core = PhysicalMemoryManager::CreateCoreManager();
+        auto scratchAddress = reinterpret_cast<uintptr_t>(scratch);
+
+        //needs a real page, since the reference table only covers real memory
+        auto page = core->allocatePage();
+        core->finishAllocation({scratchAddress});
+
+        PhysicalMemoryManager::addReference(page);
+        auto sharedAfterAdd = PhysicalMemoryManager::isShared(page);
+        auto freeBefore = core->getFreePages();
+
+        core->freePage({scratchAddress}, page);
+        auto freeAfterFirst = core->getFreePages();
+        auto sharedAfterFirst = PhysicalMemoryManager::isShared(page);
+
+        core->freePage({scratchAddress}, page);
+        auto freeAfterSecond = core->getFreePages();
+        auto expectedAfterSecond = freeBefore + 1;
+
+        return Assert::all(
+            Assert::isTrue(sharedAfterAdd, "Page wasn't shared after adding a reference"),
+            Assert::isEqual(freeAfterFirst, freeBefore, "Freeing a shared page gave it back"),
+            Assert::isFalse(sharedAfterFirst, "Freeing a shared page didn't drop a reference"),
+            Assert::isEqual(freeAfterSecond, expectedAfterSecond, "Last owner freeing the page didn't give it back")
+        );
+    }
+
+    bool PhysicalMemorySuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(allocatePage_ReusesFreedPages, "Core managers reuse freed pages without the global manager"),
+            test(freePage_TradesMagazinesWithDepot, "Full magazines go to the depot and come back"),
+            test(freePage_KeepsSharedPages, "Shared pages are only freed by their last owner")
+        );
+    }
+}
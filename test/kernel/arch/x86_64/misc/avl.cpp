@@ -112,7 +112,7 @@ namespace Test {
             std::array<int, 8> result;
             tree.traverseInOrder(result);
 
-            auto height = Assert::isEqual(tree.getHeight(), 4, "Tree height isn't 4");
+            auto height = Assert::isEqual(tree.getHeight(), 3, "Tree height isn't 3");
             auto inorder = Assert::arraySame(result, data.expectedTraversal, "In-order traversal didn't match");
 
             return Assert::all(height, inorder);
@@ -197,6 +197,92 @@ namespace Test {
             TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 11, 11});
     }
 
+    bool AVLTreeSuite::findAtMost_HandlesSimpleTree() {
+        struct TestData {
+            std::array<int, 8> values;
+            int search;
+            int result;
+        };
+
+        auto test = [](TestData data) { 
+            SimpleAllocator<480> allocator;
+            AVLTree<int, SimpleAllocator<480>> tree {allocator};
+
+            for (auto value : data.values) {
+                tree.insert(value);
+            }
+
+            auto result = tree.findAtMost(data.search);
+            auto equal = Assert::isEqual(result, data.result, "Couldn't find proper predecessor");
+
+            return Assert::all(equal);
+        };
+
+        return runCases(test, 
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 23, 23},
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 24, 23},
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 100, 65},
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 40, 29},
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 11, 11});
+    }
+
+    struct LargestValue {
+        using Summary = int;
+
+        static Summary summarize(int value) {
+            return value;
+        }
+
+        static Summary combine(Summary a, Summary b) {
+            return a > b ? a : b;
+        }
+    };
+
+    bool AVLTreeSuite::findFirst_FindsSmallestMatch() {
+        struct TestData {
+            std::array<int, 8> values;
+            int atLeast;
+            int result;
+        };
+
+        auto test = [](TestData data) { 
+            SimpleAllocator<480> allocator;
+            AVLTree<int, SimpleAllocator<480>, LargestValue> tree {allocator};
+
+            for (auto value : data.values) {
+                tree.insert(value);
+            }
+
+            auto result = tree.findFirst([=](int largest) { return largest >= data.atLeast; });
+            auto equal = Assert::isEqual(result, data.result, "Didn't find the first match");
+
+            return Assert::all(equal);
+        };
+
+        return runCases(test, 
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 0, 11},
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 24, 26},
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 42, 50},
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, 65, 65});
+    }
+
+    bool AVLTreeSuite::findFirst_TracksRemovals() {
+        SimpleAllocator<480> allocator;
+        AVLTree<int, SimpleAllocator<480>, LargestValue> tree {allocator};
+
+        for (auto value : {41, 20, 50, 29, 65, 11, 26, 23}) {
+            tree.insert(value);
+        }
+
+        tree.remove(65);
+        tree.remove(50);
+
+        auto result = tree.findFirst([](int largest) { return largest >= 42; });
+        auto isEmpty = Assert::isFalse(result.has_value(), "result shouldn't have a value");
+
+        return Assert::all(isEmpty);
+    }
+
     bool AVLTreeSuite::remove_HandlesEmptyTree() {
         SimpleAllocator<480> allocator;
         AVLTree<int, SimpleAllocator<480>> tree {allocator};
@@ -252,7 +338,8 @@ namespace Test {
             TestData {{41, 20, 50, 29, 65, 11, 26, 23}, {11, 20, 23, 26, 29, 41, 50}, 65},
             TestData {{41, 20, 50, 29, 65, 11, 26, 23}, {11, 20, 23, 29, 41, 50, 65}, 26},
             TestData {{41, 20, 50, 29, 65, 11, 26, 23}, {11, 20, 23, 26, 29, 41, 65}, 50},
-            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, {11, 23, 26, 29, 41, 50, 65}, 20}
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, {11, 23, 26, 29, 41, 50, 65}, 20},
+            TestData {{41, 20, 50, 29, 65, 11, 26, 23}, {11, 20, 23, 26, 41, 50, 65}, 29}
         );
     }
 
@@ -268,6 +355,9 @@ namespace Test {
             test(findAtLeast_HandlesSingleTreeGreater, "FindAtLeast handles single trees with greater root"),
             test(findAtLeast_HandlesSingleTreeLess, "FindAtLeast handles single trees with less root"),
             test(findAtLeast_HandlesSimpleTree, "FindAtLeast handles simple trees"),
+            test(findAtMost_HandlesSimpleTree, "FindAtMost handles simple trees"),
+            test(findFirst_FindsSmallestMatch, "FindFirst finds the smallest match"),
+            test(findFirst_TracksRemovals, "FindFirst sees removals"),
             test(remove_HandlesEmptyTree, "Remove handles empty trees"),
             test(remove_HandlesSingleTree, "Remove handles single trees"),
             test(remove_HandlesSimpleTree, "Remove handles simple trees")
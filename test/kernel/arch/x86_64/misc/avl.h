@@ -44,6 +44,11 @@ namespace Test {
         static bool findAtLeast_HandlesSingleTreeLess();
         static bool findAtLeast_HandlesSimpleTree();
 
+        static bool findAtMost_HandlesSimpleTree();
+
+        static bool findFirst_FindsSmallestMatch();
+        static bool findFirst_TracksRemovals();
+
         static bool remove_HandlesEmptyTree();
         static bool remove_HandlesSingleTree();
         static bool remove_HandlesSimpleTree();
@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "irqs.h"
+#include <misc/testing.h>
+#include <idt/irqs.h>
+#include <cpu/apic.h>
+#include <stdint.h>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace IDT;
+
+    /*
+    setupISAIRQs never routes LPT2, so a real irq can't
+    run the test's actions or skew its counts
+    */
+    constexpr auto UnusedIrq = static_cast<uint32_t>(APIC::ISAIrqs::LPT2);
+
+    bool countCall(uint32_t, void* context) {
+        (*static_cast<int*>(context))++;
+        return true;
+    }
+
+    bool ignoreIrq(uint32_t, void*) {
+        return false;
+    }
+
+    bool IrqSuite::dispatch_RunsEverySharedAction() {
+        int firstCalls {0};
+        int secondCalls {0};
+        IrqAction first {.name = "first", .handler = countCall, .context = &firstCalls};
+        IrqAction second {.name = "second", .handler = countCall, .context = &secondCalls};
+
+        registerIrqAction(UnusedIrq, &first);
+        registerIrqAction(UnusedIrq, &second);
+        auto handled = dispatchIrq(UnusedIrq);
+        unregisterIrqAction(UnusedIrq, &first);
+        dispatchIrq(UnusedIrq);
+        unregisterIrqAction(UnusedIrq, &second);
+
+        int expectedFirst {1};
+        int expectedSecond {2};
+        uint64_t expectedCount {2};
+
+        return Assert::all(
+            Assert::isTrue(handled, "Shared irq wasn't handled"),
+            Assert::isEqual(firstCalls, expectedFirst, "Unregistered action still ran"),
+            Assert::isEqual(secondCalls, expectedSecond, "Shared action didn't run"),
+            Assert::isEqual(second.count, expectedCount, "Action didn't count its irqs")
+        );
+    }
+
+    bool IrqSuite::dispatch_SignalsNotificationBits() {
+        IrqNotification notification;
+        IrqAction device {.name = "device", .notification = &notification, .notificationBit = 3};
+        IrqAction quiet {.name = "quiet", .handler = ignoreIrq, .notification = &notification, .notificationBit = 5};
+
+        registerIrqAction(UnusedIrq, &device);
+        registerIrqAction(UnusedIrq, &quiet);
+        dispatchIrq(UnusedIrq);
+        dispatchIrq(UnusedIrq);
+        unregisterIrqAction(UnusedIrq, &device);
+        unregisterIrqAction(UnusedIrq, &quiet);
+
+        auto pending = notification.take();
+        auto afterTake = notification.take();
+        uint64_t expected {1 << 3};
+        uint64_t none {0};
+
+        return Assert::all(
+            Assert::isEqual(pending, expected, "Only the raising action's bit should be set"),
+            Assert::isEqual(afterTake, none, "Taking didn't clear the pending bits")
+        );
+    }
+
+    bool IrqSuite::dispatch_CountsUnhandledIrqs() {
+        auto before = getIrqStatistics(UnusedIrq);
+        auto handled = dispatchIrq(UnusedIrq);
+        auto after = getIrqStatistics(UnusedIrq);
+
+        auto counted = after.count == before.count + 1;
+        auto unhandled = after.unhandled == before.unhandled + 1;
+
+        return Assert::all(
+            Assert::isFalse(handled, "Irq with no actions was handled"),
+            Assert::isTrue(counted, "Irq wasn't counted"),
+            Assert::isTrue(unhandled, "Irq wasn't counted as unhandled")
+        );
+    }
+
+    bool IrqSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(dispatch_RunsEverySharedAction, "Shared irqs run every registered action"),
+            test(dispatch_SignalsNotificationBits, "Irqs signal notification bits"),
+            test(dispatch_CountsUnhandledIrqs, "Irqs nobody handles are counted")
+        );
+    }
+}
@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "locks.h"
+#include <misc/testing.h>
+#include <locks.h>
+#include <stdint.h>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Kernel;
+
+    bool isRegistered(LockStatistics* statistics) {
+        auto current = LockStatisticsHead;
+
+        while (current != nullptr) {
+            if (current == statistics) {
+                return true;
+            }
+
+            current = current->next;
+        }
+
+        return false;
+    }
+
+    bool LockSuite::spinLock_ServesTheNextTicketOnRelease() {
+        uint32_t lock {0};
+
+        {
+            SpinLock guard {&lock};
+        }
+
+        {
+            SpinLock guard {&lock};
+        }
+
+        //two tickets handed out and two served
+        uint32_t expected {0x0002'0002};
+
+        return Assert::all(
+            Assert::isEqual(lock, expected, "Lock didn't hand out tickets in order")
+        );
+    }
+
+    bool LockSuite::spinLock_CountsAcquisitions() {
+        static LockStatistics statistics {"test"};
+        uint32_t lock {0};
+
+        for (int i = 0; i < 3; i++) {
+            SpinLock guard {&lock, &statistics};
+        }
+
+        uint32_t expectedAcquisitions {3};
+        uint32_t expectedContended {0};
+        auto registered = isRegistered(&statistics);
+
+        return Assert::all(
+            Assert::isEqual(statistics.acquisitions, expectedAcquisitions, "Acquisitions weren't counted"),
+            Assert::isEqual(statistics.contendedAcquisitions, expectedContended, "Uncontended lock counted as contended"),
+            Assert::isTrue(registered, "Statistics weren't added to the list")
+        );
+    }
+
+    bool LockSuite::spinLockIrqSave_RestoresInterruptFlag() {
+        uint32_t lock {0};
+        auto before = readFlags() & InterruptFlag;
+        uintptr_t inside {0};
+
+        {
+            SpinLockIrqSave guard {&lock};
+            inside = readFlags() & InterruptFlag;
+        }
+
+        auto after = readFlags() & InterruptFlag;
+        uintptr_t disabled {0};
+
+        return Assert::all(
+            Assert::isEqual(inside, disabled, "Interrupts weren't disabled while locked"),
+            Assert::isEqual(after, before, "Interrupt flag wasn't restored")
+        );
+    }
+
+    bool LockSuite::lockDebug_DetectsInvertedOrder() {
+        static LockStatistics first {"first"};
+        static LockStatistics second {"second"};
+        registerLockStatistics(&first);
+        registerLockStatistics(&second);
+
+        LockDebug::acquired(&first, false);
+        LockDebug::acquired(&second, false);
+        LockDebug::released(&second);
+        LockDebug::released(&first);
+
+        auto consistentOrder = first.orderViolation == nullptr && second.orderViolation == nullptr;
+
+        LockDebug::acquired(&second, false);
+        LockDebug::acquired(&first, false);
+        LockDebug::released(&first);
+        LockDebug::released(&second);
+
+        auto detected = first.orderViolation == &second;
+
+        return Assert::all(
+            Assert::isTrue(consistentOrder, "Locks taken in one order were flagged"),
+            Assert::isTrue(detected, "Locks taken in both orders weren't flagged")
+        );
+    }
+
+    bool LockSuite::lockDebug_DetectsInterruptsEnabled() {
+        static LockStatistics interruptLock {.name = "interrupt", .takenByInterrupts = true};
+        static LockStatistics taskLock {"task"};
+        registerLockStatistics(&interruptLock);
+        registerLockStatistics(&taskLock);
+
+        LockDebug::acquired(&interruptLock, false);
+        LockDebug::released(&interruptLock);
+        auto disabledIsFine = !interruptLock.interruptViolation;
+
+        LockDebug::acquired(&taskLock, true);
+        LockDebug::released(&taskLock);
+        LockDebug::acquired(&interruptLock, true);
+        LockDebug::released(&interruptLock);
+
+        return Assert::all(
+            Assert::isTrue(disabledIsFine, "Lock taken with interrupts off was flagged"),
+            Assert::isFalse(taskLock.interruptViolation, "Task only lock was flagged"),
+            Assert::isTrue(interruptLock.interruptViolation, "Interrupt lock taken with interrupts on wasn't flagged")
+        );
+    }
+
+    bool LockSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(spinLock_ServesTheNextTicketOnRelease, "SpinLock is a ticket lock"),
+            test(spinLock_CountsAcquisitions, "SpinLock records statistics"),
+            test(spinLockIrqSave_RestoresInterruptFlag, "SpinLockIrqSave restores the interrupt flag"),
+            test(lockDebug_DetectsInvertedOrder, "LockDebug finds locks taken in both orders"),
+            test(lockDebug_DetectsInterruptsEnabled, "LockDebug finds interrupt locks taken with interrupts on")
+        );
+    }
+}
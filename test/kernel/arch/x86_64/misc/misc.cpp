@@ -30,10 +30,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <misc/testing.h>
 #include "avl.h"
 #include "linked_list.h"
+#include "locks.h"
+#include "rcu.h"
+#include "irqs.h"
 
 namespace Test {
 
     bool runMiscTests() {
-        return Preflight::runTestSuites<LinkedListSuite>();
+        return Preflight::runTestSuites<LinkedListSuite, LockSuite, RCUSuite, IrqSuite>();
     }
 }
\ No newline at end of file
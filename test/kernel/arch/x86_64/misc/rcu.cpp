@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "rcu.h"
+#include <misc/testing.h>
+#include <rcu.h>
+#include <stdint.h>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Kernel;
+
+    void recordReclaim(void* argument) {
+        auto count = static_cast<int*>(argument);
+        (*count)++;
+    }
+
+    bool RCUSuite::defer_WaitsForQuiescentState() {
+        int reclaimed {0};
+        RCU::Callback callback {.function = recordReclaim, .argument = &reclaimed};
+
+        //brings this core online, otherwise there's nothing to wait for
+        RCU::quiescentState();
+
+        RCU::defer(&callback);
+        RCU::reclaim();
+        auto countBefore = reclaimed;
+
+        RCU::quiescentState();
+        auto countAfter = reclaimed;
+
+        int expectedBefore {0};
+        int expectedAfter {1};
+
+        return Assert::all(
+            Assert::isEqual(countBefore, expectedBefore, "Callback ran before a grace period"),
+            Assert::isEqual(countAfter, expectedAfter, "Callback didn't run after a grace period")
+        );
+    }
+
+    bool RCUSuite::defer_RunsCallbacksInOrder() {
+        int first {0};
+        int second {0};
+        RCU::Callback firstCallback {.function = recordReclaim, .argument = &first};
+        RCU::Callback secondCallback {.function = recordReclaim, .argument = &second};
+
+        RCU::quiescentState();
+        RCU::defer(&firstCallback);
+        RCU::quiescentState();
+        auto firstOnly = first == 1 && second == 0;
+
+        RCU::defer(&secondCallback);
+        RCU::quiescentState();
+
+        int expected {1};
+
+        return Assert::all(
+            Assert::isTrue(firstOnly, "Later callback ran with an earlier grace period"),
+            Assert::isEqual(first, expected, "First callback ran more than once"),
+            Assert::isEqual(second, expected, "Second callback didn't run")
+        );
+    }
+
+    bool RCUSuite::enterIdle_DoesntHoldUpGracePeriods() {
+        int whileIdle {0};
+        int afterIdle {0};
+        RCU::Callback idleCallback {.function = recordReclaim, .argument = &whileIdle};
+        RCU::Callback laterCallback {.function = recordReclaim, .argument = &afterIdle};
+
+        RCU::quiescentState();
+        RCU::defer(&idleCallback);
+        RCU::enterIdle();
+        RCU::exitIdle();
+
+        //back online, so this has to wait for another quiescent state
+        RCU::defer(&laterCallback);
+        RCU::reclaim();
+        auto countBefore = afterIdle;
+
+        RCU::quiescentState();
+
+        int expected {1};
+        int expectedBefore {0};
+
+        return Assert::all(
+            Assert::isEqual(whileIdle, expected, "Idle core held up a grace period"),
+            Assert::isEqual(countBefore, expectedBefore, "Core didn't come back online after being idle"),
+            Assert::isEqual(afterIdle, expected, "Callback didn't run after a grace period")
+        );
+    }
+
+    bool RCUSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(defer_WaitsForQuiescentState, "Deferred callbacks wait for a grace period"),
+            test(defer_RunsCallbacksInOrder, "Deferred callbacks run once, in order"),
+            test(enterIdle_DoesntHoldUpGracePeriods, "Idle cores don't hold up grace periods")
+        );
+    }
+}
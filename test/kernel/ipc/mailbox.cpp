@@ -0,0 +1,533 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "mailbox.h"
+#include <misc/testing.h>
+#include <ipc.h>
+#include <cpu/timers/tsc.h>
+#include <stdint.h>
+#include <array>
+
+namespace Test {
+
+    using namespace Preflight;
+
+    const int MailboxCapacity {70};
+    alignas(16) uint8_t mailboxStorage[sizeof(IPC::StoredMessage) * MailboxCapacity];
+
+    struct TestMessage : IPC::Message {
+        TestMessage(uint32_t id = 0, uint32_t value = 0) 
+            : value {value} {
+            messageId = id;
+            senderTaskId = 0;
+            length = sizeof(TestMessage);
+            messageNamespace = IPC::MessageNamespace::Scheduler;
+        }
+
+        uint32_t value;
+    };
+
+    //too big for the kernel stack
+    IPC::MaximumMessageBuffer batchBuffers[IPC::MaximumBatchSize];
+
+    IPC::Mailbox createMailbox() {
+        return IPC::Mailbox {reinterpret_cast<uintptr_t>(mailboxStorage), sizeof(mailboxStorage)};
+    }
+
+    bool MailboxSuite::receive_ReturnsMessagesInOrder() {
+        auto mailbox = createMailbox();
+
+        for (uint32_t i = 0; i < 5; i++) {
+            TestMessage message {i % 2, i};
+            mailbox.send(&message);
+        }
+
+        std::array<uint32_t, 5> expected = {0, 1, 2, 3, 4};
+        std::array<uint32_t, 5> result;
+
+        for (int i = 0; i < 5; i++) {
+            IPC::MaximumMessageBuffer buffer;
+            mailbox.receive(&buffer);
+            result[i] = IPC::extractMessage<TestMessage>(buffer).value;
+        }
+
+        auto hasUnread = mailbox.hasUnreadMessages();
+        auto inOrder = Assert::arraySame(result, expected, "Messages weren't received in the order they were sent");
+        auto empty = Assert::isFalse(hasUnread, "Mailbox still had unread messages");
+
+        return Assert::all(inOrder, empty);
+    }
+
+    bool MailboxSuite::filteredReceive_FindsMatchingMessage() {
+        auto mailbox = createMailbox();
+
+        TestMessage a {1, 10}, b {2, 20}, c {1, 30};
+        mailbox.send(&a);
+        mailbox.send(&b);
+        mailbox.send(&c);
+
+        IPC::MaximumMessageBuffer buffer;
+        auto found = mailbox.filteredReceive(&buffer, IPC::MessageNamespace::Scheduler, 2);
+        auto filtered = IPC::extractMessage<TestMessage>(buffer).value;
+
+        auto missing = mailbox.filteredReceive(&buffer, IPC::MessageNamespace::VFS, 1);
+
+        std::array<uint32_t, 2> expected = {10, 30};
+        std::array<uint32_t, 2> remaining;
+
+        for (int i = 0; i < 2; i++) {
+            mailbox.receive(&buffer);
+            remaining[i] = IPC::extractMessage<TestMessage>(buffer).value;
+        }
+
+        return Assert::all(
+            Assert::isTrue(found, "filteredReceive didn't find the message"),
+            Assert::isEqual(filtered, 20u, "filteredReceive returned the wrong message"),
+            Assert::isFalse(missing, "filteredReceive matched a message from the wrong namespace"),
+            Assert::arraySame(remaining, expected, "filteredReceive disturbed the order of other messages")
+        );
+    }
+
+    bool MailboxSuite::filteredReceive_HandlesManyMessageIds() {
+        auto mailbox = createMailbox();
+
+        //more ids than buckets, so some must share a bucket
+        for (uint32_t i = 0; i < MailboxCapacity; i++) {
+            TestMessage message {i, i * 3};
+            mailbox.send(&message);
+        }
+
+        std::array<uint32_t, MailboxCapacity> expected, actual;
+
+        for (int i = MailboxCapacity - 1; i >= 0; i--) {
+            IPC::MaximumMessageBuffer buffer;
+            mailbox.filteredReceive(&buffer, IPC::MessageNamespace::Scheduler, i);
+            actual[i] = IPC::extractMessage<TestMessage>(buffer).value;
+            expected[i] = i * 3;
+        }
+
+        auto hasUnread = mailbox.hasUnreadMessages();
+        auto allFound = Assert::arraySame(actual, expected, "filteredReceive returned the wrong message for a shared bucket");
+        auto empty = Assert::isFalse(hasUnread, "Mailbox still had unread messages");
+
+        return Assert::all(allFound, empty);
+    }
+
+    bool MailboxSuite::send_ReusesFreedSlots() {
+        auto mailbox = createMailbox();
+
+        bool allSent = true;
+
+        for (int round = 0; round < 3; round++) {
+            for (uint32_t i = 0; i < MailboxCapacity; i++) {
+                TestMessage message {i, i};
+                allSent &= mailbox.send(&message) == IPC::SendResult::Sent;
+            }
+
+            IPC::MaximumMessageBuffer buffer;
+
+            while (mailbox.receive(&buffer)) {}
+        }
+
+        TestMessage last {5, 42};
+        mailbox.send(&last);
+
+        IPC::MaximumMessageBuffer buffer;
+        mailbox.receive(&buffer);
+        auto value = IPC::extractMessage<TestMessage>(buffer).value;
+
+        return Assert::all(
+            Assert::isTrue(allSent, "Send didn't reuse slots freed by receive"),
+            Assert::isEqual(value, 42u, "Reused slot didn't store the new message"),
+            Assert::isEqual(mailbox.getUnreadMessagesCount(), 0u, "Unread count is wrong after reusing slots")
+        );
+    }
+
+    bool MailboxSuite::send_ReportsFullAtLimit() {
+        auto mailbox = createMailbox();
+
+        for (uint32_t i = 0; i < MailboxCapacity; i++) {
+            TestMessage message {i, i};
+            mailbox.send(&message);
+        }
+
+        TestMessage overflow {1, 1};
+        auto result = mailbox.send(&overflow);
+        auto unread = mailbox.getUnreadMessagesCount();
+
+        return Assert::all(
+            Assert::isTrue(result == IPC::SendResult::Full, "Send didn't report a full mailbox"),
+            Assert::isEqual(unread, static_cast<uint32_t>(MailboxCapacity), "Send stored a message past the limit")
+        );
+    }
+
+    class TestBlockSource : public IPC::MessageBlockSource {
+    public:
+
+        IPC::MessageBlock* allocateBlock() override {
+            if (used == 2) {
+                return nullptr;
+            }
+
+            return &blocks[used++];
+        }
+
+        void freeBlock(IPC::MessageBlock*) override {
+        }
+
+        IPC::MessageBlock blocks[2];
+        int used {0};
+    };
+
+    TestBlockSource blockSource;
+
+    bool MailboxSuite::send_GrowsFromBlockSource() {
+        auto mailbox = createMailbox();
+        blockSource.used = 0;
+
+        //room for exactly one extra block
+        mailbox.setBlockSource(&blockSource, MailboxCapacity + IPC::MessageBlock::SlotCount);
+
+        bool allSent = true;
+        const uint32_t total = MailboxCapacity + IPC::MessageBlock::SlotCount;
+
+        for (uint32_t i = 0; i < total; i++) {
+            TestMessage message {i, i};
+            allSent &= mailbox.send(&message) == IPC::SendResult::Sent;
+        }
+
+        TestMessage overflow {1, 1};
+        auto full = mailbox.send(&overflow) == IPC::SendResult::Full;
+        auto capacity = mailbox.getCapacity();
+        auto blocksUsed = blockSource.used;
+
+        IPC::MaximumMessageBuffer buffer;
+        auto found = mailbox.filteredReceive(&buffer, IPC::MessageNamespace::Scheduler, total - 1);
+
+        return Assert::all(
+            Assert::isTrue(allSent, "Send didn't grow the mailbox"),
+            Assert::isTrue(full, "Mailbox grew past its limit"),
+            Assert::isEqual(capacity, static_cast<int>(total), "Mailbox capacity is wrong after growing"),
+            Assert::isEqual(blocksUsed, 1, "Mailbox allocated the wrong number of blocks"),
+            Assert::isTrue(found, "Message stored in a grown slot wasn't received")
+        );
+    }
+
+    bool MailboxSuite::send_CoalescesWhenEnabled() {
+        auto mailbox = createMailbox();
+        mailbox.setCoalescePolicy(IPC::MessageNamespace::Scheduler, 7, IPC::CoalescePolicy::SumValues);
+
+        TestMessage first {7, 1}, second {7, 2}, other {8, 5}, third {7, 4};
+        auto firstResult = mailbox.send(&first);
+        auto secondResult = mailbox.send(&second);
+        mailbox.send(&other);
+        mailbox.send(&third);
+
+        //first and second merge, third can't merge past other
+        std::array<uint32_t, 3> expected = {3, 5, 4};
+        std::array<uint32_t, 3> result;
+        auto unread = mailbox.getUnreadMessagesCount();
+
+        for (int i = 0; i < 3; i++) {
+            IPC::MaximumMessageBuffer buffer;
+            mailbox.receive(&buffer);
+            result[i] = IPC::extractMessage<TestMessage>(buffer).value;
+        }
+
+        return Assert::all(
+            Assert::isTrue(firstResult == IPC::SendResult::Sent, "First message wasn't stored"),
+            Assert::isTrue(secondResult == IPC::SendResult::Coalesced, "Second message wasn't coalesced"),
+            Assert::isEqual(unread, 3u, "Wrong number of unread messages after coalescing"),
+            Assert::arraySame(result, expected, "Coalesced values weren't summed")
+        );
+    }
+
+    bool MailboxSuite::sendMultiple_StopsWhenFull() {
+        auto mailbox = createMailbox();
+
+        const int total = MailboxCapacity + 5;
+        TestMessage messages[total];
+        IPC::Message* pointers[total];
+
+        for (int i = 0; i < total; i++) {
+            messages[i] = TestMessage {1, static_cast<uint32_t>(i)};
+            pointers[i] = &messages[i];
+        }
+
+        auto stored = mailbox.sendMultiple(pointers, total);
+        auto unread = mailbox.getUnreadMessagesCount();
+
+        return Assert::all(
+            Assert::isEqual(stored, MailboxCapacity, "sendMultiple reported the wrong number of stored messages"),
+            Assert::isEqual(unread, static_cast<uint32_t>(MailboxCapacity), "sendMultiple stored a message past the limit")
+        );
+    }
+
+    bool MailboxSuite::receiveMultiple_ReturnsMessagesInOrder() {
+        auto mailbox = createMailbox();
+
+        for (uint32_t i = 0; i < 5; i++) {
+            TestMessage message {i, i * 2};
+            mailbox.send(&message);
+        }
+
+        auto buffers = batchBuffers;
+        auto first = mailbox.receiveMultiple(buffers, 4);
+
+        std::array<uint32_t, 4> expected = {0, 2, 4, 6};
+        std::array<uint32_t, 4> result;
+
+        for (int i = 0; i < 4; i++) {
+            result[i] = IPC::extractMessage<TestMessage>(buffers[i]).value;
+        }
+
+        auto second = mailbox.receiveMultiple(buffers, 4);
+        auto last = IPC::extractMessage<TestMessage>(buffers[0]).value;
+        auto third = mailbox.receiveMultiple(buffers, 4);
+
+        return Assert::all(
+            Assert::isEqual(first, 4, "receiveMultiple didn't fill the buffers"),
+            Assert::arraySame(result, expected, "receiveMultiple returned messages out of order"),
+            Assert::isEqual(second, 1, "receiveMultiple didn't return the remaining message"),
+            Assert::isEqual(last, 8u, "receiveMultiple returned the wrong remaining message"),
+            Assert::isEqual(third, 0, "receiveMultiple returned messages from an empty mailbox")
+        );
+    }
+
+    /*
+    Interleaves one receiver and several senders step by step in a
+    pseudo-random order, the way they could run on different cores.
+    A receiver that finds nothing sleeps until a sender's claimWaiter
+    says to wake it. If a wakeup were ever lost, the receiver would
+    end up asleep with messages in its mailbox
+    */
+    bool MailboxSuite::receiveOrWait_NeverLosesWakeups() {
+        auto mailbox = createMailbox();
+
+        enum class SenderStep {
+            Send,
+            Claim,
+            Done
+        };
+
+        const int SenderCount {3};
+        const int MessagesPerSender {2000};
+        SenderStep senders[SenderCount];
+        int sent[SenderCount] {};
+
+        for (auto& step : senders) {
+            step = SenderStep::Send;
+        }
+
+        bool receiverSleeping {false};
+        bool spuriousWake {false};
+        int received {0};
+        uint32_t random {12345};
+
+        auto allDone = [&]() {
+            for (auto step : senders) {
+                if (step != SenderStep::Done) {
+                    return false;
+                }
+            }
+
+            return true;
+        };
+
+        //only reached if the receiver slept through a full mailbox
+        int remainingSteps {1'000'000};
+
+        while ((!allDone() || !receiverSleeping) && remainingSteps-- > 0) {
+            random = random * 1103515245 + 12345;
+            auto actor = static_cast<int>((random >> 16) % (SenderCount + 1));
+
+            if (actor == SenderCount) {
+                if (receiverSleeping) {
+                    continue;
+                }
+
+                IPC::MaximumMessageBuffer buffer;
+
+                if (mailbox.receiveOrWait(&buffer)) {
+                    received++;
+                }
+                else {
+                    receiverSleeping = true;
+                }
+
+                continue;
+            }
+
+            auto& step = senders[actor];
+
+            if (step == SenderStep::Send) {
+                TestMessage message {static_cast<uint32_t>(actor), static_cast<uint32_t>(sent[actor])};
+
+                if (mailbox.send(&message) == IPC::SendResult::Sent) {
+                    sent[actor]++;
+                    step = SenderStep::Claim;
+                }
+            }
+            else if (step == SenderStep::Claim) {
+                if (mailbox.claimWaiter()) {
+                    spuriousWake |= !receiverSleeping;
+                    receiverSleeping = false;
+                }
+
+                step = sent[actor] == MessagesPerSender ? SenderStep::Done : SenderStep::Send;
+            }
+        }
+
+        auto unread = mailbox.getUnreadMessagesCount();
+
+        return Assert::all(
+            Assert::isEqual(unread, 0u, "Receiver went to sleep with unread messages"),
+            Assert::isEqual(received, SenderCount * MessagesPerSender, "Receiver didn't get every message"),
+            Assert::isFalse(spuriousWake, "claimWaiter returned true for a receiver that wasn't waiting")
+        );
+    }
+
+    bool measureLatency(int queuedMessages) {
+        auto mailbox = createMailbox();
+        const int iterations = 1000;
+
+        for (int i = 0; i < queuedMessages - 1; i++) {
+            TestMessage message {static_cast<uint32_t>(i), 0};
+            mailbox.send(&message);
+        }
+
+        //the message being received is always the newest one, the worst case for a list search
+        auto messageId = static_cast<uint32_t>(queuedMessages);
+        bool allReceived = true;
+        auto start = TSC::getTimestamp();
+
+        for (int i = 0; i < iterations; i++) {
+            TestMessage message {messageId, 0};
+            mailbox.send(&message);
+
+            IPC::MaximumMessageBuffer buffer;
+            allReceived &= mailbox.filteredReceive(&buffer, IPC::MessageNamespace::Scheduler, messageId);
+        }
+
+        auto ticks = TSC::getTimestamp() - start;
+        log("        %d queued: %d ticks per send/filteredReceive", queuedMessages, static_cast<int>(ticks / iterations));
+
+        return allReceived;
+    }
+
+    bool MailboxBenchmark::sendReceive_MeasuresLatency() {
+        return runCases(measureLatency, 10, 50, 70);
+    }
+
+    /*
+    A 1 MiB streamed read makes the VFS send one ReadRequest per
+    512 byte block to the filesystem, which receives them. Each
+    mailbox call here stands in for one system call
+    */
+    bool MailboxBenchmark::streamedRead_ComparesBatching() {
+        auto mailbox = createMailbox();
+        const int blocks = (1024 * 1024) / 512;
+        const int batchSize = IPC::MaximumBatchSize;
+
+        TestMessage requests[batchSize];
+        IPC::Message* pointers[batchSize];
+        auto buffers = batchBuffers;
+
+        for (int i = 0; i < batchSize; i++) {
+            pointers[i] = &requests[i];
+        }
+
+        int singleCalls {0};
+        int singleReceived {0};
+        auto start = TSC::getTimestamp();
+
+        for (int block = 0; block < blocks; block += batchSize) {
+            for (int i = 0; i < batchSize; i++) {
+                requests[i] = TestMessage {1, static_cast<uint32_t>(block + i)};
+                mailbox.send(&requests[i]);
+                singleCalls++;
+            }
+
+            for (int i = 0; i < batchSize; i++) {
+                singleReceived += mailbox.receive(&buffers[i]);
+                singleCalls++;
+            }
+        }
+
+        auto singleTicks = TSC::getTimestamp() - start;
+
+        int batchedCalls {0};
+        int batchedReceived {0};
+        start = TSC::getTimestamp();
+
+        for (int block = 0; block < blocks; block += batchSize) {
+            for (int i = 0; i < batchSize; i++) {
+                requests[i] = TestMessage {1, static_cast<uint32_t>(block + i)};
+            }
+
+            mailbox.sendMultiple(pointers, batchSize);
+            batchedCalls++;
+
+            batchedReceived += mailbox.receiveMultiple(buffers, batchSize);
+            batchedCalls++;
+        }
+
+        auto batchedTicks = TSC::getTimestamp() - start;
+
+        log("        one per call: %d calls, %d ticks", singleCalls, static_cast<int>(singleTicks));
+        log("        batched:      %d calls, %d ticks", batchedCalls, static_cast<int>(batchedTicks));
+
+        return singleReceived == blocks && batchedReceived == blocks;
+    }
+
+    bool MailboxBenchmark::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(sendReceive_MeasuresLatency, "Send/filteredReceive latency"),
+            test(streamedRead_ComparesBatching, "1 MiB streamed read, single vs batched")
+        );
+    }
+
+    bool MailboxSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(receive_ReturnsMessagesInOrder, "Receive returns messages in the order they were sent"),
+            test(filteredReceive_FindsMatchingMessage, "FilteredReceive finds matching messages"),
+            test(filteredReceive_HandlesManyMessageIds, "FilteredReceive handles more ids than buckets"),
+            test(send_ReusesFreedSlots, "Send reuses slots freed by receive"),
+            test(send_ReportsFullAtLimit, "Send reports a full mailbox instead of halting"),
+            test(send_GrowsFromBlockSource, "Send grows the mailbox up to its limit"),
+            test(send_CoalescesWhenEnabled, "Send coalesces opted-in messages"),
+            test(sendMultiple_StopsWhenFull, "SendMultiple stops at the first message that doesn't fit"),
+            test(receiveMultiple_ReturnsMessagesInOrder, "ReceiveMultiple returns messages in arrival order"),
+            test(receiveOrWait_NeverLosesWakeups, "Interleaved senders never leave a waiting receiver asleep")
+        );
+    }
+}
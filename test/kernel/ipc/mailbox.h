@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+namespace Test {
+
+    class MailboxSuite {
+    public:
+
+        static constexpr const char* name = "Mailbox";
+
+        static bool receive_ReturnsMessagesInOrder();
+        static bool filteredReceive_FindsMatchingMessage();
+        static bool filteredReceive_HandlesManyMessageIds();
+        static bool send_ReusesFreedSlots();
+        static bool send_ReportsFullAtLimit();
+        static bool send_GrowsFromBlockSource();
+        static bool send_CoalescesWhenEnabled();
+        static bool sendMultiple_StopsWhenFull();
+        static bool receiveMultiple_ReturnsMessagesInOrder();
+        static bool receiveOrWait_NeverLosesWakeups();
+
+        static bool run();
+    };
+
+    /*
+    Not a correctness test, logs the average number of TSC ticks
+    to send and then filteredReceive one message while the mailbox
+    already holds a given number of messages, and compares
+    one message per call against batches for a streamed read
+    */
+    class MailboxBenchmark {
+    public:
+
+        static constexpr const char* name = "Mailbox Benchmark";
+
+        static bool sendReceive_MeasuresLatency();
+        static bool streamedRead_ComparesBatching();
+
+        static bool run();
+    };
+}
@@ -30,11 +30,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <misc/testing.h>
 #include "arch/x86_64/misc/misc.h"
 #include "arch/x86_64/memory/memory.h"
+#include "ipc/ipc.h"
+#include "scheduling/scheduling.h"
 
 namespace Test {
 
     bool runKernelTests() {
         return runMiscTests()
-          && runMemoryTests();
+          && runMemoryTests()
+          && runIPCTests()
+          && runSchedulingTests();
     }
 }
\ No newline at end of file
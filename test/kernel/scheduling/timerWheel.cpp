@@ -0,0 +1,194 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "timerWheel.h"
+#include <misc/testing.h>
+#include <timerWheel.h>
+#include <stdint.h>
+#include <array>
+
+namespace Test {
+
+    using namespace Preflight;
+
+    struct TestTimer {
+        TestTimer* nextTimer {nullptr};
+        TestTimer* previousTimer {nullptr};
+        int timerSlot {-1};
+        uint64_t wakeTime {0};
+        uint64_t firedAt {0};
+        bool fired {false};
+    };
+
+    bool TimerWheelSuite::advance_ExpiresAtWakeTime() {
+        Kernel::TimerWheel<TestTimer> wheel {10};
+
+        //one timer per level, plus one sharing a slot
+        std::array<uint64_t, 5> wakeTimes = {25, 25, 700, 45'000, 3'000'000};
+        std::array<TestTimer, 5> timers;
+
+        for (auto i = 0u; i < timers.size(); i++) {
+            timers[i].wakeTime = wakeTimes[i];
+            wheel.insert(&timers[i]);
+        }
+
+        std::array<uint64_t, 5> expected = {30, 30, 700, 45'000, 3'000'000};
+        std::array<uint64_t, 5> result;
+
+        for (uint64_t time = 0; time <= 3'000'000; time += 10) {
+            wheel.advance(time, [&](TestTimer* timer) {
+                timer->fired = true;
+                timer->firedAt = time;
+            });
+        }
+
+        for (auto i = 0u; i < timers.size(); i++) {
+            result[i] = timers[i].firedAt;
+        }
+
+        auto empty = wheel.isEmpty();
+
+        return Assert::all(
+            Assert::arraySame(result, expected, "Timers didn't expire on the first advance past their wakeTime"),
+            Assert::isTrue(empty, "Wheel still had timers after they all expired")
+        );
+    }
+
+    bool TimerWheelSuite::advance_HandlesPastWakeTimes() {
+        Kernel::TimerWheel<TestTimer> wheel;
+        wheel.advance(500, [](TestTimer*) {});
+
+        TestTimer late;
+        late.wakeTime = 100;
+        wheel.insert(&late);
+
+        wheel.advance(501, [](TestTimer* timer) {
+            timer->fired = true;
+        });
+
+        return Assert::all(
+            Assert::isTrue(late.fired, "A timer whose wakeTime had passed didn't expire on the next advance")
+        );
+    }
+
+    bool TimerWheelSuite::cancel_RemovesTimer() {
+        Kernel::TimerWheel<TestTimer> wheel;
+
+        TestTimer kept, cancelled;
+        kept.wakeTime = 200;
+        cancelled.wakeTime = 200;
+        wheel.insert(&kept);
+        wheel.insert(&cancelled);
+        wheel.cancel(&cancelled);
+
+        //cancelling something not in the wheel does nothing
+        wheel.cancel(&cancelled);
+
+        wheel.advance(1000, [](TestTimer* timer) {
+            timer->fired = true;
+        });
+
+        return Assert::all(
+            Assert::isTrue(kept.fired, "Cancelling one timer removed another from the same slot"),
+            Assert::isFalse(cancelled.fired, "Cancelled timer still expired"),
+            Assert::isEqual(wheel.getCount(), 0, "Wheel count is wrong after cancelling")
+        );
+    }
+
+    bool TimerWheelSuite::insert_HandlesFarFutureTimes() {
+        Kernel::TimerWheel<TestTimer> wheel;
+
+        //past what the top level can cover, so it has to be parked and reinserted
+        const uint64_t wakeTime = (1ull << 26) + 5;
+        TestTimer timer;
+        timer.wakeTime = wakeTime;
+        wheel.insert(&timer);
+
+        auto expire = [](TestTimer* timer) {
+            timer->fired = true;
+        };
+
+        wheel.advance(wakeTime - 1, expire);
+        auto early = timer.fired;
+
+        wheel.advance(wakeTime, expire);
+        auto onTime = timer.fired;
+
+        return Assert::all(
+            Assert::isFalse(early, "Far future timer expired early"),
+            Assert::isTrue(onTime, "Far future timer didn't expire")
+        );
+    }
+
+    bool TimerWheelSuite::getNextExpiry_NeverLate() {
+        Kernel::TimerWheel<TestTimer> wheel;
+        auto none = wheel.getNextExpiry() == Kernel::TimerWheel<TestTimer>::NoExpiry;
+
+        TestTimer soon, later;
+        soon.wakeTime = 40;
+        later.wakeTime = 100'000;
+        wheel.insert(&later);
+        wheel.insert(&soon);
+
+        auto exact = wheel.getNextExpiry();
+
+        wheel.cancel(&soon);
+
+        //keep advancing to the reported time, the way a tickless scheduler would
+        int wakeups {0};
+        uint64_t time {0};
+
+        while (!later.fired && wakeups < 100) {
+            time = wheel.getNextExpiry();
+            wheel.advance(time, [](TestTimer* timer) {
+                timer->fired = true;
+            });
+            wakeups++;
+        }
+
+        return Assert::all(
+            Assert::isTrue(none, "An empty wheel reported an expiry"),
+            Assert::isEqual(exact, 40ull, "getNextExpiry wasn't exact for a nearby timer"),
+            Assert::isTrue(later.fired, "Following getNextExpiry never reached the timer"),
+            Assert::isEqual(time, 100'000ull, "Following getNextExpiry overshot the timer"),
+            Assert::isTrue(wakeups <= 4, "Following getNextExpiry took a wakeup per slot")
+        );
+    }
+
+    bool TimerWheelSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(advance_ExpiresAtWakeTime, "Advance expires timers at their wakeTime across levels"),
+            test(advance_HandlesPastWakeTimes, "Timers inserted in the past expire on the next advance"),
+            test(cancel_RemovesTimer, "Cancel removes a timer before it expires"),
+            test(insert_HandlesFarFutureTimes, "Timers beyond the top level still expire"),
+            test(getNextExpiry_NeverLate, "getNextExpiry is never later than the earliest timer")
+        );
+    }
+}
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2018, Patrick Lafferty
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its 
+      contributors may be used to endorse or promote products derived from 
+      this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR 
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "trace.h"
+#include <misc/testing.h>
+#include <trace.h>
+#include <stdint.h>
+#include <array>
+
+namespace Test {
+
+    using namespace Preflight;
+    using namespace Kernel::Trace;
+
+    /*
+    Rings are too big for the kernel stack
+    */
+    static Event events[RingSize];
+
+    bool TraceSuite::copy_ReturnsEventsOldestFirst() {
+        static Ring ring;
+
+        for (auto i = 1u; i <= 3; i++) {
+            ring.record(i * 100, EventType::Send, i, 0);
+        }
+
+        auto count = ring.copy(events, 10);
+        std::array<uint32_t, 3> expected = {1, 2, 3};
+        std::array<uint32_t, 3> result;
+
+        for (auto i = 0u; i < result.size(); i++) {
+            result[i] = events[i].taskId;
+        }
+
+        uint32_t expectedCount {3};
+
+        return Assert::all(
+            Assert::isEqual(count, expectedCount, "Copied the wrong number of events"),
+            Assert::arraySame(result, expected, "Events weren't copied oldest first")
+        );
+    }
+
+    bool TraceSuite::record_OverwritesOldestWhenFull() {
+        static Ring ring;
+
+        for (auto i = 0u; i < RingSize + 10; i++) {
+            ring.record(i, EventType::ContextSwitch, i, 0);
+        }
+
+        auto count = ring.copy(events, RingSize);
+        auto oldest = events[0].taskId;
+        auto newest = events[count - 1].taskId;
+
+        //the oldest slot could be mid-overwrite, so its left out
+        uint32_t expectedCount {RingSize - 1};
+        uint32_t expectedOldest {11};
+        uint32_t expectedNewest {RingSize + 9};
+
+        return Assert::all(
+            Assert::isEqual(count, expectedCount, "A full ring copied the wrong number of events"),
+            Assert::isEqual(oldest, expectedOldest, "The oldest events weren't overwritten"),
+            Assert::isEqual(newest, expectedNewest, "The newest event was lost")
+        );
+    }
+
+    bool TraceSuite::histogram_BucketsByPowerOfTwo() {
+        Histogram histogram;
+        std::array<uint64_t, 7> samples = {0, 1, 2, 3, 4, 1000, 1ull << 30};
+
+        for (auto sample : samples) {
+            histogram.add(sample);
+        }
+
+        std::array<uint32_t, HistogramBuckets> expected {};
+        expected[0] = 2;
+        expected[1] = 2;
+        expected[2] = 1;
+        expected[9] = 1;
+        expected[HistogramBuckets - 1] = 1;
+
+        std::array<uint32_t, HistogramBuckets> result;
+
+        for (auto i = 0u; i < HistogramBuckets; i++) {
+            result[i] = histogram.buckets[i];
+        }
+
+        return Assert::all(
+            Assert::arraySame(result, expected, "Samples landed in the wrong buckets")
+        );
+    }
+
+    bool TraceSuite::run() {
+        using namespace Preflight;
+
+        return Preflight::runTests(
+            test(copy_ReturnsEventsOldestFirst, "Copy returns recorded events oldest first"),
+            test(record_OverwritesOldestWhenFull, "A full ring overwrites its oldest events"),
+            test(histogram_BucketsByPowerOfTwo, "Histograms bucket samples by powers of two microseconds")
+        );
+    }
+}